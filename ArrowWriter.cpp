@@ -0,0 +1,662 @@
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "DataInterchange.h"
+#include "ArrowWriter.h"
+#include "TAPTimestamp.h"
+
+using namespace std;
+
+extern void log(short msgType, string msgText, string dbConnectString = "");
+extern int GetTAPDecimalPlaces();
+
+const long arrowBatchSize = 4096;
+const size_t arrowFileBufferSize = 1024 * 1024;
+
+// Arrow format constants, see Schema.fbs and Message.fbs of Apache Arrow
+const int16_t arrowMetadataVersionV5 = 4;
+const uint8_t arrowHeaderSchema = 1;
+const uint8_t arrowHeaderDictionaryBatch = 2;
+const uint8_t arrowHeaderRecordBatch = 3;
+const uint8_t arrowTypeInt = 2;
+const uint8_t arrowTypeFloatingPoint = 3;
+const uint8_t arrowTypeUtf8 = 5;
+const uint8_t arrowTypeTimestamp = 10;
+const int16_t arrowPrecisionDouble = 2;
+const int16_t arrowTimeUnitSecond = 0;
+const uint32_t arrowContinuation = 0xFFFFFFFF;
+
+
+// Minimal FlatBuffers builder for Arrow IPC metadata. Like the reference implementation it builds the buffer
+// back to front, so objects are referenced by their offset from the end of buffer. Bytes are kept in reverse order.
+class FlatBufferBuilder
+{
+public:
+	uint32_t Size() const
+	{
+		return m_reversed.size();
+	}
+
+	template<typename T> uint32_t AddScalar(T value)
+	{
+		Align(sizeof(T), 0);
+		Prepend(value);
+		return Size();
+	}
+
+	uint32_t AddOffset(uint32_t target)
+	{
+		Align(4, 0);
+		Prepend<uint32_t>(Size() + 4 - target);
+		return Size();
+	}
+
+	uint32_t CreateString(const string& value)
+	{
+		Align(4, value.size() + 1);
+		m_reversed.push_back(0);
+		for (size_t i = value.size(); i > 0; i--)
+			m_reversed.push_back(value[i - 1]);
+		Prepend<uint32_t>(value.size());
+		return Size();
+	}
+
+	uint32_t CreateOffsetVector(const vector<uint32_t>& targets)
+	{
+		Align(4, 4 * targets.size());
+		for (size_t i = targets.size(); i > 0; i--)
+			AddOffset(targets[i - 1]);
+		Prepend<uint32_t>(targets.size());
+		return Size();
+	}
+
+	// vector of structs consisting of two int64 fields (FieldNode, Buffer)
+	uint32_t CreateStructVector(const vector<int64_t>& fields)
+	{
+		Align(8, 8 * fields.size());
+		for (size_t i = fields.size(); i > 0; i--)
+			Prepend(fields[i - 1]);
+		Align(4, 0);
+		Prepend<uint32_t>(fields.size() / 2);
+		return Size();
+	}
+
+	void StartTable()
+	{
+		m_fields.clear();
+		m_tableStart = Size();
+	}
+
+	template<typename T> void AddField(int id, T value)
+	{
+		m_fields.push_back(make_pair(id, AddScalar(value)));
+	}
+
+	void AddOffsetField(int id, uint32_t target)
+	{
+		m_fields.push_back(make_pair(id, AddOffset(target)));
+	}
+
+	uint32_t EndTable()
+	{
+		uint32_t table = AddScalar<int32_t>(0);		// placeholder of vtable offset
+		int maxID = -1;
+		for (size_t i = 0; i < m_fields.size(); i++)
+			if (m_fields[i].first > maxID)
+				maxID = m_fields[i].first;
+		vector<uint16_t> vtable(maxID + 3, 0);
+		vtable[0] = (uint16_t) (vtable.size() * 2);
+		vtable[1] = (uint16_t) (table - m_tableStart);
+		for (size_t i = 0; i < m_fields.size(); i++)
+			vtable[m_fields[i].first + 2] = (uint16_t) (table - m_fields[i].second);
+		for (size_t i = vtable.size(); i > 0; i--)
+			Prepend(vtable[i - 1]);
+		int32_t vtableOffset = Size() - table;
+		for (size_t i = 0; i < 4; i++)
+			m_reversed[table - 1 - i] = (unsigned char) (vtableOffset >> (8 * i));
+		return table;
+	}
+
+	// returns finished buffer padded to 8 bytes
+	vector<unsigned char> Finish(uint32_t root)
+	{
+		Align(8, 4);
+		AddOffset(root);
+		return vector<unsigned char>(m_reversed.rbegin(), m_reversed.rend());
+	}
+private:
+	vector<unsigned char> m_reversed;
+	vector<pair<int, uint32_t> > m_fields;
+	uint32_t m_tableStart;
+
+	template<typename T> void Prepend(T value)
+	{
+		// little-endian value, its last byte goes first into reversed buffer
+		const unsigned char* bytes = (const unsigned char*) &value;
+		for (size_t i = sizeof(T); i > 0; i--)
+			m_reversed.push_back(bytes[i - 1]);
+	}
+
+	// pads the buffer so that after adding additionalBytes its size is multiple of alignment
+	void Align(size_t alignment, size_t additionalBytes)
+	{
+		while ((m_reversed.size() + additionalBytes) % alignment != 0)
+			m_reversed.push_back(0);
+	}
+};
+
+
+// Collects buffers of a record batch body, each buffer is padded to 8 bytes
+class ArrowBody
+{
+public:
+	void AddBuffer(const void* data, size_t length)
+	{
+		m_buffers.push_back(m_body.size());
+		m_buffers.push_back(length);
+		m_body.insert(m_body.end(), (const unsigned char*) data, (const unsigned char*) data + length);
+		m_body.resize((m_body.size() + 7) / 8 * 8, 0);
+	}
+
+	void AddNode(long length, long nullCount)
+	{
+		m_nodes.push_back(length);
+		m_nodes.push_back(nullCount);
+	}
+
+	uint32_t CreateRecordBatch(FlatBufferBuilder& builder, long length)
+	{
+		uint32_t nodes = builder.CreateStructVector(m_nodes);
+		uint32_t buffers = builder.CreateStructVector(m_buffers);
+		builder.StartTable();
+		builder.AddField<int64_t>(0, length);
+		builder.AddOffsetField(1, nodes);
+		builder.AddOffsetField(2, buffers);
+		return builder.EndTable();
+	}
+
+	const vector<unsigned char>& GetBody() const
+	{
+		return m_body;
+	}
+private:
+	vector<unsigned char> m_body;
+	vector<int64_t> m_nodes;
+	vector<int64_t> m_buffers;
+};
+
+
+uint32_t CreateMessage(FlatBufferBuilder& builder, uint8_t headerType, uint32_t header, int64_t bodyLength)
+{
+	builder.StartTable();
+	builder.AddField<int64_t>(3, bodyLength);
+	builder.AddOffsetField(2, header);
+	builder.AddField<int16_t>(0, arrowMetadataVersionV5);
+	builder.AddField<uint8_t>(1, headerType);
+	return builder.EndTable();
+}
+
+
+uint32_t CreateIntType(FlatBufferBuilder& builder, int bitWidth)
+{
+	builder.StartTable();
+	builder.AddField<int32_t>(0, bitWidth);
+	builder.AddField<uint8_t>(1, 1);	// is_signed
+	return builder.EndTable();
+}
+
+//-----------------------------
+
+ArrowFile::ArrowFile() :
+	m_file(NULL),
+	m_table(NULL),
+	m_column(0),
+	m_batchRowCount(0),
+	m_rowCount(0),
+	m_dictionariesSent(false)
+{
+}
+
+
+ArrowFile::~ArrowFile()
+{
+	if (m_file)
+		fclose(m_file);
+}
+
+
+bool ArrowFile::Open(string exportDir, string baseName, const TableDefinition& table)
+{
+	if (!exportDir.empty() && exportDir[exportDir.size() - 1] != '\\' && exportDir[exportDir.size() - 1] != '/')
+		exportDir += '\\';
+	string tableName = table.name;
+	m_filename = exportDir + baseName + "_" + tableName.substr(tableName.find('.') + 1) + ".arrows";
+	m_table = &table;
+	m_columns.assign(table.columnCount, ArrowColumn());
+	for (int i = 0; i < table.columnCount; i++) {
+		m_columns[i].type = table.columns[i].type;
+		m_columns[i].nullCount = 0;
+		m_columns[i].offsets.push_back(0);
+	}
+	m_column = 0;
+	m_batchRowCount = 0;
+	m_rowCount = 0;
+	m_dictionariesSent = false;
+
+	m_file = fopen(m_filename.c_str(), "wb");
+	if (!m_file) {
+		log(LOG_ERROR, "Невозможно открыть файл " + m_filename);
+		return false;
+	}
+	setvbuf(m_file, NULL, _IOFBF, arrowFileBufferSize);
+	WriteSchema();
+	return true;
+}
+
+
+bool ArrowFile::Close()
+{
+	if (!m_file)
+		return false;
+	if (m_batchRowCount > 0 || !m_dictionariesSent)
+		WriteBatch();
+	// end-of-stream marker
+	uint32_t eos[2] = { arrowContinuation, 0 };
+	fwrite(eos, sizeof(eos), 1, m_file);
+	bool success = (ferror(m_file) == 0);
+	if (fclose(m_file) != 0)
+		success = false;
+	m_file = NULL;
+	if (!success)
+		log(LOG_ERROR, "Ошибка записи в файл " + m_filename);
+	return success;
+}
+
+
+void ArrowFile::Remove()
+{
+	if (m_file) {
+		fclose(m_file);
+		m_file = NULL;
+	}
+	if (!m_filename.empty())
+		remove(m_filename.c_str());
+}
+
+
+void ArrowFile::WriteSchema()
+{
+	FlatBufferBuilder builder;
+	vector<uint32_t> fields;
+	for (int i = 0; i < m_table->columnCount; i++) {
+		uint32_t name = builder.CreateString(m_table->columns[i].name);
+		uint32_t children = builder.CreateOffsetVector(vector<uint32_t>());
+		uint32_t type;
+		uint8_t typeType;
+		uint32_t dictionary = 0;
+		switch (m_table->columns[i].type) {
+		case ctInteger:
+			type = CreateIntType(builder, 64);
+			typeType = arrowTypeInt;
+			break;
+		case ctDecimal:
+		case ctAmount:
+			builder.StartTable();
+			builder.AddField<int16_t>(0, arrowPrecisionDouble);
+			type = builder.EndTable();
+			typeType = arrowTypeFloatingPoint;
+			break;
+		case ctDateTime:
+			builder.StartTable();
+			builder.AddField<int16_t>(0, arrowTimeUnitSecond);
+			type = builder.EndTable();
+			typeType = arrowTypeTimestamp;
+			break;
+		case ctDictionary: {
+			uint32_t indexType = CreateIntType(builder, 32);
+			builder.StartTable();
+			builder.AddField<int64_t>(0, i);	// dictionary ID is column index
+			builder.AddOffsetField(1, indexType);
+			dictionary = builder.EndTable();
+			}
+			// no break, type of dictionary values is utf8
+		default:
+			builder.StartTable();
+			type = builder.EndTable();
+			typeType = arrowTypeUtf8;
+		}
+		builder.StartTable();
+		builder.AddOffsetField(0, name);
+		builder.AddOffsetField(3, type);
+		if (dictionary)
+			builder.AddOffsetField(4, dictionary);
+		builder.AddOffsetField(5, children);
+		builder.AddField<uint8_t>(1, 1);	// nullable
+		builder.AddField<uint8_t>(2, typeType);
+		fields.push_back(builder.EndTable());
+	}
+	uint32_t fieldVector = builder.CreateOffsetVector(fields);
+	builder.StartTable();
+	builder.AddOffsetField(1, fieldVector);
+	builder.AddField<int16_t>(0, 0);	// little endian
+	uint32_t schema = builder.EndTable();
+	WriteMessage(builder.Finish(CreateMessage(builder, arrowHeaderSchema, schema, 0)), vector<unsigned char>());
+}
+
+
+void ArrowFile::WriteMessage(const vector<unsigned char>& metadata, const vector<unsigned char>& body)
+{
+	uint32_t prefix[2] = { arrowContinuation, metadata.size() };
+	fwrite(prefix, sizeof(prefix), 1, m_file);
+	fwrite(&metadata[0], 1, metadata.size(), m_file);
+	if (!body.empty())
+		fwrite(&body[0], 1, body.size(), m_file);
+}
+
+
+void ArrowFile::WriteDictionaryBatch(int columnIndex, bool isDelta)
+{
+	ArrowColumn& column = m_columns[columnIndex];
+	vector<int> offsets(1, 0);
+	string chars;
+	for (size_t i = 0; i < column.newDictValues.size(); i++) {
+		chars += column.newDictValues[i];
+		offsets.push_back(chars.size());
+	}
+	ArrowBody body;
+	body.AddNode(column.newDictValues.size(), 0);
+	body.AddBuffer(NULL, 0);
+	body.AddBuffer(&offsets[0], offsets.size() * sizeof(int));
+	body.AddBuffer(chars.data(), chars.size());
+
+	FlatBufferBuilder builder;
+	uint32_t recordBatch = body.CreateRecordBatch(builder, column.newDictValues.size());
+	builder.StartTable();
+	builder.AddField<int64_t>(0, columnIndex);
+	builder.AddOffsetField(1, recordBatch);
+	builder.AddField<uint8_t>(2, isDelta ? 1 : 0);
+	uint32_t dictionaryBatch = builder.EndTable();
+	WriteMessage(builder.Finish(CreateMessage(builder, arrowHeaderDictionaryBatch, dictionaryBatch, body.GetBody().size())),
+		body.GetBody());
+	column.newDictValues.clear();
+}
+
+
+void ArrowFile::WriteBatch()
+{
+	// dictionaries must precede the record batch referencing them
+	for (size_t i = 0; i < m_columns.size(); i++)
+		if (m_columns[i].type == ctDictionary && (!m_dictionariesSent || !m_columns[i].newDictValues.empty()))
+			WriteDictionaryBatch(i, m_dictionariesSent);
+	m_dictionariesSent = true;
+
+	ArrowBody body;
+	for (size_t i = 0; i < m_columns.size(); i++) {
+		ArrowColumn& column = m_columns[i];
+		body.AddNode(m_batchRowCount, column.nullCount);
+		// validity bitmap may be omitted if there are no nulls
+		body.AddBuffer(column.nullCount > 0 ? &column.validity[0] : NULL, column.nullCount > 0 ? column.validity.size() : 0);
+		switch (column.type) {
+		case ctInteger:
+		case ctDateTime:
+			body.AddBuffer(column.intValues.empty() ? NULL : &column.intValues[0], column.intValues.size() * sizeof(long long));
+			break;
+		case ctDecimal:
+		case ctAmount:
+			body.AddBuffer(column.decimalValues.empty() ? NULL : &column.decimalValues[0], column.decimalValues.size() * sizeof(double));
+			break;
+		case ctDictionary:
+			body.AddBuffer(column.indices.empty() ? NULL : &column.indices[0], column.indices.size() * sizeof(int));
+			break;
+		default:
+			body.AddBuffer(&column.offsets[0], column.offsets.size() * sizeof(int));
+			body.AddBuffer(column.chars.data(), column.chars.size());
+		}
+	}
+	FlatBufferBuilder builder;
+	uint32_t recordBatch = body.CreateRecordBatch(builder, m_batchRowCount);
+	WriteMessage(builder.Finish(CreateMessage(builder, arrowHeaderRecordBatch, recordBatch, body.GetBody().size())),
+		body.GetBody());
+
+	for (size_t i = 0; i < m_columns.size(); i++) {
+		ArrowColumn& column = m_columns[i];
+		column.validity.clear();
+		column.nullCount = 0;
+		column.intValues.clear();
+		column.decimalValues.clear();
+		column.offsets.assign(1, 0);
+		column.chars.clear();
+		column.indices.clear();
+	}
+	m_batchRowCount = 0;
+}
+
+
+void ArrowFile::SetValidity(ArrowColumn& column, bool valid)
+{
+	if (m_batchRowCount % 8 == 0)
+		column.validity.push_back(0);
+	if (valid)
+		column.validity.back() |= (1 << (m_batchRowCount % 8));
+	else
+		column.nullCount++;
+	m_column++;
+}
+
+
+void ArrowFile::AddString(const char* value)
+{
+	if (!*value) {
+		// empty strings are NULLs in BILLING tables too
+		AddNull();
+		return;
+	}
+	ArrowColumn& column = m_columns[m_column];
+	long long intValue;
+	switch (column.type) {
+	case ctString:
+		column.chars += value;
+		column.offsets.push_back(column.chars.size());
+		break;
+	case ctDictionary: {
+		map<string, int>::iterator it = column.dictionary.find(value);
+		if (it == column.dictionary.end()) {
+			it = column.dictionary.insert(make_pair(string(value), (int) column.dictionary.size())).first;
+			column.newDictValues.push_back(value);
+		}
+		column.indices.push_back(it->second);
+		}
+		break;
+	case ctDateTime:
+		if (!ParseTAPTimestamp(value, intValue)) {
+			AddNull();
+			return;
+		}
+		column.intValues.push_back(intValue);
+		break;
+	case ctInteger:
+		intValue = 0;
+		sscanf(value, "%lld", &intValue);
+		column.intValues.push_back(intValue);
+		break;
+	case ctDecimal:
+	case ctAmount:
+		column.decimalValues.push_back(atof(value));
+		break;
+	}
+	SetValidity(column, true);
+}
+
+
+// Dictionary index of interned string is looked up once, the next values with the same ID are added without search
+void ArrowFile::AddInterned(const InternedString& value)
+{
+	ArrowColumn& column = m_columns[m_column];
+	if (column.type != ctDictionary || value.id == 0) {
+		AddString(value.value);
+		return;
+	}
+	if (value.id < (int) column.internedIndices.size() && column.internedIndices[value.id] >= 0) {
+		column.indices.push_back(column.internedIndices[value.id]);
+		SetValidity(column, true);
+		return;
+	}
+	AddString(value.value);
+	if (value.id >= (int) column.internedIndices.size())
+		column.internedIndices.resize(value.id + 1, -1);
+	column.internedIndices[value.id] = column.indices.back();
+}
+
+
+void ArrowFile::AddInteger(long long value)
+{
+	ArrowColumn& column = m_columns[m_column];
+	char buffer[30];
+	switch (column.type) {
+	case ctInteger:
+	case ctDateTime:
+		column.intValues.push_back(value);
+		SetValidity(column, true);
+		break;
+	case ctDecimal:
+	case ctAmount:
+		column.decimalValues.push_back((double) value);
+		SetValidity(column, true);
+		break;
+	default:
+		sprintf(buffer, "%lld", value);
+		AddString(buffer);
+	}
+}
+
+
+void ArrowFile::AddDecimal(double value)
+{
+	ArrowColumn& column = m_columns[m_column];
+	char buffer[30];
+	switch (column.type) {
+	case ctInteger:
+	case ctDateTime:
+		column.intValues.push_back((long long) value);
+		SetValidity(column, true);
+		break;
+	case ctDecimal:
+	case ctAmount:
+		column.decimalValues.push_back(value);
+		SetValidity(column, true);
+		break;
+	default:
+		sprintf(buffer, "%.15g", value);
+		AddString(buffer);
+	}
+}
+
+
+void ArrowFile::AddNull()
+{
+	ArrowColumn& column = m_columns[m_column];
+	switch (column.type) {
+	case ctInteger:
+	case ctDateTime:
+		column.intValues.push_back(0);
+		break;
+	case ctDecimal:
+	case ctAmount:
+		column.decimalValues.push_back(0);
+		break;
+	case ctDictionary:
+		column.indices.push_back(0);
+		break;
+	default:
+		column.offsets.push_back(column.chars.size());
+	}
+	SetValidity(column, false);
+}
+
+
+void ArrowFile::EndRow()
+{
+	m_column = 0;
+	m_rowCount++;
+	if (++m_batchRowCount >= arrowBatchSize)
+		WriteBatch();
+}
+
+
+long ArrowFile::GetRowCount() const
+{
+	return m_rowCount;
+}
+
+//-----------------------------
+
+ArrowExporter::ArrowExporter(otl_connect& otlConnect, string exportDir, string baseName) :
+	m_exportDir(exportDir),
+	m_baseName(baseName),
+	m_closed(false),
+	m_eventRowWriter(otlConnect, m_callFile, m_gprsCallFile, m_basicServiceFile, m_chargeInfoFile, m_chargeDetailFile, m_detailIDs,
+		GetTAPDecimalPlaces())
+{
+}
+
+
+ArrowExporter::~ArrowExporter()
+{
+	if (!m_closed)
+		Remove();
+}
+
+
+bool ArrowExporter::Open()
+{
+	return m_callFile.Open(m_exportDir, m_baseName, tap3CallTable) &&
+		m_gprsCallFile.Open(m_exportDir, m_baseName, tap3GPRSCallTable) &&
+		m_basicServiceFile.Open(m_exportDir, m_baseName, tap3BasicServiceTable) &&
+		m_chargeInfoFile.Open(m_exportDir, m_baseName, tap3ChargeInfoTable) &&
+		m_chargeDetailFile.Open(m_exportDir, m_baseName, tap3ChargeDetailTable);
+}
+
+
+int ArrowExporter::WriteEvent(long long eventID, long fileID, int index, const CallEventDetail* callEventDetail)
+{
+	switch (callEventDetail->present) {
+	case CallEventDetail_PR_mobileOriginatedCall:
+		return m_eventRowWriter.WriteOriginatedCall(eventID, fileID, index, &callEventDetail->choice.mobileOriginatedCall);
+	case CallEventDetail_PR_mobileTerminatedCall:
+		return m_eventRowWriter.WriteTerminatedCall(eventID, fileID, index, &callEventDetail->choice.mobileTerminatedCall);
+	case CallEventDetail_PR_gprsCall:
+		return m_eventRowWriter.WriteGPRSCall(eventID, fileID, index, &callEventDetail->choice.gprsCall);
+	default:
+		// events not loaded to DB are not exported
+		return TL_OK;
+	}
+}
+
+
+bool ArrowExporter::Close()
+{
+	bool success = m_callFile.Close();
+	success = m_gprsCallFile.Close() && success;
+	success = m_basicServiceFile.Close() && success;
+	success = m_chargeInfoFile.Close() && success;
+	success = m_chargeDetailFile.Close() && success;
+	if (!success) {
+		Remove();
+		return false;
+	}
+	m_closed = true;
+	return true;
+}
+
+
+void ArrowExporter::Remove()
+{
+	m_callFile.Remove();
+	m_gprsCallFile.Remove();
+	m_basicServiceFile.Remove();
+	m_chargeInfoFile.Remove();
+	m_chargeDetailFile.Remove();
+	m_closed = true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <map>
+#include "EventRowWriter.h"
+
+struct ArrowColumn
+{
+	ColumnType type;
+	vector<unsigned char> validity;
+	long nullCount;
+	vector<long long> intValues;		// ctInteger and ctDateTime (seconds since epoch)
+	vector<double> decimalValues;
+	vector<int> offsets;				// ctString
+	string chars;
+	vector<int> indices;				// ctDictionary
+	map<string, int> dictionary;
+	vector<string> newDictValues;		// dictionary values not sent to file yet
+	vector<int> internedIndices;		// dictionary indices by IDs of interned strings (-1 if not known yet)
+};
+
+
+// Class ArrowFile writes rows of a table to file of Arrow IPC streaming format (readable by pyarrow.ipc.open_stream,
+// Spark, DuckDB etc.). Rows are written by record batches as they come, dictionary columns are sent with
+// delta dictionary batches. Integer columns are int64, decimal and amount columns are float64, timestamps are timestamp[s] without time zone.
+class ArrowFile : public TableSink
+{
+public:
+	ArrowFile();
+	~ArrowFile();
+	bool Open(string exportDir, string baseName, const TableDefinition& table);
+	bool Close();
+	void Remove();
+	void EndRow();
+	long GetRowCount() const;
+protected:
+	void AddString(const char* value);
+	void AddInteger(long long value);
+	void AddDecimal(double value);
+	void AddNull();
+	void AddInterned(const InternedString& value);
+private:
+	FILE* m_file;
+	string m_filename;
+	const TableDefinition* m_table;
+	vector<ArrowColumn> m_columns;
+	int m_column;
+	long m_batchRowCount;
+	long m_rowCount;
+	bool m_dictionariesSent;
+
+	void SetValidity(ArrowColumn& column, bool valid);
+	void WriteSchema();
+	void WriteBatch();
+	void WriteDictionaryBatch(int columnIndex, bool isDelta);
+	void WriteMessage(const vector<unsigned char>& metadata, const vector<unsigned char>& body);
+};
+
+
+// Class ArrowExporter writes decoded events of transfer batch to Arrow files of TAP3 event tables, so that
+// analytics can read them instead of BILLING tables. Event IDs are the ones of DB rows, service and charge IDs
+// are local to file. Files are removed unless Close is called, i.e. if loading has failed.
+class ArrowExporter
+{
+public:
+	ArrowExporter(otl_connect& otlConnect, string exportDir, string baseName);
+	~ArrowExporter();
+	bool Open();
+	int WriteEvent(long long eventID, long fileID, int index, const CallEventDetail* callEventDetail);
+	bool Close();
+private:
+	string m_exportDir;
+	string m_baseName;
+	bool m_closed;
+	LocalIDCounter m_detailIDs;
+	ArrowFile m_callFile;
+	ArrowFile m_gprsCallFile;
+	ArrowFile m_basicServiceFile;
+	ArrowFile m_chargeInfoFile;
+	ArrowFile m_chargeDetailFile;
+	EventRowWriter m_eventRowWriter;
+
+	void Remove();
+};
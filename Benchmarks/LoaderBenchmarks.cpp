@@ -0,0 +1,447 @@
+// LoaderBenchmarks.cpp : microbenchmarks for per-event helpers of TAP3 loader (Google Benchmark).
+//
+// Usage: LoaderBenchmarks.exe [--benchmark_* options] [TAP sample file] [RAP sample file]
+// Sample files not given in command line are taken from TAP3_BENCH_TAP_SAMPLE and TAP3_BENCH_RAP_SAMPLE environment variables.
+// Benchmarks of CallTotalCharge and CallEventDetail/ReturnBatch encoding need sample files, they are skipped
+// if the sample could not be decoded. Every benchmark reports allocs/op besides time per iteration.
+// Note: Release build counts operator new calls only, use Debug build to count malloc/calloc of ASN.1 coder too.
+
+#include "stdafx.h"
+#include <vector>
+#include <new>
+#ifdef _DEBUG
+#include <crtdbg.h>
+#endif
+#include <benchmark/benchmark.h>
+#include "OTL_Header.h"
+#include "DataInterchange.h"
+#include "ReturnBatch.h"
+#include "TAP_Constants.h"
+#include "ConfigContainer.h"
+#include "RAPFile.h"
+#include "CallValidator.h"
+
+extern DataInterChange* dataInterchange;
+extern string BCDString(BCDString_t* src, bool bSwitchDigits);
+extern long long OctetStr2Int64(const OCTET_STRING_t& octetStr);
+extern char* OctetStrToHexStr(const OCTET_STRING_t& octetStr);
+extern string GetUTCOffset(int nCode);
+extern string GetRecordingEntity(int nCode, string& recEntityType);
+
+
+DataInterChange* sampleTapFile = NULL;
+ReturnBatch* sampleRapFile = NULL;
+// index of first event of each type in sample TAP file, -1 if there is no such event
+int sampleEventIndex[3] = { -1, -1, -1 };
+
+//-----------------------------
+// Allocation counting
+long long allocCount = 0;
+
+#ifdef _DEBUG
+int CountingAllocHook(int allocType, void* userData, size_t size, int blockType, long requestNumber,
+	const unsigned char* filename, int lineNumber)
+{
+	if (allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC)
+		allocCount++;
+	return 1; // allow allocation
+}
+#else
+void* operator new(size_t size)
+{
+	allocCount++;
+	void* p = malloc(size > 0 ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p)
+{
+	free(p);
+}
+
+void operator delete[](void* p)
+{
+	free(p);
+}
+#endif
+
+void ReportAllocations(benchmark::State& state, long long allocCountBefore)
+{
+	state.counters["allocs/op"] = benchmark::Counter((double) (allocCount - allocCountBefore),
+		benchmark::Counter::kAvgIterations);
+}
+
+//-----------------------------
+// Sample data
+template<class T> T* AllocMember(T*& member)
+{
+	member = (T*) calloc(1, sizeof(T));
+	return member;
+}
+
+template<class T> T* NewListElement(T** /* list array, used for type deduction only */)
+{
+	return (T*) calloc(1, sizeof(T));
+}
+
+// Creates transfer batch with network info only, containing listSize UTC offset and recording entity codes
+// numbered from 0 to listSize - 1
+DataInterChange* CreateNetworkInfo(int listSize)
+{
+	DataInterChange* batch = (DataInterChange*) calloc(1, sizeof(DataInterChange));
+	batch->present = DataInterChange_PR_transferBatch;
+	AllocMember(batch->choice.transferBatch.networkInfo);
+	AllocMember(batch->choice.transferBatch.networkInfo->utcTimeOffsetInfo);
+	AllocMember(batch->choice.transferBatch.networkInfo->recEntityInfo);
+	for (int i = 0; i < listSize; i++) {
+		auto utcOffsetInfo = NewListElement(batch->choice.transferBatch.networkInfo->utcTimeOffsetInfo->list.array);
+		*AllocMember(utcOffsetInfo->utcTimeOffsetCode) = i;
+		OCTET_STRING_fromBuf(AllocMember(utcOffsetInfo->utcTimeOffset), "+0300", 5);
+		ASN_SEQUENCE_ADD(batch->choice.transferBatch.networkInfo->utcTimeOffsetInfo, utcOffsetInfo);
+
+		auto recEntityInfo = NewListElement(batch->choice.transferBatch.networkInfo->recEntityInfo->list.array);
+		*AllocMember(recEntityInfo->recEntityCode) = i;
+		*AllocMember(recEntityInfo->recEntityType) = i % 11 + 1;
+		string recEntityID = "7901" + to_string((long long) 1000000 + i);
+		OCTET_STRING_fromBuf(AllocMember(recEntityInfo->recEntityId), recEntityID.c_str(), recEntityID.size());
+		ASN_SEQUENCE_ADD(batch->choice.transferBatch.networkInfo->recEntityInfo, recEntityInfo);
+	}
+	return batch;
+}
+
+bool ReadSampleFile(const char* filename, vector<unsigned char>& buffer)
+{
+	FILE* f = fopen(filename, "rb");
+	if (!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	buffer.resize(ftell(f));
+	fseek(f, 0, SEEK_SET);
+	size_t bytesRead = (buffer.size() > 0 ? fread(&buffer[0], 1, buffer.size(), f) : 0);
+	fclose(f);
+	return bytesRead == buffer.size() && bytesRead > 0;
+}
+
+void LoadSamples(const char* tapFilename, const char* rapFilename)
+{
+	vector<unsigned char> buffer;
+	if (!tapFilename)
+		cerr << "Sample TAP file is not given" << endl;
+	else if (ReadSampleFile(tapFilename, buffer)) {
+		asn_dec_rval_t rval = ber_decode(0, &asn_DEF_DataInterChange, (void**) &sampleTapFile, &buffer[0], buffer.size());
+		if (rval.code != RC_OK || sampleTapFile->present != DataInterChange_PR_transferBatch ||
+				!sampleTapFile->choice.transferBatch.callEventDetails) {
+			cerr << "Sample TAP file " << tapFilename << " is not a transfer batch with call events" << endl;
+			ASN_STRUCT_FREE(asn_DEF_DataInterChange, sampleTapFile);
+			sampleTapFile = NULL;
+		}
+		else {
+			CallEventDetailList* events = sampleTapFile->choice.transferBatch.callEventDetails;
+			for (int i = 0; i < events->list.count; i++) {
+				int typeIndex = -1;
+				switch (events->list.array[i]->present) {
+				case CallEventDetail_PR_mobileOriginatedCall:
+					typeIndex = 0;
+					break;
+				case CallEventDetail_PR_mobileTerminatedCall:
+					typeIndex = 1;
+					break;
+				case CallEventDetail_PR_gprsCall:
+					typeIndex = 2;
+					break;
+				}
+				if (typeIndex >= 0 && sampleEventIndex[typeIndex] < 0)
+					sampleEventIndex[typeIndex] = i;
+			}
+		}
+	}
+	else
+		cerr << "Unable to read sample TAP file " << tapFilename << endl;
+
+	if (!rapFilename)
+		return;
+	if (ReadSampleFile(rapFilename, buffer)) {
+		asn_dec_rval_t rval = ber_decode(0, &asn_DEF_ReturnBatch, (void**) &sampleRapFile, &buffer[0], buffer.size());
+		if (rval.code != RC_OK) {
+			cerr << "Unable to decode sample RAP file " << rapFilename << endl;
+			ASN_STRUCT_FREE(asn_DEF_ReturnBatch, sampleRapFile);
+			sampleRapFile = NULL;
+		}
+	}
+	else
+		cerr << "Unable to read sample RAP file " << rapFilename << endl;
+}
+
+int AppendToBuffer(const void *buffer, size_t size, void *app_key)
+{
+	vector<unsigned char>* dest = (vector<unsigned char>*) app_key;
+	dest->insert(dest->end(), (const unsigned char*) buffer, (const unsigned char*) buffer + size);
+	return 0;
+}
+
+//-----------------------------
+// Conversion helpers
+void BM_BCDString(benchmark::State& state)
+{
+	// IMSI of 15 digits is padded with 0xF filler, 16 digits string has no fillers
+	unsigned char imsiWithFiller[] = { 0x52, 0x00, 0x11, 0x32, 0x54, 0x76, 0x98, 0xF0 };
+	unsigned char imsiWithoutFiller[] = { 0x52, 0x00, 0x11, 0x32, 0x54, 0x76, 0x98, 0x10 };
+	bool switchDigits = state.range(0) != 0;
+	BCDString_t bcdString;
+	memset(&bcdString, 0, sizeof(bcdString));
+	bcdString.buf = (state.range(1) != 0 ? imsiWithFiller : imsiWithoutFiller);
+	bcdString.size = sizeof(imsiWithFiller);
+
+	long long allocCountBefore = allocCount;
+	for (auto _ : state) {
+		string res = BCDString(&bcdString, switchDigits);
+		benchmark::DoNotOptimize(res);
+	}
+	ReportAllocations(state, allocCountBefore);
+}
+BENCHMARK(BM_BCDString)->ArgNames({ "switch", "filler" })->Args({ 0, 0 })->Args({ 0, 1 })->Args({ 1, 0 })->Args({ 1, 1 });
+
+
+void BM_OctetStr2Int64(benchmark::State& state)
+{
+	unsigned char value[] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF };
+	OCTET_STRING_t octetStr;
+	memset(&octetStr, 0, sizeof(octetStr));
+	octetStr.buf = value;
+	octetStr.size = (int) state.range(0);
+
+	long long allocCountBefore = allocCount;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(OctetStr2Int64(octetStr));
+	}
+	ReportAllocations(state, allocCountBefore);
+}
+BENCHMARK(BM_OctetStr2Int64)->Arg(1)->Arg(4)->Arg(8);
+
+
+void BM_OctetStrToHexStr(benchmark::State& state)
+{
+	vector<unsigned char> value(state.range(0));
+	for (size_t i = 0; i < value.size(); i++)
+		value[i] = (unsigned char) (i * 37);
+	OCTET_STRING_t octetStr;
+	memset(&octetStr, 0, sizeof(octetStr));
+	octetStr.buf = &value[0];
+	octetStr.size = (int) value.size();
+
+	long long allocCountBefore = allocCount;
+	for (auto _ : state) {
+		char* hexStr = OctetStrToHexStr(octetStr);
+		benchmark::DoNotOptimize(hexStr);
+		delete [] hexStr;
+	}
+	ReportAllocations(state, allocCountBefore);
+}
+BENCHMARK(BM_OctetStrToHexStr)->Arg(8)->Arg(32)->Arg(128);
+
+
+void BM_OctetString_fromInt64(benchmark::State& state)
+{
+	OCTET_STRING_t octetStr;
+	memset(&octetStr, 0, sizeof(octetStr));
+	long long value = state.range(0);
+	// buffer is allocated before timed loop and reused by conversions
+	RAPFile::OctetString_fromInt64(octetStr, value);
+
+	long long allocCountBefore = allocCount;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(RAPFile::OctetString_fromInt64(octetStr, value));
+	}
+	ReportAllocations(state, allocCountBefore);
+	free(octetStr.buf);
+}
+BENCHMARK(BM_OctetString_fromInt64)->Arg(100)->Arg(1000000)->Arg(1LL << 40);
+
+//-----------------------------
+// Network info lookups. The last code in list is looked up, i.e. the worst case of linear search.
+void BM_GetUTCOffset(benchmark::State& state)
+{
+	int listSize = (int) state.range(0);
+	DataInterChange* savedDataInterchange = dataInterchange;
+	dataInterchange = CreateNetworkInfo(listSize);
+
+	long long allocCountBefore = allocCount;
+	for (auto _ : state) {
+		string utcOffset = GetUTCOffset(listSize - 1);
+		benchmark::DoNotOptimize(utcOffset);
+	}
+	ReportAllocations(state, allocCountBefore);
+	state.SetComplexityN(listSize);
+	ASN_STRUCT_FREE(asn_DEF_DataInterChange, dataInterchange);
+	dataInterchange = savedDataInterchange;
+}
+BENCHMARK(BM_GetUTCOffset)->RangeMultiplier(4)->Range(1, 1024)->Complexity();
+
+
+void BM_GetRecordingEntity(benchmark::State& state)
+{
+	int listSize = (int) state.range(0);
+	DataInterChange* savedDataInterchange = dataInterchange;
+	dataInterchange = CreateNetworkInfo(listSize);
+
+	long long allocCountBefore = allocCount;
+	for (auto _ : state) {
+		string recEntityType;
+		string recEntityID = GetRecordingEntity(listSize - 1, recEntityType);
+		benchmark::DoNotOptimize(recEntityID);
+	}
+	ReportAllocations(state, allocCountBefore);
+	state.SetComplexityN(listSize);
+	ASN_STRUCT_FREE(asn_DEF_DataInterChange, dataInterchange);
+	dataInterchange = savedDataInterchange;
+}
+BENCHMARK(BM_GetRecordingEntity)->RangeMultiplier(4)->Range(1, 1024)->Complexity();
+
+//-----------------------------
+// Call event processing on sample TAP file. Argument is event type: 0 - MOC, 1 - MTC, 2 - GPRS.
+void BM_CallTotalCharge(benchmark::State& state)
+{
+	int eventIndex = sampleEventIndex[state.range(0)];
+	if (!sampleTapFile || eventIndex < 0) {
+		state.SkipWithError("No event of this type in sample TAP file");
+		return;
+	}
+	otl_connect otlConnect;
+	Config config;
+	CallValidator callValidator(otlConnect, &sampleTapFile->choice.transferBatch, config, 0);
+
+	long long allocCountBefore = allocCount;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(callValidator.CallTotalCharge(eventIndex));
+	}
+	ReportAllocations(state, allocCountBefore);
+}
+BENCHMARK(BM_CallTotalCharge)->ArgName("type")->DenseRange(0, 2);
+
+
+void BM_EncodeCallEventDetail(benchmark::State& state)
+{
+	int eventIndex = sampleEventIndex[state.range(0)];
+	if (!sampleTapFile || eventIndex < 0) {
+		state.SkipWithError("No event of this type in sample TAP file");
+		return;
+	}
+	CallEventDetail* event = sampleTapFile->choice.transferBatch.callEventDetails->list.array[eventIndex];
+	vector<unsigned char> buffer;
+	buffer.reserve(4096);
+
+	long long allocCountBefore = allocCount;
+	for (auto _ : state) {
+		buffer.clear();
+		asn_enc_rval_t encodeRes = der_encode(&asn_DEF_CallEventDetail, event, AppendToBuffer, &buffer);
+		if (encodeRes.encoded == -1) {
+			state.SkipWithError("der_encode failed");
+			break;
+		}
+	}
+	ReportAllocations(state, allocCountBefore);
+	state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_EncodeCallEventDetail)->ArgName("type")->DenseRange(0, 2);
+
+
+void BM_DecodeCallEventDetail(benchmark::State& state)
+{
+	int eventIndex = sampleEventIndex[state.range(0)];
+	if (!sampleTapFile || eventIndex < 0) {
+		state.SkipWithError("No event of this type in sample TAP file");
+		return;
+	}
+	vector<unsigned char> buffer;
+	der_encode(&asn_DEF_CallEventDetail, sampleTapFile->choice.transferBatch.callEventDetails->list.array[eventIndex],
+		AppendToBuffer, &buffer);
+
+	long long allocCountBefore = allocCount;
+	for (auto _ : state) {
+		CallEventDetail* event = NULL;
+		asn_dec_rval_t rval = ber_decode(0, &asn_DEF_CallEventDetail, (void**) &event, &buffer[0], buffer.size());
+		ASN_STRUCT_FREE(asn_DEF_CallEventDetail, event);
+		if (rval.code != RC_OK) {
+			state.SkipWithError("ber_decode failed");
+			break;
+		}
+	}
+	ReportAllocations(state, allocCountBefore);
+	state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_DecodeCallEventDetail)->ArgName("type")->DenseRange(0, 2);
+
+//-----------------------------
+// RAP file coding on sample RAP file
+void BM_EncodeReturnBatch(benchmark::State& state)
+{
+	if (!sampleRapFile) {
+		state.SkipWithError("Sample RAP file is not given");
+		return;
+	}
+	vector<unsigned char> buffer;
+	buffer.reserve(65536);
+
+	long long allocCountBefore = allocCount;
+	for (auto _ : state) {
+		buffer.clear();
+		asn_enc_rval_t encodeRes = der_encode(&asn_DEF_ReturnBatch, sampleRapFile, AppendToBuffer, &buffer);
+		if (encodeRes.encoded == -1) {
+			state.SkipWithError("der_encode failed");
+			break;
+		}
+	}
+	ReportAllocations(state, allocCountBefore);
+	state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_EncodeReturnBatch);
+
+
+void BM_DecodeReturnBatch(benchmark::State& state)
+{
+	if (!sampleRapFile) {
+		state.SkipWithError("Sample RAP file is not given");
+		return;
+	}
+	vector<unsigned char> buffer;
+	der_encode(&asn_DEF_ReturnBatch, sampleRapFile, AppendToBuffer, &buffer);
+
+	long long allocCountBefore = allocCount;
+	for (auto _ : state) {
+		ReturnBatch* returnBatch = NULL;
+		asn_dec_rval_t rval = ber_decode(0, &asn_DEF_ReturnBatch, (void**) &returnBatch, &buffer[0], buffer.size());
+		ASN_STRUCT_FREE(asn_DEF_ReturnBatch, returnBatch);
+		if (rval.code != RC_OK) {
+			state.SkipWithError("ber_decode failed");
+			break;
+		}
+	}
+	ReportAllocations(state, allocCountBefore);
+	state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+BENCHMARK(BM_DecodeReturnBatch);
+
+//-----------------------------
+int main(int argc, char* argv[])
+{
+	benchmark::Initialize(&argc, argv);
+	// arguments not recognized by benchmark library are sample file names
+	LoadSamples(argc > 1 ? argv[1] : getenv("TAP3_BENCH_TAP_SAMPLE"), argc > 2 ? argv[2] : getenv("TAP3_BENCH_RAP_SAMPLE"));
+#ifdef _DEBUG
+	_CrtSetAllocHook(CountingAllocHook);
+#endif
+	benchmark::RunSpecifiedBenchmarks();
+
+	if (sampleTapFile)
+		ASN_STRUCT_FREE(asn_DEF_DataInterChange, sampleTapFile);
+	if (sampleRapFile)
+		ASN_STRUCT_FREE(asn_DEF_ReturnBatch, sampleRapFile);
+	return 0;
+}
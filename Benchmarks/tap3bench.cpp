@@ -0,0 +1,354 @@
+// tap3bench.cpp : end-to-end throughput benchmark of TAP file loading.
+//
+// Loads a sample TAP file and files generated from it (sample events replicated scale times) through
+// the full LoadTAPFileToDB path and measures events/sec, CPU time, peak working set and DB round trips
+// of loader session. Every invocation appends one JSON line to history file, so runs can be diffed over time.
+//
+// Usage: tap3bench.exe <config file> <roaming hub ID> <sample TAP file> [-scale 1,10,100] [-runs N]
+//			[-fileid ID] [-history file] [-label text] [-commit]
+// Loaded data is rolled back unless -commit is given. Exit code is 0 if all loads succeeded.
+
+#include "stdafx.h"
+#include <vector>
+#include <sstream>
+#include <windows.h>
+#include <psapi.h>
+#include "OTL_Header.h"
+#include "DataInterchange.h"
+#include "TAP_Constants.h"
+#include "ConfigContainer.h"
+#include "RAPFile.h"
+
+extern const char *pShortName;
+extern DataInterChange* dataInterchange;
+extern ofstream ofsLog;
+extern long long OctetStr2Int64(const OCTET_STRING_t& octetStr);
+extern bool Finalize(otl_connect& otlConnect, bool bSuccess);
+extern int LoadTAPFileToDB(unsigned char* buffer, long dataLen, long fileID, long roamingHubID, bool bPrintOnly,
+	otl_connect& otlConnect, Config& config);
+
+const long defaultFileID = 1001110;
+const char* defaultHistoryFile = "tap3bench_history.json";
+
+struct BenchResult
+{
+	int scale;
+	int run;
+	long fileSize;
+	int eventCount;
+	int loadResult;
+	double elapsedSec;
+	double cpuSec;
+	size_t peakWorkingSet;
+	long long roundTrips;
+};
+
+//-----------------------------
+int AppendToBuffer(const void *buffer, size_t size, void *app_key)
+{
+	vector<unsigned char>* dest = (vector<unsigned char>*) app_key;
+	dest->insert(dest->end(), (const unsigned char*) buffer, (const unsigned char*) buffer + size);
+	return 0;
+}
+//-----------------------------
+bool ReadFile(const char* filename, vector<unsigned char>& buffer)
+{
+	FILE* f = fopen(filename, "rb");
+	if (!f)
+		return false;
+	fseek(f, 0, SEEK_END);
+	buffer.resize(ftell(f));
+	fseek(f, 0, SEEK_SET);
+	size_t bytesRead = (buffer.size() > 0 ? fread(&buffer[0], 1, buffer.size(), f) : 0);
+	fclose(f);
+	return bytesRead == buffer.size() && bytesRead > 0;
+}
+//-----------------------------
+void ScaleAmount(OCTET_STRING_t* amount, int scale)
+{
+	if (amount)
+		RAPFile::OctetString_fromInt64(*amount, OctetStr2Int64(*amount) * scale);
+}
+//-----------------------------
+// Creates TAP file containing events of sample file repeated scale times. Audit control info
+// is scaled accordingly so that generated file passes validation just like the sample does.
+bool GenerateTAPFile(const vector<unsigned char>& sample, int scale, vector<unsigned char>& generated, int& eventCount)
+{
+	DataInterChange* batch = NULL;
+	asn_dec_rval_t rval = ber_decode(0, &asn_DEF_DataInterChange, (void**) &batch, &sample[0], sample.size());
+	if (rval.code != RC_OK || batch->present != DataInterChange_PR_transferBatch ||
+			!batch->choice.transferBatch.callEventDetails || !batch->choice.transferBatch.auditControlInfo ||
+			!batch->choice.transferBatch.auditControlInfo->callEventDetailsCount) {
+		ASN_STRUCT_FREE(asn_DEF_DataInterChange, batch);
+		return false;
+	}
+
+	// event structures are shared between copies, original list is restored before freeing
+	CallEventDetailList* events = batch->choice.transferBatch.callEventDetails;
+	CallEventDetail** sampleEvents = events->list.array;
+	int sampleCount = events->list.count;
+	int sampleSize = events->list.size;
+	vector<CallEventDetail*> replicated(sampleCount * scale);
+	for (size_t i = 0; i < replicated.size(); i++)
+		replicated[i] = sampleEvents[i % sampleCount];
+	events->list.array = (replicated.size() > 0 ? &replicated[0] : NULL);
+	events->list.count = events->list.size = replicated.size();
+
+	AuditControlInfo* auditControlInfo = batch->choice.transferBatch.auditControlInfo;
+	*auditControlInfo->callEventDetailsCount = replicated.size();
+	ScaleAmount(auditControlInfo->totalCharge, scale);
+	ScaleAmount(auditControlInfo->totalTaxValue, scale);
+	ScaleAmount(auditControlInfo->totalDiscountValue, scale);
+
+	generated.clear();
+	asn_enc_rval_t encodeRes = der_encode(&asn_DEF_DataInterChange, batch, AppendToBuffer, &generated);
+	eventCount = replicated.size();
+
+	events->list.array = sampleEvents;
+	events->list.count = sampleCount;
+	events->list.size = sampleSize;
+	ASN_STRUCT_FREE(asn_DEF_DataInterChange, batch);
+	return encodeRes.encoded != -1;
+}
+//-----------------------------
+// Returns count of SQL*Net round trips made by current session, -1 if statistics are not accessible
+long long GetSessionRoundTrips(otl_connect& otlConnect)
+{
+	try {
+		otl_stream otlStream(1, "select s.value from v$mystat s, v$statname n where s.statistic# = n.statistic# "
+			"and n.name = 'SQL*Net roundtrips to/from client'", otlConnect);
+		double roundTrips;
+		otlStream >> roundTrips;
+		return (long long) roundTrips;
+	}
+	catch (otl_exception&) {
+		return -1;
+	}
+}
+//-----------------------------
+double FileTimeToSec(const FILETIME& fileTime)
+{
+	ULARGE_INTEGER value;
+	value.LowPart = fileTime.dwLowDateTime;
+	value.HighPart = fileTime.dwHighDateTime;
+	return value.QuadPart / 1e7;	// FILETIME is in 100-nanosecond intervals
+}
+//-----------------------------
+double GetProcessCPUSec()
+{
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime);
+	return FileTimeToSec(kernelTime) + FileTimeToSec(userTime);
+}
+//-----------------------------
+size_t GetPeakWorkingSet()
+{
+	PROCESS_MEMORY_COUNTERS memCounters;
+	memset(&memCounters, 0, sizeof(memCounters));
+	GetProcessMemoryInfo(GetCurrentProcess(), &memCounters, sizeof(memCounters));
+	return memCounters.PeakWorkingSetSize;
+}
+//-----------------------------
+int RunLoad(vector<unsigned char>& tapFile, long fileID, long roamingHubID, bool bCommit, Config& config, BenchResult& result)
+{
+	otl_connect otlConnect;
+	try {
+		otlConnect.rlogon(config.GetConnectString().c_str());
+		// the same procedure as Tests use to make loading of the same file repeatable
+		otl_nocommit_stream otlStream;
+		otlStream.open(1, "call BILLING.TAP3_TESTS.ClearPreviousUpload(:filename /*char[20],in*/)", otlConnect);
+		otlStream << pShortName;
+		otlStream.close();
+		otlConnect.commit();
+	}
+	catch (otl_exception &otlEx) {
+		cerr << "DB error: " << (char*) otlEx.msg << endl;
+		return TL_CONNECTERROR;
+	}
+
+	long long roundTripsOverhead = GetSessionRoundTrips(otlConnect);
+	long long roundTripsBefore = GetSessionRoundTrips(otlConnect);
+	roundTripsOverhead = roundTripsBefore - roundTripsOverhead;
+
+	LARGE_INTEGER freq, start, finish;
+	QueryPerformanceFrequency(&freq);
+	double cpuBefore = GetProcessCPUSec();
+	QueryPerformanceCounter(&start);
+
+	result.loadResult = LoadTAPFileToDB(&tapFile[0], tapFile.size(), fileID, roamingHubID, false, otlConnect, config);
+
+	QueryPerformanceCounter(&finish);
+	result.cpuSec = GetProcessCPUSec() - cpuBefore;
+	result.elapsedSec = (double) (finish.QuadPart - start.QuadPart) / freq.QuadPart;
+	result.peakWorkingSet = GetPeakWorkingSet();
+	result.roundTrips = -1;
+	if (otlConnect.connected && roundTripsBefore >= 0)
+		result.roundTrips = GetSessionRoundTrips(otlConnect) - roundTripsBefore - roundTripsOverhead;
+
+	if (result.loadResult == TL_DECODEERROR)
+		dataInterchange = NULL;	// already freed by loader
+	Finalize(otlConnect, bCommit && result.loadResult == TL_OK);
+	dataInterchange = NULL;
+	return result.loadResult;
+}
+//-----------------------------
+string JsonString(const string& value)
+{
+	string res = "\"";
+	for (size_t i = 0; i < value.size(); i++) {
+		switch (value[i]) {
+		case '"':
+			res += "\\\"";
+			break;
+		case '\\':
+			res += "\\\\";
+			break;
+		case '\n':
+			res += "\\n";
+			break;
+		case '\r':
+			res += "\\r";
+			break;
+		case '\t':
+			res += "\\t";
+			break;
+		default:
+			res += value[i];
+		}
+	}
+	return res + "\"";
+}
+//-----------------------------
+string ResultsToJson(const string& label, const string& sampleFile, const vector<BenchResult>& results)
+{
+	time_t t = time(0);
+	char timestamp[30];
+	strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+
+	ostringstream json;
+	json << "{\"timestamp\":" << JsonString(timestamp) << ",\"label\":" << JsonString(label)
+		<< ",\"sample\":" << JsonString(sampleFile) << ",\"results\":[";
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& res = results[i];
+		json << (i > 0 ? "," : "")
+			<< "{\"scale\":" << res.scale
+			<< ",\"run\":" << res.run
+			<< ",\"file_size\":" << res.fileSize
+			<< ",\"events\":" << res.eventCount
+			<< ",\"result\":" << res.loadResult
+			<< ",\"elapsed_sec\":" << res.elapsedSec
+			<< ",\"events_per_sec\":" << (res.elapsedSec > 0 ? res.eventCount / res.elapsedSec : 0)
+			<< ",\"cpu_sec\":" << res.cpuSec
+			<< ",\"peak_working_set\":" << res.peakWorkingSet
+			<< ",\"db_round_trips\":" << res.roundTrips
+			<< "}";
+	}
+	json << "]}";
+	return json.str();
+}
+//-----------------------------
+vector<int> ParseScales(const char* scales)
+{
+	vector<int> res;
+	stringstream ss(scales);
+	string item;
+	while (getline(ss, item, ',')) {
+		int scale = atoi(item.c_str());
+		if (scale > 0)
+			res.push_back(scale);
+	}
+	return res;
+}
+//-----------------------------
+int main(int argc, const char* argv[])
+{
+	if (argc < 4) {
+		cerr << "Usage: tap3bench <config file> <roaming hub ID> <sample TAP file> [-scale 1,10,100] [-runs N] "
+			"[-fileid ID] [-history file] [-label text] [-commit]" << endl;
+		return TL_PARAM_ERROR;
+	}
+	long roamingHubID = strtol(argv[2], NULL, 10);
+	const char* sampleFile = argv[3];
+	vector<int> scales = ParseScales("1,10,100");
+	int runs = 1;
+	long fileID = defaultFileID;
+	string historyFile = defaultHistoryFile;
+	string label;
+	bool bCommit = false;
+	for (int i = 4; i < argc; i++) {
+		if (!strcmp(argv[i], "-scale") && i + 1 < argc)
+			scales = ParseScales(argv[++i]);
+		else if (!strcmp(argv[i], "-runs") && i + 1 < argc)
+			runs = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-fileid") && i + 1 < argc)
+			fileID = strtol(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-history") && i + 1 < argc)
+			historyFile = argv[++i];
+		else if (!strcmp(argv[i], "-label") && i + 1 < argc)
+			label = argv[++i];
+		else if (!strcmp(argv[i], "-commit"))
+			bCommit = true;
+		else {
+			cerr << "Unknown option " << argv[i] << endl;
+			return TL_PARAM_ERROR;
+		}
+	}
+
+	ifstream ifsSettings(argv[1], ifstream::in);
+	if (!ifsSettings.is_open()) {
+		cerr << "Unable to open config file " << argv[1] << endl;
+		return TL_PARAM_ERROR;
+	}
+	Config config;
+	config.ReadConfigFile(ifsSettings);
+	ifsSettings.close();
+
+	vector<unsigned char> sample;
+	if (!ReadFile(sampleFile, sample)) {
+		cerr << "Unable to read sample file " << sampleFile << endl;
+		return TL_FILEERROR;
+	}
+	pShortName = strrchr(sampleFile, '\\');
+	pShortName = (pShortName ? pShortName + 1 : sampleFile);
+
+	const int OTL_MULTITHREADED_MODE = 1;
+	otl_connect::otl_initialize(OTL_MULTITHREADED_MODE);
+
+	vector<BenchResult> results;
+	bool allLoaded = true;
+	printf("%6s %4s %10s %8s %7s %10s %10s %8s %12s %10s\n", "scale", "run", "bytes", "events", "result",
+		"elapsed,s", "events/s", "cpu,s", "peak WS,KB", "roundtrips");
+	for (size_t s = 0; s < scales.size(); s++) {
+		vector<unsigned char> tapFile;
+		int eventCount;
+		if (!GenerateTAPFile(sample, scales[s], tapFile, eventCount)) {
+			cerr << "Unable to generate TAP file of scale " << scales[s] << " from " << sampleFile << endl;
+			return TL_DECODEERROR;
+		}
+		for (int run = 1; run <= runs; run++) {
+			ofsLog.open("TAP3Loader.log", ofstream::app);
+			BenchResult result;
+			result.scale = scales[s];
+			result.run = run;
+			result.fileSize = tapFile.size();
+			result.eventCount = eventCount;
+			if (RunLoad(tapFile, fileID, roamingHubID, bCommit, config, result) != TL_OK)
+				allLoaded = false;
+			results.push_back(result);
+			printf("%6d %4d %10ld %8d %7d %10.3f %10.1f %8.3f %12lu %10lld\n", result.scale, result.run, result.fileSize,
+				result.eventCount, result.loadResult, result.elapsedSec,
+				(result.elapsedSec > 0 ? result.eventCount / result.elapsedSec : 0), result.cpuSec,
+				(unsigned long) (result.peakWorkingSet / 1024), result.roundTrips);
+		}
+	}
+
+	ofstream ofsHistory(historyFile.c_str(), ofstream::app);
+	if (ofsHistory.is_open()) {
+		ofsHistory << ResultsToJson(label, sampleFile, results) << endl;
+		ofsHistory.close();
+	}
+	else
+		cerr << "Unable to write results to " << historyFile << endl;
+
+	return allLoaded ? 0 : 1;
+}
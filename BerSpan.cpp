@@ -0,0 +1,59 @@
+#include "OTL_Header.h"
+#include "DataInterchange.h"
+#include "BerSpan.h"
+
+using namespace std;
+
+ssize_t FetchTagAndLength(const unsigned char* data, size_t size, ber_tlv_tag_t& tag, size_t& length)
+{
+	ssize_t tagSize = ber_fetch_tag(data, size, &tag);
+	if (tagSize <= 0)
+		return -1;
+	ber_tlv_len_t contentLength;
+	ssize_t lengthSize = ber_fetch_length(BER_TLV_CONSTRUCTED(data), data + tagSize, size - tagSize, &contentLength);
+	if (lengthSize <= 0 || contentLength < 0 || (size_t) contentLength > size - tagSize - lengthSize)
+		return -1;
+	length = contentLength;
+	return tagSize + lengthSize;
+}
+
+
+bool FindCallEventSpans(const unsigned char* buffer, size_t size, vector<BerSpan>& spans, BerSpan* eventList)
+{
+	spans.clear();
+	ber_tlv_tag_t tag;
+	size_t length;
+	ssize_t headerSize = FetchTagAndLength(buffer, size, tag, length);
+	if (headerSize < 0 || tag != asn_DEF_TransferBatch.tags[0])
+		return false;
+
+	// members of transfer batch
+	const unsigned char* member = buffer + headerSize;
+	const unsigned char* batchEnd = member + length;
+	while (member < batchEnd) {
+		headerSize = FetchTagAndLength(member, batchEnd - member, tag, length);
+		if (headerSize < 0)
+			return false;
+		if (tag == asn_DEF_CallEventDetailList.tags[0]) {
+			const unsigned char* event = member + headerSize;
+			const unsigned char* listEnd = event + length;
+			while (event < listEnd) {
+				headerSize = FetchTagAndLength(event, listEnd - event, tag, length);
+				if (headerSize < 0) {
+					spans.clear();
+					return false;
+				}
+				BerSpan span = { event, headerSize + length };
+				spans.push_back(span);
+				event += span.size;
+			}
+			if (eventList) {
+				eventList->data = member;
+				eventList->size = listEnd - member;
+			}
+			return true;
+		}
+		member += headerSize + length;
+	}
+	return false;
+}
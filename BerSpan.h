@@ -0,0 +1,21 @@
+#pragma once
+#include <vector>
+
+// Byte span of BER-encoded value (tag, length and contents) in the buffer a file was decoded from
+struct BerSpan
+{
+	const unsigned char* data;
+	size_t size;
+};
+
+
+// Reads tag and length of TLV at data and returns size of its header, or -1 if TLV is malformed, exceeds
+// the size or has indefinite length
+ssize_t FetchTagAndLength(const unsigned char* data, size_t size, ber_tlv_tag_t& tag, size_t& length);
+
+
+// Finds spans of call event details of transfer batch in decoded TAP file buffer, so that returned events
+// can be written to RAP file byte-identical to what the partner sent. Returns false if spans can't be found
+// (e.g. indefinite length form is used), spans are empty then. If eventList is given, it receives span of
+// the whole CallEventDetailList.
+bool FindCallEventSpans(const unsigned char* buffer, size_t size, std::vector<BerSpan>& spans, BerSpan* eventList = NULL);
@@ -7,15 +7,18 @@
 #include "RAPFile.h"
 #include "CallValidator.h"
 #include "TAPValidator.h"
+#include "TapAmount.h"
 
 using namespace std;
 
 extern long long OctetStr2Int64(const OCTET_STRING_t& octetStr);
 extern void log(string filename, short msgType, string msgText, string dbConnectString = "");
 
-CallValidator::CallValidator(otl_connect& otlConnect, const TransferBatch* transferBatch, Config& config, long roamingHubID) :
+CallValidator::CallValidator(otl_connect& otlConnect, const TransferBatch* transferBatch, Config& config, long roamingHubID,
+		const vector<BerSpan>* eventSpans) :
 	m_otlConnect(otlConnect),
 	m_transferBatch(transferBatch),
+	m_eventSpans(eventSpans),
 	m_config(config),
 	m_rapFile(otlConnect, config, roamingHubID)	
 {}
@@ -65,8 +68,8 @@ CallAgeValidationResult CallValidator::ValidateAgeAndCreateRAP(long long eventID
 		if (!m_rapFile.IsInitialized()) {
 			m_rapFile.Initialize(m_transferBatch);
 		}
-		m_rapFile.AddReturnDetail(CreateReturnDetailForCallAgeError(callIndex, CALL_OLDER_THAN_ALLOWED_BY_BARG), 
-			CallTotalCharge(callIndex));
+		m_rapFile.AddSevereReturn(CreateReturnDetailForCallAgeError(callIndex, CALL_OLDER_THAN_ALLOWED_BY_BARG), 
+			m_transferBatch->callEventDetails->list.array[callIndex], GetEventSpan(callIndex), CallTotalCharge(callIndex));
 		otlStream.open(1, "call BILLING.TAP3.SetRAPFileSeqNumForEvent(:event_id /*bigint,in*/, :call_type /*long,in*/, "
 			":rapseqnum /*char[10],in*/)", m_otlConnect);
 		otlStream
@@ -76,7 +79,7 @@ CallAgeValidationResult CallValidator::ValidateAgeAndCreateRAP(long long eventID
 		otlStream.close();
 		return CALL_AGE_EXCEEDED;
 	default:
-		log(m_rapFile.GetName(), LOG_ERROR, " TAP3.IsCallAgeValid   : " + 
+		log(m_rapFile.GetName(), LOG_ERROR, "Функция TAP3.IsCallAgeValid вернула недопустимый код: " + 
 			to_string(static_cast<long long>(res)));
 		return CALL_AGE_ERROR;
 	}
@@ -124,9 +127,10 @@ IOTValidationResult CallValidator::ValidateIOTAndCreateRAP(long long eventID, Ca
 					return IOT_VALIDATION_IMPOSSIBLE;
 				}
 			}
-			m_rapFile.AddReturnDetail(
+			m_rapFile.AddSevereReturn(
 				CreateReturnDetailForIOTError(callIndex, CHARGE_NOT_IN_ROAMING_AGREEMENT, 
-					iotDate, expectedCharge, calculation), CallTotalCharge(callIndex));
+					iotDate, expectedCharge, calculation), 
+				m_transferBatch->callEventDetails->list.array[callIndex], GetEventSpan(callIndex), CallTotalCharge(callIndex));
 		}
 	}
 
@@ -181,7 +185,7 @@ ReturnDetail* CallValidator::CreateReturnDetailForIOTError(int callIndex, int er
 		
 		char strExpectedCharge[100];
 		snprintf(strExpectedCharge, 100, "ExpCharge:%ld", 
-			(long) (expectedCharge * (double) pow((double) 10, *m_transferBatch->accountingInfo->tapDecimalPlaces)));
+			(long) TapAmount::FromDouble(expectedCharge, *m_transferBatch->accountingInfo->tapDecimalPlaces).GetMantissa());
 		OperatorSpecInformation_t* octetStrExpCharge = OCTET_STRING_new_fromBuf(&asn_DEF_OperatorSpecInformation, 
 			strExpectedCharge, strlen(strExpectedCharge));
 		ASN_SEQUENCE_ADD(returnDetail->choice.severeReturn.operatorSpecList, octetStrExpCharge);
@@ -236,11 +240,19 @@ ReturnDetail* CallValidator::CreateReturnDetail(int callIndex)
 	OCTET_STRING_fromBuf(&returnDetail->choice.severeReturn.fileSequenceNumber,
 		(const char*)m_transferBatch->batchControlInfo->fileSequenceNumber->buf,
 		m_transferBatch->batchControlInfo->fileSequenceNumber->size);
-	returnDetail->choice.severeReturn.callEventDetail = *m_transferBatch->callEventDetails->list.array[callIndex];
+	// call event is referenced by RAP file, see RAPFile::AddSevereReturn
 	return returnDetail;
 }
 
 
+const BerSpan* CallValidator::GetEventSpan(int callIndex)
+{
+	if (m_eventSpans && callIndex < (int) m_eventSpans->size())
+		return &(*m_eventSpans)[callIndex];
+	return NULL;
+}
+
+
 void CallValidator::AddErrorContext(ErrorDetail* errorDetail, int ctxLevel, int pathItemId, int itemOccurrence)
 {
 	ErrorContext* errorContext = (ErrorContext*) calloc(1, sizeof(ErrorContext));
@@ -57,13 +57,17 @@ enum CallValidationResult
 class CallValidator
 {
 public:
-	CallValidator(otl_connect& otlConnect, const TransferBatch* transferBatch, Config& config, long roamingHubID);
+	// eventSpans are spans of call events in TAP file buffer, used to return events to RAP file as they were sent
+	CallValidator(otl_connect& otlConnect, const TransferBatch* transferBatch, Config& config, long roamingHubID,
+		const vector<BerSpan>* eventSpans = NULL);
 	CallValidationResult ValidateCall(long long eventID, CallTypeForValidation callType, int callIndex, long iotValidationMode);
 	RAPFile& GetRAPFile();
+	long CallTotalCharge(int callIndex);
 private:
 	otl_connect& m_otlConnect;
 	Config& m_config;
 	const TransferBatch* m_transferBatch;
+	const vector<BerSpan>* m_eventSpans;
 	RAPFile m_rapFile;
 	vector<ReturnDetail*> m_returnDetails;
 	
@@ -71,11 +75,11 @@ private:
 		int callIndex);
 	IOTValidationResult ValidateIOTAndCreateRAP(long long eventID, CallTypeForValidation callType, 
 		int callIndex, long iotValidationMode);
-	long CallTotalCharge(int callIndex);
 	ReturnDetail* CreateReturnDetailForIOTError(int callIndex, int errorCode, 
 		string iotDate, double expectedCharge, string calculation);
 	ReturnDetail* CreateReturnDetailForCallAgeError(int callIndex, int errorCode);
 	ReturnDetail* CreateReturnDetail(int callIndex);
+	const BerSpan* GetEventSpan(int callIndex);
 	ErrorDetail* CreateCommonErrorDetail(int callIndex, int errorCode);
 	void AddErrorContext(ErrorDetail* errorDetail, int ctxLevel, int pathItemId, int itemOccurrence);
 };
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include <vector>
+#include <zlib.h>
+#include <zstd.h>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "CompressedInput.h"
+
+using namespace std;
+
+extern void log(short msgType, string msgText, string dbConnectString = "");
+
+const size_t readChunkSize = 256 * 1024;
+
+
+CompressionType DetectCompression(const unsigned char* header, size_t size)
+{
+	if (size >= 2 && header[0] == 0x1F && header[1] == 0x8B)
+		return ctGzip;
+	if (size >= 4 && header[0] == 0x28 && header[1] == 0xB5 && header[2] == 0x2F && header[3] == 0xFD)
+		return ctZstd;
+	return ctNone;
+}
+
+
+static void EnsureSpace(unsigned char*& buffer, size_t used, size_t& capacity, size_t needed)
+{
+	if (capacity - used >= needed)
+		return;
+	size_t newCapacity = capacity * 2;
+	while (newCapacity - used < needed)
+		newCapacity *= 2;
+	unsigned char* newBuffer = new unsigned char[newCapacity];
+	memcpy(newBuffer, buffer, used);
+	delete [] buffer;
+	buffer = newBuffer;
+	capacity = newCapacity;
+}
+
+
+// Decoders are called until they leave free space in output buffer, so that no decoded data is left in them
+// when input is consumed. Output buffer starts at size of compressed file and is doubled when it gets full.
+// Concatenated gzip members and zstd frames are decoded as one file, zero bytes after gzip member are padding.
+static int DecompressGzip(FILE* f, size_t capacity, unsigned char*& buffer, size_t& used)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, 15 + 16 /* gzip header */) != Z_OK)
+		return TL_DECODEERROR;
+	vector<unsigned char> input(readChunkSize);
+	int zres = Z_OK;
+	bool flushed = true;
+	while (true) {
+		if (stream.avail_in == 0 && flushed) {
+			size_t bytesRead = fread(&input[0], 1, input.size(), f);
+			if (bytesRead == 0)
+				break;
+			stream.next_in = &input[0];
+			stream.avail_in = (uInt) bytesRead;
+		}
+		if (zres == Z_STREAM_END) {
+			while (stream.avail_in > 0 && *stream.next_in == 0) {
+				stream.next_in++;
+				stream.avail_in--;
+			}
+			if (stream.avail_in == 0)
+				continue;
+			inflateReset(&stream);
+		}
+		EnsureSpace(buffer, used, capacity, readChunkSize);
+		stream.next_out = buffer + used;
+		stream.avail_out = (uInt) (capacity - used);
+		zres = inflate(&stream, Z_NO_FLUSH);
+		used = capacity - stream.avail_out;
+		flushed = (stream.avail_out > 0 || zres == Z_STREAM_END);
+		// no progress was possible: output buffer is grown or input is read on next pass
+		if (zres == Z_BUF_ERROR && (stream.avail_in == 0 || stream.avail_out == 0))
+			continue;
+		if (zres != Z_OK && zres != Z_STREAM_END) {
+			log(LOG_ERROR, string("Ошибка распаковки gzip: ") + (stream.msg ? stream.msg : to_string((long long) zres)));
+			inflateEnd(&stream);
+			return TL_DECODEERROR;
+		}
+	}
+	inflateEnd(&stream);
+	if (zres != Z_STREAM_END) {
+		log(LOG_ERROR, "Ошибка распаковки gzip: данные файла обрезаны");
+		return TL_DECODEERROR;
+	}
+	return TL_OK;
+}
+
+
+static int DecompressZstd(FILE* f, size_t capacity, unsigned char*& buffer, size_t& used)
+{
+	ZSTD_DCtx* dctx = ZSTD_createDCtx();
+	if (!dctx)
+		return TL_DECODEERROR;
+	vector<unsigned char> input(readChunkSize);
+	ZSTD_inBuffer in = { &input[0], 0, 0 };
+	size_t zres = 0;
+	bool flushed = true;
+	while (true) {
+		if (in.pos == in.size && flushed) {
+			size_t bytesRead = fread(&input[0], 1, input.size(), f);
+			if (bytesRead == 0)
+				break;
+			in.size = bytesRead;
+			in.pos = 0;
+		}
+		EnsureSpace(buffer, used, capacity, readChunkSize);
+		ZSTD_outBuffer out = { buffer + used, capacity - used, 0 };
+		zres = ZSTD_decompressStream(dctx, &out, &in);
+		if (ZSTD_isError(zres)) {
+			log(LOG_ERROR, string("Ошибка распаковки zstd: ") + ZSTD_getErrorName(zres));
+			ZSTD_freeDCtx(dctx);
+			return TL_DECODEERROR;
+		}
+		used += out.pos;
+		flushed = (out.pos < out.size);
+	}
+	ZSTD_freeDCtx(dctx);
+	// non-zero result means that the last frame is not complete
+	if (zres != 0) {
+		log(LOG_ERROR, "Ошибка распаковки zstd: данные файла обрезаны");
+		return TL_DECODEERROR;
+	}
+	return TL_OK;
+}
+
+
+int ReadInputFile(const char* filename, unsigned char*& buffer, unsigned long& size)
+{
+	buffer = NULL;
+	size = 0;
+	FILE* f = fopen(filename, "rb");
+	if (!f)
+		return TL_PARAM_ERROR;
+	fseek(f, 0, SEEK_END);
+	unsigned long fileLen = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	unsigned char header[4];
+	size_t headerLen = fread(header, 1, sizeof(header), f);
+	fseek(f, 0, SEEK_SET);
+	CompressionType compression = DetectCompression(header, headerLen);
+	if (compression == ctNone) {
+		buffer = new unsigned char [fileLen];
+		size_t bytesRead = fread(buffer, 1, fileLen, f);
+		fclose(f);
+		if (bytesRead < fileLen) {
+			delete [] buffer;
+			buffer = NULL;
+			return TL_FILEERROR;
+		}
+		size = fileLen;
+		return TL_OK;
+	}
+
+	size_t capacity = fileLen + readChunkSize;
+	size_t used = 0;
+	buffer = new unsigned char [capacity];
+	int res = (compression == ctGzip ? DecompressGzip(f, capacity, buffer, used) : DecompressZstd(f, capacity, buffer, used));
+	if (ferror(f))
+		res = TL_FILEERROR;
+	fclose(f);
+	if (res != TL_OK) {
+		delete [] buffer;
+		buffer = NULL;
+		return res;
+	}
+	size = (unsigned long) used;
+	return TL_OK;
+}
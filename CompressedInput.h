@@ -0,0 +1,16 @@
+#pragma once
+
+enum CompressionType
+{
+	ctNone = 0,
+	ctGzip = 1,
+	ctZstd = 2
+};
+
+// compression format by magic bytes at the beginning of file
+CompressionType DetectCompression(const unsigned char* header, size_t size);
+
+// Reads file into buffer allocated by new[]. Files compressed by gzip or zstd are decompressed while reading,
+// by chunks, without temporary files. Returns TL_OK, TL_PARAM_ERROR (file not found),
+// TL_FILEERROR or TL_DECODEERROR (damaged compressed data, details are logged).
+int ReadInputFile(const char* filename, unsigned char*& buffer, unsigned long& size);
@@ -0,0 +1,265 @@
+#include <map>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "ConfigContainer.h"
+#include "ContentHash.h"
+
+using namespace std;
+
+extern void log(short msgType, string msgText, string dbConnectString = "");
+
+// re-delivered copies come within days, older ones are found by DB lookup
+const long long maxIndexEntryAge = 90 * 24 * 3600;	// seconds
+const size_t minDeadIndexLines = 1000;
+const DWORD indexLockTimeout = 30000;	// ms
+
+const unsigned long long xxhPrime1 = 11400714785074694791ULL;
+const unsigned long long xxhPrime2 = 14029467366897019727ULL;
+const unsigned long long xxhPrime3 = 1609587929392839161ULL;
+const unsigned long long xxhPrime4 = 9650029242287828579ULL;
+const unsigned long long xxhPrime5 = 2870177450012600261ULL;
+
+
+static inline unsigned long long RotateLeft(unsigned long long value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+
+// little-endian reads, as on x86
+static inline unsigned long long Read64(const unsigned char* p)
+{
+	unsigned long long value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+
+static inline unsigned long long Read32(const unsigned char* p)
+{
+	unsigned int value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+
+static inline unsigned long long XXH64Round(unsigned long long acc, unsigned long long input)
+{
+	acc += input * xxhPrime2;
+	acc = RotateLeft(acc, 31);
+	return acc * xxhPrime1;
+}
+
+
+static inline unsigned long long XXH64MergeRound(unsigned long long acc, unsigned long long value)
+{
+	acc ^= XXH64Round(0, value);
+	return acc * xxhPrime1 + xxhPrime4;
+}
+
+
+static unsigned long long XXH64(const unsigned char* p, size_t size, unsigned long long seed)
+{
+	const unsigned char* end = p + size;
+	unsigned long long hash;
+	if (size >= 32) {
+		const unsigned char* limit = end - 32;
+		unsigned long long v1 = seed + xxhPrime1 + xxhPrime2;
+		unsigned long long v2 = seed + xxhPrime2;
+		unsigned long long v3 = seed;
+		unsigned long long v4 = seed - xxhPrime1;
+		do {
+			v1 = XXH64Round(v1, Read64(p));
+			v2 = XXH64Round(v2, Read64(p + 8));
+			v3 = XXH64Round(v3, Read64(p + 16));
+			v4 = XXH64Round(v4, Read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+		hash = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+		hash = XXH64MergeRound(hash, v1);
+		hash = XXH64MergeRound(hash, v2);
+		hash = XXH64MergeRound(hash, v3);
+		hash = XXH64MergeRound(hash, v4);
+	}
+	else
+		hash = seed + xxhPrime5;
+	hash += size;
+
+	for (; p + 8 <= end; p += 8) {
+		hash ^= XXH64Round(0, Read64(p));
+		hash = RotateLeft(hash, 27) * xxhPrime1 + xxhPrime4;
+	}
+	if (p + 4 <= end) {
+		hash ^= Read32(p) * xxhPrime1;
+		hash = RotateLeft(hash, 23) * xxhPrime2 + xxhPrime3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		hash ^= (*p) * xxhPrime5;
+		hash = RotateLeft(hash, 11) * xxhPrime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= xxhPrime2;
+	hash ^= hash >> 29;
+	hash *= xxhPrime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+
+string ContentHash(const unsigned char* buffer, size_t size)
+{
+	char hex[17];
+	sprintf(hex, "%016llx", XXH64(buffer, size, 0));
+	return hex;
+}
+
+
+LoadedFileIndex& LoadedFileIndex::Instance()
+{
+	static LoadedFileIndex* instance = new LoadedFileIndex();
+	return *instance;
+}
+
+
+LoadedFileIndex::LoadedFileIndex()
+{
+	InitializeCriticalSection(&m_critSection);
+	m_mutex = CreateMutex(NULL, FALSE, "TAP3LoaderLoadedFileIndex");
+}
+
+
+bool LoadedFileIndex::Lock()
+{
+	if (!m_mutex)
+		return false;
+	DWORD waitRes = WaitForSingleObject(m_mutex, indexLockTimeout);
+	// mutex abandoned by crashed loader is owned now, index file is replaced atomically
+	return (waitRes == WAIT_OBJECT_0 || waitRes == WAIT_ABANDONED);
+}
+
+
+void LoadedFileIndex::Unlock()
+{
+	ReleaseMutex(m_mutex);
+}
+
+
+// index file is read once per process, entries appended by other processes are found by DB lookup.
+// Lines are "<hash> <roaming hub ID> <file ID> <time added>", file ID 0 marks removed entry.
+// Lines written without time added are aged from now on.
+void LoadedFileIndex::Load(const Config& config)
+{
+	if (!m_indexFilename.empty())
+		return;
+	m_indexFilename = (config.GetOutputDirectory().empty() ? "." : config.GetOutputDirectory()) + "\\loaded_files.idx";
+	bool locked = Lock();
+	FILE* f = fopen(m_indexFilename.c_str(), "r");
+	if (!f) {
+		if (locked)
+			Unlock();
+		return;
+	}
+	long long now = (long long) time(NULL);
+	size_t lineCount = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		char contentHash[17];
+		long roamingHubID, fileID;
+		long long addedTime;
+		int fields = sscanf(line, "%16s %ld %ld %lld", contentHash, &roamingHubID, &fileID, &addedTime);
+		if (fields < 3)
+			continue;
+		lineCount++;
+		if (fields == 3)
+			addedTime = now;
+		IndexKey key(contentHash, roamingHubID);
+		if (fileID == 0 || now - addedTime > maxIndexEntryAge) {
+			m_entries.erase(key);
+		}
+		else {
+			IndexEntry entry = { fileID, addedTime };
+			m_entries[key] = entry;
+		}
+	}
+	fclose(f);
+	// without lock other process may append lines during rewrite, so compaction waits for next run
+	if (locked) {
+		if (lineCount - m_entries.size() > m_entries.size() / 4 + minDeadIndexLines)
+			Compact();
+		Unlock();
+	}
+}
+
+
+// rewrites index file with live entries only, called under lock
+void LoadedFileIndex::Compact()
+{
+	string tempFilename = m_indexFilename + ".tmp";
+	FILE* f = fopen(tempFilename.c_str(), "w");
+	if (!f) {
+		log(LOG_ERROR, "Невозможно создать файл индекса загруженных файлов " + tempFilename);
+		return;
+	}
+	bool success = true;
+	for (map<IndexKey, IndexEntry>::const_iterator it = m_entries.begin(); it != m_entries.end(); it++)
+		if (fprintf(f, "%s %ld %ld %lld\n", it->first.first.c_str(), it->first.second, it->second.fileID,
+				it->second.addedTime) < 0)
+			success = false;
+	if (fclose(f) != 0)
+		success = false;
+	if (!success || !MoveFileEx(tempFilename.c_str(), m_indexFilename.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		log(LOG_ERROR, "Ошибка записи файла индекса загруженных файлов " + m_indexFilename);
+		DeleteFile(tempFilename.c_str());
+	}
+}
+
+
+// lines are short enough to be appended by concurrent loader processes without interleaving,
+// lock keeps them from being lost by compaction. Index is a hint, so line is dropped if lock is not taken.
+void LoadedFileIndex::AppendLine(string contentHash, long roamingHubID, long fileID, long long addedTime)
+{
+	if (!Lock())
+		return;
+	FILE* f = fopen(m_indexFilename.c_str(), "a");
+	if (f) {
+		fprintf(f, "%s %ld %ld %lld\n", contentHash.c_str(), roamingHubID, fileID, addedTime);
+		fclose(f);
+	}
+	Unlock();
+}
+
+
+long LoadedFileIndex::Find(const Config& config, string contentHash, long roamingHubID)
+{
+	long fileID = 0;
+	EnterCriticalSection(&m_critSection);
+	Load(config);
+	map<IndexKey, IndexEntry>::const_iterator it = m_entries.find(IndexKey(contentHash, roamingHubID));
+	if (it != m_entries.end())
+		fileID = it->second.fileID;
+	LeaveCriticalSection(&m_critSection);
+	return fileID;
+}
+
+
+void LoadedFileIndex::Add(const Config& config, string contentHash, long roamingHubID, long fileID)
+{
+	EnterCriticalSection(&m_critSection);
+	Load(config);
+	IndexEntry entry = { fileID, (long long) time(NULL) };
+	m_entries[IndexKey(contentHash, roamingHubID)] = entry;
+	AppendLine(contentHash, roamingHubID, fileID, entry.addedTime);
+	LeaveCriticalSection(&m_critSection);
+}
+
+
+void LoadedFileIndex::Remove(const Config& config, string contentHash, long roamingHubID)
+{
+	EnterCriticalSection(&m_critSection);
+	Load(config);
+	if (m_entries.erase(IndexKey(contentHash, roamingHubID)) > 0)
+		AppendLine(contentHash, roamingHubID, 0, (long long) time(NULL));
+	LeaveCriticalSection(&m_critSection);
+}
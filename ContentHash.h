@@ -0,0 +1,41 @@
+#pragma once
+#include <map>
+
+// XXH64 hash of file contents, as 16 hex digits (CONTENT_HASH column of TAP3_FILE and RAP_FILE)
+string ContentHash(const unsigned char* buffer, size_t size);
+
+
+// Class LoadedFileIndex keeps content hashes of files loaded by this host in a file of output directory,
+// so that exact copies of loaded files re-delivered by roaming hubs are recognized before decoding.
+// Index entries are hints only: a copy is skipped after its file ID is checked in DB.
+// Removed entries are kept as tombstone lines (file ID 0) until the file is compacted on load;
+// entries older than maxIndexEntryAge are dropped then too, since their copies are found by DB lookup.
+class LoadedFileIndex
+{
+public:
+	static LoadedFileIndex& Instance();
+	// returns ID of loaded file with given content hash or 0
+	long Find(const Config& config, string contentHash, long roamingHubID);
+	void Add(const Config& config, string contentHash, long roamingHubID, long fileID);
+	// drops entry found to be stale (file is deleted from DB or failed validation)
+	void Remove(const Config& config, string contentHash, long roamingHubID);
+private:
+	struct IndexEntry {
+		long fileID;
+		long long addedTime;
+	};
+	typedef pair<string, long> IndexKey;	// content hash and roaming hub ID
+
+	LoadedFileIndex();
+
+	CRITICAL_SECTION m_critSection;
+	HANDLE m_mutex;						// guards index file against compaction by concurrent loader processes
+	string m_indexFilename;
+	map<IndexKey, IndexEntry> m_entries;
+
+	void Load(const Config& config);
+	void Compact();
+	void AppendLine(string contentHash, long roamingHubID, long fileID, long long addedTime);
+	bool Lock();
+	void Unlock();
+};
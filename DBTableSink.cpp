@@ -0,0 +1,198 @@
+#include <vector>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "DataInterchange.h"
+#include "DBTableSink.h"
+#include "TAPTimestamp.h"
+
+using namespace std;
+
+// bind variable types by column type, timestamps are parsed on client and bound as native dates,
+// amounts are bound as mantissas
+const char* bindTypes[] = { "bigint", "double", "char[256]", "char[256]", "timestamp", "bigint" };
+
+
+DBTableSink::DBTableSink(otl_connect& otlConnect, const TableDefinition& table, int bufferSize, string errorTag,
+		int amountScale) :
+	m_table(table),
+	m_bufferSize(bufferSize),
+	m_amountScale(amountScale),
+	m_column(0),
+	m_pendingRows(0),
+	m_rowCount(0)
+{
+	string columns, values;
+	for (int i = 0; i < table.columnCount; i++) {
+		string bindVar = ":c" + to_string((long long) i + 1) + " /*" + bindTypes[table.columns[i].type] + ",in*/";
+		if (table.columns[i].type == ctAmount && amountScale > 0)
+			bindVar += " / " + to_string(TapAmount::Power(amountScale));
+		columns += (i > 0 ? ", " : "") + string(table.columns[i].name);
+		values += (i > 0 ? ", " : "") + bindVar;
+	}
+	string errorLogging;
+	if (!errorTag.empty())
+		errorLogging = " log errors into " + GetErrorTableName(table.name) + " ('" + errorTag + "') reject limit unlimited";
+	m_otlStream.open(bufferSize, ("insert into " + string(table.name) + " (" + columns + ") values (" + values + ")" +
+		errorLogging).c_str(), otlConnect);
+}
+
+
+string DBTableSink::GetErrorTableName(const char* tableName)
+{
+	string name = tableName;
+	size_t schemaEnd = name.find('.');
+	string schema = (schemaEnd != string::npos ? name.substr(0, schemaEnd + 1) : "");
+	// default name of error table is made of 25 first characters of table name
+	return schema + "ERR$_" + name.substr(schemaEnd != string::npos ? schemaEnd + 1 : 0, 25);
+}
+
+
+ColumnType DBTableSink::NextColumnType()
+{
+	return m_table.columns[m_column++].type;
+}
+
+
+void DBTableSink::AddString(const char* value)
+{
+	otl_datetime datetime;
+	switch (NextColumnType()) {
+	case ctInteger:
+		if (*value)
+			m_otlStream << _atoi64(value);
+		else
+			m_otlStream << otl_null();
+		break;
+	case ctDecimal:
+		if (*value)
+			m_otlStream << atof(value);
+		else
+			m_otlStream << otl_null();
+		break;
+	case ctAmount:
+		if (*value)
+			m_otlStream << TapAmount::FromDouble(atof(value), m_amountScale).GetMantissa();
+		else
+			m_otlStream << otl_null();
+		break;
+	case ctDateTime:
+		// empty timestamps are NULLs, malformed ones are errors of the event like conversion errors of to_date
+		if (!*value)
+			m_otlStream << otl_null();
+		else if (ParseTAPTimestamp(value, datetime))
+			m_otlStream << datetime;
+		else {
+			if (m_valueError.empty())
+				m_valueError = string("дата ") + value + " в поле " + m_table.columns[m_column - 1].name;
+			m_otlStream << otl_null();
+		}
+		break;
+	default:
+		m_otlStream << value;
+	}
+}
+
+
+void DBTableSink::AddInteger(long long value)
+{
+	switch (NextColumnType()) {
+	case ctInteger:
+		m_otlStream << value;
+		break;
+	case ctDecimal:
+		m_otlStream << (double) value;
+		break;
+	case ctAmount:
+		m_otlStream << TapAmount(value, 0).GetMantissa(m_amountScale);
+		break;
+	default:
+		m_otlStream << to_string(value);
+	}
+}
+
+
+void DBTableSink::AddDecimal(double value)
+{
+	switch (NextColumnType()) {
+	case ctInteger:
+		m_otlStream << (long long) value;
+		break;
+	case ctDecimal:
+		m_otlStream << value;
+		break;
+	case ctAmount:
+		m_otlStream << TapAmount::FromDouble(value, m_amountScale).GetMantissa();
+		break;
+	default:
+		m_otlStream << to_string((long double) value);
+	}
+}
+
+
+void DBTableSink::AddNull()
+{
+	NextColumnType();
+	m_otlStream << otl_null();
+}
+
+
+void DBTableSink::AddAmount(const TapAmount& value)
+{
+	switch (NextColumnType()) {
+	case ctAmount:
+		m_otlStream << value.GetMantissa(m_amountScale);
+		break;
+	case ctDecimal:
+		m_otlStream << value.ToDouble();
+		break;
+	case ctInteger:
+		m_otlStream << value.GetMantissa(0);
+		break;
+	default:
+		m_otlStream << value.ToString();
+	}
+}
+
+
+void DBTableSink::EndRow()
+{
+	m_column = 0;
+	m_rowCount++;
+	// stream sends rows by itself when buffer gets full
+	m_pendingRows = (m_pendingRows + 1) % m_bufferSize;
+}
+
+
+void DBTableSink::Flush()
+{
+	m_otlStream.flush();
+	m_pendingRows = 0;
+}
+
+
+void DBTableSink::Clean()
+{
+	m_otlStream.clean(1);
+	m_column = 0;
+	m_pendingRows = 0;
+}
+
+
+bool DBTableSink::IsFull(int rowReserve) const
+{
+	return m_pendingRows + rowReserve >= m_bufferSize;
+}
+
+
+long DBTableSink::GetRowCount() const
+{
+	return m_rowCount;
+}
+
+
+string DBTableSink::TakeValueError()
+{
+	string valueError;
+	valueError.swap(m_valueError);
+	return valueError;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "EventRowWriter.h"
+
+// Class DBTableSink loads rows of a table to DB by array inserts. Insert statement is built from table definition,
+// rows are sent to DB when stream buffer is full and by Flush. Values are converted to bind type of their column.
+// If errorTag is given, rows rejected by DB are logged to error table of the table (see GetErrorTableName) with
+// this tag by DML error logging, the rest of rows of the array are inserted. Amount columns are bound as integer
+// mantissas in amountScale decimal places and divided by power of 10 in insert statement, so that NUMBER
+// values are exact. Malformed timestamps are written as NULLs and reported by TakeValueError.
+class DBTableSink : public TableSink
+{
+public:
+	DBTableSink(otl_connect& otlConnect, const TableDefinition& table, int bufferSize, string errorTag = "", int amountScale = 0);
+	void EndRow();
+	void Flush();
+	// drops row being sent after DB error, so that the stream can be used for next rows
+	void Clean();
+	// true if stream buffer has no room for given number of rows, i.e. next rows could be sent before Flush
+	bool IsFull(int rowReserve) const;
+	long GetRowCount() const;
+	string TakeValueError();
+	// error table created by DBMS_ERRLOG.CREATE_ERROR_LOG with default name, e.g. BILLING.ERR$_TAP3_CALL
+	static string GetErrorTableName(const char* tableName);
+protected:
+	void AddString(const char* value);
+	void AddInteger(long long value);
+	void AddDecimal(double value);
+	void AddNull();
+	void AddAmount(const TapAmount& value);
+private:
+	const TableDefinition& m_table;
+	otl_nocommit_stream m_otlStream;
+	int m_bufferSize;
+	int m_amountScale;
+	int m_column;
+	int m_pendingRows;
+	long m_rowCount;
+	string m_valueError;
+
+	ColumnType NextColumnType();
+};
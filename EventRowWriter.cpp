@@ -0,0 +1,517 @@
+#include <vector>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "DataInterchange.h"
+#include "EventRowWriter.h"
+#include "TAPTimestamp.h"
+
+using namespace std;
+
+extern string BCDString(BCDString_t* src, bool bSwitchDigits = false);
+extern long long OctetStr2Int64(const OCTET_STRING_t& octetStr);
+extern char* OctetStrToHexStr(const OCTET_STRING_t& octetStr);
+extern string GetUTCOffset(int nCode);
+extern string GetRecordingEntity(int nCode, string& recEntityType);
+extern double GetExRate(int nCode);
+extern double GetTaxRate(int nCode);
+extern double GetDiscountRate(int nCode, TapAmount& fixedDiscountVal, otl_connect& otlConnect);
+extern void log(short msgType, string msgText, string dbConnectString = "");
+extern long CheckChrInfo(const ChargeInformation* chargeInformation, const char* szInfo);
+extern long CheckBasicServiceUsed(int index, const BasicServiceUsed* basicServiceUsed, const char* eventName);
+extern long CheckOriginatedCall(int index, const MobileOriginatedCall* pMCall);
+extern long CheckTerminatedCall(int index, const MobileTerminatedCall* pMCall);
+extern long CheckGPRSCall(int index, const GprsCall* pMCall);
+
+const TableColumn callColumns[] = {
+	{ "EVENT_ID", ctInteger }, { "FILE_ID", ctInteger }, { "RSN", ctInteger }, { "ORIG_OR_TERM", ctInteger },
+	{ "IMSI", ctString }, { "MSISDN", ctString }, { "PARTY_NUMBER", ctString }, { "DIALLED_DIGITS", ctString },
+	{ "THIRD_PARTY", ctString }, { "SMS_PARTYNUMBER", ctString }, { "CLIR", ctInteger }, { "PARTY_NETWORK", ctDictionary },
+	{ "CALL_TIME", ctDateTime }, { "CALL_UTCOFF", ctDictionary }, { "CALL_TIME_UTC", ctInteger }, { "DURATION", ctInteger },
+	{ "CAUSE_FOR_TERM", ctInteger }, { "REC_ENTITY", ctDictionary }, { "REC_ENTITY_TYPE", ctDictionary }, { "LOCATION_AREA", ctInteger },
+	{ "CELL_ID", ctInteger }, { "SERVING_NETWORK", ctDictionary }, { "IMEI", ctString }, { "CALL_REFERENCE", ctString },
+	{ "RAP_FILE_SEQNUM", ctString }
+};
+
+const TableColumn gprsCallColumns[] = {
+	{ "EVENT_ID", ctInteger }, { "FILE_ID", ctInteger }, { "RSN", ctInteger }, { "IMSI", ctString }, { "MSISDN", ctString },
+	{ "PDP_ADDRESS", ctString }, { "APN_NI", ctDictionary }, { "APN_OI", ctDictionary }, { "CALL_TIME", ctDateTime },
+	{ "CALL_UTCOFF", ctDictionary }, { "CALL_TIME_UTC", ctInteger }, { "DURATION", ctInteger }, { "CAUSE_FOR_TERM", ctInteger },
+	{ "PARTIAL_TYPE", ctDictionary }, { "PDP_START_TIME", ctDateTime }, { "PDP_START_UTCOFF", ctDictionary },
+	{ "PDP_START_TIME_UTC", ctInteger }, { "CHARGING_ID", ctInteger },
+	{ "REC_ENTITY", ctDictionary }, { "REC_ENTITY_TYPE", ctDictionary }, { "REC_ENTITY2", ctDictionary },
+	{ "REC_ENTITY2_TYPE", ctDictionary }, { "LOCATION_AREA", ctInteger }, { "CELL_ID", ctInteger },
+	{ "SERVING_NETWORK", ctDictionary }, { "IMEI", ctString }, { "RAP_FILE_SEQNUM", ctString },
+	{ "VOLUME_INCOMING", ctInteger }, { "VOLUME_OUTGOING", ctInteger }
+};
+
+const TableColumn basicServiceColumns[] = {
+	{ "SERVICE_ID", ctInteger }, { "EVENT_ID", ctInteger }, { "SERVICE_TYPE", ctInteger }, { "SERVICE_CODE", ctDictionary },
+	{ "CHR_TIME", ctDateTime }, { "CHR_UTCOFF", ctDictionary }, { "CHR_TIME_UTC", ctInteger }, { "HSCSD", ctInteger }
+};
+
+const TableColumn chargeInfoColumns[] = {
+	{ "CHARGE_ID", ctInteger }, { "EVENT_ID", ctInteger }, { "CHR_ITEM", ctDictionary }, { "EXCHANGE_RATE", ctDecimal },
+	{ "CT_LEVEL1", ctInteger }, { "CT_LEVEL2", ctInteger }, { "CT_LEVEL3", ctInteger }, { "TAX_RATE", ctDecimal },
+	{ "TAX_VAL", ctAmount }, { "DISCOUNT_RATE", ctDecimal }, { "FIXED_DISCOUNT_VALUE", ctAmount }, { "DISCOUNT_VALUE", ctAmount }
+};
+
+const TableColumn chargeDetailColumns[] = {
+	{ "CHARGE_ID", ctInteger }, { "CHR_TYPE", ctDictionary }, { "CHARGE", ctAmount }, { "CHARGEABLE_UNITS", ctInteger },
+	{ "CHARGED_UNITS", ctInteger }, { "DETAIL_TIME", ctDateTime }, { "DETAIL_UTCOFF", ctDictionary },
+	{ "DETAIL_TIME_UTC", ctInteger }
+};
+
+const InternedString emptyString = { 0, "" };
+
+#define COLUMN_COUNT(columns) (sizeof(columns) / sizeof(TableColumn))
+
+const TableDefinition tap3CallTable = { "BILLING.TAP3_CALL", callColumns, COLUMN_COUNT(callColumns) };
+const TableDefinition tap3GPRSCallTable = { "BILLING.TAP3_GPRSCALL", gprsCallColumns, COLUMN_COUNT(gprsCallColumns) };
+const TableDefinition tap3BasicServiceTable = { "BILLING.TAP3_BASICSERVICE", basicServiceColumns, COLUMN_COUNT(basicServiceColumns) };
+const TableDefinition tap3ChargeInfoTable = { "BILLING.TAP3_CHARGEINFO", chargeInfoColumns, COLUMN_COUNT(chargeInfoColumns) };
+const TableDefinition tap3ChargeDetailTable = { "BILLING.TAP3_CHARGEDETAIL", chargeDetailColumns, COLUMN_COUNT(chargeDetailColumns) };
+
+
+EventRowWriter::EventRowWriter(otl_connect& otlConnect, TableSink& callSink, TableSink& gprsCallSink, TableSink& basicServiceSink,
+		TableSink& chargeInfoSink, TableSink& chargeDetailSink, IDGenerator& detailIDs, int tapDecimalPlaces) :
+	m_otlConnect(otlConnect),
+	m_callSink(callSink),
+	m_gprsCallSink(gprsCallSink),
+	m_basicServiceSink(basicServiceSink),
+	m_chargeInfoSink(chargeInfoSink),
+	m_chargeDetailSink(chargeDetailSink),
+	m_detailIDs(detailIDs),
+	m_tapDecimalPlaces(tapDecimalPlaces)
+{
+}
+
+
+const EventRowWriter::UTCOffsetInfo& EventRowWriter::UTCOffset(int code)
+{
+	map<int, UTCOffsetInfo>::const_iterator it = m_utcOffsets.find(code);
+	if (it != m_utcOffsets.end())
+		return it->second;
+	UTCOffsetInfo utcOffset;
+	utcOffset.text = m_strings.Intern(GetUTCOffset(code).c_str());
+	utcOffset.valid = ParseUTCOffset(utcOffset.text.value, utcOffset.seconds);
+	return m_utcOffsets.insert(make_pair(code, utcOffset)).first->second;
+}
+
+
+// Writes local timestamp, its UTC offset and UTC time in seconds since 1970-01-01. UTC time is NULL
+// if timestamp or offset could not be parsed, e.g. for unknown UTC offset code.
+void EventRowWriter::WriteTimestamp(TableSink& sink, const LocalTimeStamp_t* localTimeStamp,
+	const UtcTimeOffsetCode_t* utcTimeOffsetCode)
+{
+	if (!localTimeStamp) {
+		sink << "" << emptyString << otl_null();
+		return;
+	}
+	const char* timestamp = (const char*) localTimeStamp->buf;
+	sink << timestamp;
+	if (!utcTimeOffsetCode) {
+		sink << emptyString << otl_null();
+		return;
+	}
+	const UTCOffsetInfo& utcOffset = UTCOffset(*utcTimeOffsetCode);
+	sink << utcOffset.text;
+	long long localSeconds;
+	if (utcOffset.valid && ParseTAPTimestamp(timestamp, localSeconds))
+		sink << localSeconds - utcOffset.seconds;
+	else
+		sink << otl_null();
+}
+
+
+// Event with a value that some sink could not convert is an error, like conversion errors of DB are
+long EventRowWriter::CheckValueErrors(int index, long writeRes)
+{
+	TableSink* sinks[] = { &m_callSink, &m_gprsCallSink, &m_basicServiceSink, &m_chargeInfoSink, &m_chargeDetailSink };
+	string valueError;
+	for (size_t i = 0; i < sizeof(sinks) / sizeof(sinks[0]); i++) {
+		string sinkError = sinks[i]->TakeValueError();
+		if (valueError.empty())
+			valueError = sinkError;
+	}
+	if (valueError.empty())
+		return writeRes;
+	log(LOG_ERROR, "Ошибка преобразования значения: " + valueError + ". Номер звонка " + to_string((long long) index));
+	return TL_WRONGCODE;
+}
+
+
+// GetRecordingEntity throws on unknown code, such codes are not cached
+void EventRowWriter::RecordingEntity(int code, InternedString& recEntity, InternedString& recEntityType)
+{
+	map<int, pair<InternedString, InternedString> >::const_iterator it = m_recEntities.find(code);
+	if (it == m_recEntities.end()) {
+		string type;
+		string entity = GetRecordingEntity(code, type);
+		it = m_recEntities.insert(make_pair(code, make_pair(m_strings.Intern(entity.c_str()), m_strings.Intern(type.c_str())))).first;
+	}
+	recEntity = it->second.first;
+	recEntityType = it->second.second;
+}
+
+
+long EventRowWriter::WriteOriginatedCall(long long eventID, long fileID, int index, const MobileOriginatedCall* pMCall)
+{
+	long checkRes = CheckOriginatedCall(index, pMCall);
+	if (checkRes != TL_OK)
+		return checkRes;
+
+	m_callSink
+		<< eventID
+		<< fileID
+		<< index
+		<< (short) 1
+		<< BCDString( pMCall->basicCallInformation->chargeableSubscriber->choice.simChargeableSubscriber.imsi )
+		<< BCDString( pMCall->basicCallInformation->chargeableSubscriber->choice.simChargeableSubscriber.msisdn )
+		<< (pMCall->basicCallInformation->destination ?
+			(pMCall->basicCallInformation->destination->calledNumber ? BCDString(pMCall->basicCallInformation->destination->calledNumber) : "") : "")
+		<< (pMCall->basicCallInformation->destination ?
+		(pMCall->basicCallInformation->destination->dialledDigits ? (const char*) pMCall->basicCallInformation->destination->dialledDigits->buf : "") : "")
+		<< (pMCall->thirdPartyInformation ? BCDString(pMCall->thirdPartyInformation->thirdPartyNumber) : "")
+		<< (pMCall->basicCallInformation->destination ?
+			(pMCall->basicCallInformation->destination->sMSDestinationNumber ? (const char*) pMCall->basicCallInformation->destination->sMSDestinationNumber->buf : "") : "");
+
+	if (pMCall->thirdPartyInformation && pMCall->thirdPartyInformation->clirIndicator)
+		m_callSink << (short) *pMCall->thirdPartyInformation->clirIndicator;
+	else
+		m_callSink << otl_null();
+
+	m_callSink
+		<< (pMCall->basicCallInformation->destinationNetwork ? (const char*) pMCall->basicCallInformation->destinationNetwork->buf : "");
+	WriteTimestamp(m_callSink, pMCall->basicCallInformation->callEventStartTimeStamp->localTimeStamp,
+		pMCall->basicCallInformation->callEventStartTimeStamp->utcTimeOffsetCode);
+	m_callSink << *pMCall->basicCallInformation->totalCallEventDuration;
+
+	if (pMCall->basicCallInformation->causeForTerm )
+		m_callSink << *pMCall->basicCallInformation->causeForTerm;
+	else
+		m_callSink << otl_null();
+
+	InternedString recEntity, recEntityType;
+	RecordingEntity(*pMCall->locationInformation->networkLocation->recEntityCode, recEntity, recEntityType);
+	m_callSink
+		<< recEntity
+		<< recEntityType;
+
+	if (pMCall->locationInformation->networkLocation->locationArea )
+		m_callSink << *pMCall->locationInformation->networkLocation->locationArea;
+	else
+		m_callSink << otl_null();
+
+	if (pMCall->locationInformation->networkLocation->cellId )
+		m_callSink << *pMCall->locationInformation->networkLocation->cellId;
+	else
+		m_callSink << otl_null();
+
+	m_callSink
+		<< m_strings.Intern(pMCall->locationInformation->geographicalLocation ? (pMCall->locationInformation->geographicalLocation->servingNetwork ?
+			(const char*)pMCall->locationInformation->geographicalLocation->servingNetwork->buf : "") : "")
+		<< (pMCall->equipmentIdentifier ? (pMCall->equipmentIdentifier->present == ImeiOrEsn_PR_imei ? BCDString(&pMCall->equipmentIdentifier->choice.imei) :
+			(pMCall->equipmentIdentifier->present == ImeiOrEsn_PR_esn ? BCDString(&pMCall->equipmentIdentifier->choice.esn) : "")) : "");
+	if (pMCall->locationInformation->networkLocation->callReference) {
+		char* hexString = OctetStrToHexStr(*pMCall->locationInformation->networkLocation->callReference);
+		m_callSink << hexString;
+		delete [] hexString;
+	}
+	else
+		m_callSink << otl_null();
+	m_callSink << (pMCall->basicCallInformation->rapFileSequenceNumber ? (const char*) pMCall->basicCallInformation->rapFileSequenceNumber->buf : "");
+	m_callSink.EndRow();
+
+	return CheckValueErrors(index, WriteBasicServiceUsed(eventID, index, pMCall->basicServiceUsedList, "Mobile Originated Call"));
+}
+
+
+long EventRowWriter::WriteTerminatedCall(long long eventID, long fileID, int index, const MobileTerminatedCall* pMCall)
+{
+	long checkRes = CheckTerminatedCall(index, pMCall);
+	if (checkRes != TL_OK)
+		return checkRes;
+
+	m_callSink
+		<< eventID
+		<< fileID
+		<< index
+		<< (short) 0
+		<< BCDString( pMCall->basicCallInformation->chargeableSubscriber->choice.simChargeableSubscriber.imsi )
+		<< BCDString( pMCall->basicCallInformation->chargeableSubscriber->choice.simChargeableSubscriber.msisdn )
+		<< (pMCall->basicCallInformation->callOriginator ?
+				(pMCall->basicCallInformation->callOriginator->callingNumber ? BCDString(pMCall->basicCallInformation->callOriginator->callingNumber) : "") : "")
+		<< otl_null()	// DIALLED_DIGITS
+		<< otl_null()	// THIRD_PARTY
+		<< (pMCall->basicCallInformation->callOriginator ?
+				(pMCall->basicCallInformation->callOriginator->sMSOriginator ? (const char*) pMCall->basicCallInformation->callOriginator->sMSOriginator->buf : "") : "");
+
+	if (pMCall->basicCallInformation->callOriginator && pMCall->basicCallInformation->callOriginator->clirIndicator)
+		m_callSink << (short) *pMCall->basicCallInformation->callOriginator->clirIndicator;
+	else
+		m_callSink << otl_null();
+
+	m_callSink
+		<< (pMCall->basicCallInformation->originatingNetwork ? (const char*) pMCall->basicCallInformation->originatingNetwork->buf : "");
+	WriteTimestamp(m_callSink, pMCall->basicCallInformation->callEventStartTimeStamp->localTimeStamp,
+		pMCall->basicCallInformation->callEventStartTimeStamp->utcTimeOffsetCode);
+	m_callSink << *pMCall->basicCallInformation->totalCallEventDuration;
+
+	if (pMCall->basicCallInformation->causeForTerm )
+		m_callSink << *pMCall->basicCallInformation->causeForTerm ;
+	else
+		m_callSink << otl_null();
+
+	InternedString recEntity, recEntityType;
+	RecordingEntity(*pMCall->locationInformation->networkLocation->recEntityCode, recEntity, recEntityType);
+	m_callSink
+		<< recEntity
+		<< recEntityType;
+
+	if (pMCall->locationInformation->networkLocation->locationArea )
+		m_callSink << *pMCall->locationInformation->networkLocation->locationArea ;
+	else
+		m_callSink << otl_null();
+
+	if( pMCall->locationInformation->networkLocation->cellId )
+		m_callSink << *pMCall->locationInformation->networkLocation->cellId ;
+	else
+		m_callSink << otl_null();
+
+	m_callSink
+		<< m_strings.Intern(pMCall->locationInformation->geographicalLocation ? (pMCall->locationInformation->geographicalLocation->servingNetwork ?
+			(const char*)pMCall->locationInformation->geographicalLocation->servingNetwork->buf : "") : "")
+		<< (pMCall->equipmentIdentifier ? (pMCall->equipmentIdentifier->present == ImeiOrEsn_PR_imei ? BCDString(&pMCall->equipmentIdentifier->choice.imei) :
+			(pMCall->equipmentIdentifier->present == ImeiOrEsn_PR_esn ? BCDString(&pMCall->equipmentIdentifier->choice.esn) : "")) : "");
+	if (pMCall->locationInformation->networkLocation->callReference) {
+		char* hexString = OctetStrToHexStr(*pMCall->locationInformation->networkLocation->callReference);
+		m_callSink << hexString;
+		delete [] hexString;
+	}
+	else
+		m_callSink << otl_null();
+	m_callSink << (pMCall->basicCallInformation->rapFileSequenceNumber ? (const char*) pMCall->basicCallInformation->rapFileSequenceNumber->buf : "");
+	m_callSink.EndRow();
+
+	return CheckValueErrors(index, WriteBasicServiceUsed(eventID, index, pMCall->basicServiceUsedList, "Mobile Terminated Call"));
+}
+
+
+long EventRowWriter::WriteGPRSCall(long long eventID, long fileID, int index, const GprsCall* pMCall)
+{
+	long checkRes = CheckGPRSCall(index, pMCall);
+	if (checkRes != TL_OK)
+		return checkRes;
+
+	m_gprsCallSink
+		<< eventID
+		<< fileID
+		<< index
+		<< BCDString( pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->chargeableSubscriber->choice.simChargeableSubscriber.imsi )
+		<< (pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->chargeableSubscriber->choice.simChargeableSubscriber.msisdn ?
+				BCDString( pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->chargeableSubscriber->choice.simChargeableSubscriber.msisdn ) :
+					(pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->networkAccessIdentifier ?
+						(const char*) pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->networkAccessIdentifier->buf : ""))
+		<< (pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->pdpAddress ?
+			(const char*) pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->pdpAddress->buf : "")
+		<< m_strings.Intern(pMCall->gprsBasicCallInformation->gprsDestination->accessPointNameNI ?
+			(const char*) pMCall->gprsBasicCallInformation->gprsDestination->accessPointNameNI->buf : "")
+		<< m_strings.Intern(pMCall->gprsBasicCallInformation->gprsDestination->accessPointNameOI ?
+			(const char*) pMCall->gprsBasicCallInformation->gprsDestination->accessPointNameOI->buf : "");
+	WriteTimestamp(m_gprsCallSink, pMCall->gprsBasicCallInformation->callEventStartTimeStamp->localTimeStamp,
+		pMCall->gprsBasicCallInformation->callEventStartTimeStamp->utcTimeOffsetCode);
+	m_gprsCallSink << *pMCall->gprsBasicCallInformation->totalCallEventDuration;
+
+	if(pMCall->gprsBasicCallInformation->causeForTerm )
+		m_gprsCallSink << *pMCall->gprsBasicCallInformation->causeForTerm;
+	else
+		m_gprsCallSink << otl_null();
+
+	m_gprsCallSink
+		<< m_strings.Intern(pMCall->gprsBasicCallInformation->partialTypeIndicator ? (const char*)pMCall->gprsBasicCallInformation->partialTypeIndicator->buf : "");
+	if (pMCall->gprsBasicCallInformation->pDPContextStartTimestamp)
+		WriteTimestamp(m_gprsCallSink, pMCall->gprsBasicCallInformation->pDPContextStartTimestamp->localTimeStamp,
+			pMCall->gprsBasicCallInformation->pDPContextStartTimestamp->utcTimeOffsetCode);
+	else
+		WriteTimestamp(m_gprsCallSink, NULL, NULL);
+	m_gprsCallSink << OctetStr2Int64(*pMCall->gprsBasicCallInformation->chargingId);
+
+	// first and second recording entities
+	for (int i = 0; i < 2; i++) {
+		if (pMCall->gprsLocationInformation->gprsNetworkLocation->recEntity->list.count > i) {
+			InternedString recEntity, recEntityType;
+			RecordingEntity(*pMCall->gprsLocationInformation->gprsNetworkLocation->recEntity->list.array[i], recEntity,
+				recEntityType);
+			m_gprsCallSink
+				<< recEntity
+				<< recEntityType;
+		}
+		else {
+			m_gprsCallSink
+				<< emptyString
+				<< emptyString;
+		}
+	}
+
+	if( pMCall->gprsLocationInformation->gprsNetworkLocation->locationArea )
+		m_gprsCallSink << *pMCall->gprsLocationInformation->gprsNetworkLocation->locationArea ;
+	else
+		m_gprsCallSink << otl_null();
+
+	if (pMCall->gprsLocationInformation->gprsNetworkLocation->cellId )
+		m_gprsCallSink << *pMCall->gprsLocationInformation->gprsNetworkLocation->cellId ;
+	else
+		m_gprsCallSink << otl_null();
+
+	m_gprsCallSink
+		<< m_strings.Intern(pMCall->gprsLocationInformation->geographicalLocation ? ( pMCall->gprsLocationInformation->geographicalLocation->servingNetwork ?
+			(const char*) pMCall->gprsLocationInformation->geographicalLocation->servingNetwork->buf : "") : "")
+		<< (pMCall->equipmentIdentifier ?	( pMCall->equipmentIdentifier->present == ImeiOrEsn_PR_imei ? BCDString( &pMCall->equipmentIdentifier->choice.imei ) :
+			(pMCall->equipmentIdentifier->present == ImeiOrEsn_PR_esn ?	BCDString( &pMCall->equipmentIdentifier->choice.esn ) : "")) : "")
+		<< (pMCall->gprsBasicCallInformation->rapFileSequenceNumber ? (const char*) pMCall->gprsBasicCallInformation->rapFileSequenceNumber->buf : "")
+		<< OctetStr2Int64 (*pMCall->gprsServiceUsed->dataVolumeIncoming )
+		<< OctetStr2Int64 (*pMCall->gprsServiceUsed->dataVolumeOutgoing ) ;
+	m_gprsCallSink.EndRow();
+
+	char szChrInfo[500];
+	long chrinfoRes;
+	for(int chr_ind=0; chr_ind < pMCall->gprsServiceUsed->chargeInformationList->list.count; chr_ind++)
+	{
+		sprintf(szChrInfo,"Call number %d. Charge Information number %d", index, chr_ind);
+		chrinfoRes = WriteChrInfo(eventID, pMCall->gprsServiceUsed->chargeInformationList->list.array[chr_ind], szChrInfo);
+		if(chrinfoRes<0) return chrinfoRes;
+	}
+	return CheckValueErrors(index, TL_OK);
+}
+
+
+long EventRowWriter::WriteBasicServiceUsed(long long eventID, int index, const BasicServiceUsedList* basicServiceUsedList,
+	const char* eventName)
+{
+	char szChrInfo[500];
+	for(int bs_ind=0; bs_ind < basicServiceUsedList->list.count; bs_ind++)
+	{
+		const BasicServiceUsed* basicServiceUsed = basicServiceUsedList->list.array[bs_ind];
+		long checkRes = CheckBasicServiceUsed(index, basicServiceUsed, eventName);
+		if (checkRes != TL_OK)
+			return checkRes;
+
+		long long basicSvcID = m_detailIDs.NextID();
+		m_basicServiceSink
+			<< basicSvcID
+			<< eventID
+			<< (long) (basicServiceUsed->basicService->serviceCode->present == BasicServiceCode_PR_bearerServiceCode)
+			<< (basicServiceUsed->basicService->serviceCode->present == BasicServiceCode_PR_bearerServiceCode ?
+				(const char*)basicServiceUsed->basicService->serviceCode->choice.bearerServiceCode.buf :
+				(const char*)basicServiceUsed->basicService->serviceCode->choice.teleServiceCode.buf );
+		if (basicServiceUsed->chargingTimeStamp)
+			WriteTimestamp(m_basicServiceSink, basicServiceUsed->chargingTimeStamp->localTimeStamp,
+				basicServiceUsed->chargingTimeStamp->utcTimeOffsetCode);
+		else
+			WriteTimestamp(m_basicServiceSink, NULL, NULL);
+		m_basicServiceSink << (basicServiceUsed->hSCSDIndicator ? (short) 1 : (short) 0);
+		m_basicServiceSink.EndRow();
+
+		for(int chr_ind=0; chr_ind < basicServiceUsed->chargeInformationList->list.count; chr_ind++)
+		{
+			sprintf(szChrInfo,"Call number %d. Basic Service number %d. Charge Information number %d",index,bs_ind,chr_ind);
+			long chrinfoRes = WriteChrInfo(basicSvcID, basicServiceUsed->chargeInformationList->list.array[chr_ind], szChrInfo);
+			if(chrinfoRes<0) return chrinfoRes;
+		}
+	}
+	return TL_OK;
+}
+
+
+long EventRowWriter::WriteChrInfo(long long eventID, ChargeInformation* chargeInformation, const char* szInfo)
+{
+	long checkRes = CheckChrInfo(chargeInformation, szInfo);
+	if (checkRes != TL_OK)
+		return checkRes;
+
+	long long chargeID = m_detailIDs.NextID();
+	m_chargeInfoSink
+		<< chargeID
+		<< eventID
+		<< m_strings.Intern((const char*) chargeInformation->chargedItem->buf);
+
+	if (chargeInformation->exchangeRateCode )
+		m_chargeInfoSink << GetExRate( *chargeInformation->exchangeRateCode );
+	else
+		m_chargeInfoSink << otl_null();
+
+	if (chargeInformation->callTypeGroup )
+		m_chargeInfoSink
+			<< *chargeInformation->callTypeGroup->callTypeLevel1
+			<< *chargeInformation->callTypeGroup->callTypeLevel2
+			<< *chargeInformation->callTypeGroup->callTypeLevel3;
+	else
+		m_chargeInfoSink
+			<< otl_null()
+			<< otl_null()
+			<< otl_null();
+
+	if ( chargeInformation->taxInformation )
+		m_chargeInfoSink
+			<< GetTaxRate( *chargeInformation->taxInformation->list.array[0]->taxCode )
+			<< TapAmount::FromOctetString(*chargeInformation->taxInformation->list.array[0]->taxValue, m_tapDecimalPlaces);
+	else
+		m_chargeInfoSink
+			<< otl_null()
+			<< otl_null();
+
+	if (chargeInformation->discountInformation ) {
+		TapAmount fixedDiscountValue;
+		double discountRate = GetDiscountRate( *chargeInformation->discountInformation->discountCode, fixedDiscountValue, m_otlConnect );
+		if ( discountRate > -1 )
+			m_chargeInfoSink << discountRate;
+		else
+			m_chargeInfoSink << otl_null();
+
+		if ( fixedDiscountValue > TapAmount(-1, 0) )
+			m_chargeInfoSink << fixedDiscountValue;
+		else
+			m_chargeInfoSink << otl_null();
+
+		if (chargeInformation->discountInformation->discount)
+			m_chargeInfoSink << TapAmount::FromOctetString(*chargeInformation->discountInformation->discount, m_tapDecimalPlaces);
+		else
+			m_chargeInfoSink << otl_null();
+	}
+	else
+		m_chargeInfoSink
+			<< otl_null()
+			<< otl_null()
+			<< otl_null();
+	m_chargeInfoSink.EndRow();
+
+	for(int chdet_ind=0; chdet_ind<chargeInformation->chargeDetailList->list.count; chdet_ind++)
+	{
+		ChargeDetail* chargeDetail = chargeInformation->chargeDetailList->list.array[chdet_ind];
+		if (!chargeDetail->charge)
+			continue;
+
+		m_chargeDetailSink
+			<< chargeID
+			<< m_strings.Intern((const char*) chargeDetail->chargeType->buf)
+			<< TapAmount::FromOctetString(*chargeDetail->charge, m_tapDecimalPlaces);
+
+		if ( chargeDetail->chargeableUnits )
+			m_chargeDetailSink << OctetStr2Int64( *chargeDetail->chargeableUnits );
+		else
+			m_chargeDetailSink << otl_null();
+
+		if (chargeDetail->chargedUnits )
+			m_chargeDetailSink << OctetStr2Int64( *chargeDetail->chargedUnits );
+		else
+			m_chargeDetailSink << otl_null();
+
+		if (chargeDetail->chargeDetailTimeStamp)
+			WriteTimestamp(m_chargeDetailSink, chargeDetail->chargeDetailTimeStamp->localTimeStamp,
+				chargeDetail->chargeDetailTimeStamp->utcTimeOffsetCode);
+		else
+			WriteTimestamp(m_chargeDetailSink, NULL, NULL);
+		m_chargeDetailSink.EndRow();
+	}
+	return TL_OK;
+}
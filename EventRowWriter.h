@@ -0,0 +1,111 @@
+#pragma once
+#include "SequenceIDPool.h"
+#include "StringPool.h"
+#include "TapAmount.h"
+
+enum ColumnType
+{
+	ctInteger,
+	ctDecimal,
+	ctString,
+	ctDictionary,	// string column with few distinct values (APN, recording entity, UTC offset etc.)
+	ctDateTime,		// TAP local timestamp yyyymmddhhmmss, bound to DB as native date
+	ctAmount		// TAP money value in TAP decimal places of the file (see TapAmount)
+};
+
+struct TableColumn
+{
+	const char* name;
+	ColumnType type;
+};
+
+struct TableDefinition
+{
+	const char* name;
+	const TableColumn* columns;
+	int columnCount;
+};
+
+extern const TableDefinition tap3CallTable;
+extern const TableDefinition tap3GPRSCallTable;
+extern const TableDefinition tap3BasicServiceTable;
+extern const TableDefinition tap3ChargeInfoTable;
+extern const TableDefinition tap3ChargeDetailTable;
+
+
+// Class TableSink receives rows of a table column by column. Empty strings and otl_null are NULL values.
+class TableSink
+{
+public:
+	virtual ~TableSink() {}
+	virtual void EndRow() = 0;
+	// returns and clears description of the first value since the last call that sink could not convert to type
+	// of its column (such values are written as NULLs), empty if there was none
+	virtual string TakeValueError() { return ""; }
+
+	TableSink& operator<<(const char* value) { AddString(value); return *this; }
+	TableSink& operator<<(const unsigned char* value) { AddString((const char*) value); return *this; }
+	TableSink& operator<<(const string& value) { AddString(value.c_str()); return *this; }
+	TableSink& operator<<(short value) { AddInteger(value); return *this; }
+	TableSink& operator<<(int value) { AddInteger(value); return *this; }
+	TableSink& operator<<(long value) { AddInteger(value); return *this; }
+	TableSink& operator<<(long long value) { AddInteger(value); return *this; }
+	TableSink& operator<<(double value) { AddDecimal(value); return *this; }
+	TableSink& operator<<(const otl_null&) { AddNull(); return *this; }
+	TableSink& operator<<(const InternedString& value) { AddInterned(value); return *this; }
+	TableSink& operator<<(const TapAmount& value) { AddAmount(value); return *this; }
+protected:
+	virtual void AddString(const char* value) = 0;
+	virtual void AddInteger(long long value) = 0;
+	virtual void AddDecimal(double value) = 0;
+	virtual void AddNull() = 0;
+	// sinks may keep ID of interned value instead of the value
+	virtual void AddInterned(const InternedString& value) { AddString(value.value); }
+	// sinks may write amount exactly instead of converting it to double
+	virtual void AddAmount(const TapAmount& value) { AddDecimal(value.ToDouble()); }
+};
+
+
+// Class EventRowWriter converts call events of transfer batch to rows of TAP3_CALL, TAP3_GPRSCALL, TAP3_BASICSERVICE,
+// TAP3_CHARGEINFO and TAP3_CHARGEDETAIL tables. It is the only conversion of call events to these rows, whether they
+// are loaded to DB by single row or array inserts or exported to files. Event ID is given by caller, service and
+// charge IDs are taken from detailIDs. Amounts are read in tapDecimalPlaces given by caller, as events of RAP files
+// are written without transfer batch. Values repeating across events (APNs, serving networks, recording entities,
+// UTC offsets, charged items etc.) are passed to sinks interned in string pool of the writer, recording entities
+// and UTC offsets are looked up by code once per file.
+// Each local timestamp is followed by its UTC offset and UTC time column (*_UTC, seconds since 1970-01-01).
+class EventRowWriter
+{
+public:
+	EventRowWriter(otl_connect& otlConnect, TableSink& callSink, TableSink& gprsCallSink, TableSink& basicServiceSink,
+		TableSink& chargeInfoSink, TableSink& chargeDetailSink, IDGenerator& detailIDs, int tapDecimalPlaces);
+	long WriteOriginatedCall(long long eventID, long fileID, int index, const MobileOriginatedCall* pMCall);
+	long WriteTerminatedCall(long long eventID, long fileID, int index, const MobileTerminatedCall* pMCall);
+	long WriteGPRSCall(long long eventID, long fileID, int index, const GprsCall* pMCall);
+private:
+	otl_connect& m_otlConnect;
+	TableSink& m_callSink;
+	TableSink& m_gprsCallSink;
+	TableSink& m_basicServiceSink;
+	TableSink& m_chargeInfoSink;
+	TableSink& m_chargeDetailSink;
+	IDGenerator& m_detailIDs;
+	int m_tapDecimalPlaces;
+	struct UTCOffsetInfo
+	{
+		InternedString text;
+		bool valid;
+		int seconds;		// seconds east of UTC
+	};
+	StringPool m_strings;
+	map<int, UTCOffsetInfo> m_utcOffsets;
+	map<int, pair<InternedString, InternedString> > m_recEntities;
+
+	const UTCOffsetInfo& UTCOffset(int code);
+	long CheckValueErrors(int index, long writeRes);
+	void WriteTimestamp(TableSink& sink, const LocalTimeStamp_t* localTimeStamp, const UtcTimeOffsetCode_t* utcTimeOffsetCode);
+	void RecordingEntity(int code, InternedString& recEntity, InternedString& recEntityType);
+	long WriteBasicServiceUsed(long long eventID, int index, const BasicServiceUsedList* basicServiceUsedList,
+		const char* eventName);
+	long WriteChrInfo(long long eventID, ChargeInformation* chargeInformation, const char* szInfo);
+};
@@ -0,0 +1,178 @@
+#include <vector>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "DataInterchange.h"
+#include "ReturnBatch.h"
+#include "ConfigContainer.h"
+#include "TAPValidator.h"
+#include "FileSequenceIndex.h"
+
+using namespace std;
+
+extern void log(short msgType, string msgText, string dbConnectString = "");
+
+const size_t bitmapSize = END_TAP_SEQUENCE_NUM / 8 + 1;
+const DWORD lockTimeout = 30000;	// ms
+
+
+FileSequenceIndex::FileSequenceIndex(const Config& config, string sender, string recipient, bool testFile) :
+	m_sender(sender),
+	m_recipient(recipient),
+	m_testFile(testFile)
+{
+	string indexDir = (config.GetOutputDirectory().empty() ? "." : config.GetOutputDirectory()) + "\\seqindex";
+	CreateDirectory(indexDir.c_str(), NULL);
+	m_filename = indexDir + "\\" + sender + "_" + recipient + (testFile ? "_T" : "_C") + ".idx";
+	// one mutex for all of indexes, operations on them are short
+	m_mutex = CreateMutex(NULL, FALSE, "TAP3LoaderFileSequenceIndex");
+}
+
+
+FileSequenceIndex::~FileSequenceIndex()
+{
+	if (m_mutex)
+		CloseHandle(m_mutex);
+}
+
+
+// returns 0 if sequence number is not numeric or out of range
+int FileSequenceIndex::ParseSequenceNumber(const char* sequenceNumber)
+{
+	char* pEnd;
+	long value = strtol(sequenceNumber, &pEnd, 10);
+	while (*pEnd == ' ')
+		pEnd++;
+	if (pEnd == sequenceNumber || *pEnd != '\0' || value < START_TAP_SEQUENCE_NUM || value > END_TAP_SEQUENCE_NUM)
+		return 0;
+	return (int) value;
+}
+
+
+bool FileSequenceIndex::Lock()
+{
+	if (!m_mutex)
+		return false;
+	DWORD waitRes = WaitForSingleObject(m_mutex, lockTimeout);
+	// mutex abandoned by crashed loader is owned now, bitmap writes are single bytes or file replacement
+	return (waitRes == WAIT_OBJECT_0 || waitRes == WAIT_ABANDONED);
+}
+
+
+void FileSequenceIndex::Unlock()
+{
+	ReleaseMutex(m_mutex);
+}
+
+
+bool FileSequenceIndex::Open(otl_connect& otlConnect)
+{
+	if (!Lock())
+		return false;
+	bool success;
+	FILE* f = fopen(m_filename.c_str(), "rb");
+	if (f) {
+		fclose(f);
+		success = true;
+	}
+	else {
+		try {
+			success = Build(otlConnect);
+		}
+		catch (otl_exception&) {
+			Unlock();
+			throw;
+		}
+	}
+	Unlock();
+	return success;
+}
+
+
+bool FileSequenceIndex::Build(otl_connect& otlConnect)
+{
+	vector<unsigned char> bitmap(bitmapSize, 0);
+	otl_nocommit_stream otlStream;
+	otlStream.open(1000, "select SEQUENCE_NUMBER from BILLING.TAP3_FILE where SENDER = :sender /*char[20],in*/ "
+		"and RECIPIENT = :recipient /*char[20],in*/ and decode(FILE_TYPE_INDICATOR, 'T', 1, 0) = :test /*short,in*/ "
+		"and STATUS <> :unable /*long,in*/", otlConnect);
+	otlStream
+		<< m_sender
+		<< m_recipient
+		<< (short) (m_testFile ? 1 : 0)
+		<< (long) INFILE_STATUS_UNABLE_TO_VALIDATE;
+	while (!otlStream.eof()) {
+		string sequenceNumber;
+		otlStream >> sequenceNumber;
+		int seqNum = ParseSequenceNumber(sequenceNumber.c_str());
+		if (seqNum > 0)
+			bitmap[seqNum / 8] |= (1 << (seqNum % 8));
+	}
+	otlStream.close();
+
+	// readers never see partially written bitmap
+	string tempFilename = m_filename + ".tmp";
+	FILE* f = fopen(tempFilename.c_str(), "wb");
+	if (!f) {
+		log(LOG_ERROR, "Невозможно создать файл индекса последовательных номеров " + tempFilename);
+		return false;
+	}
+	bool success = (fwrite(&bitmap[0], 1, bitmap.size(), f) == bitmap.size());
+	if (fclose(f) != 0)
+		success = false;
+	if (!success || !MoveFileEx(tempFilename.c_str(), m_filename.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+		log(LOG_ERROR, "Ошибка записи файла индекса последовательных номеров " + m_filename);
+		return false;
+	}
+	return true;
+}
+
+
+void FileSequenceIndex::MarkLoaded(int sequenceNumber)
+{
+	if (!Lock())
+		return;
+	FILE* f = fopen(m_filename.c_str(), "r+b");
+	if (f) {
+		unsigned char bits;
+		if (fseek(f, sequenceNumber / 8, SEEK_SET) == 0 && fread(&bits, 1, 1, f) == 1) {
+			bits |= (1 << (sequenceNumber % 8));
+			fseek(f, sequenceNumber / 8, SEEK_SET);
+			fwrite(&bits, 1, 1, f);
+		}
+		fclose(f);
+	}
+	Unlock();
+}
+
+
+bool FileSequenceIndex::GetGaps(vector<SequenceGap>& gaps)
+{
+	vector<unsigned char> bitmap(bitmapSize, 0);
+	if (!Lock())
+		return false;
+	FILE* f = fopen(m_filename.c_str(), "rb");
+	size_t bytesRead = 0;
+	if (f) {
+		bytesRead = fread(&bitmap[0], 1, bitmap.size(), f);
+		fclose(f);
+	}
+	Unlock();
+	if (bytesRead != bitmap.size())
+		return false;
+
+	int highest = END_TAP_SEQUENCE_NUM;
+	while (highest >= START_TAP_SEQUENCE_NUM && !(bitmap[highest / 8] & (1 << (highest % 8))))
+		highest--;
+	gaps.clear();
+	for (int seqNum = START_TAP_SEQUENCE_NUM; seqNum < highest; seqNum++) {
+		if (bitmap[seqNum / 8] & (1 << (seqNum % 8)))
+			continue;
+		SequenceGap gap;
+		gap.first = seqNum;
+		while (seqNum + 1 < highest && !(bitmap[(seqNum + 1) / 8] & (1 << ((seqNum + 1) % 8))))
+			seqNum++;
+		gap.last = seqNum;
+		gaps.push_back(gap);
+	}
+	return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+
+struct SequenceGap
+{
+	int first;
+	int last;
+};
+
+
+// Class FileSequenceIndex keeps bitmap of loaded file sequence numbers (START_TAP_SEQUENCE_NUM..END_TAP_SEQUENCE_NUM)
+// of one sender, recipient and file type (test or commercial) in a file of output directory. Bitmap is built from
+// TAP3_FILE on first use and updated by loader under named mutex shared by loader processes after the load is
+// committed. Index may be stale (other output directory or host, rows of TAP3_FILE deleted or restored), so file
+// duplication is always checked in DB, index is used for reports of sequence gaps.
+class FileSequenceIndex
+{
+public:
+	FileSequenceIndex(const Config& config, string sender, string recipient, bool testFile);
+	~FileSequenceIndex();
+	// builds bitmap from TAP3_FILE if it does not exist yet, returns false if index can't be used
+	bool Open(otl_connect& otlConnect);
+	// index file must exist, it's not built by these functions
+	void MarkLoaded(int sequenceNumber);
+	// ranges of sequence numbers missing below the highest loaded one, returns false if there is no index
+	bool GetGaps(vector<SequenceGap>& gaps);
+	static int ParseSequenceNumber(const char* sequenceNumber);
+private:
+	string m_filename;
+	string m_sender;
+	string m_recipient;
+	bool m_testFile;
+	HANDLE m_mutex;
+
+	bool Lock();
+	void Unlock();
+	bool Build(otl_connect& otlConnect);
+};
@@ -0,0 +1,239 @@
+#include <vector>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "DataInterchange.h"
+#include "FlatFileWriter.h"
+
+using namespace std;
+
+extern void log(short msgType, string msgText, string dbConnectString = "");
+extern int GetTAPDecimalPlaces();
+
+const char fieldDelimiter = '|';
+const char fieldEnclosure = '"';
+const int idBlockSize = 1000;
+
+// SQL*Loader field specifications by column type
+const char* loaderSpecs[] = { "INTEGER EXTERNAL", "DECIMAL EXTERNAL", "", "", "DATE \"yyyymmddhh24miss\"", "DECIMAL EXTERNAL" };
+
+
+FlatFile::FlatFile() :
+	m_dataFile(NULL),
+	m_column(0),
+	m_rowCount(0)
+{
+}
+
+
+FlatFile::~FlatFile()
+{
+	if (m_dataFile)
+		fclose(m_dataFile);
+}
+
+
+bool FlatFile::Open(string stagingDir, string baseName, const TableDefinition& table)
+{
+	if (!stagingDir.empty() && stagingDir[stagingDir.size() - 1] != '\\' && stagingDir[stagingDir.size() - 1] != '/')
+		stagingDir += '\\';
+	string tableName = table.name;
+	string fileBase = stagingDir + baseName + "_" + tableName.substr(tableName.find('.') + 1);
+	m_dataFilename = fileBase + ".dat";
+	m_column = 0;
+	m_rowCount = 0;
+	m_dataFile = fopen(m_dataFilename.c_str(), "wb");
+	if (!m_dataFile) {
+		log(LOG_ERROR, "Невозможно открыть файл " + m_dataFilename);
+		return false;
+	}
+	return WriteControlFile(fileBase + ".ctl", table);
+}
+
+
+bool FlatFile::WriteControlFile(string controlFilename, const TableDefinition& table)
+{
+	FILE* controlFile = fopen(controlFilename.c_str(), "w");
+	if (!controlFile) {
+		log(LOG_ERROR, "Невозможно открыть файл " + controlFilename);
+		return false;
+	}
+	fprintf(controlFile, "OPTIONS (DIRECT=TRUE)\nLOAD DATA\nINFILE '%s'\nAPPEND\nINTO TABLE %s\n"
+		"FIELDS TERMINATED BY '%c' OPTIONALLY ENCLOSED BY '%c'\nTRAILING NULLCOLS\n(\n",
+		m_dataFilename.c_str(), table.name, fieldDelimiter, fieldEnclosure);
+	for (int i = 0; i < table.columnCount; i++) {
+		const char* loaderSpec = loaderSpecs[table.columns[i].type];
+		fprintf(controlFile, "\t%s%s%s%s\n", table.columns[i].name, (strlen(loaderSpec) > 0 ? " " : ""),
+			loaderSpec, (i < table.columnCount - 1 ? "," : ""));
+	}
+	fprintf(controlFile, ")\n");
+	bool success = (ferror(controlFile) == 0);
+	fclose(controlFile);
+	return success;
+}
+
+
+bool FlatFile::Close()
+{
+	if (!m_dataFile)
+		return false;
+	bool success = (ferror(m_dataFile) == 0);
+	if (fclose(m_dataFile) != 0)
+		success = false;
+	m_dataFile = NULL;
+	if (!success)
+		log(LOG_ERROR, "Ошибка записи в файл " + m_dataFilename);
+	return success;
+}
+
+
+void FlatFile::AddString(const char* value)
+{
+	if (m_column++ > 0)
+		fputc(fieldDelimiter, m_dataFile);
+	if (strpbrk(value, "|\"\r\n")) {
+		// field is enclosed, enclosure character inside is doubled. Line breaks would split the record
+		// of stream format, so they are replaced with spaces.
+		fputc(fieldEnclosure, m_dataFile);
+		for (const char* p = value; *p; p++) {
+			if (*p == fieldEnclosure)
+				fputc(fieldEnclosure, m_dataFile);
+			fputc((*p == '\r' || *p == '\n') ? ' ' : *p, m_dataFile);
+		}
+		fputc(fieldEnclosure, m_dataFile);
+	}
+	else
+		fputs(value, m_dataFile);
+}
+
+
+void FlatFile::AddInteger(long long value)
+{
+	char buffer[30];
+	sprintf(buffer, "%lld", value);
+	AddString(buffer);
+}
+
+
+void FlatFile::AddDecimal(double value)
+{
+	char buffer[30];
+	sprintf(buffer, "%.15g", value);
+	AddString(buffer);
+}
+
+
+void FlatFile::AddAmount(const TapAmount& value)
+{
+	AddString(value.ToString().c_str());
+}
+
+
+void FlatFile::AddNull()
+{
+	// empty field is loaded as NULL
+	AddString("");
+}
+
+
+void FlatFile::EndRow()
+{
+	fputs("\r\n", m_dataFile);
+	m_column = 0;
+	m_rowCount++;
+}
+
+
+long FlatFile::GetRowCount() const
+{
+	return m_rowCount;
+}
+
+
+string FlatFile::GetDataFilename() const
+{
+	return m_dataFilename;
+}
+
+//-----------------------------
+
+FlatFileWriter::FlatFileWriter(otl_connect& otlConnect, string stagingDir, string baseName) :
+	m_stagingDir(stagingDir),
+	m_baseName(baseName),
+	m_eventIDs(otlConnect, "BILLING.Origin_Seq", idBlockSize),
+	m_detailIDs(otlConnect, "BILLING.TAP3EVENTID", idBlockSize),
+	m_eventRowWriter(otlConnect, m_callFile, m_gprsCallFile, m_basicServiceFile, m_chargeInfoFile, m_chargeDetailFile, m_detailIDs,
+		GetTAPDecimalPlaces())
+{
+}
+
+
+bool FlatFileWriter::OpenFiles()
+{
+	return m_callFile.Open(m_stagingDir, m_baseName, tap3CallTable) &&
+		m_gprsCallFile.Open(m_stagingDir, m_baseName, tap3GPRSCallTable) &&
+		m_basicServiceFile.Open(m_stagingDir, m_baseName, tap3BasicServiceTable) &&
+		m_chargeInfoFile.Open(m_stagingDir, m_baseName, tap3ChargeInfoTable) &&
+		m_chargeDetailFile.Open(m_stagingDir, m_baseName, tap3ChargeDetailTable);
+}
+
+
+bool FlatFileWriter::CloseFiles()
+{
+	bool success = m_callFile.Close();
+	success = m_gprsCallFile.Close() && success;
+	success = m_basicServiceFile.Close() && success;
+	success = m_chargeInfoFile.Close() && success;
+	success = m_chargeDetailFile.Close() && success;
+	return success;
+}
+
+
+int FlatFileWriter::WriteEvents(long fileID, const TransferBatch* transferBatch)
+{
+	if (!OpenFiles()) {
+		CloseFiles();
+		return TL_FILEERROR;
+	}
+
+	long writeRes;
+	for(int index=0; index < transferBatch->callEventDetails->list.count; index++)
+	{
+		CallEventDetail* callEventDetail = transferBatch->callEventDetails->list.array[index];
+		switch (callEventDetail->present) {
+		case CallEventDetail_PR_mobileOriginatedCall:
+			writeRes = m_eventRowWriter.WriteOriginatedCall(m_eventIDs.NextID(), fileID, index + 1, &callEventDetail->choice.mobileOriginatedCall);
+			break;
+		case CallEventDetail_PR_mobileTerminatedCall:
+			writeRes = m_eventRowWriter.WriteTerminatedCall(m_eventIDs.NextID(), fileID, index + 1, &callEventDetail->choice.mobileTerminatedCall);
+			break;
+		case CallEventDetail_PR_supplServiceEvent:
+			// just ignore it
+			writeRes = TL_OK;
+			break;
+		case CallEventDetail_PR_gprsCall:
+			writeRes = m_eventRowWriter.WriteGPRSCall(m_eventIDs.NextID(), fileID, index + 1, &callEventDetail->choice.gprsCall);
+			break;
+		default:
+			log(LOG_ERROR, string("Не найден обработчик события с кодом ") +
+				to_string( static_cast<unsigned long long> (callEventDetail->present)) +
+				string(". Номер звонка ") + to_string(static_cast<unsigned long long> (index+1)));
+			CloseFiles();
+			return TL_NEWCOMPONENT;
+		}
+		if (writeRes != TL_OK) {
+			// ошибка загрузки
+			CloseFiles();
+			return writeRes;
+		}
+	}
+
+	if (!CloseFiles())
+		return TL_FILEERROR;
+
+	log(LOG_INFO, "Записано в файлы для прямой загрузки: звонков " +
+		to_string((long long) m_callFile.GetRowCount()) + ", GPRS-сессий " + to_string((long long) m_gprsCallFile.GetRowCount()) +
+		", Basic Service " + to_string((long long) m_basicServiceFile.GetRowCount()) +
+		", Charge Information " + to_string((long long) m_chargeInfoFile.GetRowCount()) +
+		", Charge Detail " + to_string((long long) m_chargeDetailFile.GetRowCount()) + ". Каталог " + m_stagingDir);
+	return TL_OK;
+}
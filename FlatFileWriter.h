@@ -0,0 +1,54 @@
+#pragma once
+#include "EventRowWriter.h"
+
+// Class FlatFile writes rows of a table to delimited data file and generates SQL*Loader control file for it.
+// Control file is made for direct-path load, external table definition can be produced from the same file
+// with sqlldr EXTERNAL_TABLE=GENERATE_ONLY.
+class FlatFile : public TableSink
+{
+public:
+	FlatFile();
+	~FlatFile();
+	bool Open(string stagingDir, string baseName, const TableDefinition& table);
+	bool Close();
+	void EndRow();
+	long GetRowCount() const;
+	string GetDataFilename() const;
+protected:
+	void AddString(const char* value);
+	void AddInteger(long long value);
+	void AddDecimal(double value);
+	void AddNull();
+	void AddAmount(const TapAmount& value);
+private:
+	FILE* m_dataFile;
+	string m_dataFilename;
+	int m_column;
+	long m_rowCount;
+
+	bool WriteControlFile(string controlFilename, const TableDefinition& table);
+};
+
+
+// Class FlatFileWriter writes events of transfer batch to flat files of TAP3 event tables for direct-path load.
+// Event IDs and service/charge IDs are reserved from DB sequences, so rows keep references to each other.
+class FlatFileWriter
+{
+public:
+	FlatFileWriter(otl_connect& otlConnect, string stagingDir, string baseName);
+	int WriteEvents(long fileID, const TransferBatch* transferBatch);
+private:
+	string m_stagingDir;
+	string m_baseName;
+	SequenceIDPool m_eventIDs;
+	SequenceIDPool m_detailIDs;
+	FlatFile m_callFile;
+	FlatFile m_gprsCallFile;
+	FlatFile m_basicServiceFile;
+	FlatFile m_chargeInfoFile;
+	FlatFile m_chargeDetailFile;
+	EventRowWriter m_eventRowWriter;
+
+	bool OpenFiles();
+	bool CloseFiles();
+};
@@ -0,0 +1,134 @@
+#include <vector>
+#include <map>
+#include "OTL_Header.h"
+#include "ConfigContainer.h"
+#include "FtpSessionPool.h"
+
+using namespace std;
+
+extern "C" void* ncftp_open_session(const char* host, int port, const char* user, const char* pass, char* result);
+extern "C" int ncftp_check_session(void* session);
+extern "C" int ncftp_put_files(void* session, const char* dstdir, char** files, char* result);
+extern "C" void ncftp_close_session(void* session);
+
+const int ftpOpenFailed = 1;	// kExitOpenFailed of ncftp
+
+
+FtpSessionPool& FtpSessionPool::Instance()
+{
+	// never destroyed: sessions may be in use by uploader threads at process exit
+	static FtpSessionPool* instance = new FtpSessionPool();
+	return *instance;
+}
+
+
+FtpSessionPool::FtpSessionPool()
+{
+	InitializeCriticalSection(&m_critSection);
+	InitializeCriticalSection(&m_openCritSection);
+}
+
+
+string FtpSessionPool::GetKey(const FtpSetting& ftpSetting)
+{
+	return ftpSetting.ftpServer + ":" + ftpSetting.ftpPort + "|" + ftpSetting.ftpUsername + "|" + ftpSetting.ftpDirectory;
+}
+
+
+int FtpSessionPool::Upload(FtpSetting ftpSetting, const vector<string>& files, string& error)
+{
+	if (ftpSetting.ftpPort.length() == 0)
+		ftpSetting.ftpPort = "21";	// use default ftp port
+
+	FtpSession session;
+	bool reused = TakeIdleSession(ftpSetting, session);
+	if (reused && ncftp_check_session(session.handle) != 0) {
+		// closed by server or network
+		ncftp_close_session(session.handle);
+		reused = false;
+	}
+	if (!reused && !OpenSession(ftpSetting, session, error))
+		return ftpOpenFailed;
+
+	vector<char*> filenames;
+	for (size_t i = 0; i < files.size(); i++)
+		filenames.push_back(const_cast<char*>(files[i].c_str()));
+	filenames.push_back(NULL);
+	char szFtpResult[4096] = "";
+	int ftpResult = ncftp_put_files(session.handle, ftpSetting.ftpDirectory.c_str(), &filenames[0], szFtpResult);
+	if (ftpResult == 0) {
+		ReturnSession(ftpSetting, session);
+	}
+	else {
+		// state of control connection is unknown after failed transfer
+		ncftp_close_session(session.handle);
+		error = szFtpResult;
+	}
+	return ftpResult;
+}
+
+
+bool FtpSessionPool::TakeIdleSession(const FtpSetting& ftpSetting, FtpSession& session)
+{
+	bool found = false;
+	EnterCriticalSection(&m_critSection);
+	string key = GetKey(ftpSetting);
+	for (multimap<string, FtpSession>::iterator it = m_idleSessions.lower_bound(key);
+			it != m_idleSessions.end() && it->first == key; it++) {
+		if (it->second.password == ftpSetting.ftpPassword) {
+			session = it->second;
+			m_idleSessions.erase(it);
+			found = true;
+			break;
+		}
+	}
+	LeaveCriticalSection(&m_critSection);
+	return found;
+}
+
+
+void FtpSessionPool::ReturnSession(const FtpSetting& ftpSetting, FtpSession& session)
+{
+	session.lastUsed = time(NULL);
+	EnterCriticalSection(&m_critSection);
+	m_idleSessions.insert(make_pair(GetKey(ftpSetting), session));
+	LeaveCriticalSection(&m_critSection);
+}
+
+
+bool FtpSessionPool::OpenSession(const FtpSetting& ftpSetting, FtpSession& session, string& error)
+{
+	char szFtpResult[4096] = "";
+	// ncftp library info is shared by sessions and initialized on first open
+	EnterCriticalSection(&m_openCritSection);
+	session.handle = ncftp_open_session(ftpSetting.ftpServer.c_str(), atoi(ftpSetting.ftpPort.c_str()),
+		ftpSetting.ftpUsername.c_str(), ftpSetting.ftpPassword.c_str(), szFtpResult);
+	LeaveCriticalSection(&m_openCritSection);
+	if (!session.handle) {
+		error = szFtpResult;
+		return false;
+	}
+	session.password = ftpSetting.ftpPassword;
+	session.lastUsed = time(NULL);
+	return true;
+}
+
+
+void FtpSessionPool::CloseIdleSessions(time_t maxIdleTime)
+{
+	vector<void*> expired;
+	time_t now = time(NULL);
+	EnterCriticalSection(&m_critSection);
+	for (multimap<string, FtpSession>::iterator it = m_idleSessions.begin(); it != m_idleSessions.end(); ) {
+		if (now - it->second.lastUsed >= maxIdleTime) {
+			expired.push_back(it->second.handle);
+			m_idleSessions.erase(it++);
+		}
+		else
+			it++;
+	}
+	LeaveCriticalSection(&m_critSection);
+	// QUIT is sent outside of lock
+	for (size_t i = 0; i < expired.size(); i++)
+		ncftp_close_session(expired[i]);
+}
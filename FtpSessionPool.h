@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include <map>
+
+// Class FtpSessionPool keeps logged-in FTP sessions to roaming hub servers between uploads, so that
+// a series of RAP files for one hub does not connect and log in for each file. Sessions are keyed by
+// server, port, user and directory; a session is used by one thread at a time. Sessions idle for too long
+// are closed, a reused session is checked by NOOP command before upload.
+class FtpSessionPool
+{
+public:
+	static FtpSessionPool& Instance();
+	// uploads files to server in one session, returns 0 on success or ncftp exit status
+	int Upload(FtpSetting ftpSetting, const vector<string>& files, string& error);
+	void CloseIdleSessions(time_t maxIdleTime);
+	static const time_t defaultMaxIdleTime = 120;	// seconds, less than usual server idle timeout
+private:
+	struct FtpSession {
+		void* handle;
+		string password;
+		time_t lastUsed;
+	};
+
+	FtpSessionPool();
+
+	CRITICAL_SECTION m_critSection;
+	CRITICAL_SECTION m_openCritSection;
+	multimap<string, FtpSession> m_idleSessions;
+
+	static string GetKey(const FtpSetting& ftpSetting);
+	bool TakeIdleSession(const FtpSetting& ftpSetting, FtpSession& session);
+	void ReturnSession(const FtpSetting& ftpSetting, FtpSession& session);
+	bool OpenSession(const FtpSetting& ftpSetting, FtpSession& session, string& error);
+};
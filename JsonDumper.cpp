@@ -0,0 +1,702 @@
+#include <vector>
+#include <set>
+#include <algorithm>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "DataInterchange.h"
+#include "ReturnBatch.h"
+#include "Acknowledgement.h"
+#include "JsonDumper.h"
+#include "LazyCallEvent.h"
+
+using namespace std;
+
+extern void log(short msgType, string msgText, string dbConnectString = "");
+extern int GetTAPDecimalPlaces();
+extern double GetExRate(int nCode);
+
+const size_t jsonFileBufferSize = 1024 * 1024;
+
+
+void AppendJsonString(string& line, const char* value)
+{
+	line += '"';
+	for (const unsigned char* p = (const unsigned char*) value; *p; p++) {
+		switch (*p) {
+		case '"':
+			line += "\\\"";
+			break;
+		case '\\':
+			line += "\\\\";
+			break;
+		case '\r':
+			line += "\\r";
+			break;
+		case '\n':
+			line += "\\n";
+			break;
+		case '\t':
+			line += "\\t";
+			break;
+		default:
+			if (*p < 0x20 || *p >= 0x80) {
+				// TAP strings are ASCII, other bytes are given as Latin-1 characters to keep output valid UTF-8
+				char buffer[10];
+				sprintf(buffer, "\\u%04X", *p);
+				line += buffer;
+			}
+			else
+				line += *p;
+		}
+	}
+	line += '"';
+}
+
+
+// TAP local timestamp yyyymmddhhmmss to ISO 8601 yyyy-mm-ddThh:mm:ss, other values are kept as is
+void AppendJsonTimestamp(string& line, const char* value)
+{
+	if (strlen(value) != 14 || strspn(value, "0123456789") != 14) {
+		AppendJsonString(line, value);
+		return;
+	}
+	char buffer[30];
+	sprintf(buffer, "\"%.4s-%.2s-%.2sT%.2s:%.2s:%.2s\"", value, value + 4, value + 6, value + 8, value + 10, value + 12);
+	line += buffer;
+}
+
+
+// Helper class writing fields of JSON object to line. NULL and empty values are omitted.
+class JsonObject
+{
+public:
+	JsonObject(string& line) : m_line(line), m_empty(true)
+	{
+		m_line += '{';
+	}
+
+	JsonObject& Add(const char* key, const char* value)
+	{
+		if (value && *value) {
+			AddKey(key);
+			AppendJsonString(m_line, value);
+		}
+		return *this;
+	}
+
+	JsonObject& Add(const char* key, const unsigned char* value)
+	{
+		return Add(key, (const char*) value);
+	}
+
+	JsonObject& Add(const char* key, const OCTET_STRING_t* value)
+	{
+		return Add(key, value ? (const char*) value->buf : NULL);
+	}
+
+	JsonObject& Add(const char* key, long long value)
+	{
+		char buffer[30];
+		sprintf(buffer, "%lld", value);
+		AddKey(key);
+		m_line += buffer;
+		return *this;
+	}
+
+	JsonObject& Add(const char* key, const long* value)
+	{
+		if (value)
+			Add(key, (long long) *value);
+		return *this;
+	}
+
+	JsonObject& AddDecimal(const char* key, double value)
+	{
+		char buffer[30];
+		sprintf(buffer, "%.15g", value);
+		AddKey(key);
+		m_line += buffer;
+		return *this;
+	}
+
+	// amount is written exactly with all its decimal places
+	JsonObject& AddAmount(const char* key, const TapAmount& value)
+	{
+		AddKey(key);
+		m_line += value.ToString();
+		return *this;
+	}
+
+	JsonObject& AddTimestamp(const char* timeKey, const char* utcOffsetKey, const DateTimeLong* value)
+	{
+		if (value) {
+			if (value->localTimeStamp) {
+				AddKey(timeKey);
+				AppendJsonTimestamp(m_line, (const char*) value->localTimeStamp->buf);
+			}
+			Add(utcOffsetKey, value->utcTimeOffset);
+		}
+		return *this;
+	}
+
+	// key of nested object or array, its value is appended to line by caller
+	JsonObject& AddKey(const char* key)
+	{
+		if (!m_empty)
+			m_line += ',';
+		AppendJsonString(m_line, key);
+		m_line += ':';
+		m_empty = false;
+		return *this;
+	}
+
+	void End()
+	{
+		m_line += '}';
+	}
+private:
+	string& m_line;
+	bool m_empty;
+};
+
+//-----------------------------
+
+JsonRowSink::JsonRowSink(const TableDefinition& table, const set<string>& fields) :
+	m_table(table),
+	m_fields(fields),
+	m_column(0),
+	m_rowCount(0)
+{
+}
+
+
+bool JsonRowSink::StartField()
+{
+	const char* name = m_table.columns[m_column++].name;
+	if (!m_fields.empty() && m_fields.find(name) == m_fields.end())
+		return false;
+	if (!m_row.empty())
+		m_row += ',';
+	AppendJsonString(m_row, name);
+	m_row += ':';
+	return true;
+}
+
+
+void JsonRowSink::AddString(const char* value)
+{
+	if (!*value) {
+		AddNull();
+		return;
+	}
+	bool isTimestamp = (m_table.columns[m_column].type == ctDateTime);
+	if (StartField()) {
+		if (isTimestamp)
+			AppendJsonTimestamp(m_row, value);
+		else
+			AppendJsonString(m_row, value);
+	}
+}
+
+
+void JsonRowSink::AddInteger(long long value)
+{
+	if (StartField()) {
+		char buffer[30];
+		sprintf(buffer, "%lld", value);
+		m_row += buffer;
+	}
+}
+
+
+void JsonRowSink::AddDecimal(double value)
+{
+	if (StartField()) {
+		char buffer[30];
+		sprintf(buffer, "%.15g", value);
+		m_row += buffer;
+	}
+}
+
+
+void JsonRowSink::AddAmount(const TapAmount& value)
+{
+	if (StartField())
+		m_row += value.ToString();
+}
+
+
+void JsonRowSink::AddNull()
+{
+	// NULL values are omitted
+	m_column++;
+}
+
+
+void JsonRowSink::EndRow()
+{
+	if (!m_row.empty()) {
+		if (m_rowCount > 0)
+			m_rows += ',';
+		m_rows += '{';
+		m_rows += m_row;
+		m_rows += '}';
+		m_rowCount++;
+	}
+	m_row.clear();
+	m_column = 0;
+}
+
+
+void JsonRowSink::Clear()
+{
+	m_row.clear();
+	m_rows.clear();
+	m_column = 0;
+	m_rowCount = 0;
+}
+
+
+void JsonRowSink::AppendTo(string& line, const char* key, bool isArray)
+{
+	if (m_rowCount > 0) {
+		line += ',';
+		AppendJsonString(line, key);
+		line += ':';
+		if (isArray)
+			line += '[';
+		line += m_rows;
+		if (isArray)
+			line += ']';
+	}
+	Clear();
+}
+
+//-----------------------------
+
+JsonDumper::JsonDumper(otl_connect& otlConnect, string fields, long firstEvent, long lastEvent) :
+	m_firstEvent(firstEvent),
+	m_lastEvent(lastEvent),
+	m_file(NULL),
+	m_callSink(tap3CallTable, m_fields),
+	m_gprsCallSink(tap3GPRSCallTable, m_fields),
+	m_basicServiceSink(tap3BasicServiceTable, m_fields),
+	m_chargeInfoSink(tap3ChargeInfoTable, m_fields),
+	m_chargeDetailSink(tap3ChargeDetailTable, m_fields),
+	m_eventRowWriter(otlConnect, m_callSink, m_gprsCallSink, m_basicServiceSink, m_chargeInfoSink, m_chargeDetailSink, m_detailIDs,
+		GetTAPDecimalPlaces())
+{
+	// comma-separated list of column names of TAP3 event tables
+	size_t start = 0;
+	while (start < fields.size()) {
+		size_t end = fields.find(',', start);
+		if (end == string::npos)
+			end = fields.size();
+		string field = fields.substr(start, end - start);
+		transform(field.begin(), field.end(), field.begin(), ::toupper);
+		if (!field.empty())
+			m_fields.insert(field);
+		start = end + 1;
+	}
+}
+
+
+bool JsonDumper::Open(string filename)
+{
+	m_file = fopen(filename.c_str(), "wb");
+	if (!m_file) {
+		printf("Unable to open output file %s\n", filename.c_str());
+		return false;
+	}
+	setvbuf(m_file, NULL, _IOFBF, jsonFileBufferSize);
+	return true;
+}
+
+
+bool JsonDumper::Close()
+{
+	bool success = (ferror(m_file) == 0);
+	if (fclose(m_file) != 0)
+		success = false;
+	m_file = NULL;
+	if (!success)
+		printf("Error writing output file\n");
+	return success;
+}
+
+
+void JsonDumper::WriteLine()
+{
+	m_line += '\n';
+	fwrite(m_line.data(), 1, m_line.size(), m_file);
+	m_line.clear();
+}
+
+
+int JsonDumper::DumpDataInterchange(string filename, long fileID, const DataInterChange* dataInterchange,
+	const vector<BerSpan>* eventSpans)
+{
+	if (!Open(filename))
+		return TL_FILEERROR;
+	if (dataInterchange->present == DataInterChange_PR_notification) {
+		WriteNotification(&dataInterchange->choice.notification);
+	}
+	else {
+		const TransferBatch* transferBatch = &dataInterchange->choice.transferBatch;
+		long eventCount = (transferBatch->callEventDetails ? transferBatch->callEventDetails->list.count : -1);
+		bool eventsDecoded = (eventCount > 0 || !eventSpans);
+		if (!eventsDecoded && transferBatch->callEventDetails)
+			eventCount = (long) eventSpans->size();
+		WriteTransferBatchHeader(transferBatch, eventCount);
+		for (long index = (m_firstEvent > 1 ? m_firstEvent - 1 : 0); index < eventCount && index < m_lastEvent; index++) {
+			if (eventsDecoded) {
+				WriteEvent(fileID, index + 1, transferBatch->callEventDetails->list.array[index]);
+			}
+			else {
+				LazyCallEvent callEvent(NULL, &(*eventSpans)[index]);
+				if (!callEvent.GetCallEventDetail()) {
+					log(LOG_ERROR, "Ошибка ASN-декодирования события №" + to_string((long long) index + 1));
+					Close();
+					return TL_DECODEERROR;
+				}
+				WriteEvent(fileID, index + 1, callEvent.GetCallEventDetail());
+			}
+		}
+		if (transferBatch->auditControlInfo)
+			WriteAuditControlInfo(transferBatch);
+	}
+	return Close() ? TL_OK : TL_FILEERROR;
+}
+
+
+void JsonDumper::WriteTransferBatchHeader(const TransferBatch* transferBatch, long eventCount)
+{
+	JsonObject header(m_line);
+	header.Add("record", "header");
+	if (transferBatch->batchControlInfo) {
+		const BatchControlInfo* batchControlInfo = transferBatch->batchControlInfo;
+		header
+			.Add("sender", batchControlInfo->sender)
+			.Add("recipient", batchControlInfo->recipient)
+			.Add("fileSequenceNumber", batchControlInfo->fileSequenceNumber)
+			.AddTimestamp("fileCreationTime", "fileCreationUtcOffset", batchControlInfo->fileCreationTimeStamp)
+			.AddTimestamp("transferCutOffTime", "transferCutOffUtcOffset", batchControlInfo->transferCutOffTimeStamp)
+			.AddTimestamp("fileAvailableTime", "fileAvailableUtcOffset", batchControlInfo->fileAvailableTimeStamp)
+			.Add("specificationVersionNumber", batchControlInfo->specificationVersionNumber)
+			.Add("releaseVersionNumber", batchControlInfo->releaseVersionNumber)
+			.Add("fileTypeIndicator", batchControlInfo->fileTypeIndicator)
+			.Add("rapFileSequenceNumber", batchControlInfo->rapFileSequenceNumber);
+	}
+	if (transferBatch->accountingInfo) {
+		const AccountingInfo* accountingInfo = transferBatch->accountingInfo;
+		header
+			.Add("localCurrency", accountingInfo->localCurrency)
+			.Add("tapCurrency", accountingInfo->tapCurrency)
+			.Add("tapDecimalPlaces", accountingInfo->tapDecimalPlaces);
+		if (accountingInfo->currencyConversionInfo) {
+			header.AddKey("exchangeRates");
+			m_line += '[';
+			for (int i = 0; i < accountingInfo->currencyConversionInfo->list.count; i++) {
+				if (i > 0)
+					m_line += ',';
+				const CurrencyConversion* currencyConversion = accountingInfo->currencyConversionInfo->list.array[i];
+				JsonObject rate(m_line);
+				rate.Add("code", currencyConversion->exchangeRateCode);
+				if (currencyConversion->exchangeRateCode && currencyConversion->exchangeRate && currencyConversion->numberOfDecimalPlaces)
+					rate.AddDecimal("rate", GetExRate(*currencyConversion->exchangeRateCode));
+				rate.End();
+			}
+			m_line += ']';
+		}
+	}
+	if (transferBatch->networkInfo) {
+		if (transferBatch->networkInfo->utcTimeOffsetInfo) {
+			header.AddKey("utcTimeOffsets");
+			m_line += '[';
+			for (int i = 0; i < transferBatch->networkInfo->utcTimeOffsetInfo->list.count; i++) {
+				if (i > 0)
+					m_line += ',';
+				JsonObject utcOffset(m_line);
+				utcOffset
+					.Add("code", transferBatch->networkInfo->utcTimeOffsetInfo->list.array[i]->utcTimeOffsetCode)
+					.Add("offset", transferBatch->networkInfo->utcTimeOffsetInfo->list.array[i]->utcTimeOffset)
+					.End();
+			}
+			m_line += ']';
+		}
+		if (transferBatch->networkInfo->recEntityInfo) {
+			header.AddKey("recEntities");
+			m_line += '[';
+			for (int i = 0; i < transferBatch->networkInfo->recEntityInfo->list.count; i++) {
+				if (i > 0)
+					m_line += ',';
+				JsonObject recEntity(m_line);
+				recEntity
+					.Add("code", transferBatch->networkInfo->recEntityInfo->list.array[i]->recEntityCode)
+					.Add("type", transferBatch->networkInfo->recEntityInfo->list.array[i]->recEntityType)
+					.Add("id", transferBatch->networkInfo->recEntityInfo->list.array[i]->recEntityId)
+					.End();
+			}
+			m_line += ']';
+		}
+	}
+	if (eventCount >= 0)
+		header.Add("eventCount", (long long) eventCount);
+	header.End();
+	WriteLine();
+}
+
+
+void JsonDumper::WriteAuditControlInfo(const TransferBatch* transferBatch)
+{
+	const AuditControlInfo* auditControlInfo = transferBatch->auditControlInfo;
+	JsonObject audit(m_line);
+	audit
+		.Add("record", "audit")
+		.AddTimestamp("earliestCallTime", "earliestCallUtcOffset", auditControlInfo->earliestCallTimeStamp)
+		.AddTimestamp("latestCallTime", "latestCallUtcOffset", auditControlInfo->latestCallTimeStamp)
+		.Add("callEventDetailsCount", auditControlInfo->callEventDetailsCount);
+	if (transferBatch->accountingInfo && transferBatch->accountingInfo->tapDecimalPlaces) {
+		int tapDecimalPlaces = *transferBatch->accountingInfo->tapDecimalPlaces;
+		if (auditControlInfo->totalCharge)
+			audit.AddAmount("totalCharge", TapAmount::FromOctetString(*auditControlInfo->totalCharge, tapDecimalPlaces));
+		if (auditControlInfo->totalTaxValue)
+			audit.AddAmount("totalTax", TapAmount::FromOctetString(*auditControlInfo->totalTaxValue, tapDecimalPlaces));
+		if (auditControlInfo->totalDiscountValue)
+			audit.AddAmount("totalDiscount", TapAmount::FromOctetString(*auditControlInfo->totalDiscountValue, tapDecimalPlaces));
+	}
+	audit.End();
+	WriteLine();
+}
+
+
+void JsonDumper::WriteNotification(const Notification* notification)
+{
+	JsonObject header(m_line);
+	header
+		.Add("record", "notification")
+		.Add("sender", notification->sender)
+		.Add("recipient", notification->recipient)
+		.Add("fileSequenceNumber", notification->fileSequenceNumber)
+		.Add("rapFileSequenceNumber", notification->rapFileSequenceNumber)
+		.AddTimestamp("fileCreationTime", "fileCreationUtcOffset", notification->fileCreationTimeStamp)
+		.AddTimestamp("transferCutOffTime", "transferCutOffUtcOffset", notification->transferCutOffTimeStamp)
+		.AddTimestamp("fileAvailableTime", "fileAvailableUtcOffset", notification->fileAvailableTimeStamp)
+		.Add("specificationVersionNumber", notification->specificationVersionNumber)
+		.Add("releaseVersionNumber", notification->releaseVersionNumber)
+		.Add("fileTypeIndicator", notification->fileTypeIndicator)
+		.End();
+	WriteLine();
+}
+
+
+void JsonDumper::WriteEvent(long fileID, int index, const CallEventDetail* callEventDetail)
+{
+	JsonObject event(m_line);
+	event
+		.Add("record", "event")
+		.Add("rsn", (long long) index);
+	long writeRes = TL_OK;
+	try {
+		// event ID is not known in print-only mode, RSN is used instead
+		switch (callEventDetail->present) {
+		case CallEventDetail_PR_mobileOriginatedCall:
+			event.Add("type", "MOC");
+			writeRes = m_eventRowWriter.WriteOriginatedCall(index, fileID, index, &callEventDetail->choice.mobileOriginatedCall);
+			break;
+		case CallEventDetail_PR_mobileTerminatedCall:
+			event.Add("type", "MTC");
+			writeRes = m_eventRowWriter.WriteTerminatedCall(index, fileID, index, &callEventDetail->choice.mobileTerminatedCall);
+			break;
+		case CallEventDetail_PR_gprsCall:
+			event.Add("type", "GPRS");
+			writeRes = m_eventRowWriter.WriteGPRSCall(index, fileID, index, &callEventDetail->choice.gprsCall);
+			break;
+		case CallEventDetail_PR_supplServiceEvent:
+			event.Add("type", "SupplService");
+			break;
+		default:
+			event.Add("present", (long long) callEventDetail->present);
+		}
+	}
+	catch (char* pMess) {
+		event.Add("exception", pMess);
+	}
+	if (writeRes != TL_OK)
+		event.Add("error", (long long) writeRes);
+	m_callSink.AppendTo(m_line, "call", false);
+	m_gprsCallSink.AppendTo(m_line, "call", false);
+	m_basicServiceSink.AppendTo(m_line, "basicServices", true);
+	m_chargeInfoSink.AppendTo(m_line, "chargeInfos", true);
+	m_chargeDetailSink.AppendTo(m_line, "chargeDetails", true);
+	event.End();
+	WriteLine();
+}
+
+
+int JsonDumper::DumpReturnBatch(string filename, const ReturnBatch* returnBatch)
+{
+	if (!Open(filename))
+		return TL_FILEERROR;
+	const RapBatchControlInfo& batchControlInfo = returnBatch->rapBatchControlInfoRap;
+	JsonObject header(m_line);
+	header
+		.Add("record", "header")
+		.Add("sender", &batchControlInfo.sender)
+		.Add("recipient", &batchControlInfo.recipient)
+		.Add("roamingPartner", batchControlInfo.roamingPartner)
+		.Add("rapFileSequenceNumber", &batchControlInfo.rapFileSequenceNumber)
+		.AddTimestamp("rapFileCreationTime", "rapFileCreationUtcOffset", &batchControlInfo.rapFileCreationTimeStamp)
+		.AddTimestamp("rapFileAvailableTime", "rapFileAvailableUtcOffset", &batchControlInfo.rapFileAvailableTimeStamp)
+		.Add("tapCurrency", batchControlInfo.tapCurrency)
+		.Add("tapDecimalPlaces", batchControlInfo.tapDecimalPlaces)
+		.Add("specificationVersionNumber", batchControlInfo.specificationVersionNumber)
+		.Add("releaseVersionNumber", batchControlInfo.releaseVersionNumber)
+		.Add("rapSpecificationVersionNumber", &batchControlInfo.rapSpecificationVersionNumber)
+		.Add("rapReleaseVersionNumber", &batchControlInfo.rapReleaseVersionNumber)
+		.Add("fileTypeIndicator", batchControlInfo.fileTypeIndicator)
+		.End();
+	WriteLine();
+
+	for (int i = 0; i < returnBatch->returnDetails.list.count; i++)
+		WriteReturnDetail(i + 1, returnBatch->returnDetails.list.array[i]);
+
+	int tapDecimalPlaces = (batchControlInfo.tapDecimalPlaces ? *batchControlInfo.tapDecimalPlaces : 0);
+	JsonObject audit(m_line);
+	audit
+		.Add("record", "audit")
+		.Add("returnDetailsCount", &returnBatch->rapAuditControlInfo.returnDetailsCount)
+		.AddAmount("totalSevereReturnValue", TapAmount::FromOctetString(returnBatch->rapAuditControlInfo.totalSevereReturnValue, tapDecimalPlaces));
+	if (returnBatch->rapAuditControlInfo.totalSevereReturnTax)
+		audit.AddAmount("totalSevereReturnTax", TapAmount::FromOctetString(*returnBatch->rapAuditControlInfo.totalSevereReturnTax, tapDecimalPlaces));
+	audit.End();
+	WriteLine();
+	return Close() ? TL_OK : TL_FILEERROR;
+}
+
+
+void JsonDumper::WriteReturnDetail(int index, const ReturnDetail* returnDetail)
+{
+	JsonObject detail(m_line);
+	detail
+		.Add("record", "returnDetail")
+		.Add("index", (long long) index);
+	switch (returnDetail->present) {
+	case ReturnDetail_PR_stopReturn:
+		detail
+			.Add("type", "stopReturn")
+			.Add("lastSeqNumber", &returnDetail->choice.stopReturn.lastSeqNumber);
+		break;
+	case ReturnDetail_PR_missingReturn:
+		detail
+			.Add("type", "missingReturn")
+			.Add("startMissingSeqNumber", &returnDetail->choice.missingReturn.startMissingSeqNumber)
+			.Add("endMissingSeqNumber", returnDetail->choice.missingReturn.endMissingSeqNumber);
+		break;
+	case ReturnDetail_PR_fatalReturn: {
+		const FatalReturn& fatalReturn = returnDetail->choice.fatalReturn;
+		detail
+			.Add("type", "fatalReturn")
+			.Add("fileSequenceNumber", &fatalReturn.fileSequenceNumber);
+		const ErrorDetailList_t* errorDetailList = NULL;
+		if (fatalReturn.accountingInfoError) {
+			detail.Add("errorType", "Accounting Info");
+			errorDetailList = &fatalReturn.accountingInfoError->errorDetail;
+		}
+		else if (fatalReturn.auditControlInfoError) {
+			detail.Add("errorType", "Audit Control Info");
+			errorDetailList = &fatalReturn.auditControlInfoError->errorDetail;
+		}
+		else if (fatalReturn.batchControlError) {
+			detail.Add("errorType", "Batch Control Info");
+			errorDetailList = &fatalReturn.batchControlError->errorDetail;
+		}
+		else if (fatalReturn.messageDescriptionError) {
+			detail.Add("errorType", "Message Description");
+			errorDetailList = &fatalReturn.messageDescriptionError->errorDetail;
+		}
+		else if (fatalReturn.networkInfoError) {
+			detail.Add("errorType", "Network Info");
+			errorDetailList = &fatalReturn.networkInfoError->errorDetail;
+		}
+		else if (fatalReturn.notificationError) {
+			detail.Add("errorType", "Notification");
+			errorDetailList = &fatalReturn.notificationError->errorDetail;
+		}
+		else if (fatalReturn.transferBatchError) {
+			detail.Add("errorType", "Transfer Batch");
+			errorDetailList = &fatalReturn.transferBatchError->errorDetail;
+		}
+		if (errorDetailList) {
+			detail.AddKey("errors");
+			AppendErrorDetails(errorDetailList);
+		}
+		}
+		break;
+	case ReturnDetail_PR_severeReturn:
+		// call event of severe return is not converted since the values depend on transfer batch absent in RAP file
+		detail
+			.Add("type", "severeReturn")
+			.Add("fileSequenceNumber", &returnDetail->choice.severeReturn.fileSequenceNumber)
+			.Add("eventType", (long long) returnDetail->choice.severeReturn.callEventDetail.present)
+			.AddKey("errors");
+		AppendErrorDetails(&returnDetail->choice.severeReturn.errorDetail);
+		break;
+	default:
+		detail.Add("present", (long long) returnDetail->present);
+	}
+	detail.End();
+	WriteLine();
+}
+
+
+void JsonDumper::AppendErrorDetails(const ErrorDetailList_t* errorDetailList)
+{
+	m_line += '[';
+	for (int i = 0; i < errorDetailList->list.count; i++) {
+		const ErrorDetail* errorDetail = errorDetailList->list.array[i];
+		if (i > 0)
+			m_line += ',';
+		JsonObject error(m_line);
+		error
+			.Add("errorCode", (long long) errorDetail->errorCode)
+			.Add("itemOffset", errorDetail->itemOffset);
+		if (errorDetail->errorContext) {
+			// path of ASN tags to the erroneous item
+			error.AddKey("context");
+			m_line += '[';
+			for (int j = 0; j < errorDetail->errorContext->list.count; j++) {
+				if (j > 0)
+					m_line += ',';
+				JsonObject context(m_line);
+				context
+					.Add("pathItemId", (long long) errorDetail->errorContext->list.array[j]->pathItemId)
+					.Add("itemLevel", (long long) errorDetail->errorContext->list.array[j]->itemLevel)
+					.Add("itemOccurrence", errorDetail->errorContext->list.array[j]->itemOccurrence)
+					.End();
+			}
+			m_line += ']';
+		}
+		error.End();
+	}
+	m_line += ']';
+}
+
+
+int JsonDumper::DumpAcknowledgement(string filename, const Acknowledgement* acknowledgement)
+{
+	if (!Open(filename))
+		return TL_FILEERROR;
+	JsonObject header(m_line);
+	header
+		.Add("record", "acknowledgement")
+		.Add("sender", &acknowledgement->sender)
+		.Add("recipient", &acknowledgement->recipient)
+		.Add("rapFileSequenceNumber", &acknowledgement->rapFileSequenceNumber)
+		.AddTimestamp("ackFileCreationTime", "ackFileCreationUtcOffset", &acknowledgement->ackFileCreationTimeStamp)
+		.AddTimestamp("ackFileAvailableTime", "ackFileAvailableUtcOffset", &acknowledgement->ackFileAvailableTimeStamp)
+		.Add("fileTypeIndicator", acknowledgement->fileTypeIndicator)
+		.End();
+	WriteLine();
+	return Close() ? TL_OK : TL_FILEERROR;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <set>
+#include "EventRowWriter.h"
+#include "BerSpan.h"
+
+// Class JsonRowSink collects rows of a table as JSON objects. Only selected columns are written (all if selection
+// is empty), NULL values are omitted, timestamps are converted to ISO 8601 format.
+class JsonRowSink : public TableSink
+{
+public:
+	JsonRowSink(const TableDefinition& table, const set<string>& fields);
+	void EndRow();
+	void Clear();
+	// appends collected rows to line as "key":{...} for single row or "key":[{...},...] for array
+	void AppendTo(string& line, const char* key, bool isArray);
+protected:
+	void AddString(const char* value);
+	void AddInteger(long long value);
+	void AddDecimal(double value);
+	void AddNull();
+	void AddAmount(const TapAmount& value);
+private:
+	const TableDefinition& m_table;
+	const set<string>& m_fields;
+	string m_row;
+	string m_rows;
+	int m_column;
+	long m_rowCount;
+
+	bool StartField();
+};
+
+
+// Class JsonDumper writes contents of TAP, RAP or acknowledgement file to NDJSON file (one JSON object per line)
+// for print-only mode. Each line has "record" field: "header", "notification", "event", "audit", "returnDetail"
+// or "acknowledgement". Event lines contain the same values as rows loaded to TAP3 event tables.
+class JsonDumper
+{
+public:
+	JsonDumper(otl_connect& otlConnect, string fields, long firstEvent, long lastEvent);
+	// events not decoded in dataInterchange are decoded from eventSpans, only those in range of dumped events
+	int DumpDataInterchange(string filename, long fileID, const DataInterChange* dataInterchange,
+		const vector<BerSpan>* eventSpans = NULL);
+	int DumpReturnBatch(string filename, const ReturnBatch* returnBatch);
+	int DumpAcknowledgement(string filename, const Acknowledgement* acknowledgement);
+private:
+	set<string> m_fields;
+	long m_firstEvent;
+	long m_lastEvent;
+	FILE* m_file;
+	string m_line;
+	LocalIDCounter m_detailIDs;
+	JsonRowSink m_callSink;
+	JsonRowSink m_gprsCallSink;
+	JsonRowSink m_basicServiceSink;
+	JsonRowSink m_chargeInfoSink;
+	JsonRowSink m_chargeDetailSink;
+	EventRowWriter m_eventRowWriter;
+
+	bool Open(string filename);
+	bool Close();
+	void WriteLine();
+	void WriteTransferBatchHeader(const TransferBatch* transferBatch, long eventCount);
+	void WriteAuditControlInfo(const TransferBatch* transferBatch);
+	void WriteNotification(const Notification* notification);
+	void WriteEvent(long fileID, int index, const CallEventDetail* callEventDetail);
+	void WriteReturnDetail(int index, const ReturnDetail* returnDetail);
+	void AppendErrorDetails(const ErrorDetailList_t* errorDetailList);
+};
@@ -0,0 +1,235 @@
+#include <vector>
+#include "OTL_Header.h"
+#include "DataInterchange.h"
+#include "LazyCallEvent.h"
+
+using namespace std;
+
+// Paths of fields by types of nested structures
+static asn_TYPE_descriptor_t* moTimeStampPath[] = { &asn_DEF_MoBasicCallInformation, &asn_DEF_CallEventStartTimeStamp, &asn_DEF_LocalTimeStamp, NULL };
+static asn_TYPE_descriptor_t* mtTimeStampPath[] = { &asn_DEF_MtBasicCallInformation, &asn_DEF_CallEventStartTimeStamp, &asn_DEF_LocalTimeStamp, NULL };
+static asn_TYPE_descriptor_t* gprsTimeStampPath[] = { &asn_DEF_GprsBasicCallInformation, &asn_DEF_CallEventStartTimeStamp,
+	&asn_DEF_LocalTimeStamp, NULL };
+static asn_TYPE_descriptor_t* callChargeInfoPath[] = { &asn_DEF_BasicServiceUsedList, &asn_DEF_BasicServiceUsed, &asn_DEF_ChargeInformationList, NULL };
+static asn_TYPE_descriptor_t* gprsChargeInfoPath[] = { &asn_DEF_GprsServiceUsed, &asn_DEF_ChargeInformationList, NULL };
+
+
+LazyCallEvent::LazyCallEvent(const CallEventDetail* callEventDetail, const BerSpan* span) :
+	m_callEventDetail(callEventDetail),
+	m_type(CallEventDetail_PR_NOTHING),
+	m_decodedEvent(NULL),
+	m_decodeError(false),
+	m_chargeInfoLoaded(false),
+	m_callTimeStampLoaded(false)
+{
+	memset(&m_callTimeStamp, 0, sizeof(m_callTimeStamp));
+	m_span.data = NULL;
+	m_span.size = 0;
+	if (m_callEventDetail) {
+		m_type = m_callEventDetail->present;
+		return;
+	}
+	if (!span)
+		return;
+
+	m_span = *span;
+	ber_tlv_tag_t tag;
+	size_t length;
+	ssize_t headerSize = FetchTagAndLength(m_span.data, m_span.size, tag, length);
+	if (headerSize < 0) {
+		m_decodeError = true;
+		return;
+	}
+	if (tag == asn_DEF_MobileOriginatedCall.tags[0])
+		m_type = CallEventDetail_PR_mobileOriginatedCall;
+	else if (tag == asn_DEF_MobileTerminatedCall.tags[0])
+		m_type = CallEventDetail_PR_mobileTerminatedCall;
+	else if (tag == asn_DEF_GprsCall.tags[0])
+		m_type = CallEventDetail_PR_gprsCall;
+	else
+		// other events are accessed by GetCallEventDetail only
+		return;
+
+	const unsigned char* child = m_span.data + headerSize;
+	const unsigned char* end = child + length;
+	while (child < end) {
+		headerSize = FetchTagAndLength(child, end - child, tag, length);
+		if (headerSize < 0) {
+			m_decodeError = true;
+			break;
+		}
+		ChildTLV childTLV = { tag, { child, headerSize + length } };
+		m_children.push_back(childTLV);
+		child += childTLV.span.size;
+	}
+}
+
+
+LazyCallEvent::~LazyCallEvent()
+{
+	for (size_t i = 0; i < m_decodedChargeInfoLists.size(); i++)
+		ASN_STRUCT_FREE(asn_DEF_ChargeInformationList, m_decodedChargeInfoLists[i]);
+	if (m_decodedEvent)
+		ASN_STRUCT_FREE(asn_DEF_CallEventDetail, m_decodedEvent);
+	if (m_callTimeStamp.buf)
+		free(m_callTimeStamp.buf);
+}
+
+
+CallEventDetail_PR LazyCallEvent::GetType() const
+{
+	return m_type;
+}
+
+
+bool LazyCallEvent::HasDecodeError() const
+{
+	return m_decodeError;
+}
+
+
+// Finds TLVs at path, each level may contain several TLVs with the tag of path item (items of lists)
+bool LazyCallEvent::FindFields(asn_TYPE_descriptor_t* const* path, vector<BerSpan>& fields) const
+{
+	bool parsed = true;
+	fields.clear();
+	for (size_t i = 0; i < m_children.size(); i++) {
+		if (m_children[i].tag == path[0]->tags[0])
+			fields.push_back(m_children[i].span);
+	}
+	for (int level = 1; path[level] && !fields.empty(); level++) {
+		vector<BerSpan> parents;
+		parents.swap(fields);
+		for (size_t i = 0; i < parents.size(); i++) {
+			ber_tlv_tag_t tag;
+			size_t length;
+			ssize_t headerSize = FetchTagAndLength(parents[i].data, parents[i].size, tag, length);
+			if (headerSize < 0) {
+				parsed = false;
+				continue;
+			}
+			const unsigned char* child = parents[i].data + headerSize;
+			const unsigned char* end = child + length;
+			while (child < end) {
+				headerSize = FetchTagAndLength(child, end - child, tag, length);
+				if (headerSize < 0) {
+					parsed = false;
+					break;
+				}
+				BerSpan childSpan = { child, headerSize + length };
+				if (tag == path[level]->tags[0])
+					fields.push_back(childSpan);
+				child += childSpan.size;
+			}
+		}
+	}
+	return parsed;
+}
+
+
+// Copies contents of the first primitive TLV at path to value, the copy is null-terminated like decoded strings
+bool LazyCallEvent::GetPrimitiveField(asn_TYPE_descriptor_t* const* path, OCTET_STRING_t& value) const
+{
+	vector<BerSpan> fields;
+	FindFields(path, fields);
+	if (fields.empty())
+		return false;
+	ber_tlv_tag_t tag;
+	size_t length;
+	ssize_t headerSize = FetchTagAndLength(fields[0].data, fields[0].size, tag, length);
+	if (headerSize < 0 || BER_TLV_CONSTRUCTED(fields[0].data))
+		return false;
+	return OCTET_STRING_fromBuf(&value, (const char*) fields[0].data + headerSize, (int) length) == 0;
+}
+
+
+const LocalTimeStamp_t* LazyCallEvent::GetCallTimeStamp()
+{
+	if (m_callEventDetail) {
+		switch (m_type) {
+		case CallEventDetail_PR_mobileOriginatedCall:
+			return m_callEventDetail->choice.mobileOriginatedCall.basicCallInformation->callEventStartTimeStamp->localTimeStamp;
+		case CallEventDetail_PR_mobileTerminatedCall:
+			return m_callEventDetail->choice.mobileTerminatedCall.basicCallInformation->callEventStartTimeStamp->localTimeStamp;
+		case CallEventDetail_PR_gprsCall:
+			return m_callEventDetail->choice.gprsCall.gprsBasicCallInformation->callEventStartTimeStamp->localTimeStamp;
+		default:
+			return NULL;
+		}
+	}
+
+	if (!m_callTimeStampLoaded && m_type != CallEventDetail_PR_NOTHING) {
+		m_callTimeStampLoaded = true;
+		asn_TYPE_descriptor_t** path = (m_type == CallEventDetail_PR_mobileOriginatedCall ? moTimeStampPath :
+			(m_type == CallEventDetail_PR_mobileTerminatedCall ? mtTimeStampPath : gprsTimeStampPath));
+		GetPrimitiveField(path, m_callTimeStamp);
+	}
+	return (m_callTimeStamp.buf ? &m_callTimeStamp : NULL);
+}
+
+
+const vector<const ChargeInformationList*>& LazyCallEvent::GetChargeInformationLists()
+{
+	if (m_chargeInfoLoaded)
+		return m_chargeInfoLists;
+	m_chargeInfoLoaded = true;
+
+	if (m_callEventDetail) {
+		const BasicServiceUsedList* basicServiceUsedList = NULL;
+		switch (m_type) {
+		case CallEventDetail_PR_mobileOriginatedCall:
+			basicServiceUsedList = m_callEventDetail->choice.mobileOriginatedCall.basicServiceUsedList;
+			break;
+		case CallEventDetail_PR_mobileTerminatedCall:
+			basicServiceUsedList = m_callEventDetail->choice.mobileTerminatedCall.basicServiceUsedList;
+			break;
+		case CallEventDetail_PR_gprsCall:
+			m_chargeInfoLists.push_back(m_callEventDetail->choice.gprsCall.gprsServiceUsed->chargeInformationList);
+			break;
+		default:
+			break;
+		}
+		if (basicServiceUsedList) {
+			for (int bs_used_index = 0; bs_used_index < basicServiceUsedList->list.count; bs_used_index++)
+				m_chargeInfoLists.push_back(basicServiceUsedList->list.array[bs_used_index]->chargeInformationList);
+		}
+		return m_chargeInfoLists;
+	}
+
+	if (m_type == CallEventDetail_PR_NOTHING)
+		return m_chargeInfoLists;
+	vector<BerSpan> fields;
+	// charges of the event would be missing from totals, so caller is to know about any undecoded part
+	if (!FindFields(m_type == CallEventDetail_PR_gprsCall ? gprsChargeInfoPath : callChargeInfoPath, fields))
+		m_decodeError = true;
+	for (size_t i = 0; i < fields.size(); i++) {
+		ChargeInformationList* chargeInfoList = NULL;
+		asn_dec_rval_t rval = ber_decode(0, &asn_DEF_ChargeInformationList, (void**) &chargeInfoList, fields[i].data, fields[i].size);
+		if (rval.code != RC_OK) {
+			if (chargeInfoList)
+				ASN_STRUCT_FREE(asn_DEF_ChargeInformationList, chargeInfoList);
+			m_decodeError = true;
+			continue;
+		}
+		m_decodedChargeInfoLists.push_back(chargeInfoList);
+		m_chargeInfoLists.push_back(chargeInfoList);
+	}
+	return m_chargeInfoLists;
+}
+
+
+const CallEventDetail* LazyCallEvent::GetCallEventDetail()
+{
+	if (m_callEventDetail)
+		return m_callEventDetail;
+	if (!m_decodedEvent && m_span.data) {
+		asn_dec_rval_t rval = ber_decode(0, &asn_DEF_CallEventDetail, (void**) &m_decodedEvent, m_span.data, m_span.size);
+		if (rval.code != RC_OK) {
+			if (m_decodedEvent)
+				ASN_STRUCT_FREE(asn_DEF_CallEventDetail, m_decodedEvent);
+			m_decodedEvent = NULL;
+			m_span.data = NULL;
+		}
+	}
+	return m_decodedEvent;
+}
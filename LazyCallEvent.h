@@ -0,0 +1,45 @@
+#pragma once
+#include "BerSpan.h"
+
+// Class LazyCallEvent is a view of call event detail that is either decoded or kept as BER span of TAP file.
+// For a span only child TLVs of the event are indexed on creation, fields are decoded when they are accessed
+// and full asn1c structure is built only by GetCallEventDetail. Everything decoded is owned by the view.
+class LazyCallEvent
+{
+public:
+	// span is used if callEventDetail is NULL
+	LazyCallEvent(const CallEventDetail* callEventDetail, const BerSpan* span);
+	~LazyCallEvent();
+	CallEventDetail_PR GetType() const;
+	// local time stamp of call event start, NULL if missing
+	const LocalTimeStamp_t* GetCallTimeStamp();
+	// charge information lists of basic services used (MOC/MTC) or of GPRS service used,
+	// lists are incomplete if HasDecodeError is true after the call
+	const vector<const ChargeInformationList*>& GetChargeInformationLists();
+	// true if some part of span accessed so far can't be decoded
+	bool HasDecodeError() const;
+	// returns NULL if the event can't be decoded
+	const CallEventDetail* GetCallEventDetail();
+private:
+	struct ChildTLV {
+		ber_tlv_tag_t tag;
+		BerSpan span;
+	};
+	const CallEventDetail* m_callEventDetail;
+	BerSpan m_span;
+	CallEventDetail_PR m_type;
+	vector<ChildTLV> m_children;
+	CallEventDetail* m_decodedEvent;
+	bool m_decodeError;
+	bool m_chargeInfoLoaded;
+	vector<const ChargeInformationList*> m_chargeInfoLists;
+	vector<ChargeInformationList*> m_decodedChargeInfoLists;
+	bool m_callTimeStampLoaded;
+	LocalTimeStamp_t m_callTimeStamp;
+
+	LazyCallEvent(const LazyCallEvent&);
+	LazyCallEvent& operator=(const LazyCallEvent&);
+	// returns false if some TLV on the path can't be parsed
+	bool FindFields(asn_TYPE_descriptor_t* const* path, vector<BerSpan>& fields) const;
+	bool GetPrimitiveField(asn_TYPE_descriptor_t* const* path, OCTET_STRING_t& value) const;
+};
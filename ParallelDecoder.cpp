@@ -0,0 +1,196 @@
+#include <vector>
+#include <process.h>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "DataInterchange.h"
+#include "ParallelDecoder.h"
+
+using namespace std;
+
+extern void log(short msgType, string msgText, string dbConnectString = "");
+
+const size_t minParallelEvents = 20000;		// events of smaller files are decoded by single thread
+const size_t eventsPerChunk = 2000;
+const DWORD maxDecoderThreads = 32;
+
+
+ParallelEventDecoder::ParallelEventDecoder(const vector<BerSpan>& spans) :
+	m_spans(spans),
+	m_events(NULL),
+	m_nextChunk(0),
+	m_failed(0)
+{
+}
+
+
+asn_dec_rval_code_e ParallelEventDecoder::Decode(vector<CallEventDetail*>& events, size_t& failedIndex)
+{
+	size_t chunkCount = (m_spans.size() + eventsPerChunk - 1) / eventsPerChunk;
+	events.assign(m_spans.size(), NULL);
+	m_events = &events;
+	m_chunkResults.assign(chunkCount, RC_OK);
+	m_chunkFailedIndexes.assign(chunkCount, 0);
+	m_nextChunk = 0;
+	m_failed = 0;
+
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	DWORD threadCount = systemInfo.dwNumberOfProcessors;
+	if (m_spans.size() < minParallelEvents)
+		threadCount = 1;
+	if (threadCount > maxDecoderThreads)
+		threadCount = maxDecoderThreads;
+	if (threadCount > chunkCount)
+		threadCount = (DWORD) chunkCount;
+
+	vector<HANDLE> threads;
+	for (DWORD i = 1; i < threadCount; i++) {
+		HANDLE thread = (HANDLE) _beginthreadex(NULL, 0, WorkerThread, this, 0, NULL);
+		if (thread)
+			threads.push_back(thread);
+	}
+	// current thread decodes chunks too, so the decoding goes on even if no thread is started
+	DecodeChunks();
+	if (!threads.empty()) {
+		WaitForMultipleObjects((DWORD) threads.size(), &threads[0], TRUE, INFINITE);
+		for (size_t i = 0; i < threads.size(); i++)
+			CloseHandle(threads[i]);
+	}
+
+	for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+		if (m_chunkResults[chunk] != RC_OK) {
+			failedIndex = m_chunkFailedIndexes[chunk];
+			return m_chunkResults[chunk];
+		}
+	}
+	return RC_OK;
+}
+
+
+unsigned __stdcall ParallelEventDecoder::WorkerThread(void* param)
+{
+	((ParallelEventDecoder*) param)->DecodeChunks();
+	return 0;
+}
+
+
+void ParallelEventDecoder::DecodeChunks()
+{
+	while (!m_failed) {
+		size_t chunk = InterlockedIncrement(&m_nextChunk) - 1;
+		if (chunk >= m_chunkResults.size())
+			break;
+		size_t end = (chunk + 1) * eventsPerChunk;
+		if (end > m_spans.size())
+			end = m_spans.size();
+		// each chunk is written by one thread only, events of failed chunks are freed by caller
+		for (size_t i = chunk * eventsPerChunk; i < end; i++) {
+			asn_dec_rval_t rval = ber_decode(0, &asn_DEF_CallEventDetail, (void**) &(*m_events)[i], m_spans[i].data, m_spans[i].size);
+			if (rval.code != RC_OK) {
+				m_chunkResults[chunk] = rval.code;
+				m_chunkFailedIndexes[chunk] = i;
+				InterlockedExchange(&m_failed, 1);
+				break;
+			}
+		}
+	}
+}
+
+//-----------------------------
+
+// Builds copy of transfer batch TLV with empty call event list, other members are copied as is.
+// batchSize receives size of original TLV.
+static bool BuildSkeleton(const unsigned char* buffer, size_t size, const BerSpan& eventList, vector<unsigned char>& skeleton,
+	size_t& batchSize)
+{
+	ber_tlv_tag_t tag;
+	ssize_t batchTagSize = ber_fetch_tag(buffer, size, &tag);
+	ber_tlv_len_t batchLength;
+	ssize_t batchLengthSize = ber_fetch_length(1, buffer + batchTagSize, size - batchTagSize, &batchLength);
+	ssize_t listTagSize = ber_fetch_tag(eventList.data, eventList.size, &tag);
+	if (batchTagSize <= 0 || batchLengthSize <= 0 || listTagSize <= 0)
+		return false;
+
+	const unsigned char* content = buffer + batchTagSize + batchLengthSize;
+	const unsigned char* batchEnd = content + batchLength;
+	const unsigned char* listEnd = eventList.data + eventList.size;
+	// list is left with its tag and zero length
+	ber_tlv_len_t skeletonLength = (ber_tlv_len_t) (batchLength - eventList.size + listTagSize + 1);
+	unsigned char lengthBytes[16];
+	size_t lengthSize = der_tlv_length_serialize(skeletonLength, lengthBytes, sizeof(lengthBytes));
+	if (lengthSize > sizeof(lengthBytes))
+		return false;
+
+	skeleton.reserve(batchTagSize + lengthSize + skeletonLength);
+	skeleton.assign(buffer, buffer + batchTagSize);
+	skeleton.insert(skeleton.end(), lengthBytes, lengthBytes + lengthSize);
+	skeleton.insert(skeleton.end(), content, eventList.data);
+	skeleton.insert(skeleton.end(), eventList.data, eventList.data + listTagSize);
+	skeleton.push_back(0);
+	skeleton.insert(skeleton.end(), listEnd, batchEnd);
+	batchSize = batchEnd - buffer;
+	return true;
+}
+
+
+asn_dec_rval_t DecodeDataInterchange(const unsigned char* buffer, size_t size, DataInterChange** dataInterchange,
+	vector<BerSpan>& callEventSpans, bool decodeEvents)
+{
+	asn_dec_rval_t rval;
+	BerSpan eventList;
+	vector<unsigned char> skeleton;
+	size_t batchSize;
+	if (!FindCallEventSpans(buffer, size, callEventSpans, &eventList) ||
+			(decodeEvents && callEventSpans.size() < minParallelEvents) ||
+			!BuildSkeleton(buffer, size, eventList, skeleton, batchSize)) {
+		rval = ber_decode(0, &asn_DEF_DataInterChange, (void**) dataInterchange, buffer, size);
+		if (rval.code != RC_OK || (*dataInterchange)->present != DataInterChange_PR_transferBatch ||
+				!(*dataInterchange)->choice.transferBatch.callEventDetails ||
+				callEventSpans.size() != (size_t) (*dataInterchange)->choice.transferBatch.callEventDetails->list.count) {
+			// returned events will be encoded from decoded structures
+			callEventSpans.clear();
+		}
+		return rval;
+	}
+
+	rval = ber_decode(0, &asn_DEF_DataInterChange, (void**) dataInterchange, &skeleton[0], skeleton.size());
+	if (rval.code != RC_OK)
+		return rval;
+	if (!(*dataInterchange)->choice.transferBatch.callEventDetails) {
+		// spans were found in file that is not a transfer batch
+		callEventSpans.clear();
+		return rval;
+	}
+	if (decodeEvents)
+		rval.code = DecodeCallEvents(*dataInterchange, callEventSpans);
+	rval.consumed = batchSize;
+	return rval;
+}
+
+
+asn_dec_rval_code_e DecodeCallEvents(DataInterChange* dataInterchange, vector<BerSpan>& callEventSpans)
+{
+	if (dataInterchange->present != DataInterChange_PR_transferBatch || !dataInterchange->choice.transferBatch.callEventDetails)
+		return RC_OK;
+	CallEventDetailList* callEventDetails = dataInterchange->choice.transferBatch.callEventDetails;
+	if (callEventDetails->list.count > 0 || callEventSpans.empty())
+		// decoded already
+		return RC_OK;
+
+	vector<CallEventDetail*> events;
+	size_t failedIndex;
+	ParallelEventDecoder eventDecoder(callEventSpans);
+	asn_dec_rval_code_e code = eventDecoder.Decode(events, failedIndex);
+	if (code != RC_OK) {
+		log(LOG_ERROR, "Ошибка ASN-декодирования события №" + to_string((unsigned long long) failedIndex + 1));
+		for (size_t i = 0; i < events.size(); i++) {
+			if (events[i])
+				ASN_STRUCT_FREE(asn_DEF_CallEventDetail, events[i]);
+		}
+		callEventSpans.clear();
+		return code;
+	}
+	for (size_t i = 0; i < events.size(); i++)
+		ASN_SEQUENCE_ADD(&callEventDetails->list, events[i]);
+	return RC_OK;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "BerSpan.h"
+
+// Class ParallelEventDecoder decodes call events of transfer batch by worker threads. Event spans are split
+// into chunks of consecutive events, threads take next chunk when they are done with previous one. Decoded
+// events are placed to the same positions as their spans, so order of events is kept.
+class ParallelEventDecoder
+{
+public:
+	ParallelEventDecoder(const vector<BerSpan>& spans);
+	// returns RC_OK or code of the first failed event, failedIndex receives its index then
+	asn_dec_rval_code_e Decode(vector<CallEventDetail*>& events, size_t& failedIndex);
+private:
+	const vector<BerSpan>& m_spans;
+	vector<CallEventDetail*>* m_events;
+	vector<asn_dec_rval_code_e> m_chunkResults;
+	vector<size_t> m_chunkFailedIndexes;
+	volatile LONG m_nextChunk;
+	volatile LONG m_failed;
+
+	static unsigned __stdcall WorkerThread(void* param);
+	void DecodeChunks();
+};
+
+
+// Decodes TAP file. The file without event list contents may be decoded by ber_decode and events decoded from
+// their spans then: in parallel for big transfer batches or, if decodeEvents is false, later by DecodeCallEvents or
+// on access by LazyCallEvent (event list is left empty). callEventSpans receive spans of call events or are cleared
+// if they can't be found, events are always decoded by single ber_decode then.
+asn_dec_rval_t DecodeDataInterchange(const unsigned char* buffer, size_t size, DataInterChange** dataInterchange,
+	vector<BerSpan>& callEventSpans, bool decodeEvents = true);
+
+// Decodes call events of transfer batch from spans if they were not decoded by DecodeDataInterchange
+asn_dec_rval_code_e DecodeCallEvents(DataInterChange* dataInterchange, vector<BerSpan>& callEventSpans);
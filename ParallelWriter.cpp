@@ -0,0 +1,329 @@
+#include <vector>
+#include <process.h>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "DataInterchange.h"
+#include "ParallelWriter.h"
+
+using namespace std;
+
+extern void log(short msgType, string msgText, string dbConnectString = "");
+
+const int idBlockSize = 1000;
+const int eventBufferSize = 1000;
+
+// event tables in order of StagingTable
+const TableDefinition* eventTables[] = { &tap3CallTable, &tap3GPRSCallTable, &tap3BasicServiceTable, &tap3ChargeInfoTable,
+	&tap3ChargeDetailTable };
+
+
+ParallelEventWriter::ParallelEventWriter(string connectString, int writerCount) :
+	m_connectString(connectString),
+	m_writerCount(writerCount),
+	m_fileID(0),
+	m_transferBatch(NULL),
+	m_eventIDs(NULL),
+	m_failed(0)
+{
+	for (int i = 0; i < stagingTableCount; i++) {
+		string tableName = eventTables[i]->name;
+		m_stagingNames[i] = "BILLING.STG_" + tableName.substr(tableName.find('.') + 1);
+		m_stagingTables[i].name = m_stagingNames[i].c_str();
+		m_stagingTables[i].columns = eventTables[i]->columns;
+		m_stagingTables[i].columnCount = eventTables[i]->columnCount;
+	}
+}
+
+
+// consecutive RSNs are spread evenly between sessions by any number of them
+int ParallelEventWriter::GetPartition(int rsn) const
+{
+	return (int) ((((unsigned int) rsn * 2654435761U) >> 8) % (unsigned int) m_writerCount);
+}
+
+
+int ParallelEventWriter::WriteEvents(long fileID, const TransferBatch* transferBatch, vector<long long>& eventIDs)
+{
+	m_fileID = fileID;
+	m_transferBatch = transferBatch;
+	eventIDs.assign(transferBatch->callEventDetails->list.count, 0);
+	m_eventIDs = &eventIDs;
+	m_failed = 0;
+
+	vector<WriterSession> sessions(m_writerCount);
+	vector<HANDLE> threads;
+	vector<int> notStarted;
+	for (int i = 0; i < m_writerCount; i++) {
+		sessions[i].writer = this;
+		sessions[i].partition = i;
+		sessions[i].result = TL_OK;
+		if (i > 0) {
+			HANDLE thread = (HANDLE) _beginthreadex(NULL, 0, WriterThread, &sessions[i], 0, NULL);
+			if (thread)
+				threads.push_back(thread);
+			else
+				notStarted.push_back(i);
+		}
+	}
+	// current thread writes the first partition and partitions of threads failed to start
+	sessions[0].result = WritePartition(0, sessions[0].errorText);
+	for (size_t i = 0; i < notStarted.size(); i++)
+		sessions[notStarted[i]].result = WritePartition(notStarted[i], sessions[notStarted[i]].errorText);
+	if (!threads.empty()) {
+		WaitForMultipleObjects((DWORD) threads.size(), &threads[0], TRUE, INFINITE);
+		for (size_t i = 0; i < threads.size(); i++)
+			CloseHandle(threads[i]);
+	}
+
+	// errors are logged here, as log is not shared by threads
+	int result = TL_OK;
+	for (int i = 0; i < m_writerCount; i++) {
+		if (!sessions[i].errorText.empty())
+			log(LOG_ERROR, "Сессия записи " + to_string((long long) i + 1) + ": " + sessions[i].errorText);
+		if (sessions[i].result != TL_OK && result == TL_OK)
+			result = sessions[i].result;
+	}
+	return result;
+}
+
+
+unsigned __stdcall ParallelEventWriter::WriterThread(void* param)
+{
+	WriterSession* session = (WriterSession*) param;
+	session->result = session->writer->WritePartition(session->partition, session->errorText);
+	return 0;
+}
+
+
+int ParallelEventWriter::WritePartition(int partition, string& errorText)
+{
+	otl_connect otlConnect;
+	try {
+		otlConnect.rlogon(m_connectString.c_str());
+		SequenceIDPool eventIDs(otlConnect, "BILLING.Origin_Seq", idBlockSize);
+		SequenceIDPool detailIDs(otlConnect, "BILLING.TAP3EVENTID", idBlockSize);
+		// staging tables have no constraints, so streams may send rows in any order
+		string errorTag = to_string((long long) m_fileID);
+		int amountScale = (m_transferBatch->accountingInfo && m_transferBatch->accountingInfo->tapDecimalPlaces ?
+			*m_transferBatch->accountingInfo->tapDecimalPlaces : 0);
+		DBTableSink callSink(otlConnect, m_stagingTables[stCall], eventBufferSize, errorTag);
+		DBTableSink gprsCallSink(otlConnect, m_stagingTables[stGPRSCall], eventBufferSize, errorTag);
+		DBTableSink basicServiceSink(otlConnect, m_stagingTables[stBasicService], eventBufferSize, errorTag);
+		DBTableSink chargeInfoSink(otlConnect, m_stagingTables[stChargeInfo], eventBufferSize, errorTag, amountScale);
+		DBTableSink chargeDetailSink(otlConnect, m_stagingTables[stChargeDetail], eventBufferSize, errorTag, amountScale);
+		EventRowWriter eventRowWriter(otlConnect, callSink, gprsCallSink, basicServiceSink, chargeInfoSink, chargeDetailSink,
+			detailIDs, amountScale);
+
+		long writeRes = TL_OK;
+		for (int index = 0; index < m_transferBatch->callEventDetails->list.count && writeRes == TL_OK; index++) {
+			if (GetPartition(index + 1) != partition)
+				continue;
+			if (m_failed)
+				return TL_OK;	// result of failed session is returned
+			const CallEventDetail* callEventDetail = m_transferBatch->callEventDetails->list.array[index];
+			long long eventID = 0;
+			switch (callEventDetail->present) {
+			case CallEventDetail_PR_mobileOriginatedCall:
+				eventID = eventIDs.NextID();
+				writeRes = eventRowWriter.WriteOriginatedCall(eventID, m_fileID, index + 1, &callEventDetail->choice.mobileOriginatedCall);
+				break;
+			case CallEventDetail_PR_mobileTerminatedCall:
+				eventID = eventIDs.NextID();
+				writeRes = eventRowWriter.WriteTerminatedCall(eventID, m_fileID, index + 1, &callEventDetail->choice.mobileTerminatedCall);
+				break;
+			case CallEventDetail_PR_supplServiceEvent:
+				// just ignore it
+				break;
+			case CallEventDetail_PR_gprsCall:
+				eventID = eventIDs.NextID();
+				writeRes = eventRowWriter.WriteGPRSCall(eventID, m_fileID, index + 1, &callEventDetail->choice.gprsCall);
+				break;
+			default:
+				errorText = "Не найден обработчик события с кодом " + to_string((long long) callEventDetail->present) +
+					". Номер звонка " + to_string((long long) index + 1);
+				writeRes = TL_NEWCOMPONENT;
+			}
+			// each event index is written by one session only
+			(*m_eventIDs)[index] = eventID;
+		}
+		if (writeRes != TL_OK) {
+			InterlockedExchange(&m_failed, 1);
+			return writeRes;
+		}
+		callSink.Flush();
+		gprsCallSink.Flush();
+		basicServiceSink.Flush();
+		chargeInfoSink.Flush();
+		chargeDetailSink.Flush();
+		otlConnect.commit();
+		return TL_OK;
+	}
+	catch (otl_exception& otlEx) {
+		InterlockedExchange(&m_failed, 1);
+		errorText = string("Ошибка базы данных: ") + (char*) otlEx.msg;
+		if (strlen(otlEx.stm_text) > 0)
+			errorText += string(". ") + (char*) otlEx.stm_text;
+		return TL_ORACLEERROR;
+	}
+	catch (const std::exception& ex) {
+		InterlockedExchange(&m_failed, 1);
+		errorText = string("Исключение: ") + ex.what();
+		return TL_ORACLEERROR;
+	}
+	catch (const char* pMess) {
+		InterlockedExchange(&m_failed, 1);
+		errorText = string("Исключение: ") + pMess;
+		return TL_WRONGCODE;
+	}
+}
+
+
+// conditions select rows of events of the file selected by eventCondition on calls and GPRS calls,
+// v_file_id is variable of PL/SQL block
+string ParallelEventWriter::GetStagingCondition(StagingTable table, string eventCondition) const
+{
+	switch (table) {
+	case stCall:
+	case stGPRSCall:
+		return eventCondition;
+	case stBasicService:
+		return "EVENT_ID in (select EVENT_ID from " + m_stagingNames[stCall] + " where " +
+			GetStagingCondition(stCall, eventCondition) + ")";
+	case stChargeInfo:
+		// charge information refers to basic service of call or to GPRS call
+		return "EVENT_ID in (select SERVICE_ID from " + m_stagingNames[stBasicService] + " where " +
+			GetStagingCondition(stBasicService, eventCondition) + ") or EVENT_ID in (select EVENT_ID from " +
+			m_stagingNames[stGPRSCall] + " where " + GetStagingCondition(stGPRSCall, eventCondition) + ")";
+	default:
+		return "CHARGE_ID in (select CHARGE_ID from " + m_stagingNames[stChargeInfo] + " where " +
+			GetStagingCondition(stChargeInfo, eventCondition) + ")";
+	}
+}
+
+
+// RSN of call or GPRS call of the file referred by charge information
+string ParallelEventWriter::GetChargedEventRSN(string eventIDExpression) const
+{
+	return "coalesce((select c.RSN from " + m_stagingNames[stBasicService] + " s, " + m_stagingNames[stCall] + " c "
+		"where s.SERVICE_ID = " + eventIDExpression + " and c.EVENT_ID = s.EVENT_ID and c.FILE_ID = v_file_id), "
+		"(select g.RSN from " + m_stagingNames[stGPRSCall] + " g where g.EVENT_ID = " + eventIDExpression +
+		" and g.FILE_ID = v_file_id))";
+}
+
+
+// RSN of event of rejected row e, columns of error tables are of varchar2 type
+string ParallelEventWriter::GetRejectedRowRSN(StagingTable table) const
+{
+	switch (table) {
+	case stCall:
+	case stGPRSCall:
+		return "to_number(e.RSN)";
+	case stBasicService:
+		return "(select c.RSN from " + m_stagingNames[stCall] + " c where c.EVENT_ID = to_number(e.EVENT_ID) "
+			"and c.FILE_ID = v_file_id)";
+	case stChargeInfo:
+		return GetChargedEventRSN("to_number(e.EVENT_ID)");
+	default:
+		return GetChargedEventRSN("(select i.EVENT_ID from " + m_stagingNames[stChargeInfo] + " i "
+			"where i.CHARGE_ID = to_number(e.CHARGE_ID))");
+	}
+}
+
+
+// rejected rows are moved from error tables in separate session and committed, so they are kept if the load fails
+int ParallelEventWriter::CollectRejectedRows(long fileID, vector<long>& rejectedRSNs)
+{
+	rejectedRSNs.clear();
+	otl_connect otlConnect;
+	try {
+		otlConnect.rlogon(m_connectString.c_str());
+		string block = "declare v_file_id number := :file_id /*long,in*/; v_tag varchar2(20) := to_char(v_file_id); begin "
+			"delete from BILLING.TAP3_EVENT_ERROR where FILE_ID = v_file_id; ";
+		for (int i = 0; i < stagingTableCount; i++) {
+			string tableName = eventTables[i]->name;
+			string errorTable = DBTableSink::GetErrorTableName(m_stagingNames[i].c_str());
+			block += "insert into BILLING.TAP3_EVENT_ERROR (FILE_ID, RSN, TABLE_NAME, ERROR_TEXT) "
+				"select v_file_id, " + GetRejectedRowRSN((StagingTable) i) + ", '" + tableName.substr(tableName.find('.') + 1) +
+				"', substr(e.ORA_ERR_MESG$, 1, 2000) from " + errorTable + " e where e.ORA_ERR_TAG$ = v_tag; "
+				"delete from " + errorTable + " where ORA_ERR_TAG$ = v_tag; ";
+		}
+		block += "end;";
+		otl_nocommit_stream otlStream;
+		otlStream.open(1, block.c_str(), otlConnect);
+		otlStream << fileID;
+		otlStream.close();
+		otlConnect.commit();
+
+		otlStream.open(100, "select nvl(RSN, 0) :#1<long> from BILLING.TAP3_EVENT_ERROR where FILE_ID = :file_id /*long,in*/",
+			otlConnect);
+		otlStream << fileID;
+		while (!otlStream.eof()) {
+			long rsn;
+			otlStream >> rsn;
+			rejectedRSNs.push_back(rsn);
+		}
+		otlStream.close();
+		otlConnect.logoff();
+	}
+	catch (otl_exception& otlEx) {
+		log(LOG_ERROR, string("Ошибка чтения отклоненных строк событий: ") + (char*) otlEx.msg);
+		return TL_ORACLEERROR;
+	}
+	return TL_OK;
+}
+
+
+void ParallelEventWriter::Publish(otl_connect& otlConnect, long fileID)
+{
+	string block = "declare v_file_id number := :file_id /*long,in*/; begin ";
+	for (int i = 0; i < stagingTableCount; i++) {
+		string columns;
+		for (int col = 0; col < eventTables[i]->columnCount; col++)
+			columns += (col > 0 ? ", " : "") + string(eventTables[i]->columns[col].name);
+		block += "insert into " + string(eventTables[i]->name) + " (" + columns + ") select " + columns + " from " +
+			m_stagingNames[i] + " where " + GetStagingCondition((StagingTable) i, "FILE_ID = v_file_id") + "; ";
+	}
+	block += "end;";
+	otl_nocommit_stream otlStream;
+	otlStream.open(1, block.c_str(), otlConnect);
+	otlStream << fileID;
+	otlStream.close();
+}
+
+
+void ParallelEventWriter::Discard(long fileID)
+{
+	DeleteStagingRows(fileID, "FILE_ID = v_file_id");
+}
+
+
+bool ParallelEventWriter::DiscardRejectedEvents(long fileID)
+{
+	return DeleteStagingRows(fileID, "FILE_ID = v_file_id and RSN in (select RSN from BILLING.TAP3_EVENT_ERROR where FILE_ID = v_file_id)");
+}
+
+
+// rows are deleted by separate session and committed at once, so that they are deleted even if the load is rolled back
+bool ParallelEventWriter::DeleteStagingRows(long fileID, string eventCondition)
+{
+	otl_connect otlConnect;
+	try {
+		otlConnect.rlogon(m_connectString.c_str());
+		// rows are deleted before the rows they are selected by
+		string block = "declare v_file_id number := :file_id /*long,in*/; begin ";
+		for (int i = stagingTableCount - 1; i >= 0; i--)
+			block += "delete from " + m_stagingNames[i] + " where " + GetStagingCondition((StagingTable) i, eventCondition) + "; ";
+		block += "end;";
+		otl_nocommit_stream otlStream;
+		otlStream.open(1, block.c_str(), otlConnect);
+		otlStream << fileID;
+		otlStream.close();
+		otlConnect.commit();
+		otlConnect.logoff();
+	}
+	catch (otl_exception& otlEx) {
+		log(LOG_ERROR, string("Ошибка удаления промежуточных данных файла: ") + (char*) otlEx.msg);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "DBTableSink.h"
+
+// Class ParallelEventWriter loads call events of big transfer batch by several DB sessions. Events are partitioned
+// between writer sessions by hash of RSN, each session loads its events to staging copies of TAP3 event tables
+// (BILLING.STG_TAP3_CALL etc. with the same columns) by array inserts and commits them. Publish copies staging rows
+// of the file to event tables in session of the load, so they are committed or rolled back with the rest of the load
+// by Finalize. Staging rows of the file are deleted by Discard, both after Publish and after failed write.
+// Rows rejected by DB are logged by DML error logging to error tables of staging tables (BILLING.ERR$_STG_TAP3_CALL
+// etc., see DBTableSink) with file ID as tag, so that the rest of rows are written at full speed. CollectRejectedRows
+// moves them to BILLING.TAP3_EVENT_ERROR with RSNs of their events.
+class ParallelEventWriter
+{
+public:
+	ParallelEventWriter(string connectString, int writerCount);
+	// eventIDs receive IDs of written events by event index (0 for ignored events)
+	int WriteEvents(long fileID, const TransferBatch* transferBatch, vector<long long>& eventIDs);
+	// rejectedRSNs receive RSN of event of each rejected row (0 if event is not known)
+	int CollectRejectedRows(long fileID, vector<long>& rejectedRSNs);
+	void Publish(otl_connect& otlConnect, long fileID);
+	void Discard(long fileID);
+	// deletes staging rows of events having rejected rows, so that they are not published
+	bool DiscardRejectedEvents(long fileID);
+private:
+	enum StagingTable { stCall, stGPRSCall, stBasicService, stChargeInfo, stChargeDetail, stagingTableCount };
+	struct WriterSession
+	{
+		ParallelEventWriter* writer;
+		int partition;
+		int result;
+		string errorText;
+	};
+
+	string m_connectString;
+	int m_writerCount;
+	string m_stagingNames[stagingTableCount];
+	TableDefinition m_stagingTables[stagingTableCount];
+	long m_fileID;
+	const TransferBatch* m_transferBatch;
+	vector<long long>* m_eventIDs;
+	volatile LONG m_failed;
+
+	static unsigned __stdcall WriterThread(void* param);
+	int WritePartition(int partition, string& errorText);
+	int GetPartition(int rsn) const;
+	string GetStagingCondition(StagingTable table, string eventCondition) const;
+	string GetRejectedRowRSN(StagingTable table) const;
+	string GetChargedEventRSN(string eventIDExpression) const;
+	bool DeleteStagingRows(long fileID, string eventCondition);
+};
@@ -0,0 +1,138 @@
+#include <map>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "DataInterchange.h"
+#include "ReturnBatch.h"
+#include "ConfigContainer.h"
+#include "CallValidator.h"
+#include "TAPValidator.h"
+#include "PartnerCache.h"
+
+using namespace std;
+
+
+PartnerCache& PartnerCache::Instance()
+{
+	static PartnerCache* instance = new PartnerCache();
+	return *instance;
+}
+
+
+PartnerCache::PartnerCache() :
+	m_ttl(defaultTTL)
+{
+	InitializeCriticalSection(&m_critSection);
+}
+
+
+template<class K, class T> bool PartnerCache::Find(const map<K, CacheEntry<T> >& entries, const K& key, T& value)
+{
+	bool found = false;
+	EnterCriticalSection(&m_critSection);
+	typename map<K, CacheEntry<T> >::const_iterator it = entries.find(key);
+	if (it != entries.end() && time(NULL) - it->second.loadTime < m_ttl) {
+		value = it->second.value;
+		found = true;
+	}
+	LeaveCriticalSection(&m_critSection);
+	return found;
+}
+
+
+template<class K, class T> void PartnerCache::Store(map<K, CacheEntry<T> >& entries, const K& key, const T& value)
+{
+	CacheEntry<T> entry;
+	entry.value = value;
+	entry.loadTime = time(NULL);
+	EnterCriticalSection(&m_critSection);
+	entries[key] = entry;
+	LeaveCriticalSection(&m_critSection);
+}
+
+
+// DB queries are made outside of lock, concurrent misses of the same key query DB both
+long PartnerCache::GetSenderNetworkID(otl_connect& otlConnect, string sender)
+{
+	long mobileNetworkID;
+	if (Find(m_senderNetworks, sender, mobileNetworkID))
+		return mobileNetworkID;
+	otl_nocommit_stream otlStream;
+	otlStream.open(1, "call BILLING.TAP3.GetSenderNetworkID(:sender /*char[20],in*/) "
+		"into :res /*long,out*/", otlConnect);
+	otlStream << sender;
+	otlStream >> mobileNetworkID;
+	otlStream.close();
+	if (mobileNetworkID >= 0)
+		Store(m_senderNetworks, sender, mobileNetworkID);
+	return mobileNetworkID;
+}
+
+
+long PartnerCache::GetIOTValidationMode(otl_connect& otlConnect, long mobileNetworkID)
+{
+	long iotValidationMode;
+	if (Find(m_iotValidationModes, mobileNetworkID, iotValidationMode))
+		return iotValidationMode;
+	otl_nocommit_stream otlStream;
+	otlStream.open(1, "select nvl(iot_validation_mode_id, :iot_no_need/*int,in*/) from BILLING.TMobileNetwork "
+		"where object_no = :mobilenetworkid /*long,in*/", otlConnect);
+	otlStream
+		<< IOT_NO_NEED
+		<< mobileNetworkID;
+	otlStream >> iotValidationMode;
+	otlStream.close();
+	Store(m_iotValidationModes, mobileNetworkID, iotValidationMode);
+	return iotValidationMode;
+}
+
+
+string PartnerCache::GetIncomingTAPKey(long mobileNetworkID, long roamingHubID, string availableStamp)
+{
+	// roaming agreements are set by dates, so time of day is not a part of the key
+	return to_string((long long) mobileNetworkID) + "|" + to_string((long long) roamingHubID) + "|" +
+		availableStamp.substr(0, 8);
+}
+
+
+bool PartnerCache::FindPartnerInfo(long roamingHubID, string sender, string availableStamp, PartnerInfo& partnerInfo)
+{
+	return Find(m_ourTAPCodes, roamingHubID, partnerInfo.ourTAPCode) &&
+		Find(m_senderNetworks, sender, partnerInfo.mobileNetworkID) &&
+		Find(m_iotValidationModes, partnerInfo.mobileNetworkID, partnerInfo.iotValidationMode) &&
+		Find(m_incomingTAPAllowed, GetIncomingTAPKey(partnerInfo.mobileNetworkID, roamingHubID, availableStamp), 
+			partnerInfo.incomingTAPAllowed);
+}
+
+
+void PartnerCache::StorePartnerInfo(long roamingHubID, string sender, string availableStamp, const PartnerInfo& partnerInfo)
+{
+	if (!partnerInfo.ourTAPCode.empty())
+		Store(m_ourTAPCodes, roamingHubID, partnerInfo.ourTAPCode);
+	if (partnerInfo.mobileNetworkID < 0)
+		return;
+	Store(m_senderNetworks, sender, partnerInfo.mobileNetworkID);
+	Store(m_iotValidationModes, partnerInfo.mobileNetworkID, partnerInfo.iotValidationMode);
+	// refusals and failed checks are not kept, so that a permission granted meanwhile is seen by the next file
+	if (partnerInfo.incomingTAPAllowed == INCOMING_TAP_ALLOWED)
+		Store(m_incomingTAPAllowed, GetIncomingTAPKey(partnerInfo.mobileNetworkID, roamingHubID, availableStamp), 
+			partnerInfo.incomingTAPAllowed);
+}
+
+
+void PartnerCache::Invalidate()
+{
+	EnterCriticalSection(&m_critSection);
+	m_ourTAPCodes.clear();
+	m_senderNetworks.clear();
+	m_iotValidationModes.clear();
+	m_incomingTAPAllowed.clear();
+	LeaveCriticalSection(&m_critSection);
+}
+
+
+void PartnerCache::SetTTL(time_t ttl)
+{
+	EnterCriticalSection(&m_critSection);
+	m_ttl = ttl;
+	LeaveCriticalSection(&m_critSection);
+}
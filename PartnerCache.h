@@ -0,0 +1,50 @@
+#pragma once
+#include <map>
+
+// Partner metadata checked by admission of TAP file
+struct PartnerInfo
+{
+	string ourTAPCode;
+	long mobileNetworkID;
+	long iotValidationMode;
+	long incomingTAPAllowed;	// result of TAP3.IsIncomingTAPAllowed
+};
+
+// Class PartnerCache keeps partner metadata used by validation of TAP file headers (our TAP code of roaming hub,
+// sender network, its IOT validation mode and permission of incoming TAP files) between loads in one process,
+// so that a series of files from the same partners does not query DB for each file. Entries expire after TTL,
+// all of them are dropped by Invalidate when partner settings are changed. Negative and error results (unknown sender,
+// incoming TAP files not allowed or unable to determine) are not kept.
+class PartnerCache
+{
+public:
+	static PartnerCache& Instance();
+	// returns ID of sender network or negative value if sender is not found
+	long GetSenderNetworkID(otl_connect& otlConnect, string sender);
+	long GetIOTValidationMode(otl_connect& otlConnect, long mobileNetworkID);
+	// true if all of partner info is cached, permission of incoming TAP files is kept for a day of file available timestamp
+	bool FindPartnerInfo(long roamingHubID, string sender, string availableStamp, PartnerInfo& partnerInfo);
+	// partner info fetched by admission query, only its valid values are kept
+	void StorePartnerInfo(long roamingHubID, string sender, string availableStamp, const PartnerInfo& partnerInfo);
+	void Invalidate();
+	void SetTTL(time_t ttl);
+	static const time_t defaultTTL = 600;	// seconds
+private:
+	template<class T> struct CacheEntry {
+		T value;
+		time_t loadTime;
+	};
+
+	PartnerCache();
+
+	CRITICAL_SECTION m_critSection;
+	time_t m_ttl;
+	map<long, CacheEntry<string> > m_ourTAPCodes;				// by roaming hub ID
+	map<string, CacheEntry<long> > m_senderNetworks;			// by sender TAP code
+	map<long, CacheEntry<long> > m_iotValidationModes;			// by mobile network ID
+	map<string, CacheEntry<long> > m_incomingTAPAllowed;		// by network ID, roaming hub ID and day
+
+	template<class K, class T> bool Find(const map<K, CacheEntry<T> >& entries, const K& key, T& value);
+	template<class K, class T> void Store(map<K, CacheEntry<T> >& entries, const K& key, const T& value);
+	static string GetIncomingTAPKey(long mobileNetworkID, long roamingHubID, string availableStamp);
+};
@@ -0,0 +1,169 @@
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "DataInterchange.h"
+#include "ReturnBatch.h"
+#include "RAPErrorDetailWriter.h"
+
+using namespace std;
+
+extern void log(short msgType, string msgText, string dbConnectString = "");
+
+const int detailBufferSize = 500;
+const int contextBufferSize = 2000;
+
+
+AsnTagIndex::AsnTagIndex(asn_TYPE_descriptor_t* root)
+{
+	AddType(root);
+}
+
+
+void AsnTagIndex::AddType(asn_TYPE_descriptor_t* typeDescriptor)
+{
+	if (m_types.find(typeDescriptor) != m_types.end())
+		return;
+	TypeEntry& entry = m_types[typeDescriptor];
+	// fall through untagged structures
+	asn_TYPE_descriptor_t* resolvedType = typeDescriptor;
+	while (resolvedType->elements_count > 0 && resolvedType->elements[0].tag == (ber_tlv_tag_t)-1)
+		resolvedType = resolvedType->elements[0].type;
+	entry.resolvedType = resolvedType;
+	for (int n = 0; n < resolvedType->elements_count; n++) {
+		MemberTag memberTag = { resolvedType->elements[n].tag, &resolvedType->elements[n] };
+		entry.members.push_back(memberTag);
+	}
+	// the first of members with equal tags is found as by linear search
+	stable_sort(entry.members.begin(), entry.members.end());
+
+	for (int n = 0; n < resolvedType->elements_count; n++)
+		AddType(resolvedType->elements[n].type);
+}
+
+
+const asn_TYPE_member_t* AsnTagIndex::FindMember(const asn_TYPE_descriptor_t* typeDescriptor, ber_tlv_tag_t tag) const
+{
+	map<const asn_TYPE_descriptor_t*, TypeEntry>::const_iterator it = m_types.find(typeDescriptor);
+	if (it == m_types.end())
+		return NULL;
+	MemberTag key = { tag, NULL };
+	vector<MemberTag>::const_iterator member = lower_bound(it->second.members.begin(), it->second.members.end(), key);
+	if (member == it->second.members.end() || !BER_TAGS_EQUAL(member->tag, tag))
+		return NULL;
+	return member->member;
+}
+
+
+const char* AsnTagIndex::GetTypeName(const asn_TYPE_descriptor_t* typeDescriptor) const
+{
+	map<const asn_TYPE_descriptor_t*, TypeEntry>::const_iterator it = m_types.find(typeDescriptor);
+	return (it != m_types.end() ? it->second.resolvedType->name : typeDescriptor->name);
+}
+
+
+RAPErrorDetailWriter::RAPErrorDetailWriter(otl_connect& otlConnect) :
+	m_detailIDs(otlConnect, "Billing.TAP3EventID", detailBufferSize),
+	m_pendingDetails(0),
+	m_pendingContexts(0)
+{
+	m_detailStream.open(detailBufferSize,
+		"insert into BILLING.RAP_ERROR_DETAIL (DETAIL_ID, RETURN_ID, ERROR_CODE, ITEM_OFFSET ) "
+		"values (:detail_id /*bigint,in*/, :return_id /*long,in*/, :error_code/*long,in*/, :item_offset/*long,in*/)", otlConnect);
+	m_contextStream.open(contextBufferSize,
+		"insert into BILLING.RAP_ERROR_CONTEXT (DETAIL_ID, CONTEXT_SEQNUM, PATH_ITEM_ID, ITEM_LEVEL, ITEM_NAME, ITEM_OCCURENCE ) "
+		"values (:detail_id /*bigint,in*/, :ctx_seqnum /*long,in*/, :path_item /*long,in*/, :item_level/*long,in*/, "
+		":item_name/*char[100],in*/, :item_occur/*long,in*/)", otlConnect);
+}
+
+
+// Index is built on first use from DataInterChange descriptor, path item IDs of each detail start from it
+const AsnTagIndex& RAPErrorDetailWriter::GetTagIndex()
+{
+	static AsnTagIndex tagIndex(&asn_DEF_DataInterChange);
+	return tagIndex;
+}
+
+
+int RAPErrorDetailWriter::Write(const ErrorDetailList_t* errorDetailList, long returnID)
+{
+	const AsnTagIndex& tagIndex = GetTagIndex();
+	for (int detail = 0; detail < errorDetailList->list.count; detail++) {
+		const ErrorDetail* errorDetail = errorDetailList->list.array[detail];
+		int contextCount = (errorDetail->errorContext ? errorDetail->errorContext->list.count : 0);
+		// stream buffers must not get full in the middle of detail, otherwise its contexts could be sent before it
+		if (IsDetailFull(contextCount))
+			Flush();
+
+		long long detailID = m_detailIDs.NextID();
+		m_detailStream
+			<< detailID
+			<< returnID
+			<< errorDetail->errorCode;
+		if (errorDetail->itemOffset)
+			m_detailStream << *errorDetail->itemOffset;
+		else
+			m_detailStream << otl_null();
+		m_pendingDetails++;
+		if (contextCount >= contextBufferSize)
+			m_detailStream.flush();
+
+		// context data loading to DB
+		const asn_TYPE_descriptor_t* typeDescriptor = &asn_DEF_DataInterChange;
+		for (int context = 0; context < contextCount; context++) {
+			const ErrorContext* errorContext = errorDetail->errorContext->list.array[context];
+			// Parsing Path Item ID which means ASN tag of TAP file
+			ber_tlv_tag_t tlvTag = (errorContext->pathItemId << 2) | ASN_TAG_CLASS_APPLICATION;
+			const asn_TYPE_member_t* member = tagIndex.FindMember(typeDescriptor, tlvTag);
+			if (!member) {
+				log(LOG_ERROR, "Ошибка разбора Path Item IDs в error context #" + to_string((long long)context + 1) +
+					" для detail #" + to_string((long long)detail + 1));
+				log(LOG_ERROR, "ASN-тэг " + to_string((long long) errorContext->pathItemId)
+					+ " не найден в ASN типе " + tagIndex.GetTypeName(typeDescriptor));
+				return TL_DECODEERROR;
+			}
+			typeDescriptor = member->type;
+
+			m_contextStream
+				<< detailID
+				<< (long)context + 1
+				<< errorContext->pathItemId
+				<< errorContext->itemLevel
+				<< typeDescriptor->name;
+			if (errorContext->itemOccurrence)
+				m_contextStream << *errorContext->itemOccurrence;
+			else
+				m_contextStream << otl_null();
+			m_pendingContexts = (m_pendingContexts + 1) % contextBufferSize;
+		}
+	}
+	return TL_OK;
+}
+
+
+void RAPErrorDetailWriter::Flush()
+{
+	m_detailStream.flush();
+	m_contextStream.flush();
+	m_pendingDetails = 0;
+	m_pendingContexts = 0;
+}
+
+
+bool RAPErrorDetailWriter::IsDetailFull(int contextCount) const
+{
+	return m_pendingDetails + 1 >= detailBufferSize || m_pendingContexts + contextCount >= contextBufferSize;
+}
+
+
+bool RAPErrorDetailWriter::IsFull(const ErrorDetailList_t* errorDetailList) const
+{
+	int contextCount = 0;
+	for (int detail = 0; detail < errorDetailList->list.count; detail++) {
+		const ErrorDetail* errorDetail = errorDetailList->list.array[detail];
+		contextCount += (errorDetail->errorContext ? errorDetail->errorContext->list.count : 0);
+	}
+	return m_pendingDetails + errorDetailList->list.count >= detailBufferSize ||
+		m_pendingContexts + contextCount >= contextBufferSize;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <map>
+#include "SequenceIDPool.h"
+
+// Class AsnTagIndex maps ASN tags to members of asn1c type descriptors reachable from root type. It's built once
+// and replaces linear search in elements of descriptors when path item IDs of RAP error context are resolved.
+class AsnTagIndex
+{
+public:
+	explicit AsnTagIndex(asn_TYPE_descriptor_t* root);
+	// returns member of type with given tag or NULL, untagged wrapper types (elements[0].tag == -1) are skipped
+	const asn_TYPE_member_t* FindMember(const asn_TYPE_descriptor_t* typeDescriptor, ber_tlv_tag_t tag) const;
+	const char* GetTypeName(const asn_TYPE_descriptor_t* typeDescriptor) const;
+private:
+	struct MemberTag {
+		ber_tlv_tag_t tag;
+		const asn_TYPE_member_t* member;
+		bool operator<(const MemberTag& other) const { return tag < other.tag; }
+	};
+	struct TypeEntry {
+		const asn_TYPE_descriptor_t* resolvedType;
+		vector<MemberTag> members;		// sorted by tag
+	};
+	map<const asn_TYPE_descriptor_t*, TypeEntry> m_types;
+
+	void AddType(asn_TYPE_descriptor_t* typeDescriptor);
+};
+
+
+// Class RAPErrorDetailWriter loads error details and their contexts of RAP file to RAP_ERROR_DETAIL and
+// RAP_ERROR_CONTEXT tables by array inserts. Detail IDs are reserved from DB sequence by blocks. Rows are sent
+// to DB when buffers are full and by Flush, details are always sent before their contexts.
+class RAPErrorDetailWriter
+{
+public:
+	RAPErrorDetailWriter(otl_connect& otlConnect);
+	int Write(const ErrorDetailList_t* errorDetailList, long returnID);
+	void Flush();
+	// true if Write of given list would send buffered rows to DB (callers flush parent rows before it)
+	bool IsFull(const ErrorDetailList_t* errorDetailList) const;
+private:
+	SequenceIDPool m_detailIDs;
+	otl_nocommit_stream m_detailStream;
+	otl_nocommit_stream m_contextStream;
+	int m_pendingDetails;
+	int m_pendingContexts;
+
+	bool IsDetailFull(int contextCount) const;
+	static const AsnTagIndex& GetTagIndex();
+};
@@ -4,6 +4,7 @@
 #include "DataInterchange.h"
 #include "ReturnBatch.h"
 #include "RAPFile.h"
+#include "RAPUploadQueue.h"
 
 using namespace std;
 
@@ -12,10 +13,9 @@ using namespace std;
 extern void log(string filename, short msgType, string msgText, string dbConnectString = "");
 extern void log(short msgType, string msgText, string dbConnectString = "");
 extern long long OctetStr2Int64(const OCTET_STRING_t& octetStr);
+extern bool bVerifyRAPEvents;
 extern int LoadReturnBatchToDB(ReturnBatch* returnBatch, long fileID, long roamingHubID, string rapFilename, 
-	long fileStatus, otl_connect& otlConnect);
-extern int write_out(const void *buffer, size_t size, void *app_key);
-extern "C" int ncftp_main(int argc, char **argv, char* result);
+	long fileStatus, otl_connect& otlConnect, const CallEventDetail* const* returnedEvents, string contentHash);
 
 
 RAPFile::RAPFile(otl_connect& otlConnect, Config& config, long roamingHubID) :
@@ -86,9 +86,9 @@ bool RAPFile::Initialize(string tapSender, string tapRecipient, string tapAvaila
 		>> m_fileID;
 	
 	if (m_fileID < 0) {
-		throw RAPFileException(" TAP3.CreateRAPFileByTAPLoader   " + to_string((long long)m_fileID) +
-			". , -      ,      "
-			"( \"   \").    .");
+		throw RAPFileException("Функция TAP3.CreateRAPFileByTAPLoader вернула ошибку " + to_string((long long)m_fileID) +
+			". Возможно, ТАР-файл был получен от одного роумингового координатора, а сеть приписана к другому "
+			"(справочник \"Привязка к роуминговому координатору\"). Файл не был загружен.");
 	}
 	m_returnBatch = (ReturnBatch*) calloc(1, sizeof(ReturnBatch));
 	// sender and recipient switch their places
@@ -127,11 +127,25 @@ bool RAPFile::Initialize(string tapSender, string tapRecipient, string tapAvaila
 void RAPFile::AddReturnDetail(ReturnDetail* returnDetail, long long callTotalCharge)
 {
 	ASN_SEQUENCE_ADD(&m_returnBatch->returnDetails, returnDetail);
+	m_returnedEvents.push_back(NULL);
+	BerSpan noSpan = { NULL, 0 };
+	m_returnedEventSpans.push_back(noSpan);
 	m_totalSevereReturn += callTotalCharge;
 	m_returnDetailsCount++;
 }
 
 
+void RAPFile::AddSevereReturn(ReturnDetail* returnDetail, const CallEventDetail* callEventDetail, const BerSpan* eventSpan,
+	long long callTotalCharge)
+{
+	assert(returnDetail->present == ReturnDetail_PR_severeReturn);
+	AddReturnDetail(returnDetail, callTotalCharge);
+	m_returnedEvents.back() = callEventDetail;
+	if (eventSpan)
+		m_returnedEventSpans.back() = *eventSpan;
+}
+
+
 void RAPFile::Finalize()
 {
 	OctetString_fromInt64(m_returnBatch->rapAuditControlInfo.totalSevereReturnValue, m_totalSevereReturn);
@@ -139,36 +153,155 @@ void RAPFile::Finalize()
 }
 
 
-bool RAPFile::UploadFileToFtp(string filename, string fullFileName, FtpSetting ftpSetting)
+int RAPFile::LoadToDB()
+{
+	OctetString_fromInt64(m_returnBatch->rapAuditControlInfo.totalSevereReturnValue, m_totalSevereReturn);
+	m_returnBatch->rapAuditControlInfo.returnDetailsCount = m_returnDetailsCount;
+	return LoadReturnBatchToDB(m_returnBatch, m_fileID, m_roamingHubID, m_filename, OUTFILE_CREATED_AND_SENT, m_otlConnect,
+		m_returnedEvents.empty() ? NULL : &m_returnedEvents[0], "");
+}
+
+
+int RAPFile::AppendToBuffer(const void* data, size_t size, void* buffer)
+{
+	vector<unsigned char>* pBuffer = (vector<unsigned char>*) buffer;
+	pBuffer->insert(pBuffer->end(), (const unsigned char*) data, (const unsigned char*) data + size);
+	return 0;
+}
+
+
+// Encodes structure by DER, or only calculates its encoded size if consume is NULL
+ssize_t RAPFile::EncodeMember(asn_TYPE_descriptor_t* typeDescriptor, const void* structure, 
+	asn_app_consume_bytes_f* consume, void* key)
 {
-	try {
-		if (ftpSetting.ftpPort.length() == 0)
-			ftpSetting.ftpPort = "21";	// use default ftp port
-		int ncftp_argc = 11;
-		const char* pszArguments[] = { "ncftpput", "-u", ftpSetting.ftpUsername.c_str(), "-p", 
-			ftpSetting.ftpPassword.c_str(), "-P", ftpSetting.ftpPort.c_str(), ftpSetting.ftpServer.c_str(), 
-			ftpSetting.ftpDirectory.c_str(), fullFileName.c_str(), NULL };
-		char szFtpResult[4096];
-		int ftpResult = ncftp_main(ncftp_argc, (char**) pszArguments, szFtpResult);
-		if (ftpResult != 0) {
-			throw RAPFileException(string("    ") + filename + "  FTP-" +
-				ftpSetting.ftpServer + ":\n" + szFtpResult);
+	asn_enc_rval_t encodeRes = der_encode(typeDescriptor, (void*) structure, consume, key);
+	if (encodeRes.encoded == -1) {
+		throw RAPFileException(string("Ошибка во время ASN-декодирования файла. Код ошибки: ") + 
+			string(encodeRes.failed_type ? encodeRes.failed_type->name : "<неизвестный код>"));
+	}
+	return encodeRes.encoded;
+}
+
+
+// Writes tags and length of constructed type and returns their size
+ssize_t RAPFile::EncodeTags(asn_TYPE_descriptor_t* typeDescriptor, ssize_t contentLength, 
+	asn_app_consume_bytes_f* consume, void* key)
+{
+	ssize_t tagsLength = der_write_tags(typeDescriptor, contentLength, 0, 1, 0, consume, key);
+	if (tagsLength == -1) {
+		throw RAPFileException(string("Ошибка во время ASN-декодирования файла. Код ошибки: ") + typeDescriptor->name);
+	}
+	return tagsLength;
+}
+
+
+// Severe return is encoded by parts: returned call event is copied from TAP file buffer if its span is known,
+// otherwise it's encoded from the original TAP structure which is referenced by RAPFile and not copied to SevereReturn
+ssize_t RAPFile::EncodeSevereReturnContent(int index, asn_app_consume_bytes_f* consume, void* key)
+{
+	const SevereReturn& severeReturn = m_returnBatch->returnDetails.list.array[index]->choice.severeReturn;
+	ssize_t length = EncodeMember(&asn_DEF_FileSequenceNumber, &severeReturn.fileSequenceNumber, consume, key);
+	const BerSpan& eventSpan = m_returnedEventSpans[index];
+	if (eventSpan.data) {
+		if (consume && consume(eventSpan.data, eventSpan.size, key) < 0)
+			throw RAPFileException("Ошибка записи события в RAP-файл");
+		length += eventSpan.size;
+	}
+	else
+		length += EncodeMember(&asn_DEF_CallEventDetail, m_returnedEvents[index], consume, key);
+	length += EncodeMember(&asn_DEF_ErrorDetailList, &severeReturn.errorDetail, consume, key);
+	if (severeReturn.operatorSpecList)
+		length += EncodeMember(&asn_DEF_OperatorSpecList, severeReturn.operatorSpecList, consume, key);
+	return length;
+}
+
+
+ssize_t RAPFile::EncodeReturnDetailsContent(asn_app_consume_bytes_f* consume, void* key)
+{
+	ssize_t length = 0;
+	for (int i = 0; i < m_returnBatch->returnDetails.list.count; i++) {
+		if (m_returnedEvents[i]) {
+			ssize_t contentLength = EncodeSevereReturnContent(i, NULL, NULL);
+			length += EncodeTags(&asn_DEF_SevereReturn, contentLength, consume, key) + contentLength;
+			if (consume)
+				EncodeSevereReturnContent(i, consume, key);
 		}
-		log(filename, LOG_INFO, "    FTP- " + ftpSetting.ftpServer);
-		return true;
+		else
+			length += EncodeMember(&asn_DEF_ReturnDetail, m_returnBatch->returnDetails.list.array[i], consume, key);
 	}
-	catch (...) {
-		throw RAPFileException("    " + filename + "  FTP- " 
-			+ ftpSetting.ftpServer + ".   .");
+	return length;
+}
+
+
+ssize_t RAPFile::EncodeReturnBatchContent(asn_app_consume_bytes_f* consume, void* key)
+{
+	ssize_t length = EncodeMember(&asn_DEF_RapBatchControlInfo, &m_returnBatch->rapBatchControlInfoRap, consume, key);
+	ssize_t detailsLength = EncodeReturnDetailsContent(NULL, NULL);
+	length += EncodeTags(&asn_DEF_ReturnDetailList, detailsLength, consume, key) + detailsLength;
+	if (consume)
+		EncodeReturnDetailsContent(consume, key);
+	length += EncodeMember(&asn_DEF_RapAuditControlInfo, &m_returnBatch->rapAuditControlInfo, consume, key);
+	return length;
+}
+
+
+// Encodes return batch to memory buffer of exact size found by dry run of encoder
+void RAPFile::EncodeToBuffer(vector<unsigned char>& buffer)
+{
+	ssize_t contentLength = EncodeReturnBatchContent(NULL, NULL);
+	buffer.clear();
+	buffer.reserve(EncodeTags(&asn_DEF_ReturnBatch, contentLength, NULL, NULL) + contentLength);
+	EncodeTags(&asn_DEF_ReturnBatch, contentLength, AppendToBuffer, &buffer);
+	EncodeReturnBatchContent(AppendToBuffer, &buffer);
+	if (bVerifyRAPEvents) {
+		int mismatches = VerifyEventSpans();
+		if (mismatches > 0)
+			log(m_filename, LOG_ERROR, "Событий, отличающихся от повторного кодирования: " + to_string((long long) mismatches));
+		else
+			log(m_filename, LOG_INFO, "Возвращаемые события совпадают с повторным кодированием");
 	}
 }
 
 
-int RAPFile::LoadToDB()
+// Verification mode (-v switch): compares events copied from TAP file with their DER encoding by the loader.
+// Differences are expected for files encoded by BER in non-canonical form, RAP file keeps the original bytes.
+int RAPFile::VerifyEventSpans()
 {
-	OctetString_fromInt64(m_returnBatch->rapAuditControlInfo.totalSevereReturnValue, m_totalSevereReturn);
-	m_returnBatch->rapAuditControlInfo.returnDetailsCount = m_returnDetailsCount;
-	return LoadReturnBatchToDB(m_returnBatch, m_fileID, m_roamingHubID, m_filename, OUTFILE_CREATED_AND_SENT, m_otlConnect);
+	int mismatches = 0;
+	vector<unsigned char> encodedEvent;
+	for (size_t i = 0; i < m_returnedEventSpans.size(); i++) {
+		const BerSpan& eventSpan = m_returnedEventSpans[i];
+		if (!eventSpan.data)
+			continue;
+		encodedEvent.clear();
+		EncodeMember(&asn_DEF_CallEventDetail, m_returnedEvents[i], AppendToBuffer, &encodedEvent);
+		if (encodedEvent.size() != eventSpan.size || memcmp(&encodedEvent[0], eventSpan.data, eventSpan.size)) {
+			log(m_filename, LOG_ERROR, "Возвращаемое событие " + to_string((unsigned long long) i + 1) + 
+				" отличается от повторного кодирования: " + to_string((unsigned long long) eventSpan.size) + " байт в TAP-файле, " +
+				to_string((unsigned long long) encodedEvent.size()) + " байт после кодирования");
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+
+// Writes file by one call to temporary file and renames it, so that the uploader never sees partially written file
+void RAPFile::WriteFileAtomically(string fullFileName, const vector<unsigned char>& buffer)
+{
+	string tempFileName = fullFileName + ".tmp";
+	HANDLE hFile = CreateFile(tempFileName.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		throw RAPFileException(string("Невозможно открыть файл ") + tempFileName + " для записи");
+	}
+	DWORD written = 0;
+	bool success = WriteFile(hFile, &buffer[0], (DWORD) buffer.size(), &written, NULL) && written == buffer.size()
+		&& FlushFileBuffers(hFile);
+	CloseHandle(hFile);
+	if (!success || !MoveFileEx(tempFileName.c_str(), fullFileName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		DeleteFile(tempFileName.c_str());
+		throw RAPFileException(string("Ошибка записи файла ") + fullFileName);
+	}
 }
 
 
@@ -181,32 +314,27 @@ int RAPFile::EncodeAndUpload()
 	fullFileName = (m_config.GetOutputDirectory().empty() ? "." : m_config.GetOutputDirectory()) + "/" + m_filename;
 #endif
 
-	FILE *fTapFile = fopen(fullFileName.c_str(), "wb");
-	if (!fTapFile) {
-		throw RAPFileException(string("   ") + fullFileName + "  ");
-	}
-	asn_enc_rval_t encodeRes = der_encode(&asn_DEF_ReturnBatch, m_returnBatch, write_out, fTapFile);
-
-	fclose(fTapFile);
-
-	if (encodeRes.encoded == -1) {
-		throw RAPFileException(string("   ASN- .  : ") + 
-			string(encodeRes.failed_type ? encodeRes.failed_type->name : "< >"));
-	}
+	vector<unsigned char> buffer;
+	EncodeToBuffer(buffer);
+	WriteFileAtomically(fullFileName, buffer);
 
-	log(m_filename, LOG_INFO, "RAP-    " + m_roamingHubName + 
-		"  ");
+	log(m_filename, LOG_INFO, "RAP-файл для роумингового координатора " + m_roamingHubName + 
+		" успешно сформирован");
 
-	// Upload file to FTP-server
+	// Upload to FTP-server is done by background queue after load is committed
 	FtpSetting ftpSetting = m_config.GetFTPSetting(m_roamingHubName);
 	if (!ftpSetting.ftpServer.empty()) {
-		if (!UploadFileToFtp(m_filename, fullFileName, ftpSetting)) {
-			return TL_FILEERROR;
-		}
+		RAPUploadQueue::Instance().Start(m_config);
+		RAPUploadQueue::Instance().Enqueue(m_filename, fullFileName, m_roamingHubName, m_fileID);
+		otl_nocommit_stream otlStream;
+		otlStream.open(1, "update BILLING.RAP_FILE set UPLOAD_STATUS = :status /*long,in*/, UPLOAD_ATTEMPTS = 0 "
+			"where FILE_ID = :fileid /*long,in*/", m_otlConnect);
+		otlStream << (long) usQueued << m_fileID;
+		log(m_filename, LOG_INFO, "Файл поставлен в очередь загрузки на FTP-сервер " + ftpSetting.ftpServer);
 	}
 	else
-		log(m_filename, LOG_INFO, "   " + m_roamingHubName + 
-		"     FTP-.   ,   .");
+		log(m_filename, LOG_INFO, "Для роумингового координатора " + m_roamingHubName + 
+		" в настройках не указан FTP-сервер. Файл сформирован локально, загрузки не производилось.");
 
 	return TL_OK;
 }
@@ -250,7 +378,14 @@ int RAPFile::OctetString_fromInt64(OCTET_STRING& octetStr, long long value)
 		buf[--i] = 0;
 	}
 
-	OCTET_STRING_fromBuf(&octetStr, (const char*) ( buf + i ), 8 - i);
+	// buffer of previous value is reused if it's big enough
+	if (octetStr.buf && octetStr.size >= 8 - i) {
+		memcpy(octetStr.buf, buf + i, 8 - i);
+		octetStr.size = 8 - i;
+		octetStr.buf[octetStr.size] = 0;
+	}
+	else
+		OCTET_STRING_fromBuf(&octetStr, (const char*) ( buf + i ), 8 - i);
 
 	return 8 - i;
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include "BerSpan.h"
 
 class RAPFile
 {
@@ -7,6 +8,11 @@ public:
 	bool Initialize(const TransferBatch*);
 	bool Initialize(const Notification*);
 	void AddReturnDetail(ReturnDetail* returnDetail, long long callTotalCharge);
+	// Adds severe return of call event. The event and its span in TAP file buffer (if not NULL) are referenced,
+	// not copied: they must stay valid until the file is loaded to DB and encoded. The span is written to RAP file
+	// as is. SevereReturn.callEventDetail of returnDetail is left empty.
+	void AddSevereReturn(ReturnDetail* returnDetail, const CallEventDetail* callEventDetail, const BerSpan* eventSpan,
+		long long callTotalCharge);
 	void Finalize();
 	int LoadToDB();
 	int EncodeAndUpload();
@@ -14,7 +20,10 @@ public:
 	std::string GetName() const;
 	long GetID() const;
 	std::string GetSequenceNumber() const;
+	static int OctetString_fromInt64(OCTET_STRING& octetStr, long long value);
 private:
+	friend class RAPFileTest;	// unit tests encode return batch made without DB
+
 	otl_connect& m_otlConnect;
 	Config& m_config;
 	long m_roamingHubID;
@@ -26,10 +35,21 @@ private:
 	ReturnBatch* m_returnBatch;
 	long long m_totalSevereReturn;
 	int m_returnDetailsCount;
+	vector<const CallEventDetail*> m_returnedEvents;	// by index of return detail, NULL for other than severe returns
+	vector<BerSpan> m_returnedEventSpans;				// by index of return detail, empty if not known
 	
 	bool Initialize(string tapSender, string tapRecipient, string tapAvailableStamp, string fileTypeIndicator);
-	int OctetString_fromInt64(OCTET_STRING& octetStr, long long value);
-	bool UploadFileToFtp(string filename, string fullFileName, FtpSetting ftpSetting);	
+	static int AppendToBuffer(const void* data, size_t size, void* buffer);
+	static ssize_t EncodeMember(asn_TYPE_descriptor_t* typeDescriptor, const void* structure, 
+		asn_app_consume_bytes_f* consume, void* key);
+	static ssize_t EncodeTags(asn_TYPE_descriptor_t* typeDescriptor, ssize_t contentLength, 
+		asn_app_consume_bytes_f* consume, void* key);
+	ssize_t EncodeSevereReturnContent(int index, asn_app_consume_bytes_f* consume, void* key);
+	ssize_t EncodeReturnDetailsContent(asn_app_consume_bytes_f* consume, void* key);
+	ssize_t EncodeReturnBatchContent(asn_app_consume_bytes_f* consume, void* key);
+	void EncodeToBuffer(vector<unsigned char>& buffer);
+	int VerifyEventSpans();
+	void WriteFileAtomically(string fullFileName, const vector<unsigned char>& buffer);
 };
 
 class RAPFileException : public std::runtime_error
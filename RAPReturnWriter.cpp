@@ -0,0 +1,224 @@
+#include <vector>
+#include <map>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "DataInterchange.h"
+#include "ReturnBatch.h"
+#include "RAPReturnWriter.h"
+
+using namespace std;
+
+extern void log(short msgType, string msgText, string dbConnectString = "");
+
+const int idBlockSize = 1000;
+const int eventBufferSize = 1000;
+const int returnBufferSize = 1000;
+// max rows of a table expected for one call event (basic services, charge information and details)
+const int eventRowReserve = 100;
+
+
+RAPReturnWriter::RAPReturnWriter(otl_connect& otlConnect, long fileID, int tapDecimalPlaces) :
+	m_fileID(fileID),
+	m_eventIDs(otlConnect, "BILLING.Origin_Seq", idBlockSize),
+	m_detailIDs(otlConnect, "BILLING.TAP3EVENTID", idBlockSize),
+	m_callSink(otlConnect, tap3CallTable, eventBufferSize),
+	m_gprsCallSink(otlConnect, tap3GPRSCallTable, eventBufferSize),
+	m_basicServiceSink(otlConnect, tap3BasicServiceTable, eventBufferSize),
+	m_chargeInfoSink(otlConnect, tap3ChargeInfoTable, eventBufferSize, "", tapDecimalPlaces),
+	m_chargeDetailSink(otlConnect, tap3ChargeDetailTable, eventBufferSize, "", tapDecimalPlaces),
+	m_eventRowWriter(otlConnect, m_callSink, m_gprsCallSink, m_basicServiceSink, m_chargeInfoSink, m_chargeDetailSink, m_detailIDs,
+		tapDecimalPlaces),
+	m_pendingReturns(0),
+	m_errorDetailWriter(otlConnect)
+{
+	m_stopOrMissingStream.open(returnBufferSize,
+		"insert into BILLING.RAP_STOP_OR_MISSING (FILE_ID, STOP_LAST_SEQ_NUM, MISS_START_SEQ_NUM, MISS_END_SEQ_NUM, OPERATOR_SPEC_INFO) "
+		"values (:hfileid /*long,in*/, :stop_last_seqnum/*char[10],in*/, :miss_start/*char[10],in*/, :miss_end/*char[10],in*/, "
+		":oper_spec_info /*char[1024],in*/)", otlConnect);
+	m_fatalReturnStream.open(returnBufferSize,
+		"insert into BILLING.RAP_FATAL_RETURN (RETURN_ID, FILE_ID, FILE_SEQUENCE_NUMBER, ERROR_TYPE, OPERATOR_SPEC_INFO) "
+		"values (:hreturnid /*bigint,in*/, :hfileid /*long,in*/, :fileseqnum /*char[20],in*/, "
+		":error_type /*char[50],in*/, :oper_spec_info /*char[1024],in*/)", otlConnect);
+	m_severeReturnStream.open(returnBufferSize,
+		"insert into BILLING.RAP_SEVERE_RETURN (RETURN_ID, FILE_ID, FILE_SEQUENCE_NUMBER, EVENT_ID, OPERATOR_SPEC_INFO) "
+		"values (:hreturnid /*bigint,in*/, :hfileid /*long,in*/, :fileseqnum /*char[20],in*/, :event_id /*bigint,in*/, "
+		":oper_spec_info /*char[1024],in*/)", otlConnect);
+}
+
+
+int RAPReturnWriter::Write(const ReturnDetail* returnDetail, const CallEventDetail* returnedEvent)
+{
+	switch (returnDetail->present) {
+	case ReturnDetail_PR_stopReturn:
+		return WriteStopOrMissing((char*) returnDetail->choice.stopReturn.lastSeqNumber.buf, "", "",
+			returnDetail->choice.stopReturn.operatorSpecList);
+	case ReturnDetail_PR_missingReturn:
+		return WriteStopOrMissing("", (char*) returnDetail->choice.missingReturn.startMissingSeqNumber.buf,
+			returnDetail->choice.missingReturn.endMissingSeqNumber ? (char*) returnDetail->choice.missingReturn.endMissingSeqNumber->buf : "",
+			returnDetail->choice.missingReturn.operatorSpecList);
+	case ReturnDetail_PR_fatalReturn:
+		return WriteFatalReturn(returnDetail->choice.fatalReturn);
+	case ReturnDetail_PR_severeReturn:
+		return WriteSevereReturn(returnDetail->choice.severeReturn,
+			(returnedEvent ? *returnedEvent : returnDetail->choice.severeReturn.callEventDetail));
+	default:
+		log(LOG_ERROR, "Неизвестная структура Return Detail: " + to_string(static_cast<unsigned long long> (returnDetail->present)));
+		return TL_DECODEERROR;
+	}
+}
+
+
+string RAPReturnWriter::GetOperSpecInfo(const OperatorSpecList* operSpecList)
+{
+	string operSpecInfo;
+	if (operSpecList) {
+		// concatenate operator specific info before loading
+		for (int i = 0; i < operSpecList->list.count; i++) {
+			if (operSpecInfo.length() > 0)
+				operSpecInfo += "\r\n";
+			operSpecInfo += (char*) operSpecList->list.array[i]->buf;
+		}
+		if (operSpecInfo.length() > 1024)
+			operSpecInfo = operSpecInfo.substr(0, 1024);
+	}
+	return operSpecInfo;
+}
+
+
+int RAPReturnWriter::WriteStopOrMissing(string stopLastSeqNum, string missStartSeqNum, string missEndSeqNum,
+	const OperatorSpecList* operSpecList)
+{
+	// rows are not referenced, so stream may send them any time
+	m_stopOrMissingStream
+		<< m_fileID
+		<< stopLastSeqNum
+		<< missStartSeqNum
+		<< missEndSeqNum
+		<< GetOperSpecInfo(operSpecList);
+	return TL_OK;
+}
+
+
+int RAPReturnWriter::WriteFatalReturn(const FatalReturn& fatalReturn)
+{
+	string errorType;
+	const ErrorDetailList_t* pErrDetailList;
+	if (fatalReturn.accountingInfoError) {
+		errorType = "Accounting Info";
+		pErrDetailList = &fatalReturn.accountingInfoError->errorDetail;
+	}
+	else if (fatalReturn.auditControlInfoError) {
+		errorType = "Audit Control Info";
+		pErrDetailList = &fatalReturn.auditControlInfoError->errorDetail;
+	}
+	else if (fatalReturn.batchControlError) {
+		errorType = "Batch Control Info";
+		pErrDetailList = &fatalReturn.batchControlError->errorDetail;
+	}
+	else if (fatalReturn.messageDescriptionError) {
+		errorType = "Message Description";
+		pErrDetailList = &fatalReturn.messageDescriptionError->errorDetail;
+	}
+	else if (fatalReturn.networkInfoError) {
+		errorType = "Network Info";
+		pErrDetailList = &fatalReturn.networkInfoError->errorDetail;
+	}
+	else if (fatalReturn.notificationError) {
+		errorType = "Notification";
+		pErrDetailList = &fatalReturn.notificationError->errorDetail;
+	}
+	else if (fatalReturn.transferBatchError) {
+		errorType = "Tranfer Batch";
+		pErrDetailList = &fatalReturn.transferBatchError->errorDetail;
+	}
+	else {
+		log(LOG_ERROR, "Fatal Return не содержит описания ошибки");
+		return TL_DECODEERROR;
+	}
+
+	FlushIfFull(pErrDetailList);
+	long long returnID = m_detailIDs.NextID();
+	m_fatalReturnStream
+		<< returnID
+		<< m_fileID
+		<< fatalReturn.fileSequenceNumber.buf
+		<< errorType
+		<< GetOperSpecInfo(fatalReturn.operatorSpecList);
+	m_pendingReturns++;
+
+	return m_errorDetailWriter.Write(pErrDetailList, (long) returnID);
+}
+
+
+int RAPReturnWriter::WriteSevereReturn(const SevereReturn& severeReturn, const CallEventDetail& callEventDetail)
+{
+	// call events of severe returns are loaded with RSN 0
+	const int index = 0;
+
+	FlushIfFull(&severeReturn.errorDetail);
+	long long eventID = 0;
+	long writeRes = TL_OK;
+	switch (callEventDetail.present) {
+		case CallEventDetail_PR_mobileOriginatedCall:
+			eventID = m_eventIDs.NextID();
+			writeRes = m_eventRowWriter.WriteOriginatedCall(eventID, m_fileID, index, &callEventDetail.choice.mobileOriginatedCall);
+			break;
+		case CallEventDetail_PR_mobileTerminatedCall:
+			eventID = m_eventIDs.NextID();
+			writeRes = m_eventRowWriter.WriteTerminatedCall(eventID, m_fileID, index, &callEventDetail.choice.mobileTerminatedCall);
+			break;
+		case CallEventDetail_PR_supplServiceEvent:
+			// at this time we just ignore it
+			break;
+		case CallEventDetail_PR_gprsCall:
+			eventID = m_eventIDs.NextID();
+			writeRes = m_eventRowWriter.WriteGPRSCall(eventID, m_fileID, index, &callEventDetail.choice.gprsCall);
+			break;
+		default:
+			log(LOG_ERROR, string("Не найден обработчик для ") + to_string(static_cast<unsigned long long> (callEventDetail.present)) +
+				string(". Severe Return файла ") + (const char*) severeReturn.fileSequenceNumber.buf);
+			return TL_NEWCOMPONENT;
+	}
+	if (writeRes != TL_OK)
+		return writeRes;
+
+	long long returnID = m_detailIDs.NextID();
+	m_severeReturnStream
+		<< returnID
+		<< m_fileID
+		<< severeReturn.fileSequenceNumber.buf;
+	if (eventID > 0)
+		m_severeReturnStream << eventID;
+	else
+		m_severeReturnStream << otl_null();
+	m_severeReturnStream << GetOperSpecInfo(severeReturn.operatorSpecList);
+	m_pendingReturns++;
+
+	return m_errorDetailWriter.Write(&severeReturn.errorDetail, (long) returnID);
+}
+
+
+// Rows of return and its event must not be sent by streams themselves before rows they refer to,
+// so all streams are flushed in proper order when any of them could get full.
+void RAPReturnWriter::FlushIfFull(const ErrorDetailList_t* errorDetailList)
+{
+	if (m_callSink.IsFull(1) || m_gprsCallSink.IsFull(1) || m_basicServiceSink.IsFull(eventRowReserve) ||
+			m_chargeInfoSink.IsFull(eventRowReserve) || m_chargeDetailSink.IsFull(eventRowReserve) ||
+			m_pendingReturns + 1 >= returnBufferSize || m_errorDetailWriter.IsFull(errorDetailList))
+		Flush();
+}
+
+
+void RAPReturnWriter::Flush()
+{
+	m_callSink.Flush();
+	m_gprsCallSink.Flush();
+	m_basicServiceSink.Flush();
+	m_chargeInfoSink.Flush();
+	m_chargeDetailSink.Flush();
+	m_stopOrMissingStream.flush();
+	m_fatalReturnStream.flush();
+	m_severeReturnStream.flush();
+	m_pendingReturns = 0;
+	m_errorDetailWriter.Flush();
+}
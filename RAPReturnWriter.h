@@ -0,0 +1,38 @@
+#pragma once
+#include "DBTableSink.h"
+#include "RAPErrorDetailWriter.h"
+
+// Class RAPReturnWriter loads return details of RAP file to RAP_STOP_OR_MISSING, RAP_FATAL_RETURN, RAP_SEVERE_RETURN
+// and RAP_ERROR_DETAIL tables and call events of severe returns to TAP3 event tables by array inserts. Event and
+// return IDs are reserved from DB sequences by blocks. Rows are sent to DB by Flush and before buffers get full,
+// always in order events, returns, error details, so that no row is sent before the row it refers to.
+class RAPReturnWriter
+{
+public:
+	// tapDecimalPlaces are decimal places of amounts of returned events
+	RAPReturnWriter(otl_connect& otlConnect, long fileID, int tapDecimalPlaces);
+	// returnedEvent replaces call event of severe return if not NULL
+	int Write(const ReturnDetail* returnDetail, const CallEventDetail* returnedEvent);
+	void Flush();
+private:
+	long m_fileID;
+	SequenceIDPool m_eventIDs;
+	SequenceIDPool m_detailIDs;
+	DBTableSink m_callSink;
+	DBTableSink m_gprsCallSink;
+	DBTableSink m_basicServiceSink;
+	DBTableSink m_chargeInfoSink;
+	DBTableSink m_chargeDetailSink;
+	EventRowWriter m_eventRowWriter;
+	otl_nocommit_stream m_stopOrMissingStream;
+	otl_nocommit_stream m_fatalReturnStream;
+	otl_nocommit_stream m_severeReturnStream;
+	int m_pendingReturns;
+	RAPErrorDetailWriter m_errorDetailWriter;
+
+	int WriteStopOrMissing(string stopLastSeqNum, string missStartSeqNum, string missEndSeqNum, const OperatorSpecList* operSpecList);
+	int WriteFatalReturn(const FatalReturn& fatalReturn);
+	int WriteSevereReturn(const SevereReturn& severeReturn, const CallEventDetail& callEventDetail);
+	void FlushIfFull(const ErrorDetailList_t* errorDetailList);
+	static string GetOperSpecInfo(const OperatorSpecList* operSpecList);
+};
@@ -0,0 +1,474 @@
+#include <vector>
+#include <list>
+#include <map>
+#include <algorithm>
+#include <process.h>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "ConfigContainer.h"
+#include "ReturnBatch.h"
+#include "RAPFile.h"
+#include "RAPUploadQueue.h"
+#include "FtpSessionPool.h"
+
+using namespace std;
+
+extern void log(short msgType, string msgText, string dbConnectString = "");
+
+const int uploadThreadCount = 4;
+const int maxUploadsPerHub = 1;			// concurrent FTP sessions to one roaming hub
+const int maxFilesPerSession = 20;
+const int maxUploadAttempts = 10;
+const time_t firstRetryDelay = 60;		// seconds, doubled on each next attempt
+const time_t maxRetryDelay = 60 * 60;
+const DWORD idleWaitTime = 60 * 1000;
+const string newSuffix = ".new.";
+const string busySuffix = ".busy.";
+
+
+RAPUploadQueue& RAPUploadQueue::Instance()
+{
+	// never destroyed: uploader threads may still run when static objects are destroyed at process exit
+	static RAPUploadQueue* instance = new RAPUploadQueue();
+	return *instance;
+}
+
+
+RAPUploadQueue::RAPUploadQueue() :
+	m_wakeEvent(NULL),
+	m_jobsCommitted(false)
+{
+	InitializeCriticalSection(&m_critSection);
+}
+
+
+void RAPUploadQueue::Start(const Config& config)
+{
+	EnterCriticalSection(&m_critSection);
+	// FTP settings and connect string are taken from the last loaded config
+	m_config = config;
+	if (m_threads.empty()) {
+		m_spoolDir = (m_config.GetOutputDirectory().empty() ? "." : m_config.GetOutputDirectory()) + "\\spool";
+		CreateDirectory(m_spoolDir.c_str(), NULL);
+		LoadSpool();
+		m_wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+		for (int i = 0; i < uploadThreadCount; i++) {
+			HANDLE thread = (HANDLE) _beginthreadex(NULL, 0, WorkerThread, this, 0, NULL);
+			if (thread)
+				m_threads.push_back(thread);
+		}
+		if (!m_jobs.empty())
+			SetEvent(m_wakeEvent);
+	}
+	LeaveCriticalSection(&m_critSection);
+}
+
+
+// Spool files are named after RAP file: "<file>.new.<pid>" is a job of uncommitted load of process <pid>,
+// "<file>.job" is a committed job nobody uploads, "<file>.busy.<pid>" is a job claimed by process <pid>.
+// Jobs are claimed by renaming, so concurrent loader processes never upload the same file twice.
+// Files of dead processes are taken over (a reused PID only postpones the job to a later run).
+void RAPUploadQueue::LoadSpool()
+{
+	DWORD processID = GetCurrentProcessId();
+	WIN32_FIND_DATA findData;
+	HANDLE hFind = FindFirstFile((m_spoolDir + "\\*.*").c_str(), &findData);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return;
+	do {
+		string name = findData.cFileName;
+		string baseName;
+		DWORD ownerID;
+		if (ParseOwnedName(name, newSuffix, baseName, ownerID)) {
+			// job of a load that has not been committed
+			if (ownerID != processID && !IsProcessAlive(ownerID))
+				DeleteFile((m_spoolDir + "\\" + name).c_str());
+		}
+		else if (name.size() > 4 && name.substr(name.size() - 4) == ".job") {
+			ClaimJob(name, name.substr(0, name.size() - 4));
+		}
+		else if (ParseOwnedName(name, busySuffix, baseName, ownerID)) {
+			if (ownerID == processID || !IsProcessAlive(ownerID))
+				ClaimJob(name, baseName);
+		}
+	} while (FindNextFile(hFind, &findData));
+	FindClose(hFind);
+}
+
+
+// renames spool file to busy one of this process and loads the job, fails if another process claimed it first
+bool RAPUploadQueue::ClaimJob(string name, string baseName)
+{
+	string jobFilename = m_spoolDir + "\\" + baseName + busySuffix + to_string((long long) GetCurrentProcessId());
+	string spoolFilename = m_spoolDir + "\\" + name;
+	if (spoolFilename != jobFilename && !MoveFileEx(spoolFilename.c_str(), jobFilename.c_str(), 0))
+		return false;
+	RAPUploadJob job;
+	if (!ReadJobFile(jobFilename, job))
+		return false;
+	m_jobs.push_back(job);
+	return true;
+}
+
+
+// name is "<base name><suffix><pid>"
+bool RAPUploadQueue::ParseOwnedName(const string& name, const string& suffix, string& baseName, DWORD& ownerID)
+{
+	size_t pos = name.rfind(suffix);
+	if (pos == string::npos || pos == 0 || pos + suffix.size() == name.size())
+		return false;
+	char* pEnd;
+	ownerID = strtoul(name.c_str() + pos + suffix.size(), &pEnd, 10);
+	if (*pEnd != '\0')
+		return false;
+	baseName = name.substr(0, pos);
+	return true;
+}
+
+
+bool RAPUploadQueue::IsProcessAlive(DWORD processID)
+{
+	HANDLE process = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, processID);
+	if (!process)
+		// process of another user can't be opened, but exists
+		return (GetLastError() == ERROR_ACCESS_DENIED);
+	DWORD exitCode;
+	bool alive = (GetExitCodeProcess(process, &exitCode) && exitCode == STILL_ACTIVE);
+	CloseHandle(process);
+	return alive;
+}
+
+
+void RAPUploadQueue::Enqueue(string filename, string fullFileName, string roamingHubName, long fileID)
+{
+	RAPUploadJob job;
+	job.filename = filename;
+	job.fullFileName = fullFileName;
+	job.roamingHubName = roamingHubName;
+	job.fileID = fileID;
+	job.attempts = 0;
+	job.nextAttempt = 0;
+	job.inProgress = false;
+	EnterCriticalSection(&m_critSection);
+	job.jobFilename = m_spoolDir + "\\" + filename + newSuffix + to_string((long long) GetCurrentProcessId());
+	bool written = WriteJobFile(job);
+	if (written)
+		m_uncommitted.push_back(job);
+	LeaveCriticalSection(&m_critSection);
+	if (!written)
+		throw RAPFileException("Невозможно записать файл очереди выгрузки " + job.jobFilename);
+}
+
+
+// Committed jobs stay claimed by this process. Job which spool file can't be renamed is uploaded by this process anyway,
+// its spool file is kept for operator, as uncommitted jobs are deleted on next start.
+bool RAPUploadQueue::Commit()
+{
+	bool success = true;
+	EnterCriticalSection(&m_critSection);
+	for (size_t i = 0; i < m_uncommitted.size(); i++) {
+		string jobFilename = m_spoolDir + "\\" + m_uncommitted[i].filename + busySuffix +
+			to_string((long long) GetCurrentProcessId());
+		if (MoveFileEx(m_uncommitted[i].jobFilename.c_str(), jobFilename.c_str(), MOVEFILE_REPLACE_EXISTING))
+			m_uncommitted[i].jobFilename = jobFilename;
+		else {
+			log(LOG_ERROR, "Ошибка переименования файла очереди выгрузки " + m_uncommitted[i].jobFilename + " в " + jobFilename +
+				", код ошибки " + to_string((long long) GetLastError()) + ". Файл " + m_uncommitted[i].filename +
+				" будет выгружен только текущим процессом, для выгрузки при следующем запуске переименуйте файл очереди вручную");
+			success = false;
+		}
+		m_jobs.push_back(m_uncommitted[i]);
+	}
+	if (!m_uncommitted.empty()) {
+		m_jobsCommitted = true;
+		SetEvent(m_wakeEvent);
+	}
+	m_uncommitted.clear();
+	LeaveCriticalSection(&m_critSection);
+	return success;
+}
+
+
+void RAPUploadQueue::Rollback()
+{
+	EnterCriticalSection(&m_critSection);
+	for (size_t i = 0; i < m_uncommitted.size(); i++)
+		DeleteFile(m_uncommitted[i].jobFilename.c_str());
+	m_uncommitted.clear();
+	LeaveCriticalSection(&m_critSection);
+}
+
+
+bool RAPUploadQueue::HasCommittedJobs()
+{
+	EnterCriticalSection(&m_critSection);
+	bool jobsCommitted = m_jobsCommitted;
+	LeaveCriticalSection(&m_critSection);
+	return jobsCommitted;
+}
+
+
+// Waits until jobs due now are uploaded or postponed. Used by executable before exit, jobs left are kept in spool.
+bool RAPUploadQueue::Drain(DWORD timeout)
+{
+	DWORD startTime = GetTickCount();
+	while (true) {
+		bool busy = false;
+		EnterCriticalSection(&m_critSection);
+		time_t now = time(NULL);
+		for (list<RAPUploadJob>::iterator it = m_jobs.begin(); it != m_jobs.end(); it++)
+			if (it->inProgress || it->nextAttempt <= now) {
+				busy = true;
+				break;
+			}
+		LeaveCriticalSection(&m_critSection);
+		if (!busy) {
+			// log out of FTP servers before exit
+			FtpSessionPool::Instance().CloseIdleSessions(0);
+			return true;
+		}
+		if (m_threads.empty())
+			return false;
+		if (GetTickCount() - startTime >= timeout)
+			return false;
+		Sleep(200);
+	}
+}
+
+
+unsigned __stdcall RAPUploadQueue::WorkerThread(void* param)
+{
+	((RAPUploadQueue*) param)->Work();
+	return 0;
+}
+
+
+void RAPUploadQueue::Work()
+{
+	otl_connect otlConnect;
+	while (true) {
+		vector<RAPUploadJob*> batch;
+		FtpSetting ftpSetting;
+		string connectString;
+		DWORD waitTime;
+		if (!TakeJobs(batch, ftpSetting, connectString, waitTime)) {
+			if (otlConnect.connected)
+				otlConnect.logoff();
+			FtpSessionPool::Instance().CloseIdleSessions(FtpSessionPool::defaultMaxIdleTime);
+			WaitForSingleObject(m_wakeEvent, waitTime);
+			continue;
+		}
+		if (!otlConnect.connected) {
+			try {
+				otlConnect.rlogon(connectString.c_str());
+			}
+			catch (otl_exception&) {
+				// upload goes on, status and messages are written to log file
+			}
+		}
+		UploadJobs(batch, ftpSetting, otlConnect);
+	}
+}
+
+
+// Takes due jobs of one roaming hub to upload them in one FTP session
+bool RAPUploadQueue::TakeJobs(vector<RAPUploadJob*>& batch, FtpSetting& ftpSetting, string& connectString, DWORD& waitTime)
+{
+	EnterCriticalSection(&m_critSection);
+	time_t now = time(NULL);
+	waitTime = idleWaitTime;
+	string roamingHubName;
+	bool moreJobs = false;
+	for (list<RAPUploadJob>::iterator it = m_jobs.begin(); it != m_jobs.end(); it++) {
+		if (it->inProgress)
+			continue;
+		if (it->nextAttempt > now) {
+			if ((DWORD) (it->nextAttempt - now) * 1000 < waitTime)
+				waitTime = (DWORD) (it->nextAttempt - now) * 1000;
+			continue;
+		}
+		if (batch.empty() && m_activeUploads[it->roamingHubName] < maxUploadsPerHub) {
+			roamingHubName = it->roamingHubName;
+			m_activeUploads[roamingHubName]++;
+		}
+		if (!roamingHubName.empty() && it->roamingHubName == roamingHubName && batch.size() < maxFilesPerSession) {
+			it->inProgress = true;
+			batch.push_back(&*it);
+		}
+		else if (m_activeUploads[it->roamingHubName] < maxUploadsPerHub) {
+			moreJobs = true;
+		}
+	}
+	if (!batch.empty()) {
+		ftpSetting = m_config.GetFTPSetting(roamingHubName);
+		connectString = m_config.GetConnectString();
+	}
+	LeaveCriticalSection(&m_critSection);
+	// let another uploader take jobs of other hubs
+	if (moreJobs)
+		SetEvent(m_wakeEvent);
+	return !batch.empty();
+}
+
+
+void RAPUploadQueue::UploadJobs(const vector<RAPUploadJob*>& batch, FtpSetting ftpSetting, otl_connect& otlConnect)
+{
+	string ftpError;
+	int ftpResult;
+	if (!ftpSetting.ftpServer.empty()) {
+		vector<string> files;
+		for (size_t i = 0; i < batch.size(); i++)
+			files.push_back(batch[i]->fullFileName);
+		try {
+			ftpResult = FtpSessionPool::Instance().Upload(ftpSetting, files, ftpError);
+		}
+		catch (...) {
+			ftpResult = -1;
+			ftpError = "Unknown exception";
+		}
+	}
+	else {
+		ftpResult = -1;
+		ftpError = "FTP-сервер не указан в настройках";
+	}
+
+	for (size_t i = 0; i < batch.size(); i++) {
+		RAPUploadJob& job = *batch[i];
+		if (ftpResult == 0) {
+			DeleteFile(job.jobFilename.c_str());
+			UpdateStatus(otlConnect, job, usUploaded, "");
+			Log(otlConnect, job.filename, LOG_INFO, "Файл успешно загружен на FTP-сервер " + ftpSetting.ftpServer);
+			continue;
+		}
+		job.attempts++;
+		string error = string("Ошибка при загрузке файла ") + job.filename + " на FTP-сервер " + ftpSetting.ftpServer +
+			" (попытка " + to_string((long long) job.attempts) + "): " + ftpError;
+		if (job.attempts >= maxUploadAttempts) {
+			// kept in spool for manual upload
+			MoveFileEx(job.jobFilename.c_str(), (m_spoolDir + "\\" + job.filename + ".failed").c_str(), MOVEFILE_REPLACE_EXISTING);
+			UpdateStatus(otlConnect, job, usFailed, ftpError);
+			Log(otlConnect, job.filename, LOG_ERROR, error + ". Выгрузка прекращена.");
+		}
+		else {
+			time_t retryDelay = firstRetryDelay << (job.attempts - 1);
+			job.nextAttempt = time(NULL) + (retryDelay < maxRetryDelay ? retryDelay : maxRetryDelay);
+			WriteJobFile(job);
+			UpdateStatus(otlConnect, job, usRetrying, ftpError);
+			Log(otlConnect, job.filename, LOG_ERROR, error);
+		}
+	}
+
+	EnterCriticalSection(&m_critSection);
+	m_activeUploads[batch[0]->roamingHubName]--;
+	for (list<RAPUploadJob>::iterator it = m_jobs.begin(); it != m_jobs.end(); ) {
+		if (it->inProgress && find(batch.begin(), batch.end(), &*it) != batch.end()) {
+			it->inProgress = false;
+			if (ftpResult == 0 || it->attempts >= maxUploadAttempts) {
+				it = m_jobs.erase(it);
+				continue;
+			}
+		}
+		it++;
+	}
+	LeaveCriticalSection(&m_critSection);
+	SetEvent(m_wakeEvent);
+}
+
+
+bool RAPUploadQueue::WriteJobFile(const RAPUploadJob& job)
+{
+	FILE* f = fopen(job.jobFilename.c_str(), "w");
+	if (!f)
+		return false;
+	fprintf(f, "file=%s\npath=%s\nhub=%s\nfileid=%ld\nattempts=%d\nnext=%lld\n", job.filename.c_str(),
+		job.fullFileName.c_str(), job.roamingHubName.c_str(), job.fileID, job.attempts, (long long) job.nextAttempt);
+	bool success = (ferror(f) == 0);
+	if (fclose(f) != 0)
+		success = false;
+	return success;
+}
+
+
+bool RAPUploadQueue::ReadJobFile(string jobFilename, RAPUploadJob& job)
+{
+	FILE* f = fopen(jobFilename.c_str(), "r");
+	if (!f)
+		return false;
+	job.jobFilename = jobFilename;
+	job.fileID = 0;
+	job.attempts = 0;
+	job.nextAttempt = 0;
+	job.inProgress = false;
+	char line[1024];
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		char* value = strchr(line, '=');
+		if (!value)
+			continue;
+		*value++ = '\0';
+		if (!strcmp(line, "file"))
+			job.filename = value;
+		else if (!strcmp(line, "path"))
+			job.fullFileName = value;
+		else if (!strcmp(line, "hub"))
+			job.roamingHubName = value;
+		else if (!strcmp(line, "fileid"))
+			job.fileID = strtol(value, NULL, 10);
+		else if (!strcmp(line, "attempts"))
+			job.attempts = strtol(value, NULL, 10);
+		else if (!strcmp(line, "next"))
+			job.nextAttempt = (time_t) _atoi64(value);
+	}
+	fclose(f);
+	return !job.filename.empty() && !job.fullFileName.empty();
+}
+
+
+void RAPUploadQueue::UpdateStatus(otl_connect& otlConnect, const RAPUploadJob& job, RAPUploadStatus status, string error)
+{
+	if (!otlConnect.connected)
+		return;
+	if (error.length() > 1000)
+		error = error.substr(0, 1000);
+	try {
+		otl_stream otlStream;
+		otlStream.open(1, "update BILLING.RAP_FILE set UPLOAD_STATUS = :status /*long,in*/, UPLOAD_ATTEMPTS = :attempts /*long,in*/, "
+			"UPLOAD_TIME = sysdate, UPLOAD_ERROR = :error /*char[1001],in*/ where FILE_ID = :fileid /*long,in*/", otlConnect);
+		otlStream
+			<< (long) status
+			<< (long) job.attempts
+			<< error
+			<< job.fileID;
+	}
+	catch (otl_exception &otlEx) {
+		Log(otlConnect, job.filename, LOG_ERROR, string("Ошибка обновления статуса выгрузки: ") + (char*) otlEx.msg);
+		otlConnect.logoff();
+	}
+}
+
+
+// Logging of uploader threads, they can't share DB connection and log file of loader
+void RAPUploadQueue::Log(otl_connect& otlConnect, string filename, short msgType, string msgText)
+{
+	if (msgText.length() > 2048)
+		msgText = msgText.substr(0, 2048);
+	if (otlConnect.connected) {
+		try {
+			otl_stream otlLog;
+			otlLog.open(1, "insert into BILLING.TAP3LOADER_LOG (datetime, filename, msg_type, msg_text) "
+				"values (sysdate, :fn /*char[255]*/, :msg_type/*short*/, :msg_text /*char[2048]*/)", otlConnect);
+			otlLog << filename << msgType << msgText;
+			return;
+		}
+		catch (otl_exception&) {
+			otlConnect.logoff();
+		}
+	}
+	time_t t = time(0);
+	struct tm * now = localtime(&t);
+	EnterCriticalSection(&m_critSection);
+	ofstream ofsUploadLog("TAP3Loader.log", ofstream::app);
+	ofsUploadLog << now->tm_mday << '.' << (now->tm_mon + 1) << '.' << (now->tm_year + 1900) << ' '
+		<< now->tm_hour << ':' << now->tm_min << ':' << now->tm_sec << ' ' << filename << ' ' << msgText << endl;
+	LeaveCriticalSection(&m_critSection);
+}
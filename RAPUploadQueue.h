@@ -0,0 +1,68 @@
+#pragma once
+#include <vector>
+#include <list>
+#include <map>
+
+// values of RAP_FILE.UPLOAD_STATUS
+enum RAPUploadStatus {
+	usQueued = 0,
+	usUploaded = 1,
+	usRetrying = 2,
+	usFailed = 3
+};
+
+struct RAPUploadJob
+{
+	string jobFilename;		// spool file keeping the job between runs
+	string filename;
+	string fullFileName;
+	string roamingHubName;
+	long fileID;
+	int attempts;
+	time_t nextAttempt;
+	bool inProgress;
+};
+
+
+// Class RAPUploadQueue delivers encoded RAP files to FTP servers of roaming hubs in background threads,
+// so that TAP load does not wait for partner's FTP server. Jobs are kept in spool directory until uploaded,
+// failed uploads are retried with exponential backoff. Jobs enqueued during load become visible to uploaders
+// only after the load transaction is committed. Each spool job is claimed by one loader process at a time.
+class RAPUploadQueue
+{
+public:
+	static RAPUploadQueue& Instance();
+	void Start(const Config& config);
+	void Enqueue(string filename, string fullFileName, string roamingHubName, long fileID);
+	// returns false if some job is not committed to spool
+	bool Commit();
+	void Rollback();
+	// returns true if jobs were committed by this process
+	bool HasCommittedJobs();
+	bool Drain(DWORD timeout);
+private:
+	RAPUploadQueue();
+
+	CRITICAL_SECTION m_critSection;
+	HANDLE m_wakeEvent;
+	vector<HANDLE> m_threads;
+	Config m_config;
+	string m_spoolDir;
+	list<RAPUploadJob> m_jobs;
+	vector<RAPUploadJob> m_uncommitted;
+	map<string, int> m_activeUploads;	// by roaming hub
+	bool m_jobsCommitted;
+
+	static unsigned __stdcall WorkerThread(void* param);
+	void Work();
+	bool TakeJobs(vector<RAPUploadJob*>& batch, FtpSetting& ftpSetting, string& connectString, DWORD& waitTime);
+	void UploadJobs(const vector<RAPUploadJob*>& batch, FtpSetting ftpSetting, otl_connect& otlConnect);
+	void LoadSpool();
+	bool ClaimJob(string name, string baseName);
+	static bool ParseOwnedName(const string& name, const string& suffix, string& baseName, DWORD& ownerID);
+	static bool IsProcessAlive(DWORD processID);
+	bool WriteJobFile(const RAPUploadJob& job);
+	bool ReadJobFile(string jobFilename, RAPUploadJob& job);
+	void UpdateStatus(otl_connect& otlConnect, const RAPUploadJob& job, RAPUploadStatus status, string error);
+	void Log(otl_connect& otlConnect, string filename, short msgType, string msgText);
+};
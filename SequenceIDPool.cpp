@@ -0,0 +1,42 @@
+#include <vector>
+#include <stdexcept>
+#include "OTL_Header.h"
+#include "SequenceIDPool.h"
+
+using namespace std;
+
+
+SequenceIDPool::SequenceIDPool(otl_connect& otlConnect, string sequenceName, int blockSize) :
+	m_otlConnect(otlConnect),
+	m_sequenceName(sequenceName),
+	m_blockSize(blockSize),
+	m_nextIndex(0)
+{
+}
+
+
+long long SequenceIDPool::NextID()
+{
+	if (m_nextIndex >= m_ids.size())
+		FetchBlock();
+	return m_ids[m_nextIndex++];
+}
+
+
+void SequenceIDPool::FetchBlock()
+{
+	otl_nocommit_stream otlStream;
+	otlStream.open(m_blockSize, ("select " + m_sequenceName + ".NextVal :#1<bigint> from dual "
+		"connect by level <= :count /*long,in*/").c_str(), m_otlConnect);
+	otlStream << (long) m_blockSize;
+	m_ids.clear();
+	m_nextIndex = 0;
+	while (!otlStream.eof()) {
+		long long id;
+		otlStream >> id;
+		m_ids.push_back(id);
+	}
+	otlStream.close();
+	if (m_ids.empty())
+		throw runtime_error("No values fetched from sequence " + m_sequenceName);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+class IDGenerator
+{
+public:
+	virtual ~IDGenerator() {}
+	virtual long long NextID() = 0;
+};
+
+
+// Class SequenceIDPool reserves IDs from DB sequence by blocks, so that rows referencing each other
+// can be prepared on the client side without a round trip per row.
+class SequenceIDPool : public IDGenerator
+{
+public:
+	SequenceIDPool(otl_connect& otlConnect, string sequenceName, int blockSize);
+	long long NextID();
+private:
+	otl_connect& m_otlConnect;
+	string m_sequenceName;
+	int m_blockSize;
+	vector<long long> m_ids;
+	size_t m_nextIndex;
+
+	void FetchBlock();
+};
+
+
+// IDs local to a file, used where rows are not loaded to DB tables
+class LocalIDCounter : public IDGenerator
+{
+public:
+	LocalIDCounter() : m_lastID(0) {}
+	long long NextID() { return ++m_lastID; }
+private:
+	long long m_lastID;
+};
@@ -0,0 +1,116 @@
+#include <vector>
+#include <map>
+#include "OTL_Header.h"
+#include "TAP_Constants.h"
+#include "DataInterchange.h"
+#include "SingleRowWriter.h"
+
+using namespace std;
+
+extern void log(short msgType, string msgText, string dbConnectString = "");
+
+const int idBlockSize = 1000;
+// each row is sent to DB as soon as it is complete
+const int singleRowBufferSize = 1;
+
+
+SingleRowEventWriter::SingleRowEventWriter(otl_connect& otlConnect, long fileID, int tapDecimalPlaces, bool acceptRejected) :
+	m_otlConnect(otlConnect),
+	m_fileID(fileID),
+	m_acceptRejected(acceptRejected),
+	m_eventIDs(otlConnect, "BILLING.Origin_Seq", idBlockSize),
+	m_detailIDs(otlConnect, "BILLING.TAP3EVENTID", idBlockSize),
+	m_callSink(otlConnect, tap3CallTable, singleRowBufferSize),
+	m_gprsCallSink(otlConnect, tap3GPRSCallTable, singleRowBufferSize),
+	m_basicServiceSink(otlConnect, tap3BasicServiceTable, singleRowBufferSize),
+	m_chargeInfoSink(otlConnect, tap3ChargeInfoTable, singleRowBufferSize, "", tapDecimalPlaces),
+	m_chargeDetailSink(otlConnect, tap3ChargeDetailTable, singleRowBufferSize, "", tapDecimalPlaces),
+	m_eventRowWriter(otlConnect, m_callSink, m_gprsCallSink, m_basicServiceSink, m_chargeInfoSink, m_chargeDetailSink, m_detailIDs,
+		tapDecimalPlaces)
+{
+	if (m_acceptRejected) {
+		// errors of previous load of the file
+		otl_nocommit_stream otlStream;
+		otlStream.open(1, "delete from BILLING.TAP3_EVENT_ERROR where FILE_ID = :file_id /*long,in*/", otlConnect);
+		otlStream << fileID;
+		otlStream.close();
+	}
+}
+
+
+long long SingleRowEventWriter::Write(int index, const CallEventDetail* callEventDetail)
+{
+	if (!m_acceptRejected)
+		return WriteEvent(index, callEventDetail);
+	otl_cursor::direct_exec(m_otlConnect, "savepoint TAP3_EVENT");
+	try {
+		return WriteEvent(index, callEventDetail);
+	}
+	catch (otl_exception& otlEx) {
+		otl_cursor::direct_exec(m_otlConnect, "rollback to savepoint TAP3_EVENT");
+		m_callSink.Clean();
+		m_gprsCallSink.Clean();
+		m_basicServiceSink.Clean();
+		m_chargeInfoSink.Clean();
+		m_chargeDetailSink.Clean();
+		// table of rejected row is taken from its insert statement
+		string tableName = (char*) otlEx.stm_text;
+		size_t nameStart = tableName.find("insert into ");
+		if (nameStart != string::npos) {
+			tableName = tableName.substr(nameStart + strlen("insert into "));
+			tableName = tableName.substr(0, tableName.find(' '));
+			tableName = tableName.substr(tableName.find('.') + 1);
+		}
+		else
+			tableName = "";
+		string errorText = (char*) otlEx.msg;
+		otl_nocommit_stream otlStream;
+		otlStream.open(1, "insert into BILLING.TAP3_EVENT_ERROR (FILE_ID, RSN, TABLE_NAME, ERROR_TEXT) "
+			"values (:file_id /*long,in*/, :rsn /*long,in*/, :table_name /*char[40],in*/, :error_text /*char[2001],in*/)",
+			m_otlConnect);
+		otlStream
+			<< m_fileID
+			<< (long) index
+			<< tableName.substr(0, 30)
+			<< errorText.substr(0, 2000);
+		otlStream.close();
+		m_rejectedRSNs.push_back(index);
+		return 0;
+	}
+}
+
+
+const vector<long>& SingleRowEventWriter::GetRejectedRSNs() const
+{
+	return m_rejectedRSNs;
+}
+
+
+long long SingleRowEventWriter::WriteEvent(int index, const CallEventDetail* callEventDetail)
+{
+	long long eventID = 0;
+	long writeRes = TL_OK;
+	switch (callEventDetail->present) {
+		case CallEventDetail_PR_mobileOriginatedCall:
+			eventID = m_eventIDs.NextID();
+			writeRes = m_eventRowWriter.WriteOriginatedCall(eventID, m_fileID, index, &callEventDetail->choice.mobileOriginatedCall);
+			break;
+		case CallEventDetail_PR_mobileTerminatedCall:
+			eventID = m_eventIDs.NextID();
+			writeRes = m_eventRowWriter.WriteTerminatedCall(eventID, m_fileID, index, &callEventDetail->choice.mobileTerminatedCall);
+			break;
+		case CallEventDetail_PR_supplServiceEvent:
+			// at this time we just ignore it
+			break;
+		case CallEventDetail_PR_gprsCall:
+			eventID = m_eventIDs.NextID();
+			writeRes = m_eventRowWriter.WriteGPRSCall(eventID, m_fileID, index, &callEventDetail->choice.gprsCall);
+			break;
+		default:
+			log(LOG_ERROR, string("Не найден обработчик события с кодом ") +
+				to_string(static_cast<unsigned long long> (callEventDetail->present)) +
+				string(". Номер звонка ") + to_string(static_cast<unsigned long long> (index)));
+			return TL_NEWCOMPONENT;
+	}
+	return (writeRes == TL_OK ? eventID : writeRes);
+}
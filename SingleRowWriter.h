@@ -0,0 +1,32 @@
+#pragma once
+#include "DBTableSink.h"
+
+// Class SingleRowEventWriter loads call events of transfer batch to TAP3 event tables one by one by single row
+// inserts, so that each event is in DB before its validation. Rows are made by EventRowWriter like in array
+// inserts of other writers, event and detail IDs are reserved from DB sequences by blocks.
+// If rejected events are accepted, each event is written after a savepoint: rows of event rejected by DB are rolled
+// back, its error is written to BILLING.TAP3_EVENT_ERROR and the event is skipped.
+class SingleRowEventWriter
+{
+public:
+	SingleRowEventWriter(otl_connect& otlConnect, long fileID, int tapDecimalPlaces, bool acceptRejected = false);
+	// returns ID of loaded event, 0 if event is ignored or rejected or negative error code
+	long long Write(int index, const CallEventDetail* callEventDetail);
+	// RSNs of events rejected by DB
+	const vector<long>& GetRejectedRSNs() const;
+private:
+	otl_connect& m_otlConnect;
+	long m_fileID;
+	bool m_acceptRejected;
+	vector<long> m_rejectedRSNs;
+	SequenceIDPool m_eventIDs;
+	SequenceIDPool m_detailIDs;
+	DBTableSink m_callSink;
+	DBTableSink m_gprsCallSink;
+	DBTableSink m_basicServiceSink;
+	DBTableSink m_chargeInfoSink;
+	DBTableSink m_chargeDetailSink;
+	EventRowWriter m_eventRowWriter;
+
+	long long WriteEvent(int index, const CallEventDetail* callEventDetail);
+};
@@ -0,0 +1,51 @@
+#include <vector>
+#include "OTL_Header.h"
+#include "StringPool.h"
+
+using namespace std;
+
+
+StringPool::StringPool()
+{
+	// empty string gets ID 0
+	Intern("");
+}
+
+
+StringPool::~StringPool()
+{
+	for (size_t i = 0; i < m_values.size(); i++)
+		delete [] m_values[i];
+}
+
+
+InternedString StringPool::Intern(const char* value)
+{
+	InternedString interned;
+	map<const char*, int, StringLess>::const_iterator it = m_ids.find(value);
+	if (it != m_ids.end()) {
+		interned.id = it->second;
+		interned.value = it->first;
+		return interned;
+	}
+	size_t size = strlen(value) + 1;
+	char* copy = new char[size];
+	memcpy(copy, value, size);
+	interned.id = (int) m_values.size();
+	interned.value = copy;
+	m_values.push_back(copy);
+	m_ids.insert(make_pair((const char*) copy, interned.id));
+	return interned;
+}
+
+
+const char* StringPool::GetValue(int id) const
+{
+	return m_values[id];
+}
+
+
+int StringPool::GetCount() const
+{
+	return (int) m_values.size();
+}
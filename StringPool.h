@@ -0,0 +1,33 @@
+#pragma once
+#include <map>
+
+// Interned value: ID is 0 for empty string, value stays valid while its pool exists
+struct InternedString
+{
+	int id;
+	const char* value;
+};
+
+
+// Class StringPool keeps one copy of each of repeating string values (APNs, recording entities, UTC offsets,
+// charged items etc.) and gives them small integer IDs, so that sinks may use IDs instead of comparing strings.
+// Values are looked up without temporary strings.
+class StringPool
+{
+public:
+	StringPool();
+	~StringPool();
+	InternedString Intern(const char* value);
+	const char* GetValue(int id) const;
+	int GetCount() const;
+private:
+	struct StringLess
+	{
+		bool operator()(const char* left, const char* right) const { return strcmp(left, right) < 0; }
+	};
+	map<const char*, int, StringLess> m_ids;
+	vector<char*> m_values;
+
+	StringPool(const StringPool&);
+	StringPool& operator=(const StringPool&);
+};
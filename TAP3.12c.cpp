@@ -14,19 +14,63 @@
 #include "TAPValidator.h"
 #include "RapFile.h"
 #include "CallValidator.h"
+#include "FlatFileWriter.h"
+#include "ArrowWriter.h"
+#include "JsonDumper.h"
+#include "RAPUploadQueue.h"
+#include "RAPReturnWriter.h"
+#include "ParallelDecoder.h"
+#include "ParallelWriter.h"
+#include "SingleRowWriter.h"
+#include "PartnerCache.h"
+#include "ContentHash.h"
+#include "FileSequenceIndex.h"
+#include "CompressedInput.h"
 
 
 const char *pShortName;
+// staging directory of direct-path load mode (-b switch), events are written to flat files instead of DB
+const char *pStagingDir = NULL;
+// directory of Arrow export of loaded events (-a switch)
+const char *pExportDir = NULL;
+// print-only mode (-p switch) options: selected columns (-f switch) and range of event RSNs (-e switch)
+const char *pDumpFields = NULL;
+long dumpFirstEvent = 1;
+long dumpLastEvent = LONG_MAX;
+// verification of returned events copied to RAP file from TAP file buffer (-v switch)
+bool bVerifyRAPEvents = false;
+// validate-only mode (--validate-only switch): TAP file is validated, nothing is loaded and no RAP file is created
+bool bValidateOnly = false;
+// number of DB sessions loading events of big TAP files in parallel (-w switch)
+long writerSessions = 1;
+// policy of events rejected by DB: file is loaded without them (--accept-partial switch) or not loaded at all
+bool bAcceptPartialFile = false;
+// time executable waits for upload of RAP files created by the load before exit (--upload-wait switch, seconds),
+// files not uploaded by then are uploaded by next runs
+DWORD uploadWaitTime = 60 * 1000;
+// XXH64 of loaded file contents, stored in CONTENT_HASH column to recognize exact copies of loaded files
+string fileContentHash;
 
 DataInterChange* dataInterchange = NULL;
 ReturnBatch* returnBatch = NULL;
 Acknowledgement* acknowledgement = NULL;
+// spans of call events of decoded TAP file in file buffer
+vector<BerSpan> callEventSpans;
+// index of sequence numbers of loaded TAP file, its number is registered there by Finalize after commit
+unique_ptr<FileSequenceIndex> loadedSequenceIndex;
+int loadedSequenceNumber = 0;
 
 CRITICAL_SECTION loadCritSection;
+// loader is called through LoadFileToDB of DLL, RAP uploads go on in background after the load
+bool bLibraryMode = false;
 
 ofstream ofsLog;
 
 const short mainArgsCount = 5;
+const long maxWriterSessions = 16;
+// events of smaller TAP files are loaded by the load session only
+const int minParallelWriteEvents = 20000;
+const long maxUploadWaitTime = 60 * 60;	// seconds
 
 enum FileType {
 	ftTAP = 0,
@@ -83,9 +127,23 @@ void log(string filename, short msgType, string msgText, string dbConnectString
 	}
 }
 //------------------------------
+// event checks of parallel writer sessions log from their threads
+class LogCriticalSection
+{
+public:
+	LogCriticalSection() { InitializeCriticalSection(&m_critSection); }
+	~LogCriticalSection() { DeleteCriticalSection(&m_critSection); }
+	void Enter() { EnterCriticalSection(&m_critSection); }
+	void Leave() { LeaveCriticalSection(&m_critSection); }
+private:
+	CRITICAL_SECTION m_critSection;
+} logCritSection;
+
 void log(short msgType, string msgText, string dbConnectString = "")
 {
+	logCritSection.Enter();
 	log(pShortName, msgType, msgText, dbConnectString);
+	logCritSection.Leave();
 }
 //--------------------------------
 int assign_integer_option(string _name, string _value, long& param, long minValid, long maxValid)
@@ -186,9 +244,13 @@ char* OctetStrToHexStr(const OCTET_STRING_t& octetStr)
 }
 
 //----------------------------------
-double GetTAPPower()
+// decimal places of amounts of transfer batch, 0 if they are not given or TAP file is not loaded
+int GetTAPDecimalPlaces()
 {
-	return pow((double) 10, *dataInterchange->choice.transferBatch.accountingInfo->tapDecimalPlaces);
+	if (dataInterchange && dataInterchange->choice.transferBatch.accountingInfo &&
+			dataInterchange->choice.transferBatch.accountingInfo->tapDecimalPlaces)
+		return *dataInterchange->choice.transferBatch.accountingInfo->tapDecimalPlaces;
+	return 0;
 }
 
 string GetUTCOffset(int nCode)
@@ -199,11 +261,11 @@ string GetUTCOffset(int nCode)
 			if (*dataInterchange->choice.transferBatch.networkInfo->utcTimeOffsetInfo->list.array[i]->utcTimeOffsetCode == nCode)
 				return (string)(const char*)dataInterchange->choice.transferBatch.networkInfo->utcTimeOffsetInfo->list.array[i]->utcTimeOffset->buf;
 		}
-		//  UTC offset  
+		// код UTC offset не найден
 		return "???";
 	}
 	else {
-		//  dataInterchange  ,    RAP-
+		// объект dataInterchange не инициализирован, возможно происходит загрузка RAP-файла
 		return to_string(static_cast<unsigned long long> (nCode));
 	}
 }
@@ -255,11 +317,11 @@ string GetRecordingEntity(int nCode, string& recEntityType)
 
 		}
 
-		//   
+		// неверный код емкости
 		throw "e_wrong_rec_entity_code";
 	}
 	else {
-		//  dataInterchange  ,    RAP-
+		// объект dataInterchange не инициализирован, возможно происходит загрузка RAP-файла
 		recEntityType = "";
 		return "Code: " + to_string(static_cast<unsigned long long> (nCode));
 	}
@@ -272,15 +334,15 @@ double GetExRate(int nCode)
 		{	
 			if( *dataInterchange->choice.transferBatch.accountingInfo->currencyConversionInfo->list.array[i]->exchangeRateCode == nCode)
 			{	
-				double dblPower=pow( (double) 10, *dataInterchange->choice.transferBatch.accountingInfo->currencyConversionInfo->list.array[i]->numberOfDecimalPlaces);
-				return *dataInterchange->choice.transferBatch.accountingInfo->currencyConversionInfo->list.array[i]->exchangeRate / dblPower;
+				return TapAmount(*dataInterchange->choice.transferBatch.accountingInfo->currencyConversionInfo->list.array[i]->exchangeRate,
+					*dataInterchange->choice.transferBatch.accountingInfo->currencyConversionInfo->list.array[i]->numberOfDecimalPlaces).ToDouble();
 			}
 		}
-		//   exchange rate
+		// неверный код exchange rate
 		throw "e_wrong_ex_rate_code";
 	}
 	else {
-		//  dataInterchange  ,    RAP-
+		// объект dataInterchange не инициализирован, возможно происходит загрузка RAP-файла
 		return 0;
 	}
 }
@@ -298,43 +360,30 @@ double GetTaxRate(int nCode)
 				return strtol((const char*)dataInterchange->choice.transferBatch.accountingInfo->taxation->list.array[i]->taxRate->buf, &pend, 10) 
 					/ 100000 / 100; // The rate is given to 5 decimal places, see TD.57 v32 and expresses in percents
 		}
-		//   exchange rate
+		// неверный код exchange rate
 		throw "e_wrong_tax_rate_code";
 	}
 	else {
-		//  dataInterchange  ,    RAP-
+		// объект dataInterchange не инициализирован, возможно происходит загрузка RAP-файла
 		return 0;
 	}
 }
 //-------------------------------
 long GetSenderNetworkID(long& iotValidationMode, otl_connect& otlConnect)
 {
-	otl_nocommit_stream otlStream;
-	otlStream.open(1, "call BILLING.TAP3.GetSenderNetworkID(:sender /*char[20],in*/) "
-		"into :res /*long,out*/", otlConnect);
-	if (dataInterchange->present == DataInterChange_PR_transferBatch) 
-		otlStream
-			<< dataInterchange->choice.transferBatch.batchControlInfo->sender->buf;
-	else
-		otlStream
-			<< dataInterchange->choice.notification.sender->buf;
-	long mobileNetworkID;
-	otlStream >> mobileNetworkID;
-	otlStream.close();
-	otlStream.open(1, "select nvl(iot_validation_mode_id, :iot_no_need/*int,in*/) from BILLING.TMobileNetwork "
-		"where object_no = :mobilenetworkid /*long,in*/", otlConnect);
-	otlStream 
-		<< IOT_NO_NEED
-		<< mobileNetworkID;
-	otlStream >> iotValidationMode;
+	const Sender_t* sender = (dataInterchange->present == DataInterChange_PR_transferBatch ? 
+		dataInterchange->choice.transferBatch.batchControlInfo->sender : dataInterchange->choice.notification.sender);
+	long mobileNetworkID = PartnerCache::Instance().GetSenderNetworkID(otlConnect, (const char*) sender->buf);
+	iotValidationMode = PartnerCache::Instance().GetIOTValidationMode(otlConnect, mobileNetworkID);
 	return mobileNetworkID;
 }
 //-------------------------------
-double GetDiscountRate(int nCode, double& fixedDiscountVal, otl_connect& otlConnect)
+// fixedDiscountVal is -1 if discount is given by rate
+double GetDiscountRate(int nCode, TapAmount& fixedDiscountVal, otl_connect& otlConnect)
 {
 	if (dataInterchange) {
 		if(!dataInterchange->choice.transferBatch.accountingInfo->discounting) {
-			fixedDiscountVal = 0;
+			fixedDiscountVal = TapAmount();
 			return 0;
 		}
 	
@@ -342,656 +391,146 @@ double GetDiscountRate(int nCode, double& fixedDiscountVal, otl_connect& otlConn
 		{	
 			if( *dataInterchange->choice.transferBatch.accountingInfo->discounting->list.array[i]->discountCode == nCode) {
 				if( dataInterchange->choice.transferBatch.accountingInfo->discounting->list.array[i]->discountApplied->present == DiscountApplied_PR_discountRate ) {
-					fixedDiscountVal = -1;
+					fixedDiscountVal = TapAmount(-1, 0);
 					return dataInterchange->choice.transferBatch.accountingInfo->discounting->list.array[i]->discountApplied->choice.discountRate / 100; // discount rate is held in 2 decimal places, see TD.57 v32
 				}
 				else {
-					fixedDiscountVal = OctetStr2Int64(dataInterchange->choice.transferBatch.accountingInfo->discounting->list.array[i]->discountApplied->choice.fixedDiscountValue) / GetTAPPower();
+					fixedDiscountVal = TapAmount::FromOctetString(dataInterchange->choice.transferBatch.accountingInfo->discounting->list.array[i]->discountApplied->choice.fixedDiscountValue,
+						GetTAPDecimalPlaces());
 					return -1;
 				}
 			}
 		}
-		//   exchange rate
+		// неверный код exchange rate
 		throw "e_wrong_tax_rate_code";
 	}
 	else {
-		//  dataInterchange  ,    RAP-
+		// объект dataInterchange не инициализирован, возможно происходит загрузка RAP-файла
 		return 0;
 	}
 }
 //-------------------------------
-long ProcessChrInfo(long long eventID, ChargeInformation* chargeInformation, char* szInfo, otl_connect& otlConnect)
+long CheckChrInfo(const ChargeInformation* chargeInformation, const char* szInfo)
 {
-	//   Charge Information
-	long chargeID;
-	//      Charge Information
+	// проверка наличия обязательных структур в Charge Information
 	if(!chargeInformation->chargedItem || /*!chargeInformation->exchangeRateCode ||*/ !chargeInformation->chargeDetailList)
 	{
-		log( LOG_ERROR, "     Charge Information. " + string(szInfo));
+		log( LOG_ERROR, "Обязательные структуры данных отсутствуют в Charge Information. " + string(szInfo));
 		return TL_MISSINGSTRUCT;
 	}
 
-	//      Charge Information/Call Type Group
+	// проверка наличия обязательных структур в Charge Information/Call Type Group
 	if(chargeInformation->callTypeGroup &&
 		(!chargeInformation->callTypeGroup->callTypeLevel1 || !chargeInformation->callTypeGroup->callTypeLevel2 || !chargeInformation->callTypeGroup->callTypeLevel3))
 	{
-		log( LOG_ERROR, "     Charge Information/Call Type Group. " + 
+		log( LOG_ERROR, "Обязательные структуры данных отсутствуют в Charge Information/Call Type Group. " + 
 			string(szInfo));
 		return TL_MISSINGSTRUCT;
 	}
-
-	otl_nocommit_stream otlStream;
-	double fixedDiscountValue = 0;
-
-	otlStream.open( 1 , "INSERT INTO BILLING.TAP3_CHARGEINFO (CHARGE_ID,EVENT_ID,CHR_ITEM,EXCHANGE_RATE,CT_LEVEL1,CT_LEVEL2,CT_LEVEL3, \
-		TAX_RATE,TAX_VAL,DISCOUNT_RATE,FIXED_DISCOUNT_VALUE, DISCOUNT_VALUE) VALUES (\
-		BILLING.TAP3EVENTID.NextVal, :hEventid /*bigint,in*/, :hChritem /*char[10],in*/, :hExrate /*double,in*/, :hCtlevel1 /*long,in*/, :hCtlevel2 /*long,in*/, :hCtlevel3 /*long,in*/, \
-		:hTaxrate /*double,in*/,:hTaxval /*double,in*/, :hDiscrate /*double,in*/, :hFixedDiscval /*double,in*/, :hDiscountVal /*double,in*/) \
-		returning CHARGE_ID into :hChargeId /*long,out*/", otlConnect );
-	otlStream
-		<< eventID
-		<< chargeInformation->chargedItem->buf;
-
-	if (chargeInformation->exchangeRateCode )
-		otlStream << GetExRate( *chargeInformation->exchangeRateCode );
-	else
-		otlStream << otl_null();
-	
-	if (chargeInformation->callTypeGroup ) 
-		otlStream 
-			<< *chargeInformation->callTypeGroup->callTypeLevel1
-			<< *chargeInformation->callTypeGroup->callTypeLevel2
-			<< *chargeInformation->callTypeGroup->callTypeLevel3;
-	else 
-		otlStream 
-			<< otl_null()
-			<< otl_null()
-			<< otl_null();
-
-	double dblTAPPower=pow( (double) 10, dataInterchange ? *dataInterchange->choice.transferBatch.accountingInfo->tapDecimalPlaces :
-															*returnBatch->rapBatchControlInfoRap.tapDecimalPlaces);
-	if ( chargeInformation->taxInformation )
-		otlStream
-			<< GetTaxRate( *chargeInformation->taxInformation->list.array[0]->taxCode )
-			<< OctetStr2Int64(*chargeInformation->taxInformation->list.array[0]->taxValue) / dblTAPPower;
-	else
-		otlStream 
-			<< otl_null()
-			<< otl_null();
-
-	if (chargeInformation->discountInformation ) {
-		double discountRate = GetDiscountRate( *chargeInformation->discountInformation->discountCode, fixedDiscountValue, otlConnect );
-		if ( discountRate > -1 )
-			otlStream << discountRate;
-		else
-			otlStream << otl_null();
-
-		if ( fixedDiscountValue > -1 )
-			otlStream << fixedDiscountValue;
-		else
-			otlStream << otl_null();
-
-		if (chargeInformation->discountInformation->discount)
-			otlStream << (double) (OctetStr2Int64(*chargeInformation->discountInformation->discount) / dblTAPPower);
-		else
-			otlStream << otl_null();
-	}
-	else
-		otlStream 
-			<< otl_null()
-			<< otl_null()
-			<< otl_null();
-		
-	otlStream.flush();
-	otlStream >> chargeID;
-	otlStream.close();
-
-	//   Charge Detail
-	//long det_res;
-	for(int chdet_ind=0; chdet_ind<chargeInformation->chargeDetailList->list.count; chdet_ind++)
+	return TL_OK;
+}
+//------------------------------------------------------
+long CheckBasicServiceUsed(int index, const BasicServiceUsed* basicServiceUsed, const char* eventName)
+{
+	// проверка наличия обязательных структур в Basic Service Used
+	if(!basicServiceUsed->basicService || !basicServiceUsed->chargeInformationList || !basicServiceUsed->basicService->serviceCode)
 	{
-		if(chargeInformation->chargeDetailList->list.array[chdet_ind]->charge)
-			/*if ( !strcmp( (const char*) chargeInformation->chargeDetailList->list.array[chdet_ind]->chargeType->buf, "00" ))
-				totalCharge += OctetStr2Int64(*chargeInformation->chargeDetailList->list.array[chdet_ind]->charge);*/
-		
-		otlStream.open( 1 , "INSERT INTO BILLING.TAP3_CHARGEDETAIL (CHARGE_ID,CHR_TYPE,CHARGE,CHARGEABLE_UNITS,CHARGED_UNITS,DETAIL_TIME,DETAIL_UTCOFF) \
-							VALUES ( :hChargid /* long */, :hChr_type /* char[5] */, :hCharge /* double */, :hChrable /* bigint */, :hCharged /* bigint */, \
-							to_date(:hDet_time /* char[20] */,'yyyymmddhh24miss'), :hDet_utc /* char[10] */)", otlConnect);
-		otlStream
-			<< chargeID
-			<< (const char*) chargeInformation->chargeDetailList->list.array[chdet_ind]->chargeType->buf
-			<< OctetStr2Int64( *chargeInformation->chargeDetailList->list.array[chdet_ind]->charge ) / dblTAPPower;
-
-		if ( chargeInformation->chargeDetailList->list.array[chdet_ind]->chargeableUnits )
-			otlStream << OctetStr2Int64( *chargeInformation->chargeDetailList->list.array[chdet_ind]->chargeableUnits );
-		else
-			otlStream << otl_null();
-
-		if (chargeInformation->chargeDetailList->list.array[chdet_ind]->chargedUnits )
-			otlStream << OctetStr2Int64( *chargeInformation->chargeDetailList->list.array[chdet_ind]->chargedUnits );
-		else
-			otlStream << otl_null();
-
-		otlStream 
-			<< (chargeInformation->chargeDetailList->list.array[chdet_ind]->chargeDetailTimeStamp ? 
-					(const char*) chargeInformation->chargeDetailList->list.array[chdet_ind]->chargeDetailTimeStamp->localTimeStamp->buf : "")
-			<< (chargeInformation->chargeDetailList->list.array[chdet_ind]->chargeDetailTimeStamp ? 
-				GetUTCOffset(*chargeInformation->chargeDetailList->list.array[chdet_ind]->chargeDetailTimeStamp->utcTimeOffsetCode) : "");
-		
-		otlStream.flush();
-		otlStream.close();
+		log( LOG_ERROR, string("Обязательные структуры данных отсутствуют в ") + eventName + "/"
+			"Basic Service Used. Номер звонка " + to_string( static_cast<unsigned long long> (index)));
+		return TL_MISSINGSTRUCT;
 	}
-	
 	return TL_OK;
 }
 //------------------------------------------------------
-long long ProcessOriginatedCall(long fileID, int index, const MobileOriginatedCall* pMCall, otl_connect& otlConnect)
+long CheckOriginatedCall(int index, const MobileOriginatedCall* pMCall)
 {
-	//      Mobile Originated Call
+	// проверка наличия обязательных структур в Mobile Originated Call
 	if(!pMCall->basicCallInformation || !pMCall->locationInformation || !pMCall->basicServiceUsedList)
 	{
-		log( LOG_ERROR, "     Mobile Originated Call.   " + 
+		log( LOG_ERROR, "Обязательные структуры данных отсутствуют в Mobile Originated Call. Номер звонка " + 
 			to_string( static_cast<unsigned long long> (index)));
 		return TL_MISSINGSTRUCT;
 	}
-	//      Mobile Originated Call/MO Basic Call Information
+	// проверка наличия обязательных структур в Mobile Originated Call/MO Basic Call Information
 	if(!pMCall->basicCallInformation->chargeableSubscriber || !pMCall->basicCallInformation->callEventStartTimeStamp ||
 		!pMCall->basicCallInformation->totalCallEventDuration || !pMCall->basicCallInformation->callEventStartTimeStamp)
 	{
-		log( LOG_ERROR, "     Mobile Originated Call/"
-			"MO Basic Call Information.  " + to_string( static_cast<unsigned long long> (index)));
+		log( LOG_ERROR, "Обязательные структуры данных отсутствуют в Mobile Originated Call/"
+			"MO Basic Call Information. Номер звонка" + to_string( static_cast<unsigned long long> (index)));
 		return TL_MISSINGSTRUCT;
 	}
 
-	//      Mobile Originated Call/Location Information
+	// проверка наличия обязательных структур в Mobile Originated Call/Location Information
 	if(!pMCall->locationInformation->networkLocation  ||
 		!pMCall->locationInformation->networkLocation->recEntityCode)
 	{
-		log( LOG_ERROR, "     Mobile Originated Call/"
-			"MO Basic Call Information.   " + to_string( static_cast<unsigned long long> (index)));
+		log( LOG_ERROR, "Обязательные структуры данных отсутствуют в Mobile Originated Call/"
+			"MO Basic Call Information. Номер звонка " + to_string( static_cast<unsigned long long> (index)));
 		return TL_MISSINGSTRUCT;
 	}
-
-	long long eventID;
-	string recEntityType;
-
-	otl_nocommit_stream otlStream;	
-	otlStream.open( 1 /*stream buffer size in logical rows*/, 
-		"insert into BILLING.TAP3_CALL (EVENT_ID,FILE_ID,RSN,ORIG_OR_TERM,IMSI,MSISDN,PARTY_NUMBER, DIALLED_DIGITS, THIRD_PARTY, SMS_PARTYNUMBER, "
-			"CLIR,PARTY_NETWORK,CALL_TIME,CALL_UTCOFF,DURATION,CAUSE_FOR_TERM,REC_ENTITY,REC_ENTITY_TYPE,"
-			"LOCATION_AREA,CELL_ID,SERVING_NETWORK,IMEI, CALL_REFERENCE, RAP_FILE_SEQNUM ) VALUES ("
-			"BILLING.Origin_Seq.NextVal, :hFileID /* long,in */, :hIndex /* int,in */, :hOrigorterm /*short,in*/, :hImsi /* char[20],in */, :hMsisdn  /* char[20],in */, "
-			":hCallednum  /* char[40],in */, :hDialledDigits  /* char[40],in */, :hThirdParty /* char[40],in */, :hSMSDestination /* char[40],in */, "
-			":hClir  /* short,in */, :hPartynetw  /* char[20],in */ , "
-			"to_date(:hCalltime  /* char[20],in */,'yyyymmddhh24miss'), :hCall_utc /* char[10],in */,:hDuration  /* long,in */ ,:hCause  /* long,in */,"
-			":hRecentity /* char[30],in */, :hRecentityType /* char[10],in */, :hLocarea /* long,in */, :hCellid /* long,in */, "
-			":hServnetw /* char[20],in */, :hImei /* char[30],in */, :hCallReference /* char[32],in */, :hRAPSeqnum /* char[10],in */) "
-			"returning EVENT_ID into :hEventId /*bigint,out*/", otlConnect);
-	otlStream 
-		<< fileID
-		<< index 
-		<< (short) 1
-		<< BCDString( pMCall->basicCallInformation->chargeableSubscriber->choice.simChargeableSubscriber.imsi )
-		<< BCDString( pMCall->basicCallInformation->chargeableSubscriber->choice.simChargeableSubscriber.msisdn )
-		<< (pMCall->basicCallInformation->destination ? 
-			(pMCall->basicCallInformation->destination->calledNumber ? BCDString(pMCall->basicCallInformation->destination->calledNumber) : "") : "")
-		<< (pMCall->basicCallInformation->destination ? 
-		(pMCall->basicCallInformation->destination->dialledDigits ? (const char*) pMCall->basicCallInformation->destination->dialledDigits->buf : "") : "")
-		<< (pMCall->thirdPartyInformation ? BCDString(pMCall->thirdPartyInformation->thirdPartyNumber) : "")
-		<< (pMCall->basicCallInformation->destination ? 
-			(pMCall->basicCallInformation->destination->sMSDestinationNumber ? (const char*) pMCall->basicCallInformation->destination->sMSDestinationNumber->buf : "") : "");
-
-	if( pMCall->thirdPartyInformation )
-		if( pMCall->thirdPartyInformation->clirIndicator )
-			otlStream << (short) *pMCall->thirdPartyInformation->clirIndicator;
-		else
-			otlStream << otl_null();
-	else
-		otlStream << otl_null();
-
-	otlStream 
-		<< (pMCall->basicCallInformation->destinationNetwork ? (const char*) pMCall->basicCallInformation->destinationNetwork->buf : "")
-		<< pMCall->basicCallInformation->callEventStartTimeStamp->localTimeStamp->buf
-		<< GetUTCOffset( *pMCall->basicCallInformation->callEventStartTimeStamp->utcTimeOffsetCode )
-		<< *pMCall->basicCallInformation->totalCallEventDuration;
-
-	if (pMCall->basicCallInformation->causeForTerm ) 
-		otlStream << *pMCall->basicCallInformation->causeForTerm;
-	else
-		otlStream << otl_null();
-
-	otlStream 
-		<< GetRecordingEntity(*pMCall->locationInformation->networkLocation->recEntityCode, recEntityType)
-		<< recEntityType;
-
-	if (pMCall->locationInformation->networkLocation->locationArea )
-		otlStream << *pMCall->locationInformation->networkLocation->locationArea;
-	else
-		otlStream << otl_null();
-	
-	if (pMCall->locationInformation->networkLocation->cellId )
-		otlStream << *pMCall->locationInformation->networkLocation->cellId;
-	else
-		otlStream << otl_null();
-
-	otlStream
-		<< (pMCall->locationInformation->geographicalLocation ? (pMCall->locationInformation->geographicalLocation->servingNetwork ?
-			(const char*)pMCall->locationInformation->geographicalLocation->servingNetwork->buf : "") : "")
-		<< (pMCall->equipmentIdentifier ? (pMCall->equipmentIdentifier->present == ImeiOrEsn_PR_imei ? BCDString(&pMCall->equipmentIdentifier->choice.imei) :
-			(pMCall->equipmentIdentifier->present == ImeiOrEsn_PR_esn ? BCDString(&pMCall->equipmentIdentifier->choice.esn) : "")) : "");
-		//<< (pMCall->locationInformation->networkLocation->callReference ? (const char*) pMCall->locationInformation->networkLocation->callReference->buf : "")
-	if (pMCall->locationInformation->networkLocation->callReference) {
-		unique_ptr<char> hexString(OctetStrToHexStr(*pMCall->locationInformation->networkLocation->callReference));
-		otlStream << hexString.get();
-	}
-	else {
-		otlStream << otl_null();
-	}
-	otlStream << (pMCall->basicCallInformation->rapFileSequenceNumber ? (const char*) pMCall->basicCallInformation->rapFileSequenceNumber->buf : "");
-	
-	otlStream.flush();
-	otlStream >> eventID;
-	otlStream.close();
-	
-	//   Basic Service Used
-	long basicSvcID;
-	char szChrInfo[500];
-	for(int bs_ind=0; bs_ind < pMCall->basicServiceUsedList->list.count; bs_ind++)
-	{
-		//      Mobile Originated Call/Basic Service Used
-		if(!pMCall->basicServiceUsedList->list.array[bs_ind]->basicService || !pMCall->basicServiceUsedList->list.array[bs_ind]->chargeInformationList ||
-			!pMCall->basicServiceUsedList->list.array[bs_ind]->basicService->serviceCode)
-		{
-			log( LOG_ERROR, "     Mobile Originated Call/"
-				"Basic Service Used.   " + to_string( static_cast<unsigned long long> (index)));
-			return TL_MISSINGSTRUCT;
-		}
-		
-		otlStream.open( 1 , "INSERT INTO BILLING.TAP3_BASICSERVICE (SERVICE_ID,EVENT_ID,SERVICE_TYPE,SERVICE_CODE,CHR_TIME,CHR_UTCOFF,HSCSD) \
-							VALUES (BILLING.TAP3EVENTID.NextVal, :hEventId /*bigint,in*/, :hServtype /*long,in*/, :hServcode /*char[5],in*/, \
-							to_date(:hChrtime /*char[20],in*/,'yyyymmddhh24miss'), :hChr_utc /*char[10],in*/, :hHSCSD /*short,in*/) \
-							returning SERVICE_ID into :hServiceId /*long,out*/", otlConnect);
-
-		otlStream 
-			<< eventID
-			<< (long) (pMCall->basicServiceUsedList->list.array[bs_ind]->basicService->serviceCode->present == BasicServiceCode_PR_bearerServiceCode)
-			<< (pMCall->basicServiceUsedList->list.array[bs_ind]->basicService->serviceCode->present == BasicServiceCode_PR_bearerServiceCode ?
-				(const char*)pMCall->basicServiceUsedList->list.array[bs_ind]->basicService->serviceCode->choice.bearerServiceCode.buf :
-				(const char*)pMCall->basicServiceUsedList->list.array[bs_ind]->basicService->serviceCode->choice.teleServiceCode.buf )
-			<< (pMCall->basicServiceUsedList->list.array[bs_ind]->chargingTimeStamp ?
-				(const char*)pMCall->basicServiceUsedList->list.array[bs_ind]->chargingTimeStamp->localTimeStamp->buf : "")
-			<< (pMCall->basicServiceUsedList->list.array[bs_ind]->chargingTimeStamp ?
-				GetUTCOffset( *pMCall->basicServiceUsedList->list.array[bs_ind]->chargingTimeStamp->utcTimeOffsetCode ) : "")
-			<<	(pMCall->basicServiceUsedList->list.array[bs_ind]->hSCSDIndicator ? (short) 1 : (short) 0) ;
-
-		otlStream.flush();
-		otlStream >> basicSvcID;
-
-		otlStream.close();
-		long chrinfoRes;
-
-		//   Charge Information
-		for(int chr_ind=0; chr_ind < pMCall->basicServiceUsedList->list.array[bs_ind]->chargeInformationList->list.count; chr_ind++)
-		{
-			sprintf(szChrInfo,"Call number %d. Basic Service number %d. Charge Information number %d",index,bs_ind,chr_ind);
-			chrinfoRes = ProcessChrInfo(basicSvcID, 
-				pMCall->basicServiceUsedList->list.array[bs_ind]->chargeInformationList->list.array[chr_ind], szChrInfo, otlConnect);
-			if(chrinfoRes<0) return chrinfoRes;
-		}
-	}
-		
-	return eventID;
+	return TL_OK;
 }
-
 //-----------------------------
 
-long long ProcessTerminatedCall(long fileID, int index, const MobileTerminatedCall* pMCall, otl_connect& otlConnect)
+long CheckTerminatedCall(int index, const MobileTerminatedCall* pMCall)
 {
-	//      Mobile Terminated Call
+	// проверка наличия обязательных структур в Mobile Terminated Call
 	if(!pMCall->basicCallInformation || !pMCall->locationInformation || !pMCall->basicServiceUsedList)
 	{
-		log( LOG_ERROR, "     Mobile Terminated Call.   " + 
+		log( LOG_ERROR, "Обязательные структуры данных отсутствуют в Mobile Terminated Call. Номер звонка " + 
 			to_string( static_cast<unsigned long long> (index)));
 		return TL_MISSINGSTRUCT;
 	}
-	//      Mobile Terminated Call/MT Basic Call Information
+	// проверка наличия обязательных структур в Mobile Terminated Call/MT Basic Call Information
 	if(!pMCall->basicCallInformation->chargeableSubscriber || !pMCall->basicCallInformation->callEventStartTimeStamp ||
 		!pMCall->basicCallInformation->totalCallEventDuration || !pMCall->basicCallInformation->callEventStartTimeStamp)
 	{
-		log( LOG_ERROR, "     Mobile Terminated Call/"
-			"MT Basic Call Information.   " + to_string( static_cast<unsigned long long> (index)));
+		log( LOG_ERROR, "Обязательные структуры данных отсутствуют в Mobile Terminated Call/"
+			"MT Basic Call Information. Номер звонка " + to_string( static_cast<unsigned long long> (index)));
 		return TL_MISSINGSTRUCT;
 	}
 
-	//      Mobile Terminated Call/Location Information
+	// проверка наличия обязательных структур в Mobile Terminated Call/Location Information
 	if(!pMCall->locationInformation->networkLocation  ||
 		!pMCall->locationInformation->networkLocation->recEntityCode)
 	{
-		log( LOG_ERROR, "     Mobile Terminated Call/"
-			"Location Information.   " + to_string( static_cast<unsigned long long> (index)));
+		log( LOG_ERROR, "Обязательные структуры данных отсутствуют в Mobile Terminated Call/"
+			"Location Information. Номер звонка " + to_string( static_cast<unsigned long long> (index)));
 		return TL_MISSINGSTRUCT;
 	}
-
-	long long eventID;
-	string recEntityType;
-
-	otl_nocommit_stream otlStream;
-	
-	otlStream.open( 1 /*stream buffer size in logical rows*/, 
-		"insert into BILLING.TAP3_CALL (EVENT_ID,FILE_ID,RSN,ORIG_OR_TERM,IMSI,MSISDN,PARTY_NUMBER, SMS_PARTYNUMBER, "
-			"CLIR,PARTY_NETWORK,CALL_TIME,CALL_UTCOFF,DURATION,CAUSE_FOR_TERM,REC_ENTITY,REC_ENTITY_TYPE,"
-			"LOCATION_AREA,CELL_ID,SERVING_NETWORK,IMEI, CALL_REFERENCE, RAP_FILE_SEQNUM ) VALUES ("
-			"BILLING.Origin_Seq.NextVal, :hFileID /* long,in */, :hIndex /* int,in */, :hOrigorterm /*short,in*/, :hImsi /* char[20],in */, :hMsisdn  /* char[20],in */, "
-			":hCallingnum  /* char[40],in */, :hSMSOrigin /* char[40],in */, "
-			":hClir  /* short,in */, :hPartynetw  /* char[20],in */ , "
-			"to_date(:hCalltime  /* char[20],in */,'yyyymmddhh24miss'), :hCall_utc /* char[10],in */,:hDuration  /* long,in */ ,:hCause  /* long,in */,"
-			":hRecentity /* char[30],in */, :hRecentityType /* char[10],in */, :hLocarea /* long,in */, :hCellid /* long,in */, "
-			":hServnetw /* char[20],in */, :hImei /* char[30],in */, :hCallReference /* char[32],in */, :hRAPSeqnum /* char[10],in */) "
-			"returning EVENT_ID into :hEventId /*bigint,out*/", otlConnect);
-	
-	otlStream 
-		<< fileID
-		<< index 
-		<< (short) 0
-		<< BCDString( pMCall->basicCallInformation->chargeableSubscriber->choice.simChargeableSubscriber.imsi )
-		<< BCDString( pMCall->basicCallInformation->chargeableSubscriber->choice.simChargeableSubscriber.msisdn )
-		<< (pMCall->basicCallInformation->callOriginator ? 
-				(pMCall->basicCallInformation->callOriginator->callingNumber ? BCDString(pMCall->basicCallInformation->callOriginator->callingNumber) : "") : "")
-		<< (pMCall->basicCallInformation->callOriginator ? 
-				(pMCall->basicCallInformation->callOriginator->sMSOriginator ? (const char*) pMCall->basicCallInformation->callOriginator->sMSOriginator->buf : "") : "");
-
-	if (pMCall->basicCallInformation->callOriginator ) 
-		if (pMCall->basicCallInformation->callOriginator->clirIndicator)
-			otlStream << (short) *pMCall->basicCallInformation->callOriginator->clirIndicator;
-		else
-			otlStream << otl_null();
-	else
-		otlStream << otl_null();
-	
-	otlStream 
-		<< (pMCall->basicCallInformation->originatingNetwork ? (const char*) pMCall->basicCallInformation->originatingNetwork->buf : "")
-		<< pMCall->basicCallInformation->callEventStartTimeStamp->localTimeStamp->buf
-		<< GetUTCOffset( *pMCall->basicCallInformation->callEventStartTimeStamp->utcTimeOffsetCode )
-		<< *pMCall->basicCallInformation->totalCallEventDuration;
-
-	if (pMCall->basicCallInformation->causeForTerm )
-		otlStream << *pMCall->basicCallInformation->causeForTerm ;
-	else
-		otlStream << otl_null();
-
-	otlStream 
-		<< GetRecordingEntity(*pMCall->locationInformation->networkLocation->recEntityCode, recEntityType)
-		<< recEntityType;
-
-	if (pMCall->locationInformation->networkLocation->locationArea )
-		otlStream << *pMCall->locationInformation->networkLocation->locationArea ;
-	else
-		otlStream << otl_null();
-
-	if( pMCall->locationInformation->networkLocation->cellId )
-		otlStream << *pMCall->locationInformation->networkLocation->cellId ;
-	else
-		otlStream << otl_null();
-
-	otlStream
-		<< (pMCall->locationInformation->geographicalLocation ? (pMCall->locationInformation->geographicalLocation->servingNetwork ?
-			(const char*)pMCall->locationInformation->geographicalLocation->servingNetwork->buf : "") : "")
-		<< (pMCall->equipmentIdentifier ? (pMCall->equipmentIdentifier->present == ImeiOrEsn_PR_imei ? BCDString(&pMCall->equipmentIdentifier->choice.imei) :
-			(pMCall->equipmentIdentifier->present == ImeiOrEsn_PR_esn ? BCDString(&pMCall->equipmentIdentifier->choice.esn) : "")) : "");
-	if (pMCall->locationInformation->networkLocation->callReference) {
-		unique_ptr<char> hexString(OctetStrToHexStr(*pMCall->locationInformation->networkLocation->callReference));
-		otlStream << hexString.get();
-	}
-	else
-		otlStream << otl_null();
-	otlStream << (pMCall->basicCallInformation->rapFileSequenceNumber ? (const char*) pMCall->basicCallInformation->rapFileSequenceNumber->buf : "");
-	
-	otlStream.flush();
-	otlStream >> eventID;
-	otlStream.close();
-	
-	//   Basic Service Used
-	long basicSvcID;
-	char szChrInfo[500];
-	for(int bs_ind=0; bs_ind < pMCall->basicServiceUsedList->list.count; bs_ind++)
-	{
-		//      Mobile Originated Call/Basic Service Used
-		if(!pMCall->basicServiceUsedList->list.array[bs_ind]->basicService || !pMCall->basicServiceUsedList->list.array[bs_ind]->chargeInformationList ||
-			!pMCall->basicServiceUsedList->list.array[bs_ind]->basicService->serviceCode)
-		{
-			log( LOG_ERROR, "     Mobile Terminated Call/"
-				"Basic Service Used.   " + to_string( static_cast<unsigned long long> (index)));
-			return TL_MISSINGSTRUCT;
-		}
-		
-		otlStream.open( 1 , "INSERT INTO BILLING.TAP3_BASICSERVICE (SERVICE_ID,EVENT_ID,SERVICE_TYPE,SERVICE_CODE,CHR_TIME,CHR_UTCOFF,HSCSD) \
-							VALUES (BILLING.TAP3EVENTID.NextVal, :hEventId /*bigint,in*/, :hServtype /*long,in*/, :hServcode /*char[5],in*/, \
-							to_date(:hChrtime /*char[20],in*/,'yyyymmddhh24miss'), :hChr_utc /*char[10],in*/, :hHSCSD /*short,in*/) \
-							returning SERVICE_ID into :hServiceId /*long,out*/", otlConnect);
-
-		otlStream 
-			<< eventID
-			<< (long) (pMCall->basicServiceUsedList->list.array[bs_ind]->basicService->serviceCode->present == BasicServiceCode_PR_bearerServiceCode)
-			<< (pMCall->basicServiceUsedList->list.array[bs_ind]->basicService->serviceCode->present == BasicServiceCode_PR_bearerServiceCode ?
-				(const char*)pMCall->basicServiceUsedList->list.array[bs_ind]->basicService->serviceCode->choice.bearerServiceCode.buf :
-				(const char*)pMCall->basicServiceUsedList->list.array[bs_ind]->basicService->serviceCode->choice.teleServiceCode.buf )
-			<< (pMCall->basicServiceUsedList->list.array[bs_ind]->chargingTimeStamp ?
-				(const char*)pMCall->basicServiceUsedList->list.array[bs_ind]->chargingTimeStamp->localTimeStamp->buf : "")
-			<< (pMCall->basicServiceUsedList->list.array[bs_ind]->chargingTimeStamp ?
-				GetUTCOffset( *pMCall->basicServiceUsedList->list.array[bs_ind]->chargingTimeStamp->utcTimeOffsetCode ) : "")
-			<<	(pMCall->basicServiceUsedList->list.array[bs_ind]->hSCSDIndicator ? (short) 1 : (short) 0) ;
-
-		otlStream.flush();
-		otlStream >> basicSvcID;
-
-		otlStream.close();
-		long chrinfoRes;
-
-		//   Charge Information
-		for(int chr_ind=0; chr_ind < pMCall->basicServiceUsedList->list.array[bs_ind]->chargeInformationList->list.count; chr_ind++)
-		{
-			sprintf(szChrInfo,"  %d\n Basic Service %d\n Charge Information %d",index,bs_ind,chr_ind);
-			chrinfoRes = ProcessChrInfo(basicSvcID, 
-				pMCall->basicServiceUsedList->list.array[bs_ind]->chargeInformationList->list.array[chr_ind], szChrInfo, otlConnect);
-			if(chrinfoRes<0) return chrinfoRes;
-		}
-	}
-		
-	return eventID;
+	return TL_OK;
 }
-
-
 //-----------------------------
 
-long long ProcessGPRSCall(long fileID, int index, const GprsCall* pMCall, otl_connect& otlConnect)
+long CheckGPRSCall(int index, const GprsCall* pMCall)
 {
-	//      Mobile Terminated Call
+	// проверка наличия обязательных структур в Mobile Terminated Call
 	if(!pMCall->gprsBasicCallInformation|| !pMCall->gprsLocationInformation || !pMCall->gprsServiceUsed)
 	{
-		log( LOG_ERROR, "     GPRS Call.   " + to_string( static_cast<unsigned long long> (index)));
+		log( LOG_ERROR, "Обязательные структуры данных отсутствуют в GPRS Call. Номер звонка " + to_string( static_cast<unsigned long long> (index)));
 		return TL_MISSINGSTRUCT;
 	}
-	//      Mobile Terminated Call/MT Basic Call Information
+	// проверка наличия обязательных структур в Mobile Terminated Call/MT Basic Call Information
 	if(!pMCall->gprsBasicCallInformation->gprsChargeableSubscriber || !pMCall->gprsBasicCallInformation->gprsDestination || !pMCall->gprsBasicCallInformation->callEventStartTimeStamp ||
 		!pMCall->gprsBasicCallInformation->totalCallEventDuration || !pMCall->gprsBasicCallInformation->chargingId)
 	{
-		log( LOG_ERROR, "     GPRS Call/"
-			"GPRS Basic Call Information.   " + to_string( static_cast<unsigned long long> (index)));
+		log( LOG_ERROR, "Обязательные структуры данных отсутствуют в GPRS Call/"
+			"GPRS Basic Call Information. Номер звонка " + to_string( static_cast<unsigned long long> (index)));
 		return TL_MISSINGSTRUCT;
 	}
 
-	//      Mobile Terminated Call/Location Information
+	// проверка наличия обязательных структур в Mobile Terminated Call/Location Information
 	if(!pMCall->gprsLocationInformation->gprsNetworkLocation  || !pMCall->gprsLocationInformation->gprsNetworkLocation->recEntity)
 	{
-		log( LOG_ERROR, "     GPRS Call/"
-			"GPRS Location Information.   " + to_string( static_cast<unsigned long long> (index)));
+		log( LOG_ERROR, "Обязательные структуры данных отсутствуют в GPRS Call/"
+			"GPRS Location Information. Номер звонка " + to_string( static_cast<unsigned long long> (index)));
 		return TL_MISSINGSTRUCT;
 	}
-
-	long long eventID;
-	string recEntityType;
-
-	otl_nocommit_stream otlStream;	
-	
-	otlStream.open( 1 /*stream buffer size in logical rows*/, 
-		"INSERT INTO BILLING.TAP3_GPRSCALL (\
-			EVENT_ID, \
-			FILE_ID, \
-			RSN, \
-			IMSI, \
-			MSISDN, \
-			PDP_ADDRESS, \
-			APN_NI, \
-			APN_OI, \
-			CALL_TIME, \
-			CALL_UTCOFF, \
-			DURATION, \
-			CAUSE_FOR_TERM, \
-			PARTIAL_TYPE, \
-			PDP_START_TIME, \
-			PDP_START_UTCOFF, \
-			CHARGING_ID, \
-			REC_ENTITY, \
-			REC_ENTITY_TYPE, \
-			REC_ENTITY2, \
-			REC_ENTITY2_TYPE, \
-			LOCATION_AREA, \
-			CELL_ID, \
-			SERVING_NETWORK, \
-			IMEI, \
-			RAP_FILE_SEQNUM, \
-			VOLUME_INCOMING, \
-			VOLUME_OUTGOING \
-				) VALUES (\
-			BILLING.Origin_Seq.NextVal, \
-			:hFileid /* long,in */, \
-			:hIndex /* int,in */, \
-			:hImsi /* char[30],in */, \
-			:hMsisdn /* char[30],in */, \
-			:hPdpaddr /* char[50],in */, \
-			:hApnni /* char[70],in */, \
-			:hApnoi /* char[70],in */, \
-			to_date(:hCalltime  /* char[20],in */,'yyyymmddhh24miss'), \
-			:hCall_utc /* char[20],in */, \
-			:hDuration /* long,in */, \
-			:hCause /* long,in */,\
-			:hPartial /* char[5],in */, \
-			to_date(:hPdpstart /* char[20],in */,'yyyymmddhh24miss'),\
-			:hPdp_utc /* char[10],in */, \
-			:hChargid /* bigint,in */, \
-			:hRecentity /* char[50],in */,\
-			:hRecentityType  /* char[10],in */,\
-			:hRecentity2 /* char[50],in */,\
-			:hRecentity2Type  /* char[10],in */,\
-			:hLocarea /* long,in */, \
-			:hCellid /* long,in */, \
-			:hServingNet /* char[20],in */,\
-			:hImei /* char[30],in */, \
-			:RapFileSN /* char[10],in */, \
-			:VolIncoming /* bigint,in */,\
-			:VolOutgoing /* bigint,in */) \
-			returning EVENT_ID into :hEventId /*bigint,out*/", otlConnect);
-	
-	otlStream 
-		<< fileID
-		<< index 
-		<< BCDString( pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->chargeableSubscriber->choice.simChargeableSubscriber.imsi )
-		<< (pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->chargeableSubscriber->choice.simChargeableSubscriber.msisdn ? 
-				BCDString( pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->chargeableSubscriber->choice.simChargeableSubscriber.msisdn ) :
-					(pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->networkAccessIdentifier ? 
-						(const char*) pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->networkAccessIdentifier->buf : ""))
-		<< (pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->pdpAddress ? 
-			(const char*) pMCall->gprsBasicCallInformation->gprsChargeableSubscriber->pdpAddress->buf : "")
-		<< (pMCall->gprsBasicCallInformation->gprsDestination->accessPointNameNI ? 
-			(const char*) pMCall->gprsBasicCallInformation->gprsDestination->accessPointNameNI->buf : "")
-		<< (pMCall->gprsBasicCallInformation->gprsDestination->accessPointNameOI ? 
-			(const char*) pMCall->gprsBasicCallInformation->gprsDestination->accessPointNameOI->buf : "")
-		<< pMCall->gprsBasicCallInformation->callEventStartTimeStamp->localTimeStamp->buf 
-		<< GetUTCOffset( *pMCall->gprsBasicCallInformation->callEventStartTimeStamp->utcTimeOffsetCode )
-		<< *pMCall->gprsBasicCallInformation->totalCallEventDuration;
-
-	if(pMCall->gprsBasicCallInformation->causeForTerm )
-		otlStream << *pMCall->gprsBasicCallInformation->causeForTerm;
-	else
-		otlStream << otl_null();
-
-	otlStream
-		<< (pMCall->gprsBasicCallInformation->partialTypeIndicator ? (const char*)pMCall->gprsBasicCallInformation->partialTypeIndicator->buf : "")
-		<< (pMCall->gprsBasicCallInformation->pDPContextStartTimestamp ? (const char*)pMCall->gprsBasicCallInformation->pDPContextStartTimestamp->localTimeStamp->buf : "")
-		<< (pMCall->gprsBasicCallInformation->pDPContextStartTimestamp ? GetUTCOffset(*pMCall->gprsBasicCallInformation->pDPContextStartTimestamp->utcTimeOffsetCode) : "")
-		<< OctetStr2Int64(*pMCall->gprsBasicCallInformation->chargingId);
-	if (pMCall->gprsLocationInformation->gprsNetworkLocation->recEntity->list.count > 0) {
-		// first recording entity
-		otlStream
-			<< GetRecordingEntity(*pMCall->gprsLocationInformation->gprsNetworkLocation->recEntity->list.array[0], recEntityType)
-			<< recEntityType;
-	}
-	else {
-		otlStream
-			<< ""
-			<< "";
-	}
-
-	if (pMCall->gprsLocationInformation->gprsNetworkLocation->recEntity->list.count > 1) {
-		// second recording entity
-		otlStream
-			<< GetRecordingEntity(*pMCall->gprsLocationInformation->gprsNetworkLocation->recEntity->list.array[1], recEntityType)
-			<< recEntityType;
-	}
-	else {
-		otlStream
-			<< ""
-			<< "";
-	}
-
-	if( pMCall->gprsLocationInformation->gprsNetworkLocation->locationArea )
-		otlStream << *pMCall->gprsLocationInformation->gprsNetworkLocation->locationArea ;
-	else
-		otlStream << otl_null();
-
-	if( pMCall->gprsLocationInformation->gprsNetworkLocation->locationArea )
-		cout << *pMCall->gprsLocationInformation->gprsNetworkLocation->locationArea << endl;
-	else
-		cout << otl_null() << endl;
-
-	if (pMCall->gprsLocationInformation->gprsNetworkLocation->cellId )
-		otlStream << *pMCall->gprsLocationInformation->gprsNetworkLocation->cellId ;
-	else
-		otlStream << otl_null();
-
-	if (pMCall->gprsLocationInformation->gprsNetworkLocation->cellId )
-		cout << *pMCall->gprsLocationInformation->gprsNetworkLocation->cellId << endl;
-	else
-		cout << otl_null() << endl;
-
-	otlStream 
-		<< (pMCall->gprsLocationInformation->geographicalLocation ? ( pMCall->gprsLocationInformation->geographicalLocation->servingNetwork ?
-			(const char*) pMCall->gprsLocationInformation->geographicalLocation->servingNetwork->buf : "") : "")
-		<< (pMCall->equipmentIdentifier ?	( pMCall->equipmentIdentifier->present == ImeiOrEsn_PR_imei ? BCDString( &pMCall->equipmentIdentifier->choice.imei ) : 
-			(pMCall->equipmentIdentifier->present == ImeiOrEsn_PR_esn ?	BCDString( &pMCall->equipmentIdentifier->choice.esn ) : "")) : "")
-		<< (pMCall->gprsBasicCallInformation->rapFileSequenceNumber ? (const char*) pMCall->gprsBasicCallInformation->rapFileSequenceNumber->buf : "")
-		<< OctetStr2Int64 (*pMCall->gprsServiceUsed->dataVolumeIncoming )
-		<< OctetStr2Int64 (*pMCall->gprsServiceUsed->dataVolumeOutgoing ) ;
-
-	otlStream.flush();
-	otlStream >> eventID;
-	otlStream.close();
-
-	char szChrInfo[500];
-	long chrinfoRes;
-	//   Charge Information
-	for(int chr_ind=0; chr_ind < pMCall->gprsServiceUsed->chargeInformationList->list.count; chr_ind++)
-	{
-		sprintf(szChrInfo,"  %d\n Charge Information %d", index, chr_ind);
-		chrinfoRes=ProcessChrInfo(eventID, pMCall->gprsServiceUsed->chargeInformationList->list.array[chr_ind], szChrInfo, otlConnect);
-		if(chrinfoRes<0) return chrinfoRes;
-	}
-
-	return eventID;
+	return TL_OK;
 }
-
 //-----------------------------
-void Finalize(otl_connect& otlConnect, bool bSuccess)
+// returns false if load is committed, but RAP files created by it are not committed to upload queue
+bool Finalize(otl_connect& otlConnect, bool bSuccess)
 {
 	if( dataInterchange )     
 		ASN_STRUCT_FREE(asn_DEF_DataInterChange, dataInterchange);
@@ -1007,23 +546,108 @@ void Finalize(otl_connect& otlConnect, bool bSuccess)
 			otlConnect.rollback();
 		otlConnect.logoff();
 	}
+	// RAP files are uploaded and sequence number of loaded file is registered only if the load is committed
+	bool uploadsCommitted = true;
+	if (bSuccess) {
+		uploadsCommitted = RAPUploadQueue::Instance().Commit();
+		if (loadedSequenceIndex.get())
+			loadedSequenceIndex->MarkLoaded(loadedSequenceNumber);
+	}
+	else
+		RAPUploadQueue::Instance().Rollback();
+	loadedSequenceIndex.reset();
 
 	if(ofsLog.is_open()) ofsLog.close();
+	return uploadsCommitted;
+}
+//------------------------------
+// RSNs of rejected events for log message, long lists are cut
+string RejectedRSNsToString(const vector<long>& rejectedRSNs)
+{
+	const size_t maxLoggedRSNs = 100;
+	string rsnList;
+	for (size_t i = 0; i < rejectedRSNs.size() && i < maxLoggedRSNs; i++)
+		rsnList += (i > 0 ? ", " : "") + to_string((long long) rejectedRSNs[i]);
+	if (rejectedRSNs.size() > maxLoggedRSNs)
+		rsnList += "...";
+	return rsnList;
+}
+//------------------------------
+// Loads events of transfer batch by writer sessions to staging tables and publishes them in load session.
+// eventIDs receive IDs of loaded events by event index, events rejected by DB are not loaded (ID 0)
+// if partial load is accepted.
+int WriteEventsInParallel(long fileID, otl_connect& otlConnect, Config& config, vector<long long>& eventIDs)
+{
+	ParallelEventWriter parallelWriter(config.GetConnectString(), writerSessions);
+	int writeRes = parallelWriter.WriteEvents(fileID, &dataInterchange->choice.transferBatch, eventIDs);
+	vector<long> rejectedRSNs;
+	if (writeRes == TL_OK)
+		writeRes = parallelWriter.CollectRejectedRows(fileID, rejectedRSNs);
+	if (writeRes == TL_OK && !rejectedRSNs.empty()) {
+		log(LOG_ERROR, "Строк событий отклонено базой данных: " + to_string((long long) rejectedRSNs.size()) +
+			" (номера звонков " + RejectedRSNsToString(rejectedRSNs) + "). Ошибки записаны в TAP3_EVENT_ERROR");
+		// rows of unknown events can't be excluded from the load
+		if (!bAcceptPartialFile || find(rejectedRSNs.begin(), rejectedRSNs.end(), 0) != rejectedRSNs.end() ||
+				!parallelWriter.DiscardRejectedEvents(fileID))
+			writeRes = TL_ORACLEERROR;
+		else {
+			for (size_t i = 0; i < rejectedRSNs.size(); i++)
+				eventIDs[rejectedRSNs[i] - 1] = 0;
+			log(LOG_INFO, "Файл загружается без отклоненных событий");
+		}
+	}
+	if (writeRes == TL_OK) {
+		try {
+			parallelWriter.Publish(otlConnect, fileID);
+		}
+		catch (otl_exception&) {
+			parallelWriter.Discard(fileID);
+			throw;
+		}
+	}
+	// published rows are copied by load session, so staging rows are not needed in any case
+	parallelWriter.Discard(fileID);
+	return writeRes;
 }
 //------------------------------
 int LoadTAPEventsToDB(long fileID, long iotValidationMode, long roamingHubID, otl_connect& otlConnect, Config& config)
 {
-	long long eventID;
+	long long eventID = 0;
 	CallValidationResult validationRes;
 	otl_nocommit_stream otlCallUpdater;
-	CallValidator callValidator(otlConnect, &dataInterchange->choice.transferBatch, config, roamingHubID);
+	CallValidator callValidator(otlConnect, &dataInterchange->choice.transferBatch, config, roamingHubID, &callEventSpans);
+	unique_ptr<ArrowExporter> arrowExporter;
+	if (pExportDir) {
+		arrowExporter.reset(new ArrowExporter(otlConnect, pExportDir, pShortName));
+		if (!arrowExporter->Open()) {
+			log(pShortName, LOG_ERROR, string("Ошибка открытия файлов экспорта в каталоге ") + pExportDir + ". Экспорт отключен.");
+			arrowExporter.reset();
+		}
+	}
+	// events of big files are loaded by several sessions before their validation. Other events are loaded
+	// one by one before validation of each, events rejected by DB are skipped if partial load is accepted.
+	vector<long long> writtenEventIDs;
+	unique_ptr<SingleRowEventWriter> singleRowWriter;
+	if (writerSessions > 1 && dataInterchange->choice.transferBatch.callEventDetails->list.count >= minParallelWriteEvents) {
+		int writeRes = WriteEventsInParallel(fileID, otlConnect, config, writtenEventIDs);
+		if (writeRes != TL_OK)
+			return writeRes;
+	}
+	else
+		singleRowWriter.reset(new SingleRowEventWriter(otlConnect, fileID, GetTAPDecimalPlaces(), bAcceptPartialFile));
 	for(int index=0; index < dataInterchange->choice.transferBatch.callEventDetails->list.count; index++)
 	{
+		if (!writtenEventIDs.empty() && writtenEventIDs[index] == 0)
+			continue;	// rejected or ignored event
 		switch( dataInterchange->choice.transferBatch.callEventDetails->list.array[index]->present) {
 		case CallEventDetail_PR_mobileOriginatedCall:
-			if ((eventID = ProcessOriginatedCall(fileID, index + 1,
-					&dataInterchange->choice.transferBatch.callEventDetails->list.array[index]->choice.mobileOriginatedCall, otlConnect)) < 0) {
-				//  
+			if (!writtenEventIDs.empty())
+				eventID = writtenEventIDs[index];
+			else if ((eventID = singleRowWriter->Write(index + 1,
+					dataInterchange->choice.transferBatch.callEventDetails->list.array[index])) <= 0) {
+				if (eventID == 0)
+					continue;	// rejected event
+				// ошибка загрузки
 				return (long) eventID;
 			}
 			validationRes = callValidator.ValidateCall(eventID, TELEPHONY_CALL, index, iotValidationMode);
@@ -1031,9 +655,13 @@ int LoadTAPEventsToDB(long fileID, long iotValidationMode, long roamingHubID, ot
 				return TL_TAP_NOT_VALIDATED;
 			break;
 		case CallEventDetail_PR_mobileTerminatedCall:
-			if ((eventID = ProcessTerminatedCall(fileID, index+1, 
-					&dataInterchange->choice.transferBatch.callEventDetails->list.array[index]->choice.mobileTerminatedCall, otlConnect)) < 0) {
-				//  
+			if (!writtenEventIDs.empty())
+				eventID = writtenEventIDs[index];
+			else if ((eventID = singleRowWriter->Write(index + 1,
+					dataInterchange->choice.transferBatch.callEventDetails->list.array[index])) <= 0) {
+				if (eventID == 0)
+					continue;	// rejected event
+				// ошибка загрузки
 				return (long)eventID;
 			}
 			validationRes = callValidator.ValidateCall(eventID, TELEPHONY_CALL, index, iotValidationMode);
@@ -1044,9 +672,13 @@ int LoadTAPEventsToDB(long fileID, long iotValidationMode, long roamingHubID, ot
 			// just ignore it
 			break;
 		case CallEventDetail_PR_gprsCall:
-			if ((eventID = ProcessGPRSCall(fileID, index+1, 
-					&dataInterchange->choice.transferBatch.callEventDetails->list.array[index]->choice.gprsCall, otlConnect)) < 0) {
-				//  
+			if (!writtenEventIDs.empty())
+				eventID = writtenEventIDs[index];
+			else if ((eventID = singleRowWriter->Write(index + 1,
+					dataInterchange->choice.transferBatch.callEventDetails->list.array[index])) <= 0) {
+				if (eventID == 0)
+					continue;	// rejected event
+				// ошибка загрузки
 				return (long) eventID;
 			}
 			validationRes = callValidator.ValidateCall(eventID, GPRS_CALL, index, iotValidationMode);
@@ -1054,15 +686,29 @@ int LoadTAPEventsToDB(long fileID, long iotValidationMode, long roamingHubID, ot
 					return TL_TAP_NOT_VALIDATED;
 			break;
 		default:
-			log(pShortName, LOG_ERROR, string("      ") + 
+			log(pShortName, LOG_ERROR, string("Не найден обработчик события с кодом ") + 
 				to_string( static_cast<unsigned long long> (dataInterchange->choice.transferBatch.callEventDetails->list.array[index-1]->present)) +
-				string(".   ") + to_string(static_cast<unsigned long long> (index+1)));
+				string(". Номер звонка ") + to_string(static_cast<unsigned long long> (index+1)));
 			return TL_NEWCOMPONENT;
 		}
+		if (arrowExporter.get() && arrowExporter->WriteEvent(eventID, fileID, index + 1,
+				dataInterchange->choice.transferBatch.callEventDetails->list.array[index]) != TL_OK) {
+			log(pShortName, LOG_ERROR, string("Ошибка экспорта события ") + to_string(static_cast<unsigned long long> (index+1)) +
+				". Экспорт отключен.");
+			arrowExporter.reset();
+		}
+	}
+	if (singleRowWriter.get() && !singleRowWriter->GetRejectedRSNs().empty()) {
+		const vector<long>& rejectedRSNs = singleRowWriter->GetRejectedRSNs();
+		log(LOG_ERROR, "Строк событий отклонено базой данных: " + to_string((long long) rejectedRSNs.size()) +
+			" (номера звонков " + RejectedRSNsToString(rejectedRSNs) + "). Ошибки записаны в TAP3_EVENT_ERROR");
+		log(LOG_INFO, "Файл загружается без отклоненных событий");
 	}
+	if (arrowExporter.get() && arrowExporter->Close())
+		log(pShortName, LOG_INFO, string("События экспортированы в каталог ") + pExportDir);
 	RAPFile& rapFile = callValidator.GetRAPFile();
 	if (rapFile.IsInitialized()) {
-		log(pShortName, LOG_ERROR, "   .");
+		log(pShortName, LOG_ERROR, "Обнаружены ошибки валидации событий.");
 		rapFile.Finalize();
 		rapFile.LoadToDB();
 		int writeRes = rapFile.EncodeAndUpload();
@@ -1078,7 +724,7 @@ void LoadNotificationHeader(long fileID, long roamingHubID, std::string filename
 	otlStream.open( 1 /*stream buffer size in logical rows*/, 
 		"insert into BILLING.TAP3_FILE (FILE_ID, MOBILENETWORK_ID, ROAMINGHUB_ID, FILENAME, SENDER, RECIPIENT, SEQUENCE_NUMBER , CREATION_STAMP, CREATION_UTCOFF,"
 		"CUTOFF_STAMP, CUTOFF_UTCOFF, AVAILABLE_STAMP, AVAILABLE_UTCOFF, LOAD_TIME, NOTIFICATION, TAP_VERSION, TAP_RELEASE, "
-		"FILE_TYPE_INDICATOR, STATUS, CANCEL_RAP_FILE_SEQNUM, CANCEL_RAP_FILE_ID, VALIDATION_ERROR) "
+		"FILE_TYPE_INDICATOR, STATUS, CANCEL_RAP_FILE_SEQNUM, CANCEL_RAP_FILE_ID, VALIDATION_ERROR, CONTENT_HASH) "
 		"values ("
 		":hfileid /*long,in*/, :mobilenetworkid /*long,in*/, :roamhubid /*long,in*/, :filename/*char[255],in*/, "
 		":sender/*char[20],in*/, :recipient/*char[20],in*/, :seq_num/*char[10],in*/,"
@@ -1087,7 +733,7 @@ void LoadNotificationHeader(long fileID, long roamingHubID, std::string filename
 		"to_date(:available_stamp /*char[20],in*/, 'yyyymmddhh24miss'), :available_utcoff /* char[10],in*/,"
 		"sysdate, 1 /*notification*/, :tapVer /*long,in*/, :specif /*long,in*/, :filetype /*char[5],in*/, "
 		":status /*long,in*/, :cancel_rap_file_seqnum /*char[10],in*/, :cancel_rap_file_id /*long,in*/, "
-		":validation_error /*char[1000],in*/)", otlConnect); 
+		":validation_error /*char[1000],in*/, :content_hash /*char[20],in*/)", otlConnect); 
 	otlStream
 		<< fileID
 		<< tapValidator.GetSenderNetworkID()
@@ -1136,19 +782,25 @@ void LoadNotificationHeader(long fileID, long roamingHubID, std::string filename
 	else {
 		otlStream << otl_null();
 	}
+	otlStream << fileContentHash;
 			
 	otlStream.flush();
 	otlStream.close();
 }
 //----------------------------------------
-void LoadTransferBatchHeader(long fileID, long roamingHubID, std::string filename, const TAPValidator& tapValidator, otl_connect& otlConnect)
+// header of valid file which events are not loaded to DB by the loader (bulkLoad) has status of not validated file
+void LoadTransferBatchHeader(long fileID, long roamingHubID, std::string filename, const TAPValidator& tapValidator, otl_connect& otlConnect,
+	bool bulkLoad)
 {
+	// totals are bound as mantissas and divided in statement, so that they are loaded exactly
+	int tapDecimalPlaces = GetTAPDecimalPlaces();
+	string amountDivisor = to_string(TapAmount::Power(tapDecimalPlaces));
 	otl_nocommit_stream otlStream;
-	otlStream.open(1 /*stream buffer size in logical rows*/,
+	otlStream.open(1 /*stream buffer size in logical rows*/, (string(
 		"insert into BILLING.TAP3_FILE (FILE_ID, MOBILENETWORK_ID, ROAMINGHUB_ID, FILENAME, SENDER, RECIPIENT, SEQUENCE_NUMBER , CREATION_STAMP, CREATION_UTCOFF,"
 		"CUTOFF_STAMP, CUTOFF_UTCOFF, AVAILABLE_STAMP, AVAILABLE_UTCOFF, LOCAL_CURRENCY, LOAD_TIME, EARLIEST_TIME, EARLIEST_UTCOFF, "
 		"LATEST_TIME, LATEST_UTCOFF, EVENT_COUNT, TOTAL_CHARGE, TOTAL_TAX, TOTAL_DISCOUNT, NOTIFICATION, STATUS, TAP_VERSION, TAP_RELEASE, "
-		"FILE_TYPE_INDICATOR, TAP_DECIMAL_PLACES, CANCEL_RAP_FILE_SEQNUM, CANCEL_RAP_FILE_ID, VALIDATION_ERROR) "
+		"FILE_TYPE_INDICATOR, TAP_DECIMAL_PLACES, CANCEL_RAP_FILE_SEQNUM, CANCEL_RAP_FILE_ID, VALIDATION_ERROR, CONTENT_HASH) "
 		"values ("
 		":hfileid /*long,in*/, :mobilenetworkid /*long,in*/, :roamhubid /*long,in*/, :filename/*char[255],in*/, "
 		":sender/*char[20],in*/, :recipient/*char[20],in*/, :seq_num/*char[10],in*/,"
@@ -1156,10 +808,11 @@ void LoadTransferBatchHeader(long fileID, long roamingHubID, std::string filenam
 		"to_date(:cutoff_stamp /*char[20],in*/, 'yyyymmddhh24miss'), :cutoff_utcoff /* char[10],in */,"
 		"to_date(:available_stamp /*char[20],in*/, 'yyyymmddhh24miss'), :available_utcoff /* char[10],in */,"
 		":local_currency /* char[255],in */, sysdate, to_date(:earliest /*char[20],in*/, 'yyyymmddhh24miss'), :earliest_utcoff /* char[10],in */,"
-		"to_date(:latest /*char[20],in*/, 'yyyymmddhh24miss'), :latest_utcoff /* char[10],in */, :eventcount /* long,in */, :totalchr /* double,in */, "
-		":total_tax /*double,in*/, :total_discount /*double,in*/, 0 /*notification*/, :status /*long,in*/, :tapVer /*long,in*/, :specif /*long,in*/, "
+		"to_date(:latest /*char[20],in*/, 'yyyymmddhh24miss'), :latest_utcoff /* char[10],in */, :eventcount /* long,in */, "
+		":totalchr /* bigint,in */ / ") + amountDivisor + ", :total_tax /*bigint,in*/ / " + amountDivisor + ", "
+		":total_discount /*bigint,in*/ / " + amountDivisor + ", 0 /*notification*/, :status /*long,in*/, :tapVer /*long,in*/, :specif /*long,in*/, "
 		":filetype /*char[5],in*/, :tapDecimalPlaces /*long,in*/, :cancel_rap_file_seqnum /*char[10],in*/, "
-		":cancel_rap_file_id /*long,in*/, :validation_error /*char[1000],in*/) ", otlConnect);
+		":cancel_rap_file_id /*long,in*/, :validation_error /*char[1000],in*/, :content_hash /*char[20],in*/) ").c_str(), otlConnect);
 	otlStream
 		<< fileID
 		<< tapValidator.GetSenderNetworkID()
@@ -1198,21 +851,21 @@ void LoadTransferBatchHeader(long fileID, long roamingHubID, std::string filenam
 	else
 		otlStream << otl_null();
 	if (dataInterchange->choice.transferBatch.auditControlInfo->totalCharge)
-		otlStream << OctetStr2Int64(*dataInterchange->choice.transferBatch.auditControlInfo->totalCharge) / GetTAPPower();
+		otlStream << TapAmount::FromOctetString(*dataInterchange->choice.transferBatch.auditControlInfo->totalCharge, tapDecimalPlaces).GetMantissa();
 	else
 		otlStream << otl_null();
 	if (dataInterchange->choice.transferBatch.auditControlInfo->totalTaxValue)
-		otlStream << OctetStr2Int64(*dataInterchange->choice.transferBatch.auditControlInfo->totalTaxValue) / GetTAPPower();
+		otlStream << TapAmount::FromOctetString(*dataInterchange->choice.transferBatch.auditControlInfo->totalTaxValue, tapDecimalPlaces).GetMantissa();
 	else
 		otlStream << otl_null();
 	if (dataInterchange->choice.transferBatch.auditControlInfo->totalDiscountValue)
-		otlStream << OctetStr2Int64(*dataInterchange->choice.transferBatch.auditControlInfo->totalDiscountValue) / GetTAPPower();
+		otlStream << TapAmount::FromOctetString(*dataInterchange->choice.transferBatch.auditControlInfo->totalDiscountValue, tapDecimalPlaces).GetMantissa();
 	else
 		otlStream << otl_null();
 
 	switch (tapValidator.GetValidationResult()) {
 	case TAP_VALID:
-		otlStream << (long)INFILE_STATUS_NEW;
+		otlStream << (long)(bulkLoad ? INFILE_STATUS_UNABLE_TO_VALIDATE : INFILE_STATUS_NEW);
 		break;
 	case FATAL_ERROR:
 		otlStream << (long)INFILE_STATUS_FATAL;
@@ -1256,22 +909,18 @@ void LoadTransferBatchHeader(long fileID, long roamingHubID, std::string filenam
 	if (tapValidator.GetValidationResult() != TAP_VALID) {
 		otlStream << tapValidator.GetValidationError();
 	}
+	else if (bulkLoad) {
+		otlStream << "События записаны в файлы прямой загрузки, валидация звонков не выполнялась";
+	}
 	else {
 		otlStream << otl_null();
 	}
+	otlStream << fileContentHash;
 
 	otlStream.flush();
 	otlStream.close();
 }
 //----------------------------------------
-void DeleteNotValidatedFileHeader(long fileID, otl_connect& otlConnect )
-{
-	otl_nocommit_stream stream;
-	stream.open(1, "call BILLING.TAP3.DeleteNotValidatedFileHeader(:file_id /*long,in*/)", otlConnect);
-	stream << fileID;
-	stream.close();
-}
-//----------------------------------------
 int LoadTAPFileToDB( unsigned char* buffer, long dataLen, long fileID, long roamingHubID, bool bPrintOnly, 
 		otl_connect& otlConnect, Config& config) 
 {
@@ -1279,48 +928,83 @@ int LoadTAPFileToDB( unsigned char* buffer, long dataLen, long fileID, long roam
 	try {
 		asn_dec_rval_t rval;
 		dataInterchange = NULL;
-		rval = ber_decode(0, &asn_DEF_DataInterChange, (void**) &dataInterchange, buffer, dataLen);
+		// call events are decoded after validation, if they are to be loaded
+		rval = DecodeDataInterchange(buffer, dataLen, &dataInterchange, callEventSpans, false);
 		if(rval.code != RC_OK) {
-			log( LOG_ERROR, string(" ASN- .   ") + 
+			log( LOG_ERROR, string("Ошибка ASN-декодирования файла. Код ошибки ") + 
 				to_string( static_cast<unsigned long long> (rval.code)));
 			Finalize(otlConnect, false);
 			return TL_DECODEERROR;
 		}
 		if( bPrintOnly ) {
-			char* printName = new char[ strlen(pShortName)+5 ];
-			sprintf(printName, "%s.txt", pShortName);
-			FILE* fFileContents = fopen (printName, "w");
-			if ( fFileContents ) {
-				asn_fprint(fFileContents, &asn_DEF_DataInterChange, dataInterchange);
-				fclose(fFileContents);
-			}
-			else
-			{
-				printf("   %s\n", printName);
-			}
-			delete [] printName;
+			JsonDumper jsonDumper(otlConnect, pDumpFields ? pDumpFields : "", dumpFirstEvent, dumpLastEvent);
+			int dumpRes = jsonDumper.DumpDataInterchange(string(pShortName) + ".ndjson", fileID, dataInterchange, &callEventSpans);
 			printf("---- File contents printed to output file. Exiting. -------");
-			return TL_OK;
+			return dumpRes;
+		}
+		if (bValidateOnly) {
+			// call events are decoded by validator only as far as their charges are concerned, file header is not loaded
+			TAPValidator tapValidator(otlConnect, config, roamingHubID, true);
+			tapValidator.Validate(dataInterchange, &callEventSpans);
+			const vector<string>& rapErrorCodes = tapValidator.GetRAPErrorCodes();
+			string rapErrors;
+			for (size_t i = 0; i < rapErrorCodes.size(); i++)
+				rapErrors += (i > 0 ? ", " : "") + rapErrorCodes[i];
+			log(LOG_INFO, "Результат валидации: " + to_string((long long) tapValidator.GetValidationResult()) +
+				(rapErrors.empty() ? "" : ". Коды ошибок RAP: " + rapErrors));
+			printf("Validation result: %d. RAP error codes: %s\n", tapValidator.GetValidationResult(),
+				rapErrors.empty() ? "none" : rapErrors.c_str());
+			return (tapValidator.GetValidationResult() == TAP_VALID ? TL_OK : TL_TAP_NOT_VALIDATED);
 		}
 
-		DeleteNotValidatedFileHeader(fileID, otlConnect);
+		// not validated header of the file left by previous load is deleted by admission query of validator
 		TAPValidator tapValidator(otlConnect, config, roamingHubID);
-		tapValidator.Validate(dataInterchange);
+		tapValidator.Validate(dataInterchange, &callEventSpans, fileID);
 		if (tapValidator.GetValidationResult() == VALIDATION_IMPOSSIBLE) {
-			log(LOG_ERROR, "   TAP-.     "); 
+			log(LOG_ERROR, "Невозможно провести валидацию TAP-файла. Будет загружен только заголовок файла"); 
 		}
 		else if (tapValidator.GetValidationResult() == FILE_DUPLICATION) {
 			// no uploading needed
 			return TL_OK;
 		}
 		
+		// Events of direct-path load are loaded to DB by SQL*Loader after the run, so calls can't be validated by DB procedures.
+		// Files needing IOT validation are loaded to DB, headers of others are pending (not validated) until the file is loaded
+		// without -b switch.
+		bool bulkLoad = false;
+		if (pStagingDir && dataInterchange->present == DataInterChange_PR_transferBatch &&
+				tapValidator.GetValidationResult() == TAP_VALID) {
+			if (tapValidator.GetIOTValidationMode() == IOT_NO_NEED)
+				bulkLoad = true;
+			else
+				log(LOG_INFO, "Режим прямой загрузки неприменим: файл требует IOT-валидации звонков. События загружаются в БД");
+		}
+		// header of not validated file is deleted on its next load, so its sequence number is not registered
+		if (tapValidator.GetValidationResult() != VALIDATION_IMPOSSIBLE && !bulkLoad)
+			loadedSequenceIndex.reset(tapValidator.OpenSequenceIndex(loadedSequenceNumber));
 		otl_nocommit_stream otlStream;
 		if (dataInterchange->present == DataInterChange_PR_notification) {
 			LoadNotificationHeader(fileID, roamingHubID, pShortName, tapValidator, otlConnect);
 		}
 		else {
-			LoadTransferBatchHeader(fileID, roamingHubID, pShortName, tapValidator, otlConnect);
+			LoadTransferBatchHeader(fileID, roamingHubID, pShortName, tapValidator, otlConnect, bulkLoad);
+		}
+		if (dataInterchange->present == DataInterChange_PR_transferBatch) {
 			if (tapValidator.GetValidationResult() == TAP_VALID) {
+				rval.code = DecodeCallEvents(dataInterchange, callEventSpans);
+				if (rval.code != RC_OK) {
+					log(LOG_ERROR, string("Ошибка ASN-декодирования файла. Код ошибки ") +
+						to_string(static_cast<unsigned long long> (rval.code)));
+					return TL_DECODEERROR;
+				}
+			}
+			if (bulkLoad) {
+				log(LOG_INFO, "Режим прямой загрузки: события записываются в файлы, валидация звонков не выполняется. "
+					"Файл получает статус непровалидированного");
+				FlatFileWriter flatFileWriter(otlConnect, pStagingDir, pShortName);
+				return flatFileWriter.WriteEvents(fileID, &dataInterchange->choice.transferBatch);
+			}
+			else if (tapValidator.GetValidationResult() == TAP_VALID) {
 				return LoadTAPEventsToDB(fileID, tapValidator.GetIOTValidationMode(), roamingHubID, otlConnect, config);
 			}
 			else {
@@ -1330,7 +1014,7 @@ int LoadTAPFileToDB( unsigned char* buffer, long dataLen, long fileID, long roam
 	}
 	catch (otl_exception &otlEx) {
 		otlConnect.rollback();
-		log(pShortName,  LOG_ERROR, "  :");
+		log(pShortName,  LOG_ERROR, "Ошибка базы данных:");
 		log(pShortName,  LOG_ERROR, (char*) otlEx.msg);
 		if( strlen(otlEx.stm_text) > 0 )
 			log(pShortName,  LOG_ERROR, (char*) otlEx.stm_text ); // log SQL that caused the error
@@ -1339,12 +1023,12 @@ int LoadTAPFileToDB( unsigned char* buffer, long dataLen, long fileID, long roam
 		return TL_ORACLEERROR;
 	}
 	catch(const std::exception& ex) {
-		log(pShortName, LOG_ERROR, string(": ") + ex.what() + string(".   ") + 
+		log(pShortName, LOG_ERROR, string("Исключение: ") + ex.what() + string(". Номер звонка ") + 
 			to_string( static_cast<unsigned long long> (index)));
 	}
 	catch(char* pMess)
 	{
-		log(pShortName, LOG_ERROR, string(": ") + string(pMess) + string(".   ") + 
+		log(pShortName, LOG_ERROR, string("Исключение: ") + string(pMess) + string(". Номер звонка ") + 
 			to_string( static_cast<unsigned long long> (index)));
 		return TL_WRONGCODE;
 	}
@@ -1353,279 +1037,32 @@ int LoadTAPFileToDB( unsigned char* buffer, long dataLen, long fileID, long roam
 
 //-----------------------------------------------------
 
-int LoadRAPStopOrMissingInfo(long fileID, string stopLastSeqNum, string missStartSeqNum, string missEndSeqNum, 
-	OperatorSpecList* pOperSpecList, otl_connect& otlConnect)
+// returnedEvents are call events of severe returns referenced by RAP file created by loader (NULL for loaded RAP file)
+// contentHash is XXH64 of loaded RAP file (empty for RAP file created by loader)
+int LoadReturnBatchToDB(ReturnBatch* returnBatch, long fileID, long roamingHubID, string rapFilename, long fileStatus, otl_connect& otlConnect,
+	const CallEventDetail* const* returnedEvents, string contentHash)
 {
-	string operSpecInfo;
-	if (pOperSpecList) {
-		// concatenate operator specific info before loading
-		for (int i = 0; i < pOperSpecList->list.count; i++) {
-			if (operSpecInfo.length() > 0)
-				operSpecInfo += "\r\n";
-			operSpecInfo += (char*)pOperSpecList->list.array[i]->buf;
-		}
-		if (operSpecInfo.length() > 1024)
-			operSpecInfo = operSpecInfo.substr(0, 1024);
-	}
-
-	otl_nocommit_stream otlStream;
-
-	otlStream.open(1 /*stream buffer size in logical rows*/,
-		"insert into BILLING.RAP_STOP_OR_MISSING (FILE_ID, STOP_LAST_SEQ_NUM, MISS_START_SEQ_NUM, MISS_END_SEQ_NUM, OPERATOR_SPEC_INFO) \
-					values (:hfileid /*long*/, :stop_last_seqnum/*char[10]*/, :miss_start/*char[10]*/, :miss_end/*char[10]*/, \
-					:oper_spec_info /*char[1024]*/)", otlConnect);
-
-	otlStream
-		<< fileID
-		<< stopLastSeqNum
-		<< missStartSeqNum
-		<< missEndSeqNum
-		<< operSpecInfo;
-
-	return TL_OK;
-}
-
-//------------------------------------------------
-
-int LoadRAPErrorDetailList(const ErrorDetailList_t* pErrDetailList, long returnID, otl_connect& otlConnect)
-{
-	otl_nocommit_stream otlStream;
-
-	for (int detail = 0; detail < pErrDetailList->list.count; detail++) {
-		long detailID;
-		otlStream.open(1 /*stream buffer size in logical rows*/,
-			"insert into BILLING.RAP_ERROR_DETAIL (DETAIL_ID, RETURN_ID, ERROR_CODE, ITEM_OFFSET ) "
-			"values (Billing.TAP3EventID.NextVal, :return_id /*long,in*/, :error_code/*long,in*/, :item_offset/*long,in*/) "
-			"returning DETAIL_ID into :detail_id /*long,out*/", otlConnect);
-
-		otlStream
-			<< returnID
-			<< pErrDetailList->list.array[detail]->errorCode;
-
-		if (pErrDetailList->list.array[detail]->itemOffset)
-			otlStream << *pErrDetailList->list.array[detail]->itemOffset;
-		else
-			otlStream << otl_null();
-
-		otlStream.flush();
-		otlStream >> detailID;
-		otlStream.close();
-
-		// context data loading to DB
-		asn_TYPE_descriptor_t * type_descriptor = &asn_DEF_DataInterChange;
-		for (int context = 0; context < pErrDetailList->list.array[detail]->errorContext->list.count; context++) {
-			// Parsing Path Item ID which means ASN tag of TAP file
-			ber_tlv_tag_t tlv_tag = (pErrDetailList->list.array[detail]->errorContext->list.array[context]->pathItemId << 2) | ASN_TAG_CLASS_APPLICATION;
-
-			// while elements[0.tag == -1 fall just through structures 
-			while (type_descriptor->elements[0].tag == (ber_tlv_tag_t)-1)
-				type_descriptor = type_descriptor->elements[0].type;
-
-			// linear search for tlv_tag in elements array
-			asn_TYPE_member_t *elm = NULL;
-			for (int n = 0; n < type_descriptor->elements_count; n++) {
-				if (BER_TAGS_EQUAL(tlv_tag, type_descriptor->elements[n].tag)) {
-					elm = &type_descriptor->elements[n];
-					break;
-				}
-			}
-
-			if (!elm) {
-				log(LOG_ERROR, "  Path Item IDs  error context #" + to_string((long long)context + 1) +
-					"  detail #" + to_string((long long)detail + 1));
-				log(LOG_ERROR, "ASN- " + to_string((long long) pErrDetailList->list.array[detail]->errorContext->
-						list.array[context]->pathItemId)
-					+ "    ASN  " + type_descriptor->name);
-
-				return TL_DECODEERROR;
-			}
-
-			type_descriptor = elm->type;
-
-			otl_nocommit_stream otlStreamCtx;
-			otlStreamCtx.open(1 /*stream buffer size in logical rows*/,
-				"insert into BILLING.RAP_ERROR_CONTEXT (DETAIL_ID, CONTEXT_SEQNUM, PATH_ITEM_ID, ITEM_LEVEL, ITEM_NAME, ITEM_OCCURENCE ) \
-						values (:detail_id /*long,in*/, :ctx_seqnum /*long,in*/, :path_item /*long,in*/, :item_level/*long,in*/, \
-								:item_name/*char[100],in*/, :item_occur/*long,in*/)", otlConnect);
-			otlStreamCtx
-				<< detailID
-				<< (long)context + 1
-				<< pErrDetailList->list.array[detail]->errorContext->list.array[context]->pathItemId
-				<< pErrDetailList->list.array[detail]->errorContext->list.array[context]->itemLevel
-				<< type_descriptor->name;
-
-			if (pErrDetailList->list.array[detail]->errorContext->list.array[context]->itemOccurrence)
-				otlStreamCtx << *pErrDetailList->list.array[detail]->errorContext->list.array[context]->itemOccurrence;
-			else
-				otlStreamCtx << otl_null();
-
-			otlStreamCtx.close();
-		}
-	}
-
-	return TL_OK;
-}
-
-//------------------------------------------------
-
-int LoadRAPFatalReturn(long fileID, const FatalReturn& fatalReturn, otl_connect& otlConnect)
-{
-	string errorType;
-	ErrorDetailList_t* pErrDetailList;
-	if (fatalReturn.accountingInfoError) {
-		errorType = "Accounting Info";
-		pErrDetailList = &fatalReturn.accountingInfoError->errorDetail;
-	}
-	else if (fatalReturn.auditControlInfoError) {
-		errorType = "Audit Control Info";
-		pErrDetailList = &fatalReturn.auditControlInfoError->errorDetail;
-	}
-	else if (fatalReturn.batchControlError) {
-		errorType = "Batch Control Info";
-		pErrDetailList = &fatalReturn.batchControlError->errorDetail;
-	}
-	else if (fatalReturn.messageDescriptionError) {
-		errorType = "Message Description";
-		pErrDetailList = &fatalReturn.messageDescriptionError->errorDetail;
-	}
-	else if (fatalReturn.networkInfoError) {
-		errorType = "Network Info";
-		pErrDetailList = &fatalReturn.networkInfoError->errorDetail;
-	}
-	else if (fatalReturn.notificationError) {
-		errorType = "Notification";
-		pErrDetailList = &fatalReturn.notificationError->errorDetail;
-	}
-	else if (fatalReturn.transferBatchError) {
-		errorType = "Tranfer Batch";
-		pErrDetailList = &fatalReturn.transferBatchError->errorDetail;
-	}
-	
-	string operSpecInfo;
-	if (fatalReturn.operatorSpecList) {
-		// concatenate operator specific info before loading
-		for (int i = 0; i < fatalReturn.operatorSpecList->list.count; i++) {
-			if (operSpecInfo.length() > 0)
-				operSpecInfo += "\r\n";
-			operSpecInfo += (char*)fatalReturn.operatorSpecList->list.array[i]->buf;
-		}
-		if (operSpecInfo.length() > 1024)
-			operSpecInfo = operSpecInfo.substr(0, 1024);
-	}
-
-	otl_nocommit_stream otlStream;
-	long returnID;
-	otlStream.open(1 /*stream buffer size in logical rows*/,
-		"insert into BILLING.RAP_FATAL_RETURN (RETURN_ID, FILE_ID, FILE_SEQUENCE_NUMBER, ERROR_TYPE, OPERATOR_SPEC_INFO) \
-						values (Billing.TAP3EventID.NextVal, :hfileid /*long,in*/, :fileseqnum /*char[20],in*/, \
-						:error_type /*char[50],in*/, :oper_spec_info /*char[1024],in*/) \
-						returning RETURN_ID into :hreturnid /*long,out*/", otlConnect);
-
-	otlStream
-		<< fileID
-		<< fatalReturn.fileSequenceNumber.buf
-		<< errorType
-		<< operSpecInfo;
-
-	otlStream.flush();
-	otlStream >> returnID;
-	otlStream.close();
-
-	return LoadRAPErrorDetailList(pErrDetailList, returnID, otlConnect);
-}
-
-//------------------------------------------------
-
-int LoadRAPSevereReturn(long fileID, const SevereReturn& severeReturn, otl_connect& otlConnect)
-{
-	int index = 0;
-
-	string operSpecInfo;
-	if (severeReturn.operatorSpecList) {
-		// concatenate operator specific info before loading
-		for (int i = 0; i < severeReturn.operatorSpecList->list.count; i++) {
-			if (operSpecInfo.length() > 0)
-				operSpecInfo += "\r\n";
-			operSpecInfo += (char*)severeReturn.operatorSpecList->list.array[i]->buf;
-		}
-		if (operSpecInfo.length() > 1024)
-			operSpecInfo = operSpecInfo.substr(0, 1024);
-	}
-	
-	long long eventID; 
-	switch (severeReturn.callEventDetail.present) {
-		case CallEventDetail_PR_mobileOriginatedCall:
-			if ((eventID = ProcessOriginatedCall(fileID, index, &severeReturn.callEventDetail.choice.mobileOriginatedCall, otlConnect)) < 0)
-				return (long) eventID;
-			
-			break;
-		case CallEventDetail_PR_mobileTerminatedCall:
-			if ((eventID = ProcessTerminatedCall(fileID, index, &severeReturn.callEventDetail.choice.mobileTerminatedCall, otlConnect)) < 0)
-				return (long) eventID;
-			
-			break;
-		case CallEventDetail_PR_supplServiceEvent:
-			// at this time we just ignore it
-			break;
-
-		case CallEventDetail_PR_gprsCall:
-			if ((eventID = ProcessGPRSCall(fileID, index, &severeReturn.callEventDetail.choice.gprsCall, otlConnect)) < 0)
-				return (long) eventID;
-			
-			break;
-		default:
-			log(LOG_ERROR, string("    ") + to_string(static_cast<unsigned long long> 
-					(dataInterchange->choice.transferBatch.callEventDetails->list.array[index - 1]->present)) +
-				string(".   ") + to_string(static_cast<unsigned long long> (index)));
-			return TL_NEWCOMPONENT;
-	}
-
-	otl_nocommit_stream otlStream;
-	long returnID;
-	otlStream.open(1 /*stream buffer size in logical rows*/,
-		"insert into BILLING.RAP_SEVERE_RETURN (RETURN_ID, FILE_ID, FILE_SEQUENCE_NUMBER, EVENT_ID, OPERATOR_SPEC_INFO) \
-				values (Billing.TAP3EventID.NextVal, :hfileid /*long,in*/, :fileseqnum /*char[20],in*/, :event_id /*bigint,in*/, :oper_spec_info /*char[1024],in*/) \
-					returning RETURN_ID into :hreturnid /*long,out*/", otlConnect);
-
-	otlStream
-		<< fileID
-		<< severeReturn.fileSequenceNumber.buf
-		<< eventID
- 		<< operSpecInfo;
-
-	otlStream.flush();
-	otlStream >> returnID;
-	otlStream.close();
-
-	return LoadRAPErrorDetailList(&severeReturn.errorDetail, returnID, otlConnect);
-}
-
-//-----------------------------------------------------
-
-int LoadReturnBatchToDB(ReturnBatch* returnBatch, long fileID, long roamingHubID, string rapFilename, long fileStatus, otl_connect& otlConnect)
-{
-		// set TAP power value used to convert integer values from file to double values for DB
-	double dblTAPPower;
-	if( returnBatch->rapBatchControlInfoRap.tapDecimalPlaces )
-		dblTAPPower = pow( (double) 10, *returnBatch->rapBatchControlInfoRap.tapDecimalPlaces );
-	else
-		dblTAPPower = 1;
+	// TAP decimal places used to convert integer values from file to amounts for DB
+	int tapDecimalPlaces = (returnBatch->rapBatchControlInfoRap.tapDecimalPlaces ? *returnBatch->rapBatchControlInfoRap.tapDecimalPlaces : 0);
+	// totals are bound as mantissas and divided in statement, so that they are loaded exactly
+	string amountDivisor = to_string(TapAmount::Power(tapDecimalPlaces));
 
 	otl_nocommit_stream otlStream;
 	try {	
 		// REGISTER RAP FILE IN DB 
-		otlStream.open( 1 /*stream buffer size in logical rows*/, 
+		otlStream.open( 1 /*stream buffer size in logical rows*/, (string(
 		"insert into BILLING.RAP_FILE (FILE_ID, ROAMINGHUB_ID, FILENAME, SENDER, RECIPIENT, ROAMING_PARTNER, SEQUENCE_NUMBER , CREATION_STAMP, CREATION_UTCOFF,"
 		"AVAILABLE_STAMP, AVAILABLE_UTCOFF, TAP_CURRENCY, LOAD_TIME, "
 		"RETURN_DETAILS_COUNT, TOTAL_SEVERE_RETURN, TOTAL_SEVERE_RETURN_TAX, STATUS, RAP_VERSION, RAP_RELEASE, FILE_TYPE_INDICATOR, "
-		"TAP_DECIMAL_PLACES, TAP_VERSION, TAP_RELEASE) "
+		"TAP_DECIMAL_PLACES, TAP_VERSION, TAP_RELEASE, CONTENT_HASH) "
 		"values ("
 		":hfileid /*long,in*/, :roamhubid /*long,in*/, :filename/*char[255],in*/, :sender/*char[20],in*/, :recipient/*char[20],in*/, :roam_partner/*char[10],in*/, :seq_num/*char[10],in*/,"
 		"to_date(:creation_stamp /*char[20],in*/, 'yyyymmddhh24miss'), :creation_utcoff /* char[10],in */,"
 		"to_date(:available_stamp /*char[20],in*/, 'yyyymmddhh24miss'), :available_utcoff /* char[10],in */,"
-		":tap_currency /* char[255],in */, sysdate, :eventcount /* long,in */, :total_ret /* double,in */, :total_ret_tax /*double,in*/, :status /*long,in*/, "
+		":tap_currency /* char[255],in */, sysdate, :eventcount /* long,in */, :total_ret /* bigint,in */ / ") + amountDivisor + ", "
+		":total_ret_tax /*bigint,in*/ / " + amountDivisor + ", :status /*long,in*/, "
 		":rapVer /*long,in*/, :rapSpecif /*long,in*/, :filetype /*char[5],in*/, :tapDecimalPlaces /*long,in*/, "
-		":tapVersion /*long,in*/, :tapSpecif /*long,in*/ ) ", otlConnect);
+		":tapVersion /*long,in*/, :tapSpecif /*long,in*/, :content_hash /*char[20],in*/ ) ").c_str(), otlConnect);
 
 		otlStream 
 			<< fileID
@@ -1641,10 +1078,10 @@ int LoadReturnBatchToDB(ReturnBatch* returnBatch, long fileID, long roamingHubID
 			<< (const char*) returnBatch->rapBatchControlInfoRap.rapFileAvailableTimeStamp.utcTimeOffset->buf
 			<< ( returnBatch->rapBatchControlInfoRap.tapCurrency ? (const char*) returnBatch->rapBatchControlInfoRap.tapCurrency->buf : "" )
 			<< returnBatch->rapAuditControlInfo.returnDetailsCount
-			<< OctetStr2Int64(returnBatch->rapAuditControlInfo.totalSevereReturnValue) / dblTAPPower;
+			<< TapAmount::FromOctetString(returnBatch->rapAuditControlInfo.totalSevereReturnValue, tapDecimalPlaces).GetMantissa();
 
 		if( returnBatch->rapAuditControlInfo.totalSevereReturnTax )
-			otlStream << OctetStr2Int64(*returnBatch->rapAuditControlInfo.totalSevereReturnTax) / dblTAPPower;
+			otlStream << TapAmount::FromOctetString(*returnBatch->rapAuditControlInfo.totalSevereReturnTax, tapDecimalPlaces).GetMantissa();
 		else
 			otlStream << otl_null();
 
@@ -1669,42 +1106,25 @@ int LoadReturnBatchToDB(ReturnBatch* returnBatch, long fileID, long roamingHubID
 		else
 			otlStream << otl_null();
 
+		if (!contentHash.empty())
+			otlStream << contentHash;
+		else
+			otlStream << otl_null();
+
 		otlStream.flush();
 		otlStream.close();
 
-		int loadResult = -1;
+		RAPReturnWriter returnWriter(otlConnect, fileID, tapDecimalPlaces);
 		for (int i = 0; i < returnBatch->returnDetails.list.count; i++) {
-			switch (returnBatch->returnDetails.list.array[i]->present) {
-			case ReturnDetail_PR_stopReturn:
-				loadResult = LoadRAPStopOrMissingInfo(fileID, (char*)returnBatch->returnDetails.list.array[i]->choice.stopReturn.lastSeqNumber.buf, "", "",
-					returnBatch->returnDetails.list.array[i]->choice.stopReturn.operatorSpecList, otlConnect);
-				break;
-			case ReturnDetail_PR_missingReturn:
-				loadResult = LoadRAPStopOrMissingInfo(fileID, "",
-					(char*) returnBatch->returnDetails.list.array[i]->choice.missingReturn.startMissingSeqNumber.buf, 
-					returnBatch->returnDetails.list.array[i]->choice.missingReturn.endMissingSeqNumber ?
-						(char*) returnBatch->returnDetails.list.array[i]->choice.missingReturn.endMissingSeqNumber->buf : "",
-					returnBatch->returnDetails.list.array[i]->choice.stopReturn.operatorSpecList, otlConnect);
-				break;
-			case ReturnDetail_PR_fatalReturn:
-				loadResult = LoadRAPFatalReturn(fileID, returnBatch->returnDetails.list.array[i]->choice.fatalReturn, otlConnect);
-				break;
-			case ReturnDetail_PR_severeReturn:
-				loadResult = LoadRAPSevereReturn(fileID, returnBatch->returnDetails.list.array[i]->choice.severeReturn, otlConnect);
-				break;
-			default:
-				log(LOG_ERROR, "  Return Detail: " + to_string(static_cast<unsigned long long> 
-					(returnBatch->returnDetails.list.array[i]->present)));
-				return TL_DECODEERROR;
-			}
-
+			int loadResult = returnWriter.Write(returnBatch->returnDetails.list.array[i], (returnedEvents ? returnedEvents[i] : NULL));
 			if (loadResult != TL_OK)
 				return loadResult;
 		}
+		returnWriter.Flush();
 	}
 	catch (otl_exception &otlEx) {
 		otlConnect.rollback();
-		log( LOG_ERROR, "  :");
+		log( LOG_ERROR, "Ошибка базы данных:");
 		log( LOG_ERROR, (char*) otlEx.msg);
 		if( strlen(otlEx.stm_text) > 0 )
 			log( LOG_ERROR, (char*) otlEx.stm_text ); // log SQL that caused the error
@@ -1726,34 +1146,24 @@ int LoadRAPFileToDB( unsigned char* buffer, long dataLen, long fileID, long roam
 		rval = ber_decode(0, &asn_DEF_ReturnBatch, (void**) &returnBatch, buffer, dataLen);
 
 		if (rval.code != RC_OK) {
-			log(LOG_ERROR, string(" ASN- .   ") + to_string(
+			log(LOG_ERROR, string("Ошибка ASN-декодирования файла. Код ошибки ") + to_string(
 				static_cast<unsigned long long> ( rval.code )));
 			Finalize(otlConnect, false);
 			return TL_DECODEERROR;
 		}
 
 		if (bPrintOnly) {
-			char* printName = new char[strlen(pShortName) + 5];
-			sprintf(printName, "%s.txt", pShortName);
-			FILE* fFileContents = fopen(printName, "w");
-			if (fFileContents) {
-				asn_fprint(fFileContents, &asn_DEF_ReturnBatch, returnBatch);
-				fclose(fFileContents);
-			}
-			else
-			{
-				printf("Unable to open output file %s\n", printName);
-			}
-			delete[] printName;
+			JsonDumper jsonDumper(otlConnect, "", 1, LONG_MAX);
+			int dumpRes = jsonDumper.DumpReturnBatch(string(pShortName) + ".ndjson", returnBatch);
 			printf("---- File contents printed to output file. Exiting. -------");
-			return TL_OK;
+			return dumpRes;
 		}
 	
-		return LoadReturnBatchToDB(returnBatch, fileID, roamingHubID, pShortName, INFILE_STATUS_NEW, otlConnect);
+		return LoadReturnBatchToDB(returnBatch, fileID, roamingHubID, pShortName, INFILE_STATUS_NEW, otlConnect, NULL, fileContentHash);
 	}
 	catch(char* pMess)
 	{
-		log(LOG_ERROR, string(": ") + string(pMess) + string(".   ") + to_string(static_cast<unsigned long long> (index)));
+		log(LOG_ERROR, string("Исключение: ") + string(pMess) + string(". Номер звонка ") + to_string(static_cast<unsigned long long> (index)));
 		return TL_WRONGCODE;
 	}
 	return TL_OK;
@@ -1761,6 +1171,42 @@ int LoadRAPFileToDB( unsigned char* buffer, long dataLen, long fileID, long roam
 
 //------------------------------
 
+// Returns ID of loaded file with the same contents or 0. Files which were not validated are loaded again,
+// so they are not counted. Entry of local index is checked in DB, since loaded file may be deleted from DB.
+long FindLoadedCopy(FileType fileType, long fileID, long roamingHubID, otl_connect& otlConnect, const Config& config)
+{
+	string table = (fileType == ftTAP ? "BILLING.TAP3_FILE" : "BILLING.RAP_FILE");
+	otl_nocommit_stream otlStream;
+	long copyFileID = LoadedFileIndex::Instance().Find(config, fileContentHash, roamingHubID);
+	if (copyFileID > 0 && copyFileID != fileID) {
+		otlStream.open(1, ("select count(*) from " + table + " where FILE_ID = :copy_id /*long,in*/ "
+			"and CONTENT_HASH = :hash /*char[20],in*/ and STATUS <> :unable /*long,in*/").c_str(), otlConnect);
+		otlStream
+			<< copyFileID
+			<< fileContentHash
+			<< (long) INFILE_STATUS_UNABLE_TO_VALIDATE;
+		long count;
+		otlStream >> count;
+		otlStream.close();
+		if (count > 0)
+			return copyFileID;
+		LoadedFileIndex::Instance().Remove(config, fileContentHash, roamingHubID);
+	}
+	otlStream.open(1, ("select nvl(max(FILE_ID), 0) from " + table + " where CONTENT_HASH = :hash /*char[20],in*/ "
+		"and ROAMINGHUB_ID = :roamhubid /*long,in*/ and FILE_ID <> :file_id /*long,in*/ and STATUS <> :unable /*long,in*/").c_str(),
+		otlConnect);
+	otlStream
+		<< fileContentHash
+		<< roamingHubID
+		<< fileID
+		<< (long) INFILE_STATUS_UNABLE_TO_VALIDATE;
+	otlStream >> copyFileID;
+	otlStream.close();
+	return copyFileID;
+}
+
+//------------------------------
+
 int LoadRAPAckToDB(unsigned char* buffer, long dataLen, long fileID, long roamingHubID, bool bPrintOnly, otl_connect& otlConnect)
 {
 	asn_dec_rval_t rval;
@@ -1768,33 +1214,23 @@ int LoadRAPAckToDB(unsigned char* buffer, long dataLen, long fileID, long roamin
 	rval = ber_decode(0, &asn_DEF_Acknowledgement, (void**)& acknowledgement, buffer, dataLen);
 
 	if (rval.code != RC_OK) {
-		log(LOG_ERROR, string(" ASN- .   ") + to_string(
+		log(LOG_ERROR, string("Ошибка ASN-декодирования файла. Код ошибки ") + to_string(
 			static_cast<unsigned long long> (rval.code)));
 		Finalize(otlConnect, false);
 		return TL_DECODEERROR;
 	}
 
 	if (bPrintOnly) {
-		char* printName = new char[strlen(pShortName) + 5];
-		sprintf(printName, "%s.txt", pShortName);
-		FILE* fFileContents = fopen(printName, "w");
-		if (fFileContents) {
-			asn_fprint(fFileContents, &asn_DEF_Acknowledgement, acknowledgement);
-			fclose(fFileContents);
-		}
-		else
-		{
-			printf("Unable to open output file %s\n", printName);
-		}
-		delete[] printName;
+		JsonDumper jsonDumper(otlConnect, "", 1, LONG_MAX);
+		int dumpRes = jsonDumper.DumpAcknowledgement(string(pShortName) + ".ndjson", acknowledgement);
 		printf("---- File contents printed to output file. Exiting. -------");
-		return TL_OK;
+		return dumpRes;
 	}
 	
 	// We do not load RAP ack to DB, just log it and then update RAP file STATUS and ACK_RECEIVED fields
 	log(LOG_INFO, string("Sender: ") + (char*)acknowledgement->sender.buf + ", Recipient: " + (char*)acknowledgement->recipient.buf + 
 				", RAP file seqnum: " + (char*)acknowledgement->rapFileSequenceNumber.buf);
-	log(LOG_INFO, string(" ack-: ") + (char*)acknowledgement->ackFileCreationTimeStamp.localTimeStamp->buf + 
+	log(LOG_INFO, string("Создание ack-файла: ") + (char*)acknowledgement->ackFileCreationTimeStamp.localTimeStamp->buf + 
 					", Ack file creation UTC: " + (char*)acknowledgement->ackFileCreationTimeStamp.utcTimeOffset->buf +
 					", Ack file available: " + (char*)acknowledgement->ackFileAvailableTimeStamp.localTimeStamp->buf +
 					", Ack file available UTC: " + (char*)acknowledgement->ackFileAvailableTimeStamp.utcTimeOffset->buf
@@ -1817,7 +1253,7 @@ int LoadRAPAckToDB(unsigned char* buffer, long dataLen, long fileID, long roamin
 	}
 	catch (otl_exception &otlEx) {
 		otlConnect.rollback();
-		log(LOG_ERROR, "  :");
+		log(LOG_ERROR, "Ошибка базы данных:");
 		log(LOG_ERROR, (char*)otlEx.msg);
 		if (strlen(otlEx.stm_text) > 0)
 			log(LOG_ERROR, (char*)otlEx.stm_text); // log SQL that caused the error
@@ -1831,39 +1267,41 @@ int LoadRAPAckToDB(unsigned char* buffer, long dataLen, long fileID, long roamin
 
 //------------------------------
 
+// TAP3_NO_MAIN is defined by projects that link loader sources into their own executable (benchmarks)
+#ifndef TAP3_NO_MAIN
 int main(int argc, const char* argv[])
 {
 	if( argc < mainArgsCount )
 		return TL_PARAM_ERROR;
 
-	//  pShortName   ,  
+	// установим pShortName на имя файла, отбросив путь
 	pShortName =  strrchr(argv[1],'\\');
 	if(!pShortName)
 		pShortName=argv[1];
 	else
 		pShortName++;
 
-	//    
+	// откроем файл для логгирования
 	ofsLog.open("TAP3Loader.log", ofstream::app);
 	if (!ofsLog.is_open())
 		fprintf(stderr, "Unable to open log file TAP3Loader.log");
 
 	long fileID = strtol(argv[2], NULL, 10);
 	if( fileID == 0 ) {
-		log( LOG_ERROR, string("  fileID   2- : ") + argv[2] );
+		log( LOG_ERROR, string("Неверное значение fileID передано во 2-ом аргументе: ") + argv[2] );
 		return TL_FILEERROR ;
 	}
 
 	long roamingHubID = strtol(argv[3], NULL, 10);
 	if( roamingHubID == 0 ) {
-		log( LOG_ERROR, string("  roamingHubID   3- : ") + argv[3] );
+		log( LOG_ERROR, string("Неверное значение roamingHubID передано во 3-ем аргументе: ") + argv[3] );
 		return TL_FILEERROR ;
 	}
 
 	const int OTL_MULTITHREADED_MODE = 1;
 	otl_connect::otl_initialize(OTL_MULTITHREADED_MODE); // initialize OCI environment
 	otl_connect otlConnect;
-	//   
+	// установим тип файла
 	FileType fileType;
 	if( !strnicmp(pShortName, "CD", 2) || !strnicmp(pShortName, "TD", 2))
 		fileType = ftTAP;
@@ -1872,8 +1310,8 @@ int main(int argc, const char* argv[])
 	else if( !strnicmp(pShortName, "AC", 2) || !strnicmp(pShortName, "AT", 2) )
 		fileType = ftRAPAcknowledgement;
 	else {
-		log(LOG_ERROR, string("  TAP-.       CD, TD, RC, RT, AC "
-			"  AT.      ") + argv[1]);
+		log(LOG_ERROR, string("Неизвестный тип TAP-файла. Первые буквы имени файла должы быть CD, TD, RC, RT, AC "
+			" или AT. Для разбора же передан файл ") + argv[1]);
 		Finalize(otlConnect, false);
 		return TL_FILEERROR;
 	}
@@ -1882,53 +1320,123 @@ int main(int argc, const char* argv[])
 	
 	try {
 		Config config;
-		//   
+		// чтение файла конфигурации
 		const char* configFilename = strlen(argv[4]) > 0 ? argv[4] : "TAP3Loader.cfg";
 		ifstream ifsSettings(configFilename, ifstream::in);
 		if (!ifsSettings.is_open())	{
-			log( LOG_ERROR, string("    ") + configFilename);
+			log( LOG_ERROR, string("Невозможно открыть файл конфигурации ") + configFilename);
 			return TL_PARAM_ERROR;
 		}
 		config.ReadConfigFile(ifsSettings);
 		ifsSettings.close();
 
 		if (config.GetConnectString().empty()) {
-			log(LOG_ERROR, string("       - ") + configFilename);
+			log(LOG_ERROR, string("Строка подключения к БД не найдена в конфиг-файле ") + configFilename);
 			ofsLog.close();
 			return TL_FILEERROR;
 		}
-
-		FILE *fTapFile=fopen(argv[1],"rb");
-		if(!fTapFile) {
-			log( LOG_ERROR, string ("   ") + argv[1], config.GetConnectString());
+		// gzip and zstd compressed files are decompressed while reading
+		unsigned char* buffer;
+		unsigned long tapFileLen; // длина данных файла (без заголовка)
+		int readRes = ReadInputFile(argv[1], buffer, tapFileLen);
+		if (readRes == TL_PARAM_ERROR) {
+			log( LOG_ERROR, string ("Невозможно открыть файл ") + argv[1], config.GetConnectString());
 			return TL_PARAM_ERROR;
 		}
-
-		fseek(fTapFile, 0, SEEK_END);
-		unsigned long tapFileLen=ftell(fTapFile); //    ( )
-		unsigned char* buffer = new unsigned char [tapFileLen];
-		
-		fseek(fTapFile, 0, SEEK_SET);
-		size_t bytesRead=fread(buffer, 1, tapFileLen, fTapFile);
-		fclose(fTapFile);
-		if(bytesRead < tapFileLen)
+		if (readRes != TL_OK)
 		{
-			log( LOG_ERROR, string("    ") + argv[1], config.GetConnectString());
-			delete [] buffer;
-			return TL_FILEERROR;
+			log( LOG_ERROR, string(readRes == TL_DECODEERROR ? "Ошибка распаковки данных файла " : "Ошибка чтения данных файла ") + argv[1], 
+				config.GetConnectString());
+			return readRes;
 		}
+		fileContentHash = ContentHash(buffer, tapFileLen);
 
 		bool bPrintOnly = false;
-		if(argc > mainArgsCount) {
-			if(!strcmp(argv[mainArgsCount], "-p") || !strcmp(argv[mainArgsCount], "-P")) {
+		pStagingDir = NULL;
+		pExportDir = NULL;
+		pDumpFields = NULL;
+		dumpFirstEvent = 1;
+		dumpLastEvent = LONG_MAX;
+		bVerifyRAPEvents = false;
+		bValidateOnly = false;
+		writerSessions = 1;
+		bAcceptPartialFile = false;
+		uploadWaitTime = 60 * 1000;
+		for(int argIndex = mainArgsCount; argIndex < argc; argIndex++) {
+			if(!strcmp(argv[argIndex], "-p") || !strcmp(argv[argIndex], "-P")) {
 				// key to print contents of file. No upload to DB is needed.
 				bPrintOnly = true;
 			}
 
-			if(!strcmp(argv[mainArgsCount], "-d") || !strcmp(argv[mainArgsCount], "-D")) {
+			if(!strcmp(argv[argIndex], "-d") || !strcmp(argv[argIndex], "-D")) {
 				// debugMode = 1;
 			}
+
+			if(!strcmp(argv[argIndex], "-v") || !strcmp(argv[argIndex], "-V")) {
+				// key to compare events returned in RAP file with their re-encoding
+				bVerifyRAPEvents = true;
+			}
+
+			if(!strcmp(argv[argIndex], "--validate-only")) {
+				// key to report validation result and RAP error codes of TAP file without loading its events
+				bValidateOnly = true;
+			}
+
+			if(!strcmp(argv[argIndex], "--accept-partial")) {
+				// key to load TAP file without events rejected by DB, their rows are written to TAP3_EVENT_ERROR
+				bAcceptPartialFile = true;
+			}
+
+			if((!strcmp(argv[argIndex], "-b") || !strcmp(argv[argIndex], "-B")) && argIndex + 1 < argc) {
+				// key of direct-path load mode: only file header is loaded to DB, events are written
+				// to flat files with SQL*Loader control files in given staging directory
+				pStagingDir = argv[++argIndex];
+			}
+
+			if((!strcmp(argv[argIndex], "-a") || !strcmp(argv[argIndex], "-A")) && argIndex + 1 < argc) {
+				// key of Arrow export: loaded events are also written to Arrow IPC stream files in given directory
+				pExportDir = argv[++argIndex];
+			}
+
+			if((!strcmp(argv[argIndex], "-w") || !strcmp(argv[argIndex], "-W")) && argIndex + 1 < argc) {
+				// number of DB sessions loading events of big TAP files, rows are published by the load session
+				writerSessions = strtol(argv[++argIndex], NULL, 10);
+				if (writerSessions < 1 || writerSessions > maxWriterSessions)
+					writerSessions = 1;
+			}
+
+			if(!strcmp(argv[argIndex], "--upload-wait") && argIndex + 1 < argc) {
+				long seconds = strtol(argv[++argIndex], NULL, 10);
+				if (seconds >= 0 && seconds <= maxUploadWaitTime)
+					uploadWaitTime = (DWORD) seconds * 1000;
+			}
+
+			if((!strcmp(argv[argIndex], "-f") || !strcmp(argv[argIndex], "-F")) && argIndex + 1 < argc) {
+				// columns of event tables printed in -p mode, comma-separated
+				pDumpFields = argv[++argIndex];
+			}
+
+			if((!strcmp(argv[argIndex], "-e") || !strcmp(argv[argIndex], "-E")) && argIndex + 1 < argc) {
+				// range of events printed in -p mode: <first RSN>-<last RSN>, <first RSN>- or <RSN>
+				char* pEnd;
+				argIndex++;
+				dumpFirstEvent = strtol(argv[argIndex], &pEnd, 10);
+				if (*pEnd == '-')
+					dumpLastEvent = (*(pEnd + 1) ? strtol(pEnd + 1, NULL, 10) : LONG_MAX);
+				else
+					dumpLastEvent = dumpFirstEvent;
+			}
+		}
+
+		if (bValidateOnly && fileType != ftTAP) {
+			log( LOG_ERROR, "Режим --validate-only применим только к TAP-файлам");
+			if(ofsLog.is_open()) ofsLog.close();
+			delete [] buffer;
+			return TL_PARAM_ERROR;
 		}
+		// retry uploads of RAP files left in spool by previous runs, nothing is uploaded in print and validate-only modes
+		if (!bPrintOnly && !bValidateOnly)
+			RAPUploadQueue::Instance().Start(config);
 
 		//otl_connect otlLogConnect;
 		try {
@@ -1936,67 +1444,97 @@ int main(int argc, const char* argv[])
 			//otlLogConnect.rlogon(config.GetConnectString().c_str());	
 		}
 		catch (otl_exception &otlEx) {
-			log( LOG_ERROR, "    :" );
+			log( LOG_ERROR, "Невозможно подключиться к базе данных:" );
 			log( LOG_ERROR, (char*) otlEx.msg );
 			if( strlen(otlEx.stm_text) > 0 )
 				log( LOG_ERROR, (char*) otlEx.stm_text ); // log SQL that caused the error
 			if( strlen(otlEx.var_info) > 0 )
 				log( LOG_ERROR, (char*) otlEx.var_info ); // log the variable that caused the error
-			log( LOG_ERROR, "---- TAP3 loader    , .  ----");
+			log( LOG_ERROR, "---- TAP3 loader завершил работу с ошибками, см. журнал ----");
 			if(ofsLog.is_open()) ofsLog.close();
 			delete [] buffer;
 			return TL_CONNECTERROR; 
 		}
 		
 		int res;
+		// exact copies of loaded files re-delivered by roaming hubs are skipped without decoding
+		long copyFileID = 0;
+		if (!bPrintOnly && !bValidateOnly && fileType != ftRAPAcknowledgement) {
+			try {
+				copyFileID = FindLoadedCopy(fileType, fileID, roamingHubID, otlConnect, config);
+			}
+			catch (otl_exception &otlEx) {
+				log( LOG_ERROR, "Ошибка поиска копии файла по контрольной сумме, файл будет загружен:" );
+				log( LOG_ERROR, (char*) otlEx.msg );
+			}
+		}
+		if (copyFileID > 0) {
+			log(LOG_INFO, "Файл с тем же содержимым уже загружен (ID " + to_string((long long) copyFileID) +
+				"). Повторной загрузки не требуется.", config.GetConnectString());
+			Finalize(otlConnect, true);
+			delete [] buffer;
+			return TL_OK;
+		}
+
 		switch( fileType ) {
 		case ftTAP:
-			log(LOG_INFO, "---------  TAP3- (ID " + to_string((long long) fileID)+")  ---------", 
+			log(LOG_INFO, "--------- Загрузка TAP3-файла (ID " + to_string((long long) fileID)+") начата ---------", 
 				config.GetConnectString());
 			res = LoadTAPFileToDB( buffer, tapFileLen, fileID, roamingHubID, bPrintOnly, otlConnect, config) ; 
 			if (res == TL_OK) {
-				log(LOG_INFO, "---------  TAP3- (ID " + to_string((long long)fileID) +
-					")   ---------");
+				log(LOG_INFO, "--------- Загрузка TAP3-файла (ID " + to_string((long long)fileID) +
+					") завершена успешно ---------");
 			}
 			else {
-				log(LOG_INFO, "---------  TAP3- (ID " + to_string((long long)fileID) +
-					")    ---------");
+				log(LOG_INFO, "--------- Загрузка TAP3-файла (ID " + to_string((long long)fileID) +
+					") завершена с ошибками ---------");
 			}
 			break;
 		case ftRAP:
-			log(LOG_INFO, "---------  RAP- (ID " + to_string((long long) fileID) + ")  ---------", 
+			log(LOG_INFO, "--------- Загрузка RAP-файла (ID " + to_string((long long) fileID) + ") начата ---------", 
 				config.GetConnectString());
 			res = LoadRAPFileToDB( buffer, tapFileLen, fileID, roamingHubID, bPrintOnly, otlConnect ) ; 
 			if (res == TL_OK) {
-				log(LOG_INFO, "---------  RAP- (ID " + to_string((long long)fileID) +
-					")   ---------");
+				log(LOG_INFO, "--------- Загрузка RAP-файла (ID " + to_string((long long)fileID) +
+					") завершена успешно ---------");
 			}
 			else {
-				log(LOG_INFO, "---------  RAP- (ID " + to_string((long long)fileID) +
-					")    ---------");
+				log(LOG_INFO, "--------- Загрузка RAP-файла (ID " + to_string((long long)fileID) +
+					") завершена с ошибками ---------");
 			}
 			break;
 		case ftRAPAcknowledgement:
-			log(LOG_INFO, "---------  RAP Acknowledgement- (ID " + to_string((long long) fileID) + 
-					")  ---------", config.GetConnectString());
+			log(LOG_INFO, "--------- Загрузка RAP Acknowledgement-файла (ID " + to_string((long long) fileID) + 
+					") начата ---------", config.GetConnectString());
 			res = LoadRAPAckToDB(buffer, tapFileLen, fileID, roamingHubID, bPrintOnly, otlConnect);
 			if (res == TL_OK) {
-				log(LOG_INFO, "---------  RAP Acknowledgement- (ID " + to_string((long long)fileID) +
-					")   ---------");
+				log(LOG_INFO, "--------- Загрузка RAP Acknowledgement-файла (ID " + to_string((long long)fileID) +
+					") завершена успешно ---------");
 			}
 			else {
-				log(LOG_INFO, "---------  RAP Acknowledgement- (ID " + to_string((long long)fileID) +
-					")    ---------");
+				log(LOG_INFO, "--------- Загрузка RAP Acknowledgement-файла (ID " + to_string((long long)fileID) +
+					") завершена с ошибками ---------");
 			}
 			break;
 		}
-		Finalize(otlConnect, res == TL_OK);
+		// nothing is to be committed in validate-only mode
+		bool committed = (res == TL_OK && !bValidateOnly);
+		if (!Finalize(otlConnect, committed)) {
+			// loaded data is committed, but RAP files may be not uploaded
+			res = TL_FILEERROR;
+		}
+		// events of direct-path load are not in DB yet
+		if (committed && !bPrintOnly && !pStagingDir && fileType != ftRAPAcknowledgement)
+			LoadedFileIndex::Instance().Add(config, fileContentHash, roamingHubID, fileID);
 		delete [] buffer;
+		// spool jobs of previous runs not uploaded by exit are taken over by next runs
+		if (!bLibraryMode && RAPUploadQueue::Instance().HasCommittedJobs() && !RAPUploadQueue::Instance().Drain(uploadWaitTime))
+			log(LOG_INFO, "Не все RAP-файлы загружены на FTP-сервер, загрузка будет продолжена при следующем запуске");
 		return res;
 	}
 	catch(...)
 	{
-		log( LOG_ERROR, " .   " + to_string( static_cast<unsigned long long> 
+		log( LOG_ERROR, "Неизвестное исключение. Номер звонка " + to_string( static_cast<unsigned long long> 
 				(index)));
 		Finalize(otlConnect, false);
 		return TL_UNKNOWN;
@@ -2027,10 +1565,47 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
 __declspec (dllexport) int __stdcall LoadFileToDB(char* pFilename, long fileID, long roamingHubID, char* pConfigFilename)
 {
 	EnterCriticalSection(&loadCritSection);
+	bLibraryMode = true;
 	string strFileID = to_string ((unsigned long long) fileID);
 	string strRoamHubID = to_string((unsigned long long) roamingHubID);
 	const char* pArgv[] = { "TAP3Loader.exe", pFilename, strFileID.c_str(), strRoamHubID.c_str(), pConfigFilename };
 	int loadRes = main(mainArgsCount, pArgv);
 	LeaveCriticalSection(&loadCritSection);
 	return loadRes;
-}
\ No newline at end of file
+}
+
+
+// drops partner metadata kept between loads, to be called after partner settings are changed in DB
+__declspec (dllexport) void __stdcall InvalidatePartnerCache()
+{
+	PartnerCache::Instance().Invalidate();
+}
+
+
+// Writes ranges of missing file sequence numbers of sender and recipient ("12-14,20") to gaps buffer.
+// Returns number of ranges, TL_FILEERROR if there is no sequence index yet or TL_PARAM_ERROR.
+__declspec (dllexport) int __stdcall ReportFileSequenceGaps(char* pConfigFilename, char* pSender, char* pRecipient, 
+	int testFiles, char* pGaps, int gapsSize)
+{
+	Config config;
+	ifstream ifsSettings(strlen(pConfigFilename) > 0 ? pConfigFilename : "TAP3Loader.cfg", ifstream::in);
+	if (!ifsSettings.is_open() || gapsSize <= 0)
+		return TL_PARAM_ERROR;
+	config.ReadConfigFile(ifsSettings);
+	ifsSettings.close();
+
+	FileSequenceIndex sequenceIndex(config, pSender, pRecipient, testFiles != 0);
+	vector<SequenceGap> gaps;
+	if (!sequenceIndex.GetGaps(gaps))
+		return TL_FILEERROR;
+	string report;
+	for (size_t i = 0; i < gaps.size(); i++) {
+		report += (i > 0 ? "," : "") + to_string((long long) gaps[i].first);
+		if (gaps[i].last > gaps[i].first)
+			report += "-" + to_string((long long) gaps[i].last);
+	}
+	strncpy(pGaps, report.c_str(), gapsSize - 1);
+	pGaps[gapsSize - 1] = '\0';
+	return (int) gaps.size();
+}
+#endif // TAP3_NO_MAIN
@@ -0,0 +1,79 @@
+#include "OTL_Header.h"
+#include "TAPTimestamp.h"
+
+using namespace std;
+
+
+static bool ParseDigits(const char*& p, int width, int& value)
+{
+	value = 0;
+	for (int i = 0; i < width; i++, p++) {
+		if (*p < '0' || *p > '9')
+			return false;
+		value = value * 10 + (*p - '0');
+	}
+	return true;
+}
+
+
+// t receives year, month, day, hour, minute, second
+static bool ParseTimestampFields(const char* value, int t[6])
+{
+	const int widths[6] = { 4, 2, 2, 2, 2, 2 };
+	const char* p = value;
+	for (int i = 0; i < 6; i++) {
+		if (!ParseDigits(p, widths[i], t[i]))
+			return false;
+	}
+	if (*p != '\0' || t[1] < 1 || t[1] > 12 || t[2] < 1 || t[3] > 23 || t[4] > 59 || t[5] > 59)
+		return false;
+	const int monthDays[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	bool leapYear = (t[0] % 4 == 0 && (t[0] % 100 != 0 || t[0] % 400 == 0));
+	return t[2] <= monthDays[t[1] - 1] + (t[1] == 2 && leapYear ? 1 : 0);
+}
+
+
+bool ParseTAPTimestamp(const char* value, otl_datetime& datetime)
+{
+	int t[6];
+	if (!ParseTimestampFields(value, t))
+		return false;
+	datetime.year = t[0];
+	datetime.month = t[1];
+	datetime.day = t[2];
+	datetime.hour = t[3];
+	datetime.minute = t[4];
+	datetime.second = t[5];
+	datetime.fraction = 0;
+	return true;
+}
+
+
+bool ParseTAPTimestamp(const char* value, long long& seconds)
+{
+	int t[6];
+	if (!ParseTimestampFields(value, t))
+		return false;
+	// days from civil date, see http://howardhinnant.github.io/date_algorithms.html
+	int year = t[0] - (t[1] <= 2 ? 1 : 0);
+	int era = (year >= 0 ? year : year - 399) / 400;
+	int yearOfEra = year - era * 400;
+	int dayOfYear = (153 * (t[1] + (t[1] > 2 ? -3 : 9)) + 2) / 5 + t[2] - 1;
+	int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	long long days = (long long) era * 146097 + dayOfEra - 719468;
+	seconds = days * 86400 + t[3] * 3600 + t[4] * 60 + t[5];
+	return true;
+}
+
+
+bool ParseUTCOffset(const char* value, int& seconds)
+{
+	if (*value != '+' && *value != '-')
+		return false;
+	const char* p = value + 1;
+	int hours, minutes;
+	if (!ParseDigits(p, 2, hours) || !ParseDigits(p, 2, minutes) || *p != '\0' || hours > 14 || minutes > 59)
+		return false;
+	seconds = (hours * 3600 + minutes * 60) * (*value == '-' ? -1 : 1);
+	return true;
+}
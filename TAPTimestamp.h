@@ -0,0 +1,11 @@
+#pragma once
+
+// Parsers of fixed-format TAP timestamps, no locale or sscanf involved. Values are checked to be real dates,
+// so that invalid dates are not sent to DB by native binds.
+
+// TAP local timestamp yyyymmddhhmmss to date and time fields
+bool ParseTAPTimestamp(const char* value, otl_datetime& datetime);
+// TAP local timestamp yyyymmddhhmmss to seconds since 1970-01-01 (no time zone applied)
+bool ParseTAPTimestamp(const char* value, long long& seconds);
+// TAP UTC time offset +hhmm or -hhmm to seconds east of UTC
+bool ParseUTCOffset(const char* value, int& seconds);
@@ -1,7 +1,6 @@
 // Class TAPValidator checks TAP file (DataInterchange structure) validity according to TD.57 requirements.
 // If Fatal or Severe errors are found it creates RAP file (Return Batch structure) and registers it in DB tables (RAP_File, RAP_Fatal_Return and so on).
 
-#include <math.h>
 #include <set>
 #include <map>
 #include "OTL_Header.h"
@@ -11,8 +10,12 @@
 #include "ReturnBatch.h"
 #include "ConfigContainer.h"
 #include "TAPValidator.h"
+#include "TapAmount.h"
 #include "CallValidator.h"
 #include "RAPFile.h"
+#include "LazyCallEvent.h"
+#include "PartnerCache.h"
+#include "FileSequenceIndex.h"
 
 using namespace std;
 
@@ -25,67 +28,241 @@ extern int write_out(const void *buffer, size_t size, void *app_key);
 extern "C" int ncftp_main(int argc, char **argv, char* result);
 
 
-TAPValidator::TAPValidator(otl_connect& dbConnect, Config& config, long roamingHubID) 
-	: m_otlConnect(dbConnect), m_config(config), m_roamingHubID(roamingHubID), m_rapFile(dbConnect, config, roamingHubID)
+static int AppendToBuffer(const void* data, size_t size, void* buffer)
 {
+	vector<unsigned char>* dest = (vector<unsigned char>*) buffer;
+	dest->insert(dest->end(), (const unsigned char*) data, (const unsigned char*) data + size);
+	return 0;
+}
+
+
+// Copies TAP structure to a member of return detail by DER encoding and decoding it, so that return detail owns
+// all of its contents and is freed by ASN_STRUCT_FREE as a whole. dest must be zeroed.
+static bool CopyTAPStructure(asn_TYPE_descriptor_t* typeDescriptor, const void* source, void* dest)
+{
+	vector<unsigned char> buffer;
+	asn_enc_rval_t encodeRes = der_encode(typeDescriptor, (void*) source, AppendToBuffer, &buffer);
+	if (encodeRes.encoded <= 0)
+		return false;
+	asn_dec_rval_t decodeRes = ber_decode(0, typeDescriptor, &dest, &buffer[0], buffer.size());
+	return (decodeRes.code == RC_OK);
+}
+
+
+TAPValidator::TAPValidator(otl_connect& dbConnect, Config& config, long roamingHubID, bool validateOnly) 
+	: m_otlConnect(dbConnect), m_config(config), m_eventSpans(NULL), m_roamingHubID(roamingHubID), m_duplicationChecked(false),
+	m_rapFile(dbConnect, config, roamingHubID), m_validateOnly(validateOnly), m_chargeSummaryReady(false)
+{
+}
+
+
+TAPValidator::~TAPValidator()
+{
+	// return details own copies of TAP structures made by Create*RAPFile functions
+	for (size_t i = 0; i < m_notUploadedDetails.size(); i++)
+		ASN_STRUCT_FREE(asn_DEF_ReturnDetail, m_notUploadedDetails[i]);
 }
 
 
 bool TAPValidator::IsRecipientCorrect(string recipient)
 {
-	otl_nocommit_stream otlStream;
-	string ourTAPCode;
-	otlStream.open(1, "call BILLING.TAP3.GetOurTAPCode(:roamhubid /*long,in*/) into :ourTapCode /*char[20],out*/" , m_otlConnect);
-	otlStream << m_roamingHubID;
-	otlStream
-		>> ourTAPCode;
-	otlStream.close();
-	return (recipient == ourTAPCode);
+	return (recipient == m_ourTAPCode);
 }
 
 
-bool TAPValidator::SetSenderNetworkID()
+// Duplication check is made on admission if all of file header fields it needs are present,
+// otherwise it's made by separate query after the fields are validated
+bool TAPValidator::CanCheckDuplicationOnAdmission() const
 {
-	otl_nocommit_stream otlStream;
-	otlStream.open(1, "call BILLING.TAP3.GetSenderNetworkID(:sender /*char[20],in*/) "
-		"into :res /*long,out*/", m_otlConnect);
 	if (m_transferBatch) {
-		otlStream << m_transferBatch->batchControlInfo->sender->buf;
+		return m_transferBatch->batchControlInfo && m_transferBatch->batchControlInfo->recipient && 
+			m_transferBatch->batchControlInfo->fileSequenceNumber && m_transferBatch->accountingInfo && 
+			m_transferBatch->accountingInfo->tapDecimalPlaces && m_transferBatch->auditControlInfo && 
+			m_transferBatch->auditControlInfo->totalCharge;
 	}
 	else {
-		otlStream << m_notification->sender->buf;
+		return m_notification->recipient && m_notification->fileSequenceNumber;
 	}
-	otlStream >> m_mobileNetworkID;
-	otlStream.close();
-	if (m_mobileNetworkID < 0) {
+}
+
+
+bool TAPValidator::GetSequenceIndexKey(string& sender, string& recipient, int& sequenceNumber) const
+{
+	const Sender_t* pSender = (m_transferBatch ? m_transferBatch->batchControlInfo->sender : m_notification->sender);
+	const Recipient_t* pRecipient = (m_transferBatch ? m_transferBatch->batchControlInfo->recipient : m_notification->recipient);
+	const FileSequenceNumber_t* pSequenceNumber = (m_transferBatch ? m_transferBatch->batchControlInfo->fileSequenceNumber :
+		m_notification->fileSequenceNumber);
+	if (!pSender || !pRecipient || !pSequenceNumber)
 		return false;
+	sender = (const char*) pSender->buf;
+	recipient = (const char*) pRecipient->buf;
+	sequenceNumber = FileSequenceIndex::ParseSequenceNumber((const char*) pSequenceNumber->buf);
+	return sequenceNumber > 0;
+}
+
+
+// Index is built before header of the file is loaded, so that it has no rows of uncommitted load
+FileSequenceIndex* TAPValidator::OpenSequenceIndex(int& sequenceNumber)
+{
+	string sender, recipient;
+	if (!GetSequenceIndexKey(sender, recipient, sequenceNumber))
+		return NULL;
+	FileSequenceIndex* sequenceIndex = new FileSequenceIndex(m_config, sender, recipient, IsTestFile());
+	try {
+		if (sequenceIndex->Open(m_otlConnect))
+			return sequenceIndex;
+	}
+	catch (otl_exception& otlEx) {
+		log(LOG_ERROR, string("Ошибка построения индекса последовательных номеров: ") + (char*) otlEx.msg);
 	}
-	return true;
+	delete sequenceIndex;
+	return NULL;
+}
+
+
+// Total charge of transfer batch is bound to duplication checks as mantissa in maximum TAP decimal places
+// and divided in SQL, so that it is compared with total charges of loaded files exactly
+static long long GetTotalChargeMantissa(const TransferBatch* transferBatch)
+{
+	return TapAmount::FromOctetString(*transferBatch->auditControlInfo->totalCharge,
+		*transferBatch->accountingInfo->tapDecimalPlaces).GetMantissa(TAP_DECIMAL_VALID_TO);
 }
 
 
-void TAPValidator::SetIOTValidationMode()
+// All of DB checks of file header (our TAP code, sender network and its IOT validation mode, permission of
+// incoming TAP files, file duplication) and deletion of not validated file header are made by one PL/SQL block.
+// Partner info found in cache is not fetched again.
+bool TAPValidator::AdmitFile(long notValidatedFileID)
 {
+	const char* sender = (const char*) (m_transferBatch ? m_transferBatch->batchControlInfo->sender->buf :
+		m_notification->sender->buf);
+	const char* availableStamp = (const char*) (m_transferBatch ? 
+		m_transferBatch->batchControlInfo->fileAvailableTimeStamp->localTimeStamp->buf :
+		m_notification->fileAvailableTimeStamp->localTimeStamp->buf);
+	PartnerInfo partnerInfo;
+	bool partnerCached = PartnerCache::Instance().FindPartnerInfo(m_roamingHubID, sender, availableStamp, partnerInfo);
+	bool checkDuplication = CanCheckDuplicationOnAdmission();
+
+	string totalChargeDivisor = to_string(TapAmount::Power(TAP_DECIMAL_VALID_TO));
 	otl_nocommit_stream otlStream;
-	otlStream.open(1, "select nvl(iot_validation_mode_id, :iot_no_need/*int,in*/) from BILLING.TMobileNetwork "
-		"where object_no = :mobilenetworkid /*long,in*/", m_otlConnect);
-	otlStream 
-		<< IOT_NO_NEED
-		<< m_mobileNetworkID;
-	otlStream >> m_iotValidationMode;
+	otlStream.open(1, (
+		"declare "
+		"  v_roamhub_id number := :roamhubid /*long,in*/; "
+		"  v_fetch_partner number := :fetch_partner /*short,in*/; "
+		"  v_network_id number := :cached_network_id /*long,in*/; "
+		"  v_iot_mode number := :iot_no_need /*long,in*/; "
+		"  v_avail_stamp date := to_date(:avail_stamp /*char[20],in*/, 'yyyymmddhh24miss'); "
+		"  v_delete_file_id number := :delete_file_id /*long,in*/; "
+		"  v_our_tap_code varchar2(20); "
+		"  v_allowed number; "
+		"  v_duplicated number; "
+		"begin "
+		"  if v_fetch_partner = 1 then "
+		"    v_our_tap_code := BILLING.TAP3.GetOurTAPCode(v_roamhub_id); "
+		"    v_network_id := BILLING.TAP3.GetSenderNetworkID(:sender /*char[20],in*/); "
+		"    if v_network_id >= 0 then "
+		"      begin "
+		"        select nvl(iot_validation_mode_id, v_iot_mode) into v_iot_mode from BILLING.TMobileNetwork "
+		"          where object_no = v_network_id; "
+		"      exception when no_data_found then null; "
+		"      end; "
+		"      v_allowed := BILLING.TAP3.IsIncomingTAPAllowed(v_network_id, v_roamhub_id, v_avail_stamp); "
+		"    end if; "
+		"  end if; "
+		"  if :check_dup /*short,in*/ = 1 and v_network_id >= 0 then "
+		"    v_duplicated := BILLING.TAP3.IsTAPFileDuplicated(v_network_id, :recipient /*char[20],in*/, v_roamhub_id, "
+		"      :file_seqnum /*char[20],in*/, :file_type_indic /*char[20],in*/, :rap_file_seqnum /*char[20],in*/, "
+		"      :notif /*short,in*/, v_avail_stamp, :event_count /*long,in*/, :total_charge /*bigint,in*/ / " + 
+		totalChargeDivisor + "); "
+		"  end if; "
+		"  if v_delete_file_id > 0 then "
+		"    BILLING.TAP3.DeleteNotValidatedFileHeader(v_delete_file_id); "
+		"  end if; "
+		"  :our_tap_code /*char[20],out*/ := v_our_tap_code; "
+		"  :network_id /*long,out*/ := v_network_id; "
+		"  :iot_mode /*long,out*/ := v_iot_mode; "
+		"  :allowed /*long,out*/ := nvl(v_allowed, -1); "
+		"  :duplicated /*long,out*/ := nvl(v_duplicated, -1); "
+		"end;").c_str(), m_otlConnect);
+	otlStream
+		<< m_roamingHubID
+		<< (short) (partnerCached ? 0 : 1)
+		<< (partnerCached ? partnerInfo.mobileNetworkID : -1L)
+		<< (long) IOT_NO_NEED
+		<< availableStamp
+		<< notValidatedFileID
+		<< sender
+		<< (short) (checkDuplication ? 1 : 0);
+	if (checkDuplication && m_transferBatch) {
+		otlStream
+			<< m_transferBatch->batchControlInfo->recipient->buf
+			<< m_transferBatch->batchControlInfo->fileSequenceNumber->buf
+			<< ( m_transferBatch->batchControlInfo->fileTypeIndicator ? 
+					(char*)m_transferBatch->batchControlInfo->fileTypeIndicator->buf : "" )
+			<< ( m_transferBatch->batchControlInfo->rapFileSequenceNumber ? 
+					(char*) m_transferBatch->batchControlInfo->rapFileSequenceNumber->buf : "" )
+			<< (short) 0 /* transfer batch */
+			<< ( m_transferBatch->auditControlInfo->callEventDetailsCount ? *m_transferBatch->auditControlInfo->callEventDetailsCount : 0L )
+			<< GetTotalChargeMantissa(m_transferBatch);
+	}
+	else if (checkDuplication) {
+		otlStream
+			<< m_notification->recipient->buf
+			<< m_notification->fileSequenceNumber->buf
+			<< ( m_notification->fileTypeIndicator ? (char*) m_notification->fileTypeIndicator->buf : "" )
+			<< ( m_notification->rapFileSequenceNumber ? (char*) m_notification->rapFileSequenceNumber->buf : "" )
+			<< (short) 1 /* notification */
+			<< 0L
+			<< (long long) 0;
+	}
+	else {
+		otlStream << "" << "" << "" << "" << (short) 0 << 0L << (long long) 0;
+	}
+
+	PartnerInfo fetchedInfo;
+	otlStream
+		>> fetchedInfo.ourTAPCode
+		>> fetchedInfo.mobileNetworkID
+		>> fetchedInfo.iotValidationMode
+		>> fetchedInfo.incomingTAPAllowed
+		>> m_duplicationCheckRes;
+	otlStream.close();
+	if (partnerCached) {
+		fetchedInfo = partnerInfo;
+	}
+	else {
+		PartnerCache::Instance().StorePartnerInfo(m_roamingHubID, sender, availableStamp, fetchedInfo);
+	}
+
+	m_ourTAPCode = fetchedInfo.ourTAPCode;
+	m_mobileNetworkID = fetchedInfo.mobileNetworkID;
+	m_iotValidationMode = fetchedInfo.iotValidationMode;
+	m_incomingTAPAllowed = fetchedInfo.incomingTAPAllowed;
+	m_duplicationChecked = (checkDuplication && m_mobileNetworkID >= 0);
+	return (m_mobileNetworkID >= 0);
+}
 
+
+void TAPValidator::DeleteNotValidatedFileHeader(long fileID)
+{
+	otl_nocommit_stream otlStream;
+	otlStream.open(1, "call BILLING.TAP3.DeleteNotValidatedFileHeader(:file_id /*long,in*/)", m_otlConnect);
+	otlStream << fileID;
+	otlStream.close();
 }
 
+
 FileDuplicationCheckRes TAPValidator::IsFileDuplicated()
 {
+	if (m_duplicationChecked)
+		return ReportDuplicationCheckRes(m_duplicationCheckRes);
 	otl_nocommit_stream otlStream;
-	otlStream.open(1, "call BILLING.TAP3.IsTAPFileDuplicated("
+	otlStream.open(1, ("call BILLING.TAP3.IsTAPFileDuplicated("
 		":sender /*long,in*/, :recipient /*char[20],in*/, :roam_hub_id /*long,in*/, :file_seqnum /*char[20],in*/, "
 		":file_type_indic /*char[20],in*/, :rap_file_seqnum /*char[20],in*/, :notif /*short,in*/, to_date(:avail_stamp /*char[20],in*/,'yyyymmddhh24miss'),"
-		":event_count /*long,in*/, :total_charge /*double,in*/ ) "
-		"into :res /*long,out*/", m_otlConnect);
+		":event_count /*long,in*/, :total_charge /*bigint,in*/ / " + to_string(TapAmount::Power(TAP_DECIMAL_VALID_TO)) + ") "
+		"into :res /*long,out*/").c_str(), m_otlConnect);
 	if (m_transferBatch) {
-		double tapPower=pow( (double) 10, *m_transferBatch->accountingInfo->tapDecimalPlaces);
 		otlStream
 			<< m_mobileNetworkID
 			<< m_transferBatch->batchControlInfo->recipient->buf
@@ -98,7 +275,7 @@ FileDuplicationCheckRes TAPValidator::IsFileDuplicated()
 			<< (short) 0 /* transfer batch */
 			 << m_transferBatch->batchControlInfo->fileAvailableTimeStamp->localTimeStamp->buf
 			<< ( m_transferBatch->auditControlInfo->callEventDetailsCount ? *m_transferBatch->auditControlInfo->callEventDetailsCount : 0L )
-			<< OctetStr2Int64(*m_transferBatch->auditControlInfo->totalCharge) / tapPower;
+			<< GetTotalChargeMantissa(m_transferBatch);
 	}
 	else {
 		otlStream
@@ -111,15 +288,21 @@ FileDuplicationCheckRes TAPValidator::IsFileDuplicated()
 			<< (short) 1 /* notification */
 			<< m_notification->fileAvailableTimeStamp->localTimeStamp->buf
 			<< 0L
-			<< 0.0;
+			<< (long long) 0;
 	}
 
 	long result;
 	otlStream >> result;
 	otlStream.close();
+	return ReportDuplicationCheckRes(result);
+}
+
+
+FileDuplicationCheckRes TAPValidator::ReportDuplicationCheckRes(long result)
+{
 	if(result < 0)
 	{
-		SetErrorAndLog(" TAP3.IsTAPFileDuplicated   " + to_string((long long) result));
+		SetErrorAndLog("Функция TAP3.IsTAPFileDuplicated вернула ошибку " + to_string((long long) result));
 		result = DUPLICATION_CHECK_ERROR;
 	}
 	return (FileDuplicationCheckRes) result;
@@ -130,28 +313,10 @@ IncomingTAPAllowed TAPValidator::IsIncomingTAPAllowed()
 {
 	if (IsTestFile())
 		return INCOMING_TAP_ALLOWED;
-	otl_nocommit_stream otlStream;
-	otlStream.open(1, "call BILLING.TAP3.IsIncomingTAPAllowed("
-		":sender /*long,in*/, :roam_hub_id /*long,in*/, to_date(:avail_stamp /*char[20],in*/,'yyyymmddhh24miss'))"
-		"into :res /*long,out*/", m_otlConnect);
-	if (m_transferBatch) {
-		otlStream
-			<< m_mobileNetworkID
-			<< m_roamingHubID
-			<< m_transferBatch->batchControlInfo->fileAvailableTimeStamp->localTimeStamp->buf;
-	}
-	else {
-		otlStream
-			<< m_mobileNetworkID
-			<< m_roamingHubID
-			<< m_notification->fileAvailableTimeStamp->localTimeStamp->buf;
-	}
-	long result;
-	otlStream >> result;
-	otlStream.close();
+	long result = m_incomingTAPAllowed;
 	if(result < 0)
 	{
-		SetErrorAndLog(" TAP3.IsIncomingTAPAllowed   " + to_string((long long) result));
+		SetErrorAndLog("Функция TAP3.IsIncomingTAPAllowed вернула ошибку " + to_string((long long) result));
 		result = UNABLE_TO_DETERMINE;
 	}
 	return (IncomingTAPAllowed) result;
@@ -173,66 +338,79 @@ bool TAPValidator::IsTestFile()
 }
 
 
-bool TAPValidator::BatchContainsTaxes()
+int TAPValidator::GetCallCount() const
 {
-	for (int call_index = 0; call_index < m_transferBatch->callEventDetails->list.count; call_index++) {
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_mobileOriginatedCall) {
-			MobileOriginatedCall* moCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.mobileOriginatedCall;
-			for (int bs_used_index = 0; bs_used_index < moCall->basicServiceUsedList->list.count; bs_used_index++) 
-				for (int chr_index = 0; chr_index < moCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList->list.count; chr_index++)
-					if (moCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList->list.array[chr_index]->taxInformation != NULL)
-						return true;
-		}
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_mobileTerminatedCall) {
-			MobileTerminatedCall* mtCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.mobileTerminatedCall;
-			for (int bs_used_index = 0; bs_used_index < mtCall->basicServiceUsedList->list.count; bs_used_index++) 
-				for (int chr_index = 0; chr_index < mtCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList->list.count; chr_index++)
-					if (mtCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList->list.array[chr_index]->taxInformation != NULL)
-						return true;
+	if (m_transferBatch->callEventDetails->list.count > 0 || !m_eventSpans)
+		return m_transferBatch->callEventDetails->list.count;
+	// events are not decoded
+	return (int) m_eventSpans->size();
+}
+
+
+const CallEventDetail* TAPValidator::GetCallEvent(int callIndex) const
+{
+	return (callIndex < m_transferBatch->callEventDetails->list.count ? m_transferBatch->callEventDetails->list.array[callIndex] : NULL);
+}
+
+
+const BerSpan* TAPValidator::GetCallEventSpan(int callIndex) const
+{
+	return (m_eventSpans && (size_t) callIndex < m_eventSpans->size() ? &(*m_eventSpans)[callIndex] : NULL);
+}
+
+
+const BatchChargeSummary& TAPValidator::GetBatchChargeSummary()
+{
+	if (m_chargeSummaryReady)
+		return m_chargeSummary;
+	// every call event is decoded once for all checks of Accounting Info and Audit Control Info
+	m_chargeSummary.containsTaxes = false;
+	m_chargeSummary.containsDiscounts = false;
+	m_chargeSummary.containsPositiveCharges = false;
+	m_chargeSummary.totalCharge = 0;
+	m_chargeSummary.decodeError = false;
+	for (int call_index = 0; call_index < GetCallCount(); call_index++) {
+		LazyCallEvent callEvent(GetCallEvent(call_index), GetCallEventSpan(call_index));
+		const vector<const ChargeInformationList*>& chargeInfoLists = callEvent.GetChargeInformationLists();
+		if (callEvent.HasDecodeError()) {
+			SetErrorAndLog("Ошибка ASN-декодирования события " + to_string((long long) call_index + 1) +
+				". Валидация невозможна.");
+			m_chargeSummary.decodeError = true;
+			break;
 		}
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_gprsCall) {
-			GprsCall* gprsCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.gprsCall;
-			for (int chr_index = 0; chr_index < gprsCall->gprsServiceUsed->chargeInformationList->list.count; chr_index++)
-				if (gprsCall->gprsServiceUsed->chargeInformationList->list.array[chr_index]->taxInformation != NULL)
-					return true;
+		for (size_t list_index = 0; list_index < chargeInfoLists.size(); list_index++) {
+			for (int chr_index = 0; chr_index < chargeInfoLists[list_index]->list.count; chr_index++) {
+				const ChargeInformation* chargeInfo = chargeInfoLists[list_index]->list.array[chr_index];
+				if (chargeInfo->taxInformation != NULL)
+					m_chargeSummary.containsTaxes = true;
+				if (chargeInfo->discountInformation != NULL)
+					m_chargeSummary.containsDiscounts = true;
+				if (!m_chargeSummary.containsPositiveCharges && ChargeInfoContainsPositiveCharges(chargeInfo))
+					m_chargeSummary.containsPositiveCharges = true;
+			}
+			m_chargeSummary.totalCharge += ChargeInfoListTotalCharge(chargeInfoLists[list_index]);
 		}
 	}
-	return false;
+	m_chargeSummaryReady = true;
+	return m_chargeSummary;
+}
+
+
+bool TAPValidator::BatchContainsTaxes()
+{
+	return GetBatchChargeSummary().containsTaxes;
 }
 
 bool TAPValidator::BatchContainsDiscounts()
 {
-	for (int call_index = 0; call_index < m_transferBatch->callEventDetails->list.count; call_index++) {
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_mobileOriginatedCall) {
-			MobileOriginatedCall* moCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.mobileOriginatedCall;
-			for (int bs_used_index = 0; bs_used_index < moCall->basicServiceUsedList->list.count; bs_used_index++) 
-				for (int chr_index = 0; chr_index < moCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList->list.count; chr_index++)
-					if (moCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList->list.array[chr_index]->discountInformation != NULL)
-						return true;
-		}
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_mobileTerminatedCall) {
-			MobileTerminatedCall* mtCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.mobileTerminatedCall;
-			for (int bs_used_index = 0; bs_used_index < mtCall->basicServiceUsedList->list.count; bs_used_index++) 
-				for (int chr_index = 0; chr_index < mtCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList->list.count; chr_index++)
-					if (mtCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList->list.array[chr_index]->discountInformation != NULL)
-						return true;
-		}
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_gprsCall) {
-			GprsCall* gprsCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.gprsCall;
-			for (int chr_index = 0; chr_index < gprsCall->gprsServiceUsed->chargeInformationList->list.count; chr_index++)
-				if (gprsCall->gprsServiceUsed->chargeInformationList->list.array[chr_index]->discountInformation != NULL)
-					return true;
-		}
-	}
-	return false;
+	return GetBatchChargeSummary().containsDiscounts;
 }
 
-bool TAPValidator::ChargeInfoContainsPositiveCharges(ChargeInformation* chargeInfo)
+bool TAPValidator::ChargeInfoContainsPositiveCharges(const ChargeInformation* chargeInfo)
 {
-	double tapPower = pow( (double) 10, *m_transferBatch->accountingInfo->tapDecimalPlaces);
+	// sign of amount does not depend on decimal places
 	for (int chr_det_index = 0; chr_det_index < chargeInfo->chargeDetailList->list.count; chr_det_index++) {
-		double charge = OctetStr2Int64(*chargeInfo->chargeDetailList->list.array[chr_det_index]->charge) / tapPower;
-		if (charge > 0)
+		if (OctetStr2Int64(*chargeInfo->chargeDetailList->list.array[chr_det_index]->charge) > 0)
 			return true;
 	}
 	return false;
@@ -240,37 +418,11 @@ bool TAPValidator::ChargeInfoContainsPositiveCharges(ChargeInformation* chargeIn
 
 bool TAPValidator::BatchContainsPositiveCharges()
 {
-	for (int call_index = 0; call_index < m_transferBatch->callEventDetails->list.count; call_index++) {
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_mobileOriginatedCall) {
-			MobileOriginatedCall* moCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.mobileOriginatedCall;
-			for (int bs_used_index = 0; bs_used_index < moCall->basicServiceUsedList->list.count; bs_used_index++)
-				for (int chr_index = 0; chr_index < moCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList->list.count; chr_index++)
-					if (ChargeInfoContainsPositiveCharges(
-							moCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList->list.array[chr_index]))
-						return true;
-		}
-		
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_mobileTerminatedCall) {
-			MobileTerminatedCall* mtCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.mobileTerminatedCall;
-			for (int bs_used_index = 0; bs_used_index < mtCall->basicServiceUsedList->list.count; bs_used_index++) 
-				for (int chr_index = 0; chr_index < mtCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList->list.count; chr_index++) 
-					if (ChargeInfoContainsPositiveCharges(
-							mtCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList->list.array[chr_index]))
-						return true;
-		}
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_gprsCall) {
-			GprsCall* gprsCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.gprsCall;
-			for (int chr_index = 0; chr_index < gprsCall->gprsServiceUsed->chargeInformationList->list.count; chr_index++)
-				if (ChargeInfoContainsPositiveCharges(
-						gprsCall->gprsServiceUsed->chargeInformationList->list.array[chr_index]))
-					return true;
-		}
-	}
-	return false;
+	return GetBatchChargeSummary().containsPositiveCharges;
 }
 
 
-long long TAPValidator::ChargeInfoListTotalCharge(ChargeInformationList* chargeInfoList)
+long long TAPValidator::ChargeInfoListTotalCharge(const ChargeInformationList* chargeInfoList)
 {
 	long long totalCharge = 0;
 	for (int chr_index = 0; chr_index < chargeInfoList->list.count; chr_index++)
@@ -284,30 +436,18 @@ long long TAPValidator::ChargeInfoListTotalCharge(ChargeInformationList* chargeI
 
 long long TAPValidator::BatchTotalCharge()
 {
-	long long totalCharge = 0;
-	for (int call_index = 0; call_index < m_transferBatch->callEventDetails->list.count; call_index++) {
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_mobileOriginatedCall) {
-			MobileOriginatedCall* mCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.mobileOriginatedCall;
-			for (int bs_used_index = 0; bs_used_index < mCall->basicServiceUsedList->list.count; bs_used_index++)
-				totalCharge += ChargeInfoListTotalCharge(mCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList);
-		}
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_mobileTerminatedCall) {
-			MobileTerminatedCall* mCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.mobileTerminatedCall;
-			for (int bs_used_index = 0; bs_used_index < mCall->basicServiceUsedList->list.count; bs_used_index++)
-				totalCharge += ChargeInfoListTotalCharge(mCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList);
-		}
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_gprsCall) {
-			GprsCall* mCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.gprsCall;
-			totalCharge += ChargeInfoListTotalCharge(mCall->gprsServiceUsed->chargeInformationList);
-		}
-	}
-	return totalCharge;
+	return GetBatchChargeSummary().totalCharge;
 }
 
 
 int TAPValidator::CreateAndUploadRapFile(ReturnDetail* returnDetail)
 {
 	assert(m_transferBatch || m_notification);
+	if (m_validateOnly) {
+		CollectRAPErrorCodes(returnDetail);
+		m_notUploadedDetails.push_back(returnDetail);
+		return TL_OK;
+	}
 	try {
 		if (m_transferBatch) {
 			m_rapFile.Initialize(m_transferBatch);
@@ -327,9 +467,46 @@ int TAPValidator::CreateAndUploadRapFile(ReturnDetail* returnDetail)
 }
 
 
+void TAPValidator::CollectRAPErrorCodes(const ReturnDetail* returnDetail)
+{
+	assert(returnDetail->present == ReturnDetail_PR_fatalReturn);
+	const FatalReturn& fatalReturn = returnDetail->choice.fatalReturn;
+	string errorType;
+	const ErrorDetailList_t* pErrDetailList;
+	if (fatalReturn.accountingInfoError) {
+		errorType = "Accounting Info";
+		pErrDetailList = &fatalReturn.accountingInfoError->errorDetail;
+	}
+	else if (fatalReturn.auditControlInfoError) {
+		errorType = "Audit Control Info";
+		pErrDetailList = &fatalReturn.auditControlInfoError->errorDetail;
+	}
+	else if (fatalReturn.batchControlError) {
+		errorType = "Batch Control Info";
+		pErrDetailList = &fatalReturn.batchControlError->errorDetail;
+	}
+	else if (fatalReturn.networkInfoError) {
+		errorType = "Network Info";
+		pErrDetailList = &fatalReturn.networkInfoError->errorDetail;
+	}
+	else if (fatalReturn.notificationError) {
+		errorType = "Notification";
+		pErrDetailList = &fatalReturn.notificationError->errorDetail;
+	}
+	else if (fatalReturn.transferBatchError) {
+		errorType = "Transfer Batch";
+		pErrDetailList = &fatalReturn.transferBatchError->errorDetail;
+	}
+	else
+		return;
+	for (int detail = 0; detail < pErrDetailList->list.count; detail++)
+		m_rapErrorCodes.push_back(errorType + ": " + to_string((long long) pErrDetailList->list.array[detail]->errorCode));
+}
+
+
 int TAPValidator::CreateBatchControlInfoRAPFile(string logMessage, int errorCode, const vector<ErrContextAsnItem>& asnItems)
 {
-	SetErrorAndLog(" Batch Control Info: " + logMessage);
+	SetErrorAndLog("Валидация Batch Control Info: " + logMessage);
 	ReturnDetail* returnDetail = (ReturnDetail*) calloc(1, sizeof(ReturnDetail));
 	returnDetail->present = ReturnDetail_PR_fatalReturn;
 	OCTET_STRING_fromBuf(&returnDetail->choice.fatalReturn.fileSequenceNumber, 
@@ -337,7 +514,12 @@ int TAPValidator::CreateBatchControlInfoRAPFile(string logMessage, int errorCode
 		m_transferBatch->batchControlInfo->fileSequenceNumber->size);
 	returnDetail->choice.fatalReturn.batchControlError = (BatchControlError*) calloc(1, sizeof(BatchControlError));
 	
-	returnDetail->choice.fatalReturn.batchControlError->batchControlInfo = *m_transferBatch->batchControlInfo;
+	if (!CopyTAPStructure(&asn_DEF_BatchControlInfo, m_transferBatch->batchControlInfo,
+			&returnDetail->choice.fatalReturn.batchControlError->batchControlInfo)) {
+		ASN_STRUCT_FREE(asn_DEF_ReturnDetail, returnDetail);
+		log(LOG_ERROR, "Ошибка копирования Batch Control Info в RAP-файл");
+		return TL_TAP_NOT_VALIDATED;
+	}
 	
 	ErrorDetail* errorDetail = (ErrorDetail*) calloc(1, sizeof(ErrorDetail));
 	errorDetail->errorCode = errorCode;
@@ -372,22 +554,7 @@ int TAPValidator::CreateBatchControlInfoRAPFile(string logMessage, int errorCode
 	assert(m_transferBatch->batchControlInfo->recipient);
 	assert(m_transferBatch->batchControlInfo->fileAvailableTimeStamp);
 
-	int loadRes = CreateAndUploadRapFile(returnDetail);
-
-	// Clear previously copied pointers to avoid ASN_STRUCT_FREE errors
-	returnDetail->choice.fatalReturn.batchControlError->batchControlInfo.sender = NULL;
-	returnDetail->choice.fatalReturn.batchControlError->batchControlInfo.recipient = NULL;
-	returnDetail->choice.fatalReturn.batchControlError->batchControlInfo.fileAvailableTimeStamp = NULL;
-	returnDetail->choice.fatalReturn.batchControlError->batchControlInfo.fileCreationTimeStamp = NULL;
-	returnDetail->choice.fatalReturn.batchControlError->batchControlInfo.transferCutOffTimeStamp = NULL;
-	returnDetail->choice.fatalReturn.batchControlError->batchControlInfo.fileSequenceNumber = NULL;
-	returnDetail->choice.fatalReturn.batchControlError->batchControlInfo.fileTypeIndicator = NULL;
-	returnDetail->choice.fatalReturn.batchControlError->batchControlInfo.operatorSpecInformation = NULL;
-	returnDetail->choice.fatalReturn.batchControlError->batchControlInfo.rapFileSequenceNumber = NULL;
-	returnDetail->choice.fatalReturn.batchControlError->batchControlInfo.releaseVersionNumber = NULL;
-	returnDetail->choice.fatalReturn.batchControlError->batchControlInfo.specificationVersionNumber = NULL;
-	
-	return loadRes;
+	return CreateAndUploadRapFile(returnDetail);
 }
 
 TAPValidationResult TAPValidator::FileSequenceNumberControl()
@@ -399,13 +566,13 @@ TAPValidationResult TAPValidator::FileSequenceNumberControl()
 		case DUPLICATION_NOTFOUND:
 			return TAP_VALID;
 		case COPY_FOUND:
-			log(LOG_INFO, ",     ,     . "
-				"   .");
+			log(LOG_INFO, "Файл, имеющий тот же последовательный номер, уже был загружен и обработан. "
+				"Повторной загрузки не требуется.");
 			return FILE_DUPLICATION;
 		case DUPLICATION_FOUND:
 			asnItems.push_back(ErrContextAsnItem(&asn_DEF_FileSequenceNumber, 0));
 			createRapRes = CreateBatchControlInfoRAPFile(
-				": ,     ,     .",
+				"Дублирование: Файл, имеющий тот же последовательный номер, уже был загружен и обработан.",
 				FILE_SEQ_NUM_DUPLICATION, asnItems);
 			return ( createRapRes >= 0 ? FILE_DUPLICATION : VALIDATION_IMPOSSIBLE );
 		case DUPLICATION_CHECK_ERROR:
@@ -418,28 +585,28 @@ TAPValidationResult TAPValidator::ValidateBatchControlInfo()
 {
 	if (!m_transferBatch->batchControlInfo->sender || !m_transferBatch->batchControlInfo->recipient || 
 			!m_transferBatch->batchControlInfo->fileSequenceNumber) {
-		SetErrorAndLog(std::string(": Sender, Recipient  FileSequenceNumber   Batch Control Info."));
+		SetErrorAndLog(std::string("Валидация: Sender, Recipient или FileSequenceNumber отсутствуют в Batch Control Info."));
 		return VALIDATION_IMPOSSIBLE;
 	}
 
 	if(!IsRecipientCorrect((char*) m_transferBatch->batchControlInfo->recipient->buf)) {
-		SetErrorAndLog(":   " + string((char*) m_transferBatch->batchControlInfo->
-			recipient->buf) + "    .");
+		SetErrorAndLog("Валидация: Некорректный получатель " + string((char*) m_transferBatch->batchControlInfo->
+			recipient->buf) + " Файл адресован другому получателю.");
 		return VALIDATION_IMPOSSIBLE;
 	}
 
 	if (!m_transferBatch->batchControlInfo->fileAvailableTimeStamp) {
-		int createRapRes = CreateBatchControlInfoRAPFile("fileAvailableTimeStamp   Batch Control Info", 
+		int createRapRes = CreateBatchControlInfoRAPFile("fileAvailableTimeStamp отсутствует в Batch Control Info", 
 			BATCH_CTRL_FILE_AVAIL_TIMESTAMP_MISSING, NO_ASN_ITEMS);
 		return (createRapRes >=0 ? FATAL_ERROR : VALIDATION_IMPOSSIBLE);
 	}
 	if (!m_transferBatch->batchControlInfo->specificationVersionNumber) {
-		int createRapRes = CreateBatchControlInfoRAPFile("specificationVersionNumber   Batch Control Info", 
+		int createRapRes = CreateBatchControlInfoRAPFile("specificationVersionNumber отсутствует в Batch Control Info", 
 			BATCH_CTRL_SPEC_VERSION_MISSING, NO_ASN_ITEMS);
 		return (createRapRes >=0 ? FATAL_ERROR : VALIDATION_IMPOSSIBLE);
 	}
 	if (!m_transferBatch->batchControlInfo->transferCutOffTimeStamp) {
-		int createRapRes = CreateBatchControlInfoRAPFile("transferCutOffTimeStamp   Batch Control Info", 
+		int createRapRes = CreateBatchControlInfoRAPFile("transferCutOffTimeStamp отсутствует в Batch Control Info", 
 			BATCH_CTRL_TRANSFER_CUTOFF_MISSING, NO_ASN_ITEMS);
 		return (createRapRes >=0 ? FATAL_ERROR : VALIDATION_IMPOSSIBLE);
 	}
@@ -452,7 +619,7 @@ TAPValidationResult TAPValidator::ValidateBatchControlInfo()
 		// wrong file sequence number given
 		vector<ErrContextAsnItem> asnItems;
 		asnItems.push_back(ErrContextAsnItem(&asn_DEF_FileSequenceNumber, 0));
-		int createRapRes = CreateBatchControlInfoRAPFile("  fileSequenceNumber", 
+		int createRapRes = CreateBatchControlInfoRAPFile("Указан нечисловой fileSequenceNumber", 
 			FILE_SEQ_NUM_SYNTAX_ERROR, asnItems);
 		return (createRapRes >=0 ? FATAL_ERROR : VALIDATION_IMPOSSIBLE);
 	}
@@ -460,7 +627,7 @@ TAPValidationResult TAPValidator::ValidateBatchControlInfo()
 	if (!(fileSeqNum >= START_TAP_SEQUENCE_NUM && fileSeqNum <= END_TAP_SEQUENCE_NUM)) {
 		vector<ErrContextAsnItem> asnItems;
 		asnItems.push_back(ErrContextAsnItem(&asn_DEF_FileSequenceNumber, 0));
-		int createRapRes = CreateBatchControlInfoRAPFile("fileSequenceNumber   ", 
+		int createRapRes = CreateBatchControlInfoRAPFile("fileSequenceNumber вне допустимого диапазона", 
 			FILE_SEQ_NUM_OUT_OF_RANGE, asnItems);
 		return (createRapRes >=0 ? FATAL_ERROR : VALIDATION_IMPOSSIBLE);
 	}
@@ -471,14 +638,19 @@ TAPValidationResult TAPValidator::ValidateBatchControlInfo()
 
 int TAPValidator::CreateAccountingInfoRAPFile(string logMessage, int errorCode, const vector<ErrContextAsnItem>& asnItems)
 {
-	SetErrorAndLog(" Accounting Info: " + logMessage);
+	SetErrorAndLog("Валидация Accounting Info: " + logMessage);
 	ReturnDetail* returnDetail = (ReturnDetail*) calloc(1, sizeof(ReturnDetail));
 	returnDetail->present = ReturnDetail_PR_fatalReturn;
 	OCTET_STRING_fromBuf(&returnDetail->choice.fatalReturn.fileSequenceNumber, (const char*) m_transferBatch->batchControlInfo->fileSequenceNumber->buf, 
 		m_transferBatch->batchControlInfo->fileSequenceNumber->size);
 	returnDetail->choice.fatalReturn.accountingInfoError = (AccountingInfoError*) calloc(1, sizeof(AccountingInfoError));
 	
-	returnDetail->choice.fatalReturn.accountingInfoError->accountingInfo = *m_transferBatch->accountingInfo;
+	if (!CopyTAPStructure(&asn_DEF_AccountingInfo, m_transferBatch->accountingInfo,
+			&returnDetail->choice.fatalReturn.accountingInfoError->accountingInfo)) {
+		ASN_STRUCT_FREE(asn_DEF_ReturnDetail, returnDetail);
+		log(LOG_ERROR, "Ошибка копирования Accounting Info в RAP-файл");
+		return TL_TAP_NOT_VALIDATED;
+	}
 		
 	ErrorDetail* errorDetail = (ErrorDetail*) calloc(1, sizeof(ErrorDetail));
 	errorDetail->errorCode = errorCode;
@@ -513,21 +685,11 @@ int TAPValidator::CreateAccountingInfoRAPFile(string logMessage, int errorCode,
 	assert(m_transferBatch->batchControlInfo->recipient);
 	assert(m_transferBatch->batchControlInfo->fileAvailableTimeStamp);
 
-	int loadRes = CreateAndUploadRapFile(returnDetail);
-	
-	// Clear previously copied pointers to avoid ASN_STRUCT_FREE errors
-	returnDetail->choice.fatalReturn.accountingInfoError->accountingInfo.currencyConversionInfo = NULL;
-	returnDetail->choice.fatalReturn.accountingInfoError->accountingInfo.discounting = NULL;
-	returnDetail->choice.fatalReturn.accountingInfoError->accountingInfo.localCurrency = NULL;
-	returnDetail->choice.fatalReturn.accountingInfoError->accountingInfo.tapCurrency = NULL;
-	returnDetail->choice.fatalReturn.accountingInfoError->accountingInfo.tapDecimalPlaces = NULL;
-	returnDetail->choice.fatalReturn.accountingInfoError->accountingInfo.taxation = NULL;
-	
-	return loadRes;
+	return CreateAndUploadRapFile(returnDetail);
 }
 
 
-ExRateValidationRes TAPValidator::ValidateChrInfoExRates(ChargeInformationList* pChargeInfoList, LocalTimeStamp_t* pCallTimestamp,
+ExRateValidationRes TAPValidator::ValidateChrInfoExRates(const ChargeInformationList* pChargeInfoList, const LocalTimeStamp_t* pCallTimestamp,
 		const map<ExchangeRateCode_t, double>& exchangeRates, string tapLocalCurrency)
 {
 	long long eventCharge = ChargeInfoListTotalCharge(pChargeInfoList);
@@ -566,42 +728,20 @@ ExRateValidationRes TAPValidator::ValidateChrInfoExRates(ChargeInformationList*
 
 ExRateValidationRes TAPValidator::ValidateExchangeRates(const map<ExchangeRateCode_t, double>& exchangeRates, string tapLocalCurrency)
 {
-	long long eventCharge = 0;
-	ChargeInformationList* pChargeInfoList;
-	otl_nocommit_stream otlStream;
-	for (int call_index = 0; call_index < m_transferBatch->callEventDetails->list.count; call_index++) {
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_mobileOriginatedCall) {
-			MobileOriginatedCall* mCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.mobileOriginatedCall;
-			for (int bs_used_index = 0; bs_used_index < mCall->basicServiceUsedList->list.count; bs_used_index++) {
-				pChargeInfoList = mCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList;
-				ExRateValidationRes validationRes = ValidateChrInfoExRates(pChargeInfoList, 
-					mCall->basicCallInformation->callEventStartTimeStamp->localTimeStamp, exchangeRates, tapLocalCurrency);
-				if (validationRes != EXRATE_VALID) {
-					// break processing and return error
-					return (ExRateValidationRes)validationRes;
-				}
-			}
-		}
-		if(m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_mobileTerminatedCall) {
-			MobileTerminatedCall* mCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.mobileTerminatedCall;
-			for (int bs_used_index = 0; bs_used_index < mCall->basicServiceUsedList->list.count; bs_used_index++) {
-				pChargeInfoList = mCall->basicServiceUsedList->list.array[bs_used_index]->chargeInformationList;
-				ExRateValidationRes validationRes = ValidateChrInfoExRates(pChargeInfoList, 
-					mCall->basicCallInformation->callEventStartTimeStamp->localTimeStamp, exchangeRates, tapLocalCurrency);
-				if (validationRes != EXRATE_VALID) {
-					// break processing and return error
-					return (ExRateValidationRes)validationRes;
-				}
-			}
-		}
-		if (m_transferBatch->callEventDetails->list.array[call_index]->present == CallEventDetail_PR_gprsCall) {
-			GprsCall* mCall = &m_transferBatch->callEventDetails->list.array[call_index]->choice.gprsCall;
-			pChargeInfoList = mCall->gprsServiceUsed->chargeInformationList;
-			ExRateValidationRes validationRes = ValidateChrInfoExRates(pChargeInfoList,
-				mCall->gprsBasicCallInformation->callEventStartTimeStamp->localTimeStamp, exchangeRates, tapLocalCurrency);
+	for (int call_index = 0; call_index < GetCallCount(); call_index++) {
+		LazyCallEvent callEvent(GetCallEvent(call_index), GetCallEventSpan(call_index));
+		if (callEvent.GetType() != CallEventDetail_PR_mobileOriginatedCall && callEvent.GetType() != CallEventDetail_PR_mobileTerminatedCall &&
+				callEvent.GetType() != CallEventDetail_PR_gprsCall)
+			continue;
+		const vector<const ChargeInformationList*>& chargeInfoLists = callEvent.GetChargeInformationLists();
+		if (callEvent.HasDecodeError())
+			return EXRATE_DECODE_ERROR;
+		for (size_t list_index = 0; list_index < chargeInfoLists.size(); list_index++) {
+			ExRateValidationRes validationRes = ValidateChrInfoExRates(chargeInfoLists[list_index], 
+				callEvent.GetCallTimeStamp(), exchangeRates, tapLocalCurrency);
 			if (validationRes != EXRATE_VALID) {
 				// break processing and return error
-				return (ExRateValidationRes)validationRes;
+				return validationRes;
 			}
 		}
 	}
@@ -621,6 +761,9 @@ TAPValidationResult TAPValidator::ValidateAccountingInfo()
 			ACCOUNTING_TAP_DECIMAL_PLACES_MISSING, NO_ASN_ITEMS);
 		return (createRapRes >=0 ? FATAL_ERROR : VALIDATION_IMPOSSIBLE);
 	}
+	// charge checks of incompletely decoded batch would create false RAP files
+	if (GetBatchChargeSummary().decodeError)
+		return VALIDATION_IMPOSSIBLE;
 	if (!m_transferBatch->accountingInfo->taxation && BatchContainsTaxes()) {
 		int createRapRes = CreateAccountingInfoRAPFile(
 			"taxation group is missing in Accounting Info and batch contains taxes", 
@@ -674,8 +817,8 @@ TAPValidationResult TAPValidator::ValidateAccountingInfo()
 			else {
 				exchangeRates.insert(pair<ExchangeRateCode_t, double>
 					(*m_transferBatch->accountingInfo->currencyConversionInfo->list.array[i]->exchangeRateCode,
-					*m_transferBatch->accountingInfo->currencyConversionInfo->list.array[i]->exchangeRate /
-					pow((double)10, *m_transferBatch->accountingInfo->currencyConversionInfo->list.array[i]->numberOfDecimalPlaces)));
+					TapAmount(*m_transferBatch->accountingInfo->currencyConversionInfo->list.array[i]->exchangeRate,
+						*m_transferBatch->accountingInfo->currencyConversionInfo->list.array[i]->numberOfDecimalPlaces).ToDouble()));
 			}
 		}
 		ExRateValidationRes validationRes = ValidateExchangeRates(exchangeRates, 
@@ -711,8 +854,11 @@ TAPValidationResult TAPValidator::ValidateAccountingInfo()
 					logMessage = string("Exchange rate for \"") + (char*) m_transferBatch->accountingInfo->localCurrency->buf  + 
 						"\" is not set in IRBiS";
 					break;
+				case EXRATE_DECODE_ERROR:
+					logMessage = "Call event can't be decoded";
+					break;
 				}
-			SetErrorAndLog("    ,   " + to_string((long long) validationRes) +
+			SetErrorAndLog("Невозможно проверить курсы обмена валют, код ошибки " + to_string((long long) validationRes) +
 				" (" + logMessage + ")");
 			return VALIDATION_IMPOSSIBLE;
 		}
@@ -788,7 +934,7 @@ TAPValidationResult TAPValidator::ValidateAccountingInfo()
 
 int TAPValidator::CreateNetworkInfoRAPFile(string logMessage, int errorCode, const vector<ErrContextAsnItem>& asnItems)
 {
-	SetErrorAndLog(" Network Info: " + logMessage);
+	SetErrorAndLog("Валидация Network Info: " + logMessage);
 	ReturnDetail* returnDetail = (ReturnDetail*) calloc(1, sizeof(ReturnDetail));
 	returnDetail->present = ReturnDetail_PR_fatalReturn;
 	OCTET_STRING_fromBuf(&returnDetail->choice.fatalReturn.fileSequenceNumber, (const char*) m_transferBatch->batchControlInfo->fileSequenceNumber->buf, 
@@ -796,7 +942,12 @@ int TAPValidator::CreateNetworkInfoRAPFile(string logMessage, int errorCode, con
 	returnDetail->choice.fatalReturn.networkInfoError = (NetworkInfoError*) calloc(1, sizeof(NetworkInfoError));
 	
 	//Copy NetworkInfo fields to Return Batch structure
-	returnDetail->choice.fatalReturn.networkInfoError->networkInfo = *m_transferBatch->networkInfo;
+	if (!CopyTAPStructure(&asn_DEF_NetworkInfo, m_transferBatch->networkInfo,
+			&returnDetail->choice.fatalReturn.networkInfoError->networkInfo)) {
+		ASN_STRUCT_FREE(asn_DEF_ReturnDetail, returnDetail);
+		log(LOG_ERROR, "Ошибка копирования Network Info в RAP-файл");
+		return TL_TAP_NOT_VALIDATED;
+	}
 		
 	ErrorDetail* errorDetail = (ErrorDetail*) calloc(1, sizeof(ErrorDetail));
 	errorDetail->errorCode = errorCode;
@@ -830,13 +981,7 @@ int TAPValidator::CreateNetworkInfoRAPFile(string logMessage, int errorCode, con
 	assert(m_transferBatch->batchControlInfo->recipient);
 	assert(m_transferBatch->batchControlInfo->fileAvailableTimeStamp);
 
-	int loadRes = CreateAndUploadRapFile(returnDetail);
-
-	// Clear previously copied pointers to avoid ASN_STRUCT_FREE errors
-	returnDetail->choice.fatalReturn.networkInfoError->networkInfo.recEntityInfo = NULL;
-	returnDetail->choice.fatalReturn.networkInfoError->networkInfo.utcTimeOffsetInfo = NULL;
-	
-	return loadRes;
+	return CreateAndUploadRapFile(returnDetail);
 }
 
 
@@ -897,7 +1042,7 @@ TAPValidationResult TAPValidator::ValidateNetworkInfo()
 
 int TAPValidator::CreateAuditControlInfoRAPFile(string logMessage, int errorCode, const vector<ErrContextAsnItem>& asnItems)
 {
-	SetErrorAndLog(" Audit Control Info: " + logMessage);
+	SetErrorAndLog("Валидация Audit Control Info: " + logMessage);
 	ReturnDetail* returnDetail = (ReturnDetail*) calloc(1, sizeof(ReturnDetail));
 	returnDetail->present = ReturnDetail_PR_fatalReturn;
 	OCTET_STRING_fromBuf(&returnDetail->choice.fatalReturn.fileSequenceNumber, (const char*) m_transferBatch->batchControlInfo->fileSequenceNumber->buf, 
@@ -905,7 +1050,12 @@ int TAPValidator::CreateAuditControlInfoRAPFile(string logMessage, int errorCode
 	returnDetail->choice.fatalReturn.auditControlInfoError = (AuditControlInfoError*) calloc(1, sizeof(AuditControlInfoError));
 	
 	//Copy auditControlInfo fields to Return Batch structure
-	returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo = *m_transferBatch->auditControlInfo;
+	if (!CopyTAPStructure(&asn_DEF_AuditControlInfo, m_transferBatch->auditControlInfo,
+			&returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo)) {
+		ASN_STRUCT_FREE(asn_DEF_ReturnDetail, returnDetail);
+		log(LOG_ERROR, "Ошибка копирования Audit Control Info в RAP-файл");
+		return TL_TAP_NOT_VALIDATED;
+	}
 	
 	ErrorDetail* errorDetail = (ErrorDetail*) calloc(1, sizeof(ErrorDetail));
 	errorDetail->errorCode = errorCode;
@@ -939,22 +1089,7 @@ int TAPValidator::CreateAuditControlInfoRAPFile(string logMessage, int errorCode
 	assert(m_transferBatch->batchControlInfo->sender);
 	assert(m_transferBatch->batchControlInfo->fileAvailableTimeStamp);
 
-	int loadRes = CreateAndUploadRapFile(returnDetail);
-
-	// Clear previously copied pointers to avoid ASN_STRUCT_FREE errors
-	returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo.callEventDetailsCount = NULL;
-	returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo.earliestCallTimeStamp = NULL;
-	returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo.latestCallTimeStamp = NULL;
-	returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo.operatorSpecInformation = NULL;
-	returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo.totalAdvisedChargeValueList = NULL;
-	returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo.totalCharge = NULL;
-	returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo.totalChargeRefund = NULL;
-	returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo.totalDiscountRefund = NULL;
-	returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo.totalDiscountValue = NULL;
-	returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo.totalTaxRefund = NULL;
-	returnDetail->choice.fatalReturn.auditControlInfoError->auditControlInfo.totalTaxValue = NULL;
-	
-	return loadRes;
+	return CreateAndUploadRapFile(returnDetail);
 }
 
 
@@ -981,7 +1116,7 @@ TAPValidationResult TAPValidator::ValidateAuditControlInfo()
 			AUDIT_CTRL_CALL_COUNT_MISSING, NO_ASN_ITEMS);
 		return (createRapRes >=0 ? FATAL_ERROR : VALIDATION_IMPOSSIBLE);
 	}
-	if (*m_transferBatch->auditControlInfo->callEventDetailsCount != m_transferBatch->callEventDetails->list.count) {
+	if (*m_transferBatch->auditControlInfo->callEventDetailsCount != GetCallCount()) {
 		vector<ErrContextAsnItem> asnItems;
 		asnItems.push_back(ErrContextAsnItem(&asn_DEF_CallEventDetailsCount, 0));
 		int createRapRes = CreateAuditControlInfoRAPFile(
@@ -990,6 +1125,8 @@ TAPValidationResult TAPValidator::ValidateAuditControlInfo()
 		return (createRapRes >=0 ? FATAL_ERROR : VALIDATION_IMPOSSIBLE);
 	}
 
+	if (GetBatchChargeSummary().decodeError)
+		return VALIDATION_IMPOSSIBLE;
 	long long auditTotalCharge = OctetStr2Int64(*m_transferBatch->auditControlInfo->totalCharge);
 	long long calcTotalCharge = BatchTotalCharge();
 	if (OctetStr2Int64(*m_transferBatch->auditControlInfo->totalCharge) != BatchTotalCharge()) {
@@ -1006,7 +1143,7 @@ TAPValidationResult TAPValidator::ValidateAuditControlInfo()
 
 int TAPValidator::CreateTransferBatchRAPFile(string logMessage, int errorCode)
 {
-	SetErrorAndLog(" Transfer Batch: " + logMessage);
+	SetErrorAndLog("Валидация Transfer Batch: " + logMessage);
 	ReturnDetail* returnDetail = (ReturnDetail*) calloc(1, sizeof(ReturnDetail));
 	returnDetail->present = ReturnDetail_PR_fatalReturn;
 	OCTET_STRING_fromBuf(&returnDetail->choice.fatalReturn.fileSequenceNumber, (const char*)m_transferBatch->batchControlInfo->fileSequenceNumber->buf, 
@@ -1082,7 +1219,7 @@ TAPValidationResult TAPValidator::ValidateTransferBatch()
 
 int TAPValidator::CreateNotificationRAPFile(string logMessage, int errorCode, const vector<ErrContextAsnItem>& asnItems)
 {
-	SetErrorAndLog(" Notification: " + logMessage);
+	SetErrorAndLog("Валидация Notification: " + logMessage);
 	ReturnDetail* returnDetail = (ReturnDetail*) calloc(1, sizeof(ReturnDetail));
 	returnDetail->present = ReturnDetail_PR_fatalReturn;
 	OCTET_STRING_fromBuf(&returnDetail->choice.fatalReturn.fileSequenceNumber, (const char*) m_notification->fileSequenceNumber->buf, 
@@ -1124,12 +1261,12 @@ TAPValidationResult TAPValidator::ValidateNotification()
 	assert(m_notification);
 	assert(!m_transferBatch);
 	if (!m_notification->sender || !m_notification->recipient || !m_notification->fileSequenceNumber) {
-		SetErrorAndLog(std::string(": Sender, Recipient  FileSequenceNumber   Notification."));
+		SetErrorAndLog(std::string("Валидация: Sender, Recipient либо FileSequenceNumber отсутствует в Notification."));
 		return VALIDATION_IMPOSSIBLE;
 	}
 
 	if(!IsRecipientCorrect((char*) m_notification->recipient->buf)) {
-		SetErrorAndLog(":   " + string((char*) m_notification->recipient->buf));
+		SetErrorAndLog("Валидация: некорректный получатель " + string((char*) m_notification->recipient->buf));
 		return VALIDATION_IMPOSSIBLE;
 	}
 
@@ -1141,14 +1278,14 @@ TAPValidationResult TAPValidator::ValidateNotification()
 		// wrong file sequence number given
 		vector<ErrContextAsnItem> asnItems;
 		asnItems.push_back(ErrContextAsnItem(&asn_DEF_FileSequenceNumber, 0));
-		int createRapRes = CreateNotificationRAPFile("    fileSequenceNumber", 
+		int createRapRes = CreateNotificationRAPFile("В файле указан нечисловой fileSequenceNumber", 
 			FILE_SEQ_NUM_SYNTAX_ERROR, asnItems);
 		return (createRapRes >=0 ? FATAL_ERROR : VALIDATION_IMPOSSIBLE);
 	}
 	if (!(fileSeqNum >= START_TAP_SEQUENCE_NUM && fileSeqNum <= END_TAP_SEQUENCE_NUM)) {
 		vector<ErrContextAsnItem> asnItems;
 		asnItems.push_back(ErrContextAsnItem(&asn_DEF_FileSequenceNumber, 0));
-		int createRapRes = CreateNotificationRAPFile("fileSequenceNumber   ", 
+		int createRapRes = CreateNotificationRAPFile("fileSequenceNumber вне допустимого диапазона", 
 			FILE_SEQ_NUM_OUT_OF_RANGE, asnItems);
 		return (createRapRes >=0 ? FATAL_ERROR : VALIDATION_IMPOSSIBLE);
 	}
@@ -1156,8 +1293,10 @@ TAPValidationResult TAPValidator::ValidateNotification()
 }
 
 
-void TAPValidator::Validate(DataInterChange* dataInterchange)
+void TAPValidator::Validate(DataInterChange* dataInterchange, const vector<BerSpan>* eventSpans, long notValidatedFileID)
 {
+	m_eventSpans = eventSpans;
+	m_chargeSummaryReady = false;
 	switch (dataInterchange->present) {
 		case DataInterChange_PR_transferBatch:
 			m_transferBatch = &dataInterchange->choice.transferBatch;
@@ -1168,32 +1307,36 @@ void TAPValidator::Validate(DataInterChange* dataInterchange)
 			m_transferBatch = NULL;
 			break;
 		default:
-			SetErrorAndLog(std::string("       TAP: ") + 
+			SetErrorAndLog(std::string("Для валидации был передан неподдерживаемый тип данных TAP: ") + 
 				std::to_string(static_cast<long long>(dataInterchange->present)));
 			m_validationResult = VALIDATION_IMPOSSIBLE;
-	}
-	if (!SetSenderNetworkID()) {
-		SetErrorAndLog(std::string("       TAP-.   "
-			" .    ."));
+			// file is not admitted, so not validated header is deleted here
+			if (notValidatedFileID > 0)
+				DeleteNotValidatedFileHeader(notValidatedFileID);
+			return;
+	}
+	// not validated header is deleted by admission query, whatever the result of admission is
+	if (!AdmitFile(notValidatedFileID)) {
+		SetErrorAndLog(std::string("Невозможно найти в базе сеть отправителя по TAP-коду. Проверьте корректность "
+			"ее заведения. Файл не был загружен."));
 		m_validationResult = VALIDATION_IMPOSSIBLE;
 		return;
 	}
 
-	SetIOTValidationMode();
 	IncomingTAPAllowed tapAllowed = IsIncomingTAPAllowed();
 	switch (tapAllowed) {
 	case INCOMING_TAP_ALLOWED:
 		break;
 	case INCOMING_TAP_NOT_ALLOWED:
-		SetErrorAndLog(std::string(":  TAP-     .    "
-			"\" \"   \"   \"."));
+		SetErrorAndLog(std::string("Валидация: Входящие TAP-файлы не разрешены для данной сети. Проверьте настройку поля "
+			"\"Вид роуминга\" в справочнике \"Привязка к роуминговому координатору\"."));
 		m_validationResult = VALIDATION_IMPOSSIBLE;
 		return;
 	case UNABLE_TO_DETERMINE:
 	default:
-		SetErrorAndLog(std::string(":  ,     TAP-   ."
-			"    \"   \". ,  "
-			"   ,     ."));
+		SetErrorAndLog(std::string("Валидация: Невозможно определить, разрешены или нет входящие TAP-файлы для данной сети."
+			" Проверьте настройки справочника \"Привязка к роуминговому координатору\". Возможно, сеть привязана"
+			" к одному координатору, а файлы поступают от другого."));
 		m_validationResult = VALIDATION_IMPOSSIBLE;
 		return;
 	}
@@ -1251,6 +1394,12 @@ void TAPValidator::SetErrorAndLog(std::string& error)
 	log(LOG_ERROR, error);
 }
 
+const vector<string>& TAPValidator::GetRAPErrorCodes() const
+{
+	return m_rapErrorCodes;
+}
+
+
 const std::string& TAPValidator::GetValidationError() const
 {
 	return m_validationError;
@@ -98,7 +98,8 @@ enum ExRateValidationRes
 	EXRATE_CURRENCY_MISMATCH		= -205,
 	EXRATE_NOT_SET					= -207,
 	EXRATE_HIGHER					= -210,
-	EXRATE_LOWER					= -220
+	EXRATE_LOWER					= -220,
+	EXRATE_DECODE_ERROR				= -300
 };
 
 
@@ -120,11 +121,29 @@ struct ExchangeRate
 	{}
 };
 
+// Charge figures of all call events of transfer batch, collected by one pass over events
+struct BatchChargeSummary
+{
+	bool containsTaxes;
+	bool containsDiscounts;
+	bool containsPositiveCharges;
+	long long totalCharge;
+	// figures are incomplete if some call event can't be decoded
+	bool decodeError;
+};
+
+class FileSequenceIndex;
+
 class TAPValidator
 {
 public:
-	TAPValidator(otl_connect& dbConnect, Config& config, long roamingHubID);
-	void Validate(DataInterChange* dataInterchange);
+	// in validate-only mode RAP files are neither created nor uploaded, their error codes are only collected
+	TAPValidator(otl_connect& dbConnect, Config& config, long roamingHubID, bool validateOnly = false);
+	~TAPValidator();
+	// call events may be left not decoded if their spans are given,
+	// not validated header of file with notValidatedFileID (if > 0) is deleted whatever the result of validation,
+	// usually by admission query
+	void Validate(DataInterChange* dataInterchange, const vector<BerSpan>* eventSpans = NULL, long notValidatedFileID = 0);
 
 	long GetRapFileID() const;
 	string GetRapSequenceNum() const;
@@ -132,37 +151,59 @@ public:
 	long GetIOTValidationMode() const;
 	TAPValidationResult GetValidationResult() const;
 	const std::string& GetValidationError() const;
+	// error codes of RAP file which would be created in validate-only mode, as "<group>: <code>"
+	const vector<string>& GetRAPErrorCodes() const;
+	// opens FileSequenceIndex of the file (owned by caller) to register its sequence number there after the load
+	// is committed, returns NULL if file has no valid sequence number or index can't be used
+	FileSequenceIndex* OpenSequenceIndex(int& sequenceNumber);
 private:
 	otl_connect& m_otlConnect;
 	Config& m_config;
 	
 	TransferBatch* m_transferBatch;
 	Notification* m_notification;
+	const vector<BerSpan>* m_eventSpans;
 
 	//long m_rapFileID;
 	long m_mobileNetworkID;
 	long m_iotValidationMode;
 	long m_roamingHubID;
+	std::string m_ourTAPCode;
+	long m_incomingTAPAllowed;
+	bool m_duplicationChecked;
+	long m_duplicationCheckRes;
 	std::string m_rapSequenceNum;
 	TAPValidationResult m_validationResult;
 	std::string m_validationError;
 	RAPFile m_rapFile;
-
-	bool SetSenderNetworkID();
-	void SetIOTValidationMode();
+	bool m_validateOnly;
+	vector<string> m_rapErrorCodes;
+	vector<ReturnDetail*> m_notUploadedDetails;
+	BatchChargeSummary m_chargeSummary;
+	bool m_chargeSummaryReady;
+
+	bool AdmitFile(long notValidatedFileID);
+	void DeleteNotValidatedFileHeader(long fileID);
+	bool CanCheckDuplicationOnAdmission() const;
+	bool GetSequenceIndexKey(string& sender, string& recipient, int& sequenceNumber) const;
 	bool IsRecipientCorrect(string recipient);
 	bool IsTestFile();
 	void SetErrorAndLog(std::string& error);
 	FileDuplicationCheckRes IsFileDuplicated();
+	FileDuplicationCheckRes ReportDuplicationCheckRes(long result);
 	IncomingTAPAllowed IsIncomingTAPAllowed();
 	TAPValidationResult FileSequenceNumberControl();
+	int GetCallCount() const;
+	const CallEventDetail* GetCallEvent(int callIndex) const;
+	const BerSpan* GetCallEventSpan(int callIndex) const;
+	const BatchChargeSummary& GetBatchChargeSummary();
 	bool BatchContainsTaxes();
 	bool BatchContainsDiscounts();
-	bool ChargeInfoContainsPositiveCharges(ChargeInformation* chargeInfo);
+	bool ChargeInfoContainsPositiveCharges(const ChargeInformation* chargeInfo);
 	bool BatchContainsPositiveCharges();
-	long long ChargeInfoListTotalCharge(ChargeInformationList* chargeInfoList);
+	long long ChargeInfoListTotalCharge(const ChargeInformationList* chargeInfoList);
 	long long BatchTotalCharge();
-	ExRateValidationRes ValidateChrInfoExRates(ChargeInformationList* pChargeInfoList, LocalTimeStamp_t* pCallTimestamp,
+	ExRateValidationRes ValidateChrInfoExRates(const ChargeInformationList* pChargeInfoList, const LocalTimeStamp_t* pCallTimestamp,
 		const map<ExchangeRateCode_t, double>& exchangeRates, string tapLocalCurrency);
 	ExRateValidationRes ValidateExchangeRates(const map<ExchangeRateCode_t, double>& exchangeRates, string tapLocalCurrency);
 	
@@ -173,6 +214,7 @@ private:
 	int CreateNetworkInfoRAPFile(string logMessage, int errorCode, const vector<ErrContextAsnItem>& asnItems);
 	int CreateAuditControlInfoRAPFile(string logMessage, int errorCode, const vector<ErrContextAsnItem>& asnItems);
 	int CreateAndUploadRapFile(ReturnDetail* returnDetail);
+	void CollectRAPErrorCodes(const ReturnDetail* returnDetail);
 
 	int CreateSevereRAPFile(string logMessage, int errorCode, const vector<ErrContextAsnItem>& asnItems);
 
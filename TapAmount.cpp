@@ -0,0 +1,135 @@
+#include "OTL_Header.h"
+#include "DataInterchange.h"
+#include "TapAmount.h"
+
+using namespace std;
+
+extern long long OctetStr2Int64(const OCTET_STRING_t& octetStr);
+
+static const long long powersOf10[TapAmount::maxScale + 1] = {
+	1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL, 100000000LL, 1000000000LL,
+	10000000000LL, 100000000000LL, 1000000000000LL, 10000000000000LL, 100000000000000LL, 1000000000000000LL,
+	10000000000000000LL, 100000000000000000LL, 1000000000000000000LL
+};
+
+
+TapAmount::TapAmount() :
+	m_mantissa(0),
+	m_scale(0)
+{
+}
+
+
+TapAmount::TapAmount(long long mantissa, int scale) :
+	m_mantissa(mantissa),
+	m_scale(scale < 0 ? 0 : (scale > maxScale ? maxScale : scale))
+{
+}
+
+
+TapAmount TapAmount::FromOctetString(const OCTET_STRING_t& value, int scale)
+{
+	return TapAmount(OctetStr2Int64(value), scale);
+}
+
+
+TapAmount TapAmount::FromDouble(double value, int scale)
+{
+	TapAmount amount(0, scale);
+	double scaled = value * powersOf10[amount.m_scale];
+	amount.m_mantissa = (long long) (scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+	return amount;
+}
+
+
+long long TapAmount::Power(int scale)
+{
+	return powersOf10[scale < 0 ? 0 : (scale > maxScale ? maxScale : scale)];
+}
+
+
+long long TapAmount::GetMantissa() const
+{
+	return m_mantissa;
+}
+
+
+int TapAmount::GetScale() const
+{
+	return m_scale;
+}
+
+
+long long TapAmount::GetMantissa(int scale) const
+{
+	if (scale >= m_scale)
+		return m_mantissa * Power(scale - m_scale);
+	long long divisor = Power(m_scale - scale);
+	long long half = divisor / 2;
+	return (m_mantissa < 0 ? (m_mantissa - half) : (m_mantissa + half)) / divisor;
+}
+
+
+double TapAmount::ToDouble() const
+{
+	return (double) m_mantissa / powersOf10[m_scale];
+}
+
+
+string TapAmount::ToString() const
+{
+	char buffer[48];
+	unsigned long long absMantissa = (m_mantissa < 0 ? 0ULL - (unsigned long long) m_mantissa : (unsigned long long) m_mantissa);
+	unsigned long long power = (unsigned long long) powersOf10[m_scale];
+	if (m_scale > 0)
+		sprintf(buffer, "%s%llu.%0*llu", (m_mantissa < 0 ? "-" : ""), absMantissa / power, m_scale, absMantissa % power);
+	else
+		sprintf(buffer, "%lld", m_mantissa);
+	return buffer;
+}
+
+
+// sum has the greater scale of two amounts
+TapAmount& TapAmount::operator+=(const TapAmount& other)
+{
+	if (other.m_scale > m_scale) {
+		m_mantissa = GetMantissa(other.m_scale);
+		m_scale = other.m_scale;
+	}
+	m_mantissa += other.GetMantissa(m_scale);
+	return *this;
+}
+
+
+TapAmount TapAmount::operator+(const TapAmount& other) const
+{
+	TapAmount sum(*this);
+	sum += other;
+	return sum;
+}
+
+
+bool TapAmount::operator==(const TapAmount& other) const
+{
+	int scale = (m_scale > other.m_scale ? m_scale : other.m_scale);
+	return GetMantissa(scale) == other.GetMantissa(scale);
+}
+
+
+bool TapAmount::operator!=(const TapAmount& other) const
+{
+	return !(*this == other);
+}
+
+
+bool TapAmount::operator<(const TapAmount& other) const
+{
+	int scale = (m_scale > other.m_scale ? m_scale : other.m_scale);
+	return GetMantissa(scale) < other.GetMantissa(scale);
+}
+
+
+bool TapAmount::operator>(const TapAmount& other) const
+{
+	return other < *this;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// Class TapAmount keeps TAP money value (charge, tax, discount, audit total) as integer mantissa and number of
+// decimal places (TAP decimal places of the file), so that amounts are summed and compared exactly and may be
+// bound to DB as integers. Powers of 10 are taken from table instead of pow.
+class TapAmount
+{
+public:
+	static const int maxScale = 18;
+
+	TapAmount();
+	TapAmount(long long mantissa, int scale);
+	static TapAmount FromOctetString(const OCTET_STRING_t& value, int scale);
+	// value is rounded half away from zero
+	static TapAmount FromDouble(double value, int scale);
+	static long long Power(int scale);
+
+	long long GetMantissa() const;
+	int GetScale() const;
+	// mantissa of value rescaled to given number of decimal places, rounded half away from zero if they are less
+	long long GetMantissa(int scale) const;
+	double ToDouble() const;
+	// decimal text with point and all decimal places, e.g. -12.340
+	string ToString() const;
+
+	TapAmount& operator+=(const TapAmount& other);
+	TapAmount operator+(const TapAmount& other) const;
+	bool operator==(const TapAmount& other) const;
+	bool operator!=(const TapAmount& other) const;
+	bool operator<(const TapAmount& other) const;
+	bool operator>(const TapAmount& other) const;
+private:
+	long long m_mantissa;
+	int m_scale;
+};
@@ -33,6 +33,7 @@ int main(int argc, const char* argv[])
 	const char* configFile = "c:\\Projects\\TAP3\\TAP3\\TAP3.12_Loader\\Tests\\Tests.cfg";
 
 	HINSTANCE hinstDLL = nullptr;
+	bool testsPassed = false;
 	otl_connect otlConnect;
 	try {
 		typedef VOID(*DLLPROC) (LPTSTR);
@@ -173,6 +174,7 @@ int main(int argc, const char* argv[])
 		}
 
 		std::cout << "Tests PASSED. " << std::endl; 
+		testsPassed = true;
 	}
 	catch (otl_exception &otlEx) {
 		otlConnect.rollback();
@@ -194,8 +196,7 @@ int main(int argc, const char* argv[])
 	if (hinstDLL != nullptr) {
 		FreeLibrary(hinstDLL);
 	}
-	std::cout << "Enter anything to exit." << std::endl; 
-	char dummy;
-	std::cin >> dummy;
+	// exit code is checked by deploy scripts, throughput is measured by Benchmarks\tap3bench
+	return testsPassed ? 0 : 1;
 }
 
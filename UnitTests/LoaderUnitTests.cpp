@@ -0,0 +1,903 @@
+// LoaderUnitTests.cpp : unit tests of TAP3 loader parts that need neither DB nor sample files.
+//
+// Usage: LoaderUnitTests.exe
+// Every failed check is printed, exit code is 1 if any check failed. Temporary files are created in
+// %TEMP%\LoaderUnitTests. FTP session pool is tested against local FTP stand-in listening on 127.0.0.1.
+
+#include "stdafx.h"
+#include <winsock2.h>
+#include <vector>
+#include <zlib.h>
+#include <zstd.h>
+#include "OTL_Header.h"
+#include "DataInterchange.h"
+#include "ReturnBatch.h"
+#include "TAP_Constants.h"
+#include "ConfigContainer.h"
+#include "TapAmount.h"
+#include "TAPTimestamp.h"
+#include "BerSpan.h"
+#include "ContentHash.h"
+#include "CompressedInput.h"
+#include "TAPValidator.h"
+#include "FileSequenceIndex.h"
+#include "FtpSessionPool.h"
+#include "RAPFile.h"
+#include "CallValidator.h"
+
+extern const char* pShortName;
+extern long long OctetStr2Int64(const OCTET_STRING_t& octetStr);
+
+int checkCount = 0;
+int failedCheckCount = 0;
+
+void Check(bool passed, const char* condition, const char* file, int line)
+{
+	checkCount++;
+	if (!passed) {
+		failedCheckCount++;
+		cerr << file << "(" << line << "): check failed: " << condition << endl;
+	}
+}
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
+
+string tempDir;
+
+string TempFilename(const char* name)
+{
+	return tempDir + "\\" + name;
+}
+
+bool WriteTestFile(string filename, const void* data, size_t size, const char* mode = "wb")
+{
+	FILE* f = fopen(filename.c_str(), mode);
+	if (!f)
+		return false;
+	bool success = (size == 0 || fwrite(data, 1, size, f) == size);
+	return (fclose(f) == 0 && success);
+}
+
+bool WriteTestFile(string filename, const vector<unsigned char>& data, const char* mode = "wb")
+{
+	return WriteTestFile(filename, data.empty() ? NULL : &data[0], data.size(), mode);
+}
+
+// Config of tests has output directory only
+void MakeConfig(Config& config)
+{
+	string cfgFilename = TempFilename("LoaderUnitTests.cfg");
+	string cfgText = "OUTPUT_DIRECTORY " + tempDir + "\n";
+	WriteTestFile(cfgFilename, cfgText.c_str(), cfgText.size());
+	ifstream cfgStream(cfgFilename.c_str(), ifstream::in);
+	config.ReadConfigFile(cfgStream);
+	cfgStream.close();
+	DeleteFile(cfgFilename.c_str());
+}
+
+int AppendToBuffer(const void *buffer, size_t size, void *app_key)
+{
+	vector<unsigned char>* dest = (vector<unsigned char>*) app_key;
+	dest->insert(dest->end(), (const unsigned char*) buffer, (const unsigned char*) buffer + size);
+	return 0;
+}
+
+// position of bytes in buffer or -1
+ptrdiff_t FindBytes(const vector<unsigned char>& buffer, const unsigned char* bytes, size_t size)
+{
+	for (size_t i = 0; i + size <= buffer.size(); i++) {
+		if (memcmp(&buffer[i], bytes, size) == 0)
+			return i;
+	}
+	return -1;
+}
+
+//-----------------------------
+// TAP amounts
+void TestTapAmount()
+{
+	unsigned char value[] = { 0x12, 0xD6, 0x87 };
+	OCTET_STRING_t octetStr;
+	memset(&octetStr, 0, sizeof(octetStr));
+	octetStr.buf = value;
+	octetStr.size = sizeof(value);
+	TapAmount amount = TapAmount::FromOctetString(octetStr, 5);
+	CHECK(amount.GetMantissa() == 1234567);
+	CHECK(amount.GetScale() == 5);
+	CHECK(amount.ToString() == "12.34567");
+
+	// rescaling
+	CHECK(amount.GetMantissa(5) == 1234567);
+	CHECK(amount.GetMantissa(7) == 123456700);
+	CHECK(amount.GetMantissa(2) == 1235);
+	CHECK(amount.GetMantissa(0) == 12);
+	CHECK(TapAmount(12345, 3).GetMantissa(2) == 1235);
+	CHECK(TapAmount(-12345, 3).GetMantissa(2) == -1235);
+	CHECK(TapAmount(12344, 3).GetMantissa(2) == 1234);
+	CHECK(TapAmount(-12344, 3).GetMantissa(2) == -1234);
+
+	// scale is limited by table of powers
+	CHECK(TapAmount(1, 30).GetScale() == TapAmount::maxScale);
+	CHECK(TapAmount(1, -1).GetScale() == 0);
+	CHECK(TapAmount::Power(0) == 1);
+	CHECK(TapAmount::Power(6) == 1000000);
+	CHECK(TapAmount::Power(TapAmount::maxScale) == 1000000000000000000LL);
+	CHECK(TapAmount::Power(TapAmount::maxScale + 1) == 1000000000000000000LL);
+
+	CHECK(TapAmount::FromDouble(12.5, 0).GetMantissa() == 13);
+	CHECK(TapAmount::FromDouble(-12.5, 0).GetMantissa() == -13);
+	CHECK(TapAmount::FromDouble(0.125, 2).GetMantissa() == 13);
+	CHECK(TapAmount::FromDouble(0.1 + 0.2, 2).GetMantissa() == 30);
+
+	CHECK(TapAmount(-5, 3).ToString() == "-0.005");
+	CHECK(TapAmount(42, 0).ToString() == "42");
+	CHECK(TapAmount(1200, 2).ToString() == "12.00");
+
+	// sum keeps the greater scale, comparison is exact across scales
+	TapAmount sum = TapAmount(150, 2) + TapAmount(1, 3);
+	CHECK(sum.GetMantissa() == 1501 && sum.GetScale() == 3);
+	CHECK(TapAmount(150, 2) == TapAmount(1500, 3));
+	CHECK(TapAmount(150, 2) != TapAmount(1501, 3));
+	CHECK(TapAmount(150, 2) < TapAmount(1501, 3));
+	CHECK(TapAmount(1501, 3) > TapAmount(150, 2));
+	TapAmount total;
+	for (int i = 0; i < 10; i++)
+		total += TapAmount(1, 1);
+	CHECK(total == TapAmount(1, 0));
+}
+
+//-----------------------------
+// TAP timestamps
+void TestTAPTimestamp()
+{
+	int offset = 0;
+	CHECK(ParseUTCOffset("+0300", offset) && offset == 10800);
+	CHECK(ParseUTCOffset("-0530", offset) && offset == -19800);
+	CHECK(ParseUTCOffset("+0000", offset) && offset == 0);
+	CHECK(ParseUTCOffset("+1400", offset) && offset == 50400);
+	CHECK(!ParseUTCOffset("+1500", offset));
+	CHECK(!ParseUTCOffset("+0360", offset));
+	CHECK(!ParseUTCOffset("0300", offset));
+	CHECK(!ParseUTCOffset("+03", offset));
+	CHECK(!ParseUTCOffset("+03000", offset));
+	CHECK(!ParseUTCOffset("+03:0", offset));
+	CHECK(!ParseUTCOffset("", offset));
+
+	long long seconds = -1;
+	CHECK(ParseTAPTimestamp("19700101000000", seconds) && seconds == 0);
+	CHECK(ParseTAPTimestamp("20160229235959", seconds) && seconds == 1456790399LL);
+	CHECK(ParseTAPTimestamp("20000229120000", seconds) && seconds == 951825600LL);
+	CHECK(!ParseTAPTimestamp("20150229000000", seconds));
+	CHECK(!ParseTAPTimestamp("19000229000000", seconds));
+	CHECK(!ParseTAPTimestamp("20161301000000", seconds));
+	CHECK(!ParseTAPTimestamp("20160101240000", seconds));
+	CHECK(!ParseTAPTimestamp("2016010100000", seconds));
+	CHECK(!ParseTAPTimestamp("201601010000001", seconds));
+
+	otl_datetime datetime;
+	CHECK(ParseTAPTimestamp("20171231235958", datetime));
+	CHECK(datetime.year == 2017 && datetime.month == 12 && datetime.day == 31);
+	CHECK(datetime.hour == 23 && datetime.minute == 59 && datetime.second == 58);
+	CHECK(!ParseTAPTimestamp("20170431000000", datetime));
+}
+
+//-----------------------------
+// Spans of call events in BER buffer
+void TestBerSpan()
+{
+	ber_tlv_tag_t tag;
+	size_t length;
+	// context tag 200 in 3 bytes
+	const unsigned char multiByteTag[] = { 0x9F, 0x81, 0x48, 0x01, 0x07 };
+	CHECK(FetchTagAndLength(multiByteTag, sizeof(multiByteTag), tag, length) == 4);
+	CHECK(BER_TAG_CLASS(tag) == ASN_TAG_CLASS_CONTEXT && BER_TAG_VALUE(tag) == 200 && length == 1);
+	const unsigned char exceedingLength[] = { 0x80, 0x05, 0x01, 0x02 };
+	CHECK(FetchTagAndLength(exceedingLength, sizeof(exceedingLength), tag, length) == -1);
+	const unsigned char indefiniteLength[] = { 0x63, 0x80, 0x00, 0x00 };
+	CHECK(FetchTagAndLength(indefiniteLength, sizeof(indefiniteLength), tag, length) == -1);
+
+	// transfer batch: batch control info, call event list of MOC and GPRS call (long form length),
+	// audit control info
+	const unsigned char transferBatch[] = {
+		0x61, 0x12,
+			0x64, 0x00,
+			0x63, 0x0A,
+				0x69, 0x03, 0x80, 0x01, 0x05,
+				0x6E, 0x81, 0x02, 0x80, 0x00,
+			0x6F, 0x02, 0x80, 0x00
+	};
+	vector<BerSpan> spans;
+	BerSpan eventList = { NULL, 0 };
+	CHECK(FindCallEventSpans(transferBatch, sizeof(transferBatch), spans, &eventList));
+	CHECK(spans.size() == 2);
+	if (spans.size() == 2) {
+		CHECK(spans[0].data == transferBatch + 6 && spans[0].size == 5);
+		CHECK(spans[1].data == transferBatch + 11 && spans[1].size == 5);
+	}
+	CHECK(eventList.data == transferBatch + 4 && eventList.size == 12);
+
+	// not a transfer batch
+	const unsigned char notification[] = { 0x62, 0x00 };
+	CHECK(!FindCallEventSpans(notification, sizeof(notification), spans));
+	// event list of indefinite length
+	const unsigned char indefiniteList[] = {
+		0x61, 0x0B,
+			0x63, 0x80,
+				0x69, 0x03, 0x80, 0x01, 0x05,
+				0x00, 0x00,
+			0x6F, 0x00
+	};
+	CHECK(!FindCallEventSpans(indefiniteList, sizeof(indefiniteList), spans));
+	CHECK(spans.empty());
+	// second event is truncated
+	vector<unsigned char> truncated(transferBatch, transferBatch + sizeof(transferBatch));
+	truncated[13] = 0x03;
+	CHECK(!FindCallEventSpans(&truncated[0], truncated.size(), spans));
+	CHECK(spans.empty());
+}
+
+//-----------------------------
+// Content hash
+void TestContentHash()
+{
+	// reference XXH64 values, seed 0
+	const char* empty = "";
+	const char* abc = "abc";
+	const char* longText = "Nobody inspects the spammish repetition";
+	CHECK(ContentHash((const unsigned char*) empty, 0) == "ef46db3751d8e999");
+	CHECK(ContentHash((const unsigned char*) "a", 1) == "d24ec4f1a98c6e5b");
+	CHECK(ContentHash((const unsigned char*) abc, strlen(abc)) == "44bc2cf5ad770999");
+	// 32 bytes and more are hashed by stripes
+	CHECK(ContentHash((const unsigned char*) longText, strlen(longText)) == "fbcea83c8a378bf1");
+}
+
+//-----------------------------
+// Compressed input files
+void TestCompressedInput()
+{
+	const unsigned char gzipHeader[] = { 0x1F, 0x8B, 0x08, 0x00 };
+	const unsigned char zstdHeader[] = { 0x28, 0xB5, 0x2F, 0xFD };
+	const unsigned char berHeader[] = { 0x61, 0x84, 0x00, 0x01 };
+	CHECK(DetectCompression(gzipHeader, sizeof(gzipHeader)) == ctGzip);
+	CHECK(DetectCompression(zstdHeader, sizeof(zstdHeader)) == ctZstd);
+	CHECK(DetectCompression(berHeader, sizeof(berHeader)) == ctNone);
+	CHECK(DetectCompression(zstdHeader, 3) == ctNone);
+
+	// several MB of repeating records, so that output buffer grows while decompressing
+	vector<unsigned char> original;
+	for (int i = 0; original.size() < 3 * 1024 * 1024; i++) {
+		string record = "record " + to_string((long long) i) + " of compressed input test;";
+		original.insert(original.end(), record.begin(), record.end());
+	}
+	size_t half = original.size() / 2;
+
+	string plainFilename = TempFilename("input.dat");
+	string gzipFilename = TempFilename("input.dat.gz");
+	string zstdFilename = TempFilename("input.dat.zst");
+	unsigned char* buffer = NULL;
+	unsigned long size = 0;
+
+	CHECK(WriteTestFile(plainFilename, original));
+	CHECK(ReadInputFile(plainFilename.c_str(), buffer, size) == TL_OK);
+	CHECK(size == original.size() && buffer && memcmp(buffer, &original[0], size) == 0);
+	delete [] buffer;
+
+	// gzip file of two members
+	gzFile gz = gzopen(gzipFilename.c_str(), "wb");
+	CHECK(gz != NULL);
+	if (gz) {
+		gzwrite(gz, &original[0], (unsigned) half);
+		gzclose(gz);
+	}
+	gz = gzopen(gzipFilename.c_str(), "ab");
+	CHECK(gz != NULL);
+	if (gz) {
+		gzwrite(gz, &original[half], (unsigned) (original.size() - half));
+		gzclose(gz);
+	}
+	CHECK(ReadInputFile(gzipFilename.c_str(), buffer, size) == TL_OK);
+	CHECK(size == original.size() && buffer && memcmp(buffer, &original[0], size) == 0);
+	delete [] buffer;
+	// zero padding after the last member
+	vector<unsigned char> padding(1000, 0);
+	CHECK(WriteTestFile(gzipFilename, padding, "ab"));
+	CHECK(ReadInputFile(gzipFilename.c_str(), buffer, size) == TL_OK);
+	CHECK(size == original.size() && buffer && memcmp(buffer, &original[0], size) == 0);
+	delete [] buffer;
+
+	// zstd file of two frames
+	vector<unsigned char> compressed(ZSTD_compressBound(original.size()));
+	size_t firstFrameSize = ZSTD_compress(&compressed[0], compressed.size(), &original[0], half, 3);
+	CHECK(!ZSTD_isError(firstFrameSize));
+	size_t secondFrameSize = ZSTD_compress(&compressed[firstFrameSize], compressed.size() - firstFrameSize,
+		&original[half], original.size() - half, 3);
+	CHECK(!ZSTD_isError(secondFrameSize));
+	compressed.resize(firstFrameSize + secondFrameSize);
+	CHECK(WriteTestFile(zstdFilename, compressed));
+	CHECK(ReadInputFile(zstdFilename.c_str(), buffer, size) == TL_OK);
+	CHECK(size == original.size() && buffer && memcmp(buffer, &original[0], size) == 0);
+	delete [] buffer;
+
+	// truncated files are decode errors
+	compressed.resize(firstFrameSize + secondFrameSize / 2);
+	CHECK(WriteTestFile(zstdFilename, compressed));
+	CHECK(ReadInputFile(zstdFilename.c_str(), buffer, size) == TL_DECODEERROR);
+	CHECK(buffer == NULL && size == 0);
+	vector<unsigned char> gzipData;
+	FILE* f = fopen(gzipFilename.c_str(), "rb");
+	if (f) {
+		unsigned char chunk[4096];
+		size_t bytesRead;
+		while ((bytesRead = fread(chunk, 1, sizeof(chunk), f)) > 0)
+			gzipData.insert(gzipData.end(), chunk, chunk + bytesRead);
+		fclose(f);
+	}
+	gzipData.resize(gzipData.size() - padding.size() - 10);
+	CHECK(WriteTestFile(gzipFilename, gzipData));
+	CHECK(ReadInputFile(gzipFilename.c_str(), buffer, size) == TL_DECODEERROR);
+	CHECK(buffer == NULL);
+
+	DeleteFile(plainFilename.c_str());
+	DeleteFile(gzipFilename.c_str());
+	DeleteFile(zstdFilename.c_str());
+	CHECK(ReadInputFile(plainFilename.c_str(), buffer, size) == TL_PARAM_ERROR);
+}
+
+//-----------------------------
+// Index of loaded file sequence numbers. Bitmap file is created by test, so that index is not built from DB.
+void TestFileSequenceIndex()
+{
+	CHECK(FileSequenceIndex::ParseSequenceNumber("00042") == 42);
+	CHECK(FileSequenceIndex::ParseSequenceNumber("42 ") == 42);
+	CHECK(FileSequenceIndex::ParseSequenceNumber("00000") == 0);
+	CHECK(FileSequenceIndex::ParseSequenceNumber("4a") == 0);
+	CHECK(FileSequenceIndex::ParseSequenceNumber("") == 0);
+
+	Config config;
+	MakeConfig(config);
+	FileSequenceIndex index(config, "RUSNW", "USATM", true);
+	string indexFilename = tempDir + "\\seqindex\\RUSNW_USATM_T.idx";
+
+	// without index file there is nothing to report
+	DeleteFile(indexFilename.c_str());
+	vector<SequenceGap> gaps;
+	CHECK(!index.GetGaps(gaps));
+
+	vector<unsigned char> bitmap(END_TAP_SEQUENCE_NUM / 8 + 1, 0);
+	CHECK(WriteTestFile(indexFilename, bitmap));
+	otl_connect otlConnect;		// not connected, existing index is opened without DB
+	CHECK(index.Open(otlConnect));
+	CHECK(index.GetGaps(gaps) && gaps.empty());
+	const int loaded[] = { 1, 2, 3, 5, 6, 10, 16, END_TAP_SEQUENCE_NUM };
+	for (size_t i = 0; i < sizeof(loaded) / sizeof(loaded[0]); i++)
+		index.MarkLoaded(loaded[i]);
+
+	// other file type has its own index
+	FileSequenceIndex commercialIndex(config, "RUSNW", "USATM", false);
+	CHECK(!commercialIndex.GetGaps(gaps));
+
+	CHECK(index.GetGaps(gaps));
+	CHECK(gaps.size() == 4);
+	if (gaps.size() == 4) {
+		CHECK(gaps[0].first == 4 && gaps[0].last == 4);
+		CHECK(gaps[1].first == 7 && gaps[1].last == 9);
+		CHECK(gaps[2].first == 11 && gaps[2].last == 15);
+		CHECK(gaps[3].first == 17 && gaps[3].last == END_TAP_SEQUENCE_NUM - 1);
+	}
+
+	// no gaps below the highest loaded number
+	CHECK(WriteTestFile(indexFilename, bitmap));
+	index.MarkLoaded(START_TAP_SEQUENCE_NUM);
+	index.MarkLoaded(START_TAP_SEQUENCE_NUM + 1);
+	CHECK(index.GetGaps(gaps) && gaps.empty());
+	DeleteFile(indexFilename.c_str());
+}
+
+//-----------------------------
+// Local FTP stand-in: serves each control connection by its own thread and stores nothing, only names
+// and sizes of uploaded files are kept. Commands other than needed for login and upload are answered by 502.
+class FtpStandIn
+{
+public:
+	FtpStandIn();
+	~FtpStandIn();
+	bool Start();
+	int GetPort() const;
+	// closes open control connections as FTP server does on idle timeout
+	void DropConnections();
+	long GetConnectionCount() const;
+	long GetNoopCount() const;
+	long GetQuitCount() const;
+	vector<pair<string, size_t> > GetStoredFiles();
+private:
+	struct Connection {
+		FtpStandIn* server;
+		SOCKET controlSocket;
+	};
+
+	SOCKET m_listenSocket;
+	int m_port;
+	HANDLE m_thread;
+	vector<HANDLE> m_connectionThreads;
+	vector<SOCKET> m_controlSockets;
+	volatile long m_connections;
+	volatile long m_noops;
+	volatile long m_quits;
+	CRITICAL_SECTION m_critSection;
+	vector<pair<string, size_t> > m_storedFiles;
+
+	static DWORD WINAPI ServerThread(LPVOID param);
+	static DWORD WINAPI ConnectionThread(LPVOID param);
+	void Serve(SOCKET controlSocket);
+	static bool SendReply(SOCKET socket, string reply);
+	static bool ReceiveLine(SOCKET socket, string& received, string& line);
+};
+
+
+FtpStandIn::FtpStandIn() :
+	m_listenSocket(INVALID_SOCKET),
+	m_port(0),
+	m_thread(NULL),
+	m_connections(0),
+	m_noops(0),
+	m_quits(0)
+{
+	InitializeCriticalSection(&m_critSection);
+}
+
+
+FtpStandIn::~FtpStandIn()
+{
+	if (m_listenSocket != INVALID_SOCKET)
+		closesocket(m_listenSocket);
+	if (m_thread) {
+		WaitForSingleObject(m_thread, 10000);
+		CloseHandle(m_thread);
+	}
+	// no more connections are accepted
+	DropConnections();
+	for (size_t i = 0; i < m_connectionThreads.size(); i++) {
+		WaitForSingleObject(m_connectionThreads[i], 10000);
+		CloseHandle(m_connectionThreads[i]);
+	}
+	DeleteCriticalSection(&m_critSection);
+}
+
+
+bool FtpStandIn::Start()
+{
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		return false;
+	m_listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (m_listenSocket == INVALID_SOCKET)
+		return false;
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+	int addressLen = sizeof(address);
+	if (bind(m_listenSocket, (sockaddr*) &address, sizeof(address)) != 0 || listen(m_listenSocket, 5) != 0 ||
+			getsockname(m_listenSocket, (sockaddr*) &address, &addressLen) != 0)
+		return false;
+	m_port = ntohs(address.sin_port);
+	m_thread = CreateThread(NULL, 0, ServerThread, this, 0, NULL);
+	return (m_thread != NULL);
+}
+
+
+int FtpStandIn::GetPort() const
+{
+	return m_port;
+}
+
+
+void FtpStandIn::DropConnections()
+{
+	EnterCriticalSection(&m_critSection);
+	for (size_t i = 0; i < m_controlSockets.size(); i++)
+		shutdown(m_controlSockets[i], SD_BOTH);
+	LeaveCriticalSection(&m_critSection);
+}
+
+
+long FtpStandIn::GetConnectionCount() const
+{
+	return m_connections;
+}
+
+
+long FtpStandIn::GetNoopCount() const
+{
+	return m_noops;
+}
+
+
+long FtpStandIn::GetQuitCount() const
+{
+	return m_quits;
+}
+
+
+vector<pair<string, size_t> > FtpStandIn::GetStoredFiles()
+{
+	EnterCriticalSection(&m_critSection);
+	vector<pair<string, size_t> > storedFiles = m_storedFiles;
+	LeaveCriticalSection(&m_critSection);
+	return storedFiles;
+}
+
+
+DWORD WINAPI FtpStandIn::ServerThread(LPVOID param)
+{
+	FtpStandIn* server = (FtpStandIn*) param;
+	while (true) {
+		SOCKET controlSocket = accept(server->m_listenSocket, NULL, NULL);
+		if (controlSocket == INVALID_SOCKET)
+			break;	// listening socket is closed
+		InterlockedIncrement(&server->m_connections);
+		Connection* connection = new Connection;
+		connection->server = server;
+		connection->controlSocket = controlSocket;
+		EnterCriticalSection(&server->m_critSection);
+		server->m_controlSockets.push_back(controlSocket);
+		HANDLE thread = CreateThread(NULL, 0, ConnectionThread, connection, 0, NULL);
+		if (thread)
+			server->m_connectionThreads.push_back(thread);
+		LeaveCriticalSection(&server->m_critSection);
+		if (!thread) {
+			delete connection;
+			break;
+		}
+	}
+	return 0;
+}
+
+
+DWORD WINAPI FtpStandIn::ConnectionThread(LPVOID param)
+{
+	Connection* connection = (Connection*) param;
+	FtpStandIn* server = connection->server;
+	server->Serve(connection->controlSocket);
+	EnterCriticalSection(&server->m_critSection);
+	server->m_controlSockets.erase(find(server->m_controlSockets.begin(), server->m_controlSockets.end(),
+		connection->controlSocket));
+	closesocket(connection->controlSocket);
+	LeaveCriticalSection(&server->m_critSection);
+	delete connection;
+	return 0;
+}
+
+
+bool FtpStandIn::SendReply(SOCKET socket, string reply)
+{
+	reply += "\r\n";
+	return send(socket, reply.c_str(), (int) reply.size(), 0) == (int) reply.size();
+}
+
+
+bool FtpStandIn::ReceiveLine(SOCKET socket, string& received, string& line)
+{
+	size_t lineEnd;
+	while ((lineEnd = received.find("\r\n")) == string::npos) {
+		char chunk[512];
+		int bytesReceived = recv(socket, chunk, sizeof(chunk), 0);
+		if (bytesReceived <= 0)
+			return false;
+		received.append(chunk, bytesReceived);
+	}
+	line = received.substr(0, lineEnd);
+	received.erase(0, lineEnd + 2);
+	return true;
+}
+
+
+void FtpStandIn::Serve(SOCKET controlSocket)
+{
+	SOCKET dataListenSocket = INVALID_SOCKET;
+	string received, line;
+	if (!SendReply(controlSocket, "220 LoaderUnitTests FTP stand-in"))
+		return;
+	while (ReceiveLine(controlSocket, received, line)) {
+		size_t argPos = line.find(' ');
+		string command = line.substr(0, argPos);
+		string argument = (argPos != string::npos ? line.substr(argPos + 1) : "");
+		transform(command.begin(), command.end(), command.begin(), ::toupper);
+		string reply;
+		if (command == "USER")
+			reply = "331 Password required";
+		else if (command == "PASS")
+			reply = "230 Logged in";
+		else if (command == "SYST")
+			reply = "215 UNIX Type: L8";
+		else if (command == "PWD" || command == "XPWD")
+			reply = "257 \"/\" is current directory";
+		else if (command == "CWD")
+			reply = "250 OK";
+		else if (command == "TYPE")
+			reply = "200 OK";
+		else if (command == "NOOP") {
+			InterlockedIncrement(&m_noops);
+			reply = "200 OK";
+		}
+		else if (command == "QUIT") {
+			InterlockedIncrement(&m_quits);
+			SendReply(controlSocket, "221 Bye");
+			break;
+		}
+		else if (command == "PASV") {
+			if (dataListenSocket != INVALID_SOCKET)
+				closesocket(dataListenSocket);
+			dataListenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			sockaddr_in address;
+			memset(&address, 0, sizeof(address));
+			address.sin_family = AF_INET;
+			address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+			int addressLen = sizeof(address);
+			if (dataListenSocket != INVALID_SOCKET && bind(dataListenSocket, (sockaddr*) &address, sizeof(address)) == 0 &&
+					listen(dataListenSocket, 1) == 0 && getsockname(dataListenSocket, (sockaddr*) &address, &addressLen) == 0) {
+				int dataPort = ntohs(address.sin_port);
+				reply = "227 Entering Passive Mode (127,0,0,1," + to_string((long long) dataPort / 256) + "," +
+					to_string((long long) dataPort % 256) + ")";
+			}
+			else
+				reply = "425 Can't open data connection";
+		}
+		else if (command == "STOR" && dataListenSocket != INVALID_SOCKET) {
+			SendReply(controlSocket, "150 Opening data connection");
+			SOCKET dataSocket = accept(dataListenSocket, NULL, NULL);
+			closesocket(dataListenSocket);
+			dataListenSocket = INVALID_SOCKET;
+			size_t fileSize = 0;
+			if (dataSocket != INVALID_SOCKET) {
+				char chunk[4096];
+				int bytesReceived;
+				while ((bytesReceived = recv(dataSocket, chunk, sizeof(chunk), 0)) > 0)
+					fileSize += bytesReceived;
+				closesocket(dataSocket);
+			}
+			size_t namePos = argument.find_last_of('/');
+			EnterCriticalSection(&m_critSection);
+			m_storedFiles.push_back(make_pair(namePos != string::npos ? argument.substr(namePos + 1) : argument, fileSize));
+			LeaveCriticalSection(&m_critSection);
+			reply = (dataSocket != INVALID_SOCKET ? "226 Transfer complete" : "425 Can't open data connection");
+		}
+		else
+			reply = "502 Command not implemented";
+		if (!SendReply(controlSocket, reply))
+			break;
+	}
+	if (dataListenSocket != INVALID_SOCKET)
+		closesocket(dataListenSocket);
+}
+
+
+void TestFtpSessionPool()
+{
+	FtpStandIn server;
+	CHECK(server.Start());
+	if (server.GetPort() == 0)
+		return;
+
+	const char* rapNames[] = { "RCRUSNWUSATM00001", "RCRUSNWUSATM00002", "RCRUSNWUSATM00003", "RCRUSNWUSATM00004" };
+	const int rapCount = sizeof(rapNames) / sizeof(rapNames[0]);
+	vector<string> rapFilenames;
+	for (int i = 0; i < rapCount; i++) {
+		rapFilenames.push_back(TempFilename(rapNames[i]));
+		string content(100 * (i + 1), 'R');
+		WriteTestFile(rapFilenames.back(), content.c_str(), content.size());
+	}
+
+	FtpSetting ftpSetting;
+	ftpSetting.ftpServer = "127.0.0.1";
+	ftpSetting.ftpPort = to_string((long long) server.GetPort());
+	ftpSetting.ftpUsername = "rap";
+	ftpSetting.ftpPassword = "secret";
+	ftpSetting.ftpDirectory = "/rap";
+	FtpSessionPool& pool = FtpSessionPool::Instance();
+	string error;
+
+	// new session
+	CHECK(pool.Upload(ftpSetting, vector<string>(1, rapFilenames[0]), error) == 0);
+	CHECK(server.GetConnectionCount() == 1);
+
+	// idle session is reused after NOOP check
+	long noopCount = server.GetNoopCount();
+	CHECK(pool.Upload(ftpSetting, vector<string>(1, rapFilenames[1]), error) == 0);
+	CHECK(server.GetConnectionCount() == 1);
+	CHECK(server.GetNoopCount() == noopCount + 1);
+
+	// session closed by server fails NOOP check and is replaced by new one
+	server.DropConnections();
+	Sleep(200);
+	CHECK(pool.Upload(ftpSetting, vector<string>(1, rapFilenames[2]), error) == 0);
+	CHECK(server.GetConnectionCount() == 2);
+
+	// sessions are not shared by users
+	FtpSetting otherUserSetting = ftpSetting;
+	otherUserSetting.ftpPassword = "other";
+	CHECK(pool.Upload(otherUserSetting, vector<string>(1, rapFilenames[3]), error) == 0);
+	CHECK(server.GetConnectionCount() == 3);
+
+	vector<pair<string, size_t> > storedFiles = server.GetStoredFiles();
+	CHECK(storedFiles.size() == (size_t) rapCount);
+	for (size_t i = 0; i < storedFiles.size() && i < (size_t) rapCount; i++)
+		CHECK(storedFiles[i].first == rapNames[i] && storedFiles[i].second == 100 * (i + 1));
+
+	// idle sessions are closed by QUIT
+	pool.CloseIdleSessions(0);
+	for (int i = 0; i < 20 && server.GetQuitCount() < 2; i++)
+		Sleep(100);
+	CHECK(server.GetQuitCount() == 2);
+
+	// connection refused by host
+	SOCKET unusedSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	int addressLen = sizeof(address);
+	bind(unusedSocket, (sockaddr*) &address, sizeof(address));
+	getsockname(unusedSocket, (sockaddr*) &address, &addressLen);
+	closesocket(unusedSocket);
+	FtpSetting refusedSetting = ftpSetting;
+	refusedSetting.ftpPort = to_string((long long) ntohs(address.sin_port));
+	error.clear();
+	CHECK(pool.Upload(refusedSetting, vector<string>(1, rapFilenames[0]), error) != 0);
+	CHECK(!error.empty());
+
+	for (int i = 0; i < rapCount; i++)
+		DeleteFile(rapFilenames[i].c_str());
+}
+
+//-----------------------------
+// RAP file encoding with events spliced from TAP file buffer
+class RAPFileTest
+{
+public:
+	// Fills return batch as RAPFile::Initialize does with values from DB
+	static void Initialize(RAPFile& rapFile)
+	{
+		rapFile.m_filename = "RCUSATMRUSNW00001";
+		rapFile.m_fileSeqNum = "00001";
+		ReturnBatch* returnBatch = (ReturnBatch*) calloc(1, sizeof(ReturnBatch));
+		RapBatchControlInfo& controlInfo = returnBatch->rapBatchControlInfoRap;
+		OCTET_STRING_fromBuf(&controlInfo.sender, "USATM", 5);
+		OCTET_STRING_fromBuf(&controlInfo.recipient, "RUSNW", 5);
+		OCTET_STRING_fromBuf(&controlInfo.rapFileSequenceNumber, "00001", 5);
+		controlInfo.rapFileCreationTimeStamp.localTimeStamp =
+			OCTET_STRING_new_fromBuf(&asn_DEF_LocalTimeStamp, "20170101120000", 14);
+		controlInfo.rapFileCreationTimeStamp.utcTimeOffset = OCTET_STRING_new_fromBuf(&asn_DEF_UtcTimeOffset, "+0300", 5);
+		controlInfo.rapFileAvailableTimeStamp.localTimeStamp =
+			OCTET_STRING_new_fromBuf(&asn_DEF_LocalTimeStamp, "20170101120000", 14);
+		controlInfo.rapFileAvailableTimeStamp.utcTimeOffset = OCTET_STRING_new_fromBuf(&asn_DEF_UtcTimeOffset, "+0300", 5);
+		controlInfo.rapSpecificationVersionNumber = 1;
+		controlInfo.rapReleaseVersionNumber = 5;
+		rapFile.m_returnBatch = returnBatch;
+	}
+
+	static ReturnBatch* GetReturnBatch(RAPFile& rapFile)
+	{
+		return rapFile.m_returnBatch;
+	}
+
+	static void Encode(RAPFile& rapFile, vector<unsigned char>& buffer)
+	{
+		rapFile.EncodeToBuffer(buffer);
+	}
+
+	static void Free(RAPFile& rapFile)
+	{
+		ASN_STRUCT_FREE(asn_DEF_ReturnBatch, rapFile.m_returnBatch);
+		rapFile.m_returnBatch = NULL;
+	}
+};
+
+
+ReturnDetail* CreateSevereReturn(int errorCode)
+{
+	ReturnDetail* returnDetail = (ReturnDetail*) calloc(1, sizeof(ReturnDetail));
+	returnDetail->present = ReturnDetail_PR_severeReturn;
+	OCTET_STRING_fromBuf(&returnDetail->choice.severeReturn.fileSequenceNumber, "00042", 5);
+	ErrorDetail* errorDetail = (ErrorDetail*) calloc(1, sizeof(ErrorDetail));
+	errorDetail->errorCode = errorCode;
+	ASN_SEQUENCE_ADD(&returnDetail->choice.severeReturn.errorDetail, errorDetail);
+	return returnDetail;
+}
+
+
+void TestRAPFileSpans()
+{
+	// MOC in BER form with long form length, as partner may send it, and the same MOC in DER
+	const unsigned char berEvent[] = { 0x69, 0x81, 0x00 };
+	const unsigned char derEvent[] = { 0x69, 0x00 };
+	CallEventDetail* events[2] = { NULL, NULL };
+	asn_dec_rval_t rval = ber_decode(0, &asn_DEF_CallEventDetail, (void**) &events[0], berEvent, sizeof(berEvent));
+	CHECK(rval.code == RC_OK && rval.consumed == sizeof(berEvent));
+	rval = ber_decode(0, &asn_DEF_CallEventDetail, (void**) &events[1], derEvent, sizeof(derEvent));
+	CHECK(rval.code == RC_OK && rval.consumed == sizeof(derEvent));
+	if (!events[0] || !events[1] || events[0]->present != CallEventDetail_PR_mobileOriginatedCall) {
+		CHECK(!"MOC can't be decoded");
+		ASN_STRUCT_FREE(asn_DEF_CallEventDetail, events[0]);
+		ASN_STRUCT_FREE(asn_DEF_CallEventDetail, events[1]);
+		return;
+	}
+	BerSpan berSpan = { berEvent, sizeof(berEvent) };
+	otl_connect otlConnect;
+	Config config;
+	MakeConfig(config);
+
+	// events are encoded by loader
+	RAPFile encodedRapFile(otlConnect, config, 0);
+	RAPFileTest::Initialize(encodedRapFile);
+	encodedRapFile.AddSevereReturn(CreateSevereReturn(CHARGE_NOT_IN_ROAMING_AGREEMENT), events[0], NULL, 100);
+	encodedRapFile.AddSevereReturn(CreateSevereReturn(CHARGE_NOT_IN_ROAMING_AGREEMENT), events[1], NULL, 250);
+	encodedRapFile.Finalize();
+	vector<unsigned char> encoded;
+	RAPFileTest::Encode(encodedRapFile, encoded);
+
+	// encoding of return details one by one is the same as DER of whole return batch
+	ReturnBatch* returnBatch = RAPFileTest::GetReturnBatch(encodedRapFile);
+	for (int i = 0; i < 2; i++)
+		returnBatch->returnDetails.list.array[i]->choice.severeReturn.callEventDetail = *events[i];
+	vector<unsigned char> expected;
+	asn_enc_rval_t encodeRes = der_encode(&asn_DEF_ReturnBatch, returnBatch, AppendToBuffer, &expected);
+	for (int i = 0; i < 2; i++)
+		memset(&returnBatch->returnDetails.list.array[i]->choice.severeReturn.callEventDetail, 0, sizeof(CallEventDetail));
+	CHECK(encodeRes.encoded > 0);
+	CHECK(encoded == expected);
+	RAPFileTest::Free(encodedRapFile);
+
+	// the first event is copied from TAP file as is, lengths of enclosing TLVs include its longer form
+	RAPFile splicedRapFile(otlConnect, config, 0);
+	RAPFileTest::Initialize(splicedRapFile);
+	splicedRapFile.AddSevereReturn(CreateSevereReturn(CHARGE_NOT_IN_ROAMING_AGREEMENT), events[0], &berSpan, 100);
+	splicedRapFile.AddSevereReturn(CreateSevereReturn(CHARGE_NOT_IN_ROAMING_AGREEMENT), events[1], NULL, 250);
+	splicedRapFile.Finalize();
+	vector<unsigned char> spliced;
+	RAPFileTest::Encode(splicedRapFile, spliced);
+	RAPFileTest::Free(splicedRapFile);
+	CHECK(spliced.size() == encoded.size() + 1);
+	CHECK(FindBytes(spliced, berEvent, sizeof(berEvent)) >= 0);
+
+	ReturnBatch* decoded = NULL;
+	rval = ber_decode(0, &asn_DEF_ReturnBatch, (void**) &decoded, &spliced[0], spliced.size());
+	CHECK(rval.code == RC_OK && rval.consumed == spliced.size());
+	if (rval.code == RC_OK) {
+		CHECK(decoded->returnDetails.list.count == 2);
+		for (int i = 0; i < decoded->returnDetails.list.count; i++) {
+			CHECK(decoded->returnDetails.list.array[i]->present == ReturnDetail_PR_severeReturn);
+			CHECK(decoded->returnDetails.list.array[i]->choice.severeReturn.callEventDetail.present ==
+				CallEventDetail_PR_mobileOriginatedCall);
+			CHECK(decoded->returnDetails.list.array[i]->choice.severeReturn.errorDetail.list.count == 1);
+		}
+		CHECK(decoded->rapAuditControlInfo.returnDetailsCount == 2);
+		CHECK(OctetStr2Int64(decoded->rapAuditControlInfo.totalSevereReturnValue) == 350);
+	}
+	ASN_STRUCT_FREE(asn_DEF_ReturnBatch, decoded);
+	ASN_STRUCT_FREE(asn_DEF_CallEventDetail, events[0]);
+	ASN_STRUCT_FREE(asn_DEF_CallEventDetail, events[1]);
+}
+
+//-----------------------------
+int main(int argc, const char* argv[])
+{
+	pShortName = "LoaderUnitTests";
+	char tempPath[MAX_PATH];
+	GetTempPath(sizeof(tempPath), tempPath);
+	tempDir = string(tempPath) + "LoaderUnitTests";
+	CreateDirectory(tempDir.c_str(), NULL);
+
+	TestTapAmount();
+	TestTAPTimestamp();
+	TestBerSpan();
+	TestContentHash();
+	TestCompressedInput();
+	TestFileSequenceIndex();
+	TestFtpSessionPool();
+	TestRAPFileSpans();
+
+	cout << checkCount - failedCheckCount << " of " << checkCount << " checks passed" << endl;
+	return (failedCheckCount == 0 ? 0 : 1);
+}
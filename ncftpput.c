@@ -371,3 +371,104 @@ int ncftp_main(int argc, char **argv, char* ftpResult)
 	DisposeWinsock();
 	return((int) es);
 }	/* main */
+
+
+
+
+/* Persistent sessions used by the loader to upload RAP files.
+ * Unlike ncftp_main, each session keeps its own connection info,
+ * so sessions may be used by different threads at the same time.
+ */
+static int gSessionLibInit = 0;
+
+void *
+ncftp_open_session(const char *host, int port, const char *user, const char *pass, char *ftpResult)
+{
+	FTPCIPtr cip;
+	int result;
+
+	/* Library info is shared by all sessions, caller serializes opening */
+	if (gSessionLibInit == 0) {
+		result = FTPInitLibrary(&li);
+		if (result < 0) {
+			(void) sprintf(ftpResult, "ncftpput: init library error %d (%s).\n", result, FTPStrError(result));
+			return (NULL);
+		}
+		InitOurDirectory();
+		LoadFirewallPrefs();
+		gSessionLibInit = 1;
+	}
+
+	cip = (FTPCIPtr) calloc(1, sizeof(FTPConnectionInfo));
+	if (cip == NULL) {
+		(void) sprintf(ftpResult, "ncftpput: out of memory.\n");
+		return (NULL);
+	}
+	InitWinsock();
+	result = FTPInitConnectionInfo(&li, cip, kDefaultFTPBufSize);
+	if (result < 0) {
+		(void) sprintf(ftpResult, "ncftpput: init connection info error %d (%s).\n", result, FTPStrError(result));
+		DisposeWinsock();
+		free(cip);
+		return (NULL);
+	}
+
+	cip->xferTimeout = 60 * 60;
+	cip->connTimeout = 30;
+	cip->ctrlTimeout = 135;
+	cip->debugLog = NULL;
+	cip->errLog = NULL;
+	cip->hasSITE_UTIME = 0;
+	cip->port = port;
+	(void) STRNCPY(cip->host, host);
+	(void) STRNCPY(cip->user, user);
+	(void) STRNCPY(cip->pass, pass);
+
+	if (MayUseFirewall(cip->host) != 0) {
+		cip->firewallType = gFirewallType;
+		(void) STRNCPY(cip->firewallHost, gFirewallHost);
+		(void) STRNCPY(cip->firewallUser, gFirewallUser);
+		(void) STRNCPY(cip->firewallPass, gFirewallPass);
+		cip->firewallPort = gFirewallPort;
+	}
+
+	if ((result = FTPOpenHost(cip)) < 0) {
+		(void) sprintf(ftpResult, "ncftpput: cannot open %s: %s.\n", cip->host, FTPStrError(result));
+		DisposeWinsock();
+		free(cip);
+		return (NULL);
+	}
+	return (cip);
+}	/* ncftp_open_session */
+
+
+
+
+/* Returns 0 if control connection of the session is still alive */
+int
+ncftp_check_session(void *session)
+{
+	return ((FTPCmd((FTPCIPtr) session, "NOOP") == 2) ? 0 : -1);
+}	/* ncftp_check_session */
+
+
+
+
+int
+ncftp_put_files(void *session, const char *dstdir, char **files, char *ftpResult)
+{
+	if (Copy((FTPCIPtr) session, dstdir, files, 0, kTypeBinary, kAppendNo, "", "", kResumeNo, kDeleteNo, ftpResult) < 0)
+		return ((int) kExitXferFailed);
+	return ((int) kExitSuccess);
+}	/* ncftp_put_files */
+
+
+
+
+void
+ncftp_close_session(void *session)
+{
+	(void) FTPCloseHost((FTPCIPtr) session);
+	DisposeWinsock();
+	free(session);
+}	/* ncftp_close_session */
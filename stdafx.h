@@ -12,6 +12,7 @@
 #include <tchar.h>
 #include <time.h>
 #include <math.h>
+#include <limits.h>
 #include <string>
 #include <iostream>
 #include <fstream>